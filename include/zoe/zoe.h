@@ -22,6 +22,17 @@
 #include <memory>
 #include <future>
 #include <map>
+#include <vector>
+#include <functional>
+
+// The awaitable of Zoe::download is only declared when the code including zoe is compiled as C++20 or later,
+// zoe itself is built as C++11.
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define ZOE_HAS_COROUTINE 1
+#endif
+#endif
 
 #ifdef ZOE_STATIC
 #define ZOE_API
@@ -77,13 +88,16 @@ enum Result {
   FETCH_FILE_INFO_FAILED = 31,
   REDIRECT_URL_DIFFERENT = 32,
   NOT_CLEARLY_RESULT = 33,
+  DECOMPRESS_FAILED = 34,
+  UNSUPPORTED_CODEC = 35,
+  INVALID_DELTA_MANIFEST = 36,
 };
 
 enum DownloadState { STOPPED = 0, DOWNLODING = 1, PAUSED = 2 };
 
 ZOE_API const char* GetResultString(int enumVal);
 
-enum SlicePolicy { Auto = 0, FixedSize, FixedNum };
+enum SlicePolicy { Auto = 0, FixedSize, FixedNum, Adaptive };
 
 enum HashType { MD5 = 0, CRC32, SHA1, SHA256 };
 
@@ -91,6 +105,18 @@ enum HashVerifyPolicy { ALWAYS = 0, ONLY_NO_FILESIZE };
 
 enum UncompletedSliceSavePolicy { ALWAYS_DISCARD = 0, SAVE_EXCEPT_FAILED };
 
+enum DiskIoPolicy { STANDARD_IO = 0, MEMORY_MAPPED_IO, DIRECT_IO };
+
+enum StorageClass { STORAGE_SSD = 0, STORAGE_HDD, STORAGE_NETWORK };
+
+enum CheckpointPolicy { CHECKPOINT_BY_TIME = 0, CHECKPOINT_BY_BYTES, CHECKPOINT_ON_SLICE_COMPLETED };
+
+enum HttpVersion { HTTP_VERSION_AUTO = 0, HTTP_VERSION_1_1, HTTP_VERSION_2, HTTP_VERSION_2_PRIOR_KNOWLEDGE, HTTP_VERSION_3 };
+
+enum TaskPriority { PRIORITY_LOW = 0, PRIORITY_NORMAL, PRIORITY_HIGH };
+
+enum CompressionCodec { COMPRESSION_NONE = 0, COMPRESSION_GZIP, COMPRESSION_ZSTD, COMPRESSION_CUSTOM };
+
 class ZOE_API Event {
  public:
   Event(bool setted = false);
@@ -113,8 +139,128 @@ typedef std::function<void(Result ret)> ResultFunctor;
 typedef std::function<void(int64_t total, int64_t downloaded)> ProgressFunctor;
 typedef std::function<void(int64_t byte_per_sec)> RealtimeSpeedFunctor;
 typedef std::function<void(const utf8string& verbose)> VerboseOuputFunctor;
+typedef std::function<void(const void* data, int64_t size)> StreamFunctor;
 typedef std::multimap<utf8string, utf8string> HttpHeaders;
 
+// Run the task on the executor, such as posting it to an event loop or a thread pool. See Zoe::setCallbackExecutor.
+typedef std::function<void(std::function<void()> task)> CallbackExecutor;
+
+// Decode a compressed stream piece by piece, see Zoe::setDecompression.
+class ZOE_API StreamDecoder {
+ public:
+  virtual ~StreamDecoder() {}
+
+  // Decode the next piece of compressed data and pass the decoded data to output, return false if the data is corrupted.
+  virtual bool decode(const void* data, int64_t size, const StreamFunctor& output) = 0;
+
+  // All of compressed data has been decoded, pass the rest of decoded data to output.
+  // Return false if the compressed data is truncated.
+  virtual bool finish(const StreamFunctor& output) = 0;
+};
+typedef std::function<std::shared_ptr<StreamDecoder>()> StreamDecoderFactory;
+
+// The speeds are smoothed by exponentially weighted moving average, the weight of a sample halves every 3 seconds.
+typedef struct _SliceStats {
+  int32_t index;
+  int64_t begin;
+  int64_t end;         // -1 if unknown
+  int64_t downloaded;  // byte
+  int64_t speed;       // byte per second, 0 if not downloading
+  bool downloading;
+} SliceStats;
+
+typedef struct _DownloadStats {
+  int64_t total;          // file size, -1 if unknown
+  int64_t downloaded;     // byte
+  int64_t speed;          // byte per second
+  int64_t instant_speed;  // byte per second of the last interval
+  int64_t eta;            // remaining seconds, -1 if unknown
+  int32_t active_slice_num;
+  std::vector<SliceStats> slices;
+
+  _DownloadStats()
+      : total(-1L)
+      , downloaded(0L)
+      , speed(0L)
+      , instant_speed(0L)
+      , eta(-1L)
+      , active_slice_num(0) {}
+} DownloadStats;
+
+// The times are measured from the start of the last transfer of slice, -1 if unknown.
+typedef struct _SliceMetrics {
+  int32_t index;
+  int64_t downloaded;  // byte, when the last transfer finished
+  int32_t retries;     // failed times
+  int32_t transfers;
+  int64_t connect_time_us;
+  int64_t tls_time_us;  // SSL/TLS handshake completed, 0 if not used
+  int64_t first_byte_time_us;
+} SliceMetrics;
+
+typedef struct _DownloadMetrics {
+  int64_t fetch_file_info_time_ms;
+  int64_t transfer_time_ms;
+  int64_t finish_time_ms;          // flush, verify hash and rename
+  int64_t hash_verify_time_ms;     // part of finish time
+  int64_t streaming_hash_time_us;  // hashing while downloading
+  int64_t hash_lock_wait_time_us;  // writes blocked by streaming hash
+  int64_t disk_write_num;
+  int64_t disk_write_bytes;
+  int64_t disk_write_time_us;
+  std::vector<int64_t> disk_write_latency;  // histogram, bucket i counts the writes take [2^(i-1), 2^i) us
+  int64_t write_stall_num;                  // transfers paused because disk can't catch up
+  int64_t hedge_num;                        // hedged requests started for slow slices
+  int64_t hedge_won_num;                    // slices completed by the hedged request rather than the original one
+  bool download_cache_hit;                  // the file was copied from the download cache, see setDownloadCache
+  int64_t decompressed_bytes;               // see setDecompression
+  int64_t decompress_time_us;               // decoding and writing the decompressed data
+  int64_t delta_copied_bytes;               // copied from the old file rather than downloaded, see setDeltaSource
+  int64_t delta_scan_time_ms;               // searching the blocks of manifest in the old file
+  int64_t peer_received_bytes;              // received from peers and verified, see setPeerMode
+  std::vector<SliceMetrics> slices;
+} DownloadMetrics;
+
+// Counted for all downloads in the process that use a download cache.
+typedef struct _DownloadCacheStats {
+  int64_t hit_num;      // downloads completed from the cache
+  int64_t miss_num;     // downloads that looked up the cache but transferred the file
+  int64_t hit_bytes;    // bytes copied from the cache instead of transferring
+  int64_t store_num;    // files added to the cache
+  int64_t evicted_num;  // files removed to keep the cache under its size limit
+} DownloadCacheStats;
+
+// Engine runs the network transfer of many Zoe objects on a fixed set of threads.
+// All slices of the Zoe objects that use the same engine are multiplexed over the engine's curl multi handles,
+// so the thread number doesn't grow with the number of downloads.
+// The engine must outlive all of the Zoe objects that use it.
+//
+class ZOE_API Engine {
+ public:
+  // io_thread_num: number of event loop threads, each thread owns a curl multi handle.
+  // worker_thread_num: number of threads for blocking work, such as fetching file information, verifying hash.
+  // Set to 0 or negative to switch to the default built-in number - 1.
+  //
+  Engine(int32_t io_thread_num = 1, int32_t worker_thread_num = 1);
+  ~Engine();
+
+  // Limit the number of slices transferring at the same time, counted across all of the Zoe objects that use this engine.
+  // The slices of each Zoe object are also limited by its own thread number.
+  // Set to 0 or negative to switch to the default - 0(unlimited).
+  //
+  void setMaxConcurrentTransfers(int32_t num) noexcept;
+
+  class EngineImpl;
+
+ protected:
+  friend class Zoe;
+  friend class Batch;
+  EngineImpl* impl_;
+
+  Engine(const Engine&) = delete;
+  Engine& operator=(const Engine&) = delete;
+};
+
 class ZOE_API Zoe {
  public:
   Zoe();
@@ -123,6 +269,75 @@ class ZOE_API Zoe {
   static void GlobalInit();
   static void GlobalUnInit();
 
+  // Limit the total download speed of all Zoe objects in this process, counted in bytes per second.
+  // The bandwidth is taken by slices as they receive data, so the bandwidth left by a slice or a finished download
+  // is used by the others at once.
+  // Set to 0 or negative to switch to the default - 0(unlimited).
+  //
+  static void SetGlobalMaxDownloadSpeed(int64_t byte_per_seconds) noexcept;
+  static int64_t GlobalMaxDownloadSpeed() noexcept;
+
+  // Limit the total number of slices transferring at the same time of all Zoe objects in this process.
+  // The slices beyond the limit wait until other slices finish.
+  // Set to 0 or negative to switch to the default - 0(unlimited).
+  //
+  static void SetGlobalMaxConnections(int32_t num) noexcept;
+  static int32_t GlobalMaxConnections() noexcept;
+
+  // Limit the total memory of disk caches of all Zoe objects in this process, see setDiskCacheSize.
+  // The blocks of cache are handed out to the downloading slices as they need them, and the faster downloads get the
+  // larger shares when the memory is short, the blocks beyond the share are freed once written.
+  // The slices without a block write to disk directly, so the memory never exceeds the limit.
+  // Set to 0 or negative to switch to the default - 0(unlimited, each download uses its own disk cache size).
+  //
+  static void SetGlobalCacheMemoryLimit(int64_t bytes) noexcept;
+  static int64_t GlobalCacheMemoryLimit() noexcept;
+
+  // Bytes of disk cache memory allocated by all Zoe objects in this process.
+  //
+  static int64_t GlobalCacheMemoryUsed() noexcept;
+
+  // Limit the download speed and the number of connections to one host, such as "example.com".
+  // The host is case insensitive, without port.
+  // The host limits apply together with the global limits. Set both to 0 to remove the limits of host.
+  //
+  static void SetHostLimit(const utf8string& host, int64_t max_speed, int32_t max_connections) noexcept;
+
+  // Drop the file info cached in this process, see setFileInfoCacheTime.
+  //
+  static void ClearFileInfoCache() noexcept;
+
+  // The statistics of download caches in this process, see setDownloadCache.
+  //
+  static DownloadCacheStats GlobalDownloadCacheStats() noexcept;
+
+  // Stop the server of peer mode and the sharing of all files, see setPeerMode. Called by GlobalUnInit too.
+  //
+  static void StopPeerSharing() noexcept;
+
+  // Record the timeline of all downloads in this process: the transfers of slices and their first bytes, the writes of
+  // disk cache, the rounds of curl_multi_poll and curl_multi_perform, hash verification and checkpoints.
+  // The events are binary records kept in a ring buffer of each thread, the last events_per_thread events are kept.
+  // The events recorded before are dropped. When tracing is off, each trace point only costs an atomic load.
+  // Set events_per_thread to 0 or negative to switch to the default - 16384.
+  //
+  static void StartTracing(int32_t events_per_thread = 0) noexcept;
+  static void StopTracing() noexcept;
+
+  // Write the events recorded to json_path in Chrome trace format, which can be opened by Perfetto or chrome://tracing.
+  // It can be called while tracing, the events are kept until StartTracing is called again.
+  //
+  static Result ExportTrace(const utf8string& json_path) noexcept;
+
+  // Make the manifest of delta update for file_path and save it to manifest_path, see setDeltaSource.
+  // The manifest holds the checksums of each block, 8 bytes per block_size of file, so smaller blocks find more data in
+  // the old file but make a larger manifest. The blocks are checksummed on all CPU cores.
+  // block_size must be in [512, 16777216], INVALID_DELTA_MANIFEST is returned if not, or if the file is empty.
+  //
+  static Result MakeDeltaManifest(const utf8string& file_path,
+                                  const utf8string& manifest_path,
+                                  int32_t block_size = 65536) noexcept;
+
   void setVerboseOutput(VerboseOuputFunctor verbose_functor) noexcept;
 
   // Pass an int specifying the maximum thread number.
@@ -133,6 +348,15 @@ class ZOE_API Zoe {
   Result setThreadNum(int32_t thread_num) noexcept;
   int32_t threadNum() const noexcept;
 
+  // Set true, zoe will measure the throughput and adjust the number of concurrent connections
+  // between min_thread_num and the thread number set by setThreadNum, aiming for the highest throughput.
+  // Zoe starts with min_thread_num connections.
+  // If min_thread_num is greater than thread number, zoe will return INVALID_THREAD_NUM.
+  // Default to false.
+  //
+  Result setAdaptiveConcurrency(bool enabled, int32_t min_thread_num) noexcept;
+  void adaptiveConcurrency(bool& enabled, int32_t& min_thread_num) const noexcept;
+
   // Pass an int. It should contain the maximum time in milliseconds that you allow the connection phase to the server to take.
   // This only limits the connection phase, it has no impact once it has connected.
   // Set to 0 or negative to switch to the default built-in connection timeout - 3000 milliseconds.
@@ -151,6 +375,24 @@ class ZOE_API Zoe {
   Result setFetchFileInfoHeadMethod(bool use_head) noexcept;
   bool fetchFileInfoHeadMethod() const noexcept;
 
+  // If enabled is true, zoe will fetch file info with a GET request of the beginning of file,
+  // and take the file size from Content-Range rather than sending HEAD.
+  // The data received is kept as the beginning of the first slice, so the download doesn't wait another round trip.
+  // It takes precedence over HEAD method, the mirrors are still fetched by the method above.
+  // Default to false.
+  //
+  Result setFetchFileInfoRangeProbe(bool enabled) noexcept;
+  bool fetchFileInfoRangeProbe() const noexcept;
+
+  // The file info (size, ETag, Last-Modified, Accept-Ranges and redirected url) is cached in the process by url.
+  // Within these seconds after fetched, the cached info is used without any request.
+  // After that, it is revalidated with If-None-Match or If-Modified-Since, and used again if the server answers 304.
+  // Set to 0 to always revalidate the cached info.
+  // Default to -1, the file info is neither cached nor taken from cache.
+  //
+  Result setFileInfoCacheTime(int32_t seconds) noexcept;
+  int32_t fileInfoCacheTime() const noexcept;
+
   // Pass an int as parameter.
   // If the interval seconds that from the saved time of temporary file to present greater than or equal to this parameter, the temporary file will be discarded.
   // Default to -1, never expired.
@@ -160,9 +402,9 @@ class ZOE_API Zoe {
 
   // Pass an int as parameter.
   // If a download exceeds this speed (counted in bytes per second) the transfer will pause to keep the speed less than or equal to the parameter value.
+  // The speed is shared by the slices dynamically, the bandwidth left by a slice is used by the others.
   // Defaults to -1, unlimited speed.
   // Set to 0 or negative to switch to the default built-in limit - -1(unlimited speed).
-  // This option doesn't affect transfer speeds done with FILE:// URLs.
   //
   Result setMaxDownloadSpeed(int32_t byte_per_seconds) noexcept;
   int32_t maxDownloadSpeed() const noexcept;
@@ -178,18 +420,56 @@ class ZOE_API Zoe {
   int32_t minDownloadSpeed() const noexcept;
   int32_t minDownloadSpeedDuration() const noexcept;  // seconds
 
+  // Set how often the ProgressFunctor and RealtimeSpeedFunctor passed to start are called, in milliseconds.
+  // The speed passed to RealtimeSpeedFunctor is smoothed, see DownloadStats.
+  // The functors are called on the thread that performs the transfers, they should return quickly.
+  // Set to 0 or negative to switch to the default - 500 for progress and 1000 for speed.
+  //
+  Result setProgressInterval(int32_t progress_interval_ms, int32_t speed_interval_ms) noexcept;
+  int32_t progressInterval() const noexcept;  // milliseconds
+  int32_t speedInterval() const noexcept;     // milliseconds
+
+  // Post the ResultFunctor, ProgressFunctor and RealtimeSpeedFunctor passed to start to executor rather than calling them
+  // on the threads of zoe, so that they run on the threads of caller, such as an event loop, and nothing is blocked.
+  // The tasks are posted in the order they happen, the ResultFunctor task is posted before the future of start is ready.
+  // Zoe can be destroyed in the functors only if the executor runs the tasks on other threads than zoe's, since the
+  // destructor waits for the download thread.
+  // Set to nullptr to call the functors on the threads of zoe.
+  // Default: nullptr.
+  //
+  Result setCallbackExecutor(CallbackExecutor executor) noexcept;
+  CallbackExecutor callbackExecutor() const noexcept;
+
   // Pass an unsigned int specifying your maximal size for the disk cache total buffer in zoe.
   // This buffer size is by default 20971520 byte (20MB).
+  // The buffer is split into page aligned blocks shared by slices, and the memory used by disk cache never exceeds it
+  // (unless it is too small to give each slice a 16KB block). See SetGlobalCacheMemoryLimit for the limit of process.
   //
   Result setDiskCacheSize(int32_t cache_size) noexcept;  // byte
   int32_t diskCacheSize() const noexcept;                // byte
 
+  // Set true, when a slice's disk cache is full, the cache is written to disk on a background thread
+  // instead of blocking the transfers. The data queued is limited to twice of disk cache size,
+  // the slices will be paused when the queue is full until the disk catches up.
+  // Only works when disk cache size is greater than 0.
+  // The downloads on an Engine share the writer thread of engine for each StorageClass, see setStorageClass.
+  // Default to true.
+  //
+  Result setAsyncDiskWriteEnabled(bool enabled) noexcept;
+  bool asyncDiskWriteEnabled() const noexcept;
+
   // Set an event, zoe will stop downloading when this event set.
   // If download is stopped for stop_event set or call stop, zoe will return CANCELED.
   //
   Result setStopEvent(Event* stop_event) noexcept;
   Event* stopEvent() noexcept;
 
+  // Set an engine, zoe will transfer data on the engine's threads instead of creating its own threads.
+  // Default to nullptr, zoe creates its own threads for each download.
+  //
+  Result setEngine(Engine* engine) noexcept;
+  Engine* engine() noexcept;
+
   // Set false, zoe will not check whether the redirected url is the same as in the index file,
   // Default to true, if the redirected url is different from the url in the index file, zoe will return REDIRECT_URL_DIFFERENT error.
   //
@@ -205,11 +485,50 @@ class ZOE_API Zoe {
   bool contentMd5Enabled() const noexcept;
 
   // Set slice policy, tell zoe how to calculate each slice size.
-  // Default: fixed to 10485760 bytes(10MB)
+  // Auto: 10485760 bytes(10MB), policy_value is ignored.
+  // FixedSize: policy_value is the slice size, 0 or negative means 10MB.
+  // FixedNum: policy_value is the slice number, 0 or negative means 1.
+  // Adaptive: the slices are cut one by one when they are about to be downloaded, sized so that each request takes
+  // about policy_value milliseconds (0 or negative means 10000) on its connection, and at least 50 times the latency
+  // of server. The size starts from file size and thread number, follows the throughput of connections measured
+  // by the completed slices, and gets smaller near the end of file, between 1MB and 256MB.
+  // Default: Auto.
   //
   Result setSlicePolicy(SlicePolicy policy, int64_t policy_value) noexcept;
   void slicePolicy(SlicePolicy& policy, int64_t& policy_value) const noexcept;
 
+  // Set true, when a connection is idle and there is no slice left to fetch,
+  // zoe will split the largest remaining range of a downloading slice into two and download the second half on the idle connection.
+  // The slice will not be split if its remaining range is less than 2MB.
+  // Default to true.
+  //
+  Result setSliceSplitEnabled(bool enabled) noexcept;
+  bool sliceSplitEnabled() const noexcept;
+
+  // Set true, when a connection is idle, a downloading slice that is much slower than the others is hedged:
+  // its remaining range is requested again on the idle connection, the data is taken from whichever connection receives it first,
+  // and the other connection is closed when the slice completes.
+  // A slice is slow if its speed is less than slow_percent percent of the median speed of other downloading slices.
+  // Default to true, 20.
+  //
+  Result setHedgeEnabled(bool enabled, int32_t slow_percent) noexcept;
+  void hedge(bool& enabled, int32_t& slow_percent) const noexcept;
+
+  // Set the delay before a failed slice is downloaded again, the delay doubles each time the slice fails until max_delay,
+  // and a random part of it up to half is subtracted, so that the slices failed together are not retried at the same time.
+  // Set base_delay to 0 to retry at once.
+  // Default: 500, 8000 milliseconds.
+  //
+  Result setSliceRetryDelay(int32_t base_delay, int32_t max_delay) noexcept;
+  void sliceRetryDelay(int32_t& base_delay, int32_t& max_delay) const noexcept;
+
+  // Files not larger than this size are downloaded in one slice, they are neither sliced by slice policy nor split.
+  // It saves the range requests and connections of small files.
+  // Set to 0 or negative to switch to the default - 0(always slice).
+  //
+  Result setUnslicedFileSize(int64_t file_size) noexcept;
+  int64_t unslicedFileSize() const noexcept;
+
   // Set hash verify policy, the hash value is the whole file's hash, not for a slice.
   // If fetch file size failed, hash verify is the only way to know whether file download completed.
   // If hash value is empty, will not calculate hash, nor verify hash value.
@@ -221,6 +540,16 @@ class ZOE_API Zoe {
                         HashType& hash_type,
                         utf8string& hash_value) const noexcept;
 
+  // Set the number of threads reading the file when the hash is calculated after downloaded, such as for a resumed
+  // download whose data wasn't all hashed while downloading.
+  // CRC32 is calculated over ranges of file at the same time and combined, the other hash types read the file
+  // ahead on another thread while hashing, when the number is greater than 1.
+  // Set to 0 to use the number of CPU cores, negative to switch to the default.
+  // Default: 1.
+  //
+  Result setHashVerifyThreadNum(int32_t thread_num) noexcept;
+  int32_t hashVerifyThreadNum() const noexcept;
+
   Result setHttpHeaders(const HttpHeaders& headers) noexcept;
   HttpHeaders httpHeaders() const noexcept;
 
@@ -255,6 +584,213 @@ class ZOE_API Zoe {
       UncompletedSliceSavePolicy policy) noexcept;
   UncompletedSliceSavePolicy uncompletedSliceSavePolicy() const noexcept;
 
+  // When resuming or repairing corrupted chunks, the data missing at the end of adjacent slices is merged into one
+  // request if the data received between them is not more than gap bytes, the data between is downloaded again.
+  // So that the holes left by failed slices or corrupted chunks are not requested one by one.
+  // A merged slice is never larger than the largest slice of the file, so the slices made by slice policy are kept,
+  // it is mostly the small slices split while downloading that are merged.
+  // Set to 0 to only merge the slices that have received nothing, negative to disable.
+  // Only the slices that have received nothing are merged while streaming(see setStreamOutput), since the data
+  // downloaded again can't be delivered twice.
+  // Default: 131072(128KB).
+  //
+  Result setSliceCoalesceGap(int64_t gap) noexcept;
+  int64_t sliceCoalesceGap() const noexcept;
+
+  // Set how zoe writes data to the target file.
+  // MEMORY_MAPPED_IO: the target file is mapped into memory, slices copy data into the mapped region directly
+  // without disk cache, and dirty ranges are synchronized to disk at checkpoints.
+  // If the file size is unknown or the mapping failed, zoe falls back to STANDARD_IO.
+  // DIRECT_IO: disk caches are written bypassing the page cache of OS(O_DIRECT, FILE_FLAG_NO_BUFFERING or F_NOCACHE),
+  // so that downloading very large file doesn't evict the page cache of other processes.
+  // The target file is preallocated, only the unaligned heads and tails of slices are buffered.
+  // If the file size is unknown, disk cache is disabled or the file system doesn't support it,
+  // zoe falls back to STANDARD_IO.
+  // Default is STANDARD_IO.
+  //
+  Result setDiskIoPolicy(DiskIoPolicy policy) noexcept;
+  DiskIoPolicy diskIoPolicy() const noexcept;
+
+  // Tell zoe what kind of storage the target file is on, so that the writes of slices are scheduled for it.
+  // The slices write at scattered offsets of the file, which is slow on spinning disks and network file systems.
+  // For STORAGE_HDD and STORAGE_NETWORK, the disk writer(see setAsyncDiskWriteEnabled) collects the caches of slices
+  // for a while, writes them in the order of file offset like an elevator and merges the adjacent ones into one write.
+  // STORAGE_NETWORK collects longer than STORAGE_HDD, since a round trip of network storage costs more than a seek.
+  // STORAGE_SSD writes the caches one by one as they come.
+  // Default: STORAGE_SSD.
+  //
+  Result setStorageClass(StorageClass storage_class) noexcept;
+  StorageClass storageClass() const noexcept;
+
+  // Set true, zoe calculates CRC32 of each 4MB chunk of slices while downloading and records them in the index file.
+  // When resuming, the recorded chunks are read back and verified, the data from the first corrupted chunk of a slice
+  // is downloaded again instead of being trusted.
+  // If the hash verify of whole file does not pass, the chunks are verified once and only the corrupted ones are
+  // downloaded again, HASH_VERIFY_NOT_PASS is returned if none is corrupted or the file still doesn't pass.
+  // Default to false.
+  //
+  Result setChunkHashEnabled(bool enabled) noexcept;
+  bool chunkHashEnabled() const noexcept;
+
+  // Set checkpoint policy, tell zoe when to save the downloading progress to index file, so that it can be resumed
+  // after the process crashed.
+  // CHECKPOINT_BY_TIME: policy_value is the interval in milliseconds, 0 or negative means 10000.
+  // CHECKPOINT_BY_BYTES: policy_value is the data size downloaded since last checkpoint, 0 or negative means 64MB.
+  // CHECKPOINT_ON_SLICE_COMPLETED: checkpoint when any slice completed, policy_value is ignored.
+  // When disk cache is enabled, the checkpoint is done on disk writer thread and doesn't block the transfers.
+  // Default: CHECKPOINT_BY_TIME, 10000 milliseconds.
+  //
+  Result setCheckpointPolicy(CheckpointPolicy policy, int64_t policy_value) noexcept;
+  void checkpointPolicy(CheckpointPolicy& policy, int64_t& policy_value) const noexcept;
+
+  // Set the HTTP version and the maximum number of connections to each server.
+  // HTTP_VERSION_AUTO: let libcurl decide, HTTP/2 is used for HTTPS if the server supports it.
+  // HTTP_VERSION_2: HTTP/2 for HTTPS and HTTP/1.1 for HTTP, HTTP_VERSION_2_PRIOR_KNOWLEDGE: HTTP/2 without upgrade.
+  // HTTP_VERSION_3: fallback to HTTP_VERSION_2 if libcurl is built without HTTP/3.
+  // With HTTP/2 or HTTP/3, the slices are multiplexed as streams over the connections rather than one connection each,
+  // so that the handshakes and the connection limit of servers are avoided.
+  // max_host_connections: 0 means unlimited. With engine, the connections are not limited by multi handle because
+  // it is shared, only the number of concurrent slices is limited.
+  // Default: HTTP_VERSION_AUTO, 0.
+  //
+  Result setHttpVersion(HttpVersion version, int32_t max_host_connections) noexcept;
+  void httpVersion(HttpVersion& version, int32_t& max_host_connections) const noexcept;
+
+  // Set the priority and weight of this download on the engine, only used with engine.
+  // While a task of higher priority is transferring, the slices of this download are paused rather than stopped,
+  // so the received data is kept whatever the uncompleted slice save policy is, and they continue when it is done.
+  // The tasks of the same priority share the concurrent transfers of engine (see Engine::setMaxConcurrentTransfers)
+  // in proportion to their weights, and the bandwidth follows the transfers.
+  // Default: PRIORITY_NORMAL, 1.
+  //
+  Result setPriority(TaskPriority priority, int32_t weight) noexcept;
+  void priority(TaskPriority& priority, int32_t& weight) const noexcept;
+
+  // Set how long the connections are kept while the download is paused or preempted, in milliseconds.
+  // Servers time out the connections that are not read for a while, so after that the transfers are stopped and
+  // the connections are closed, the received data is kept whatever the uncompleted slice save policy is,
+  // and the slices are requested from where they stopped when resumed.
+  // 0 means the connections are closed as soon as paused, negative means they are always kept.
+  // Default: 30000.
+  //
+  Result setPauseKeepAliveTime(int32_t milliseconds) noexcept;
+  int32_t pauseKeepAliveTime() const noexcept;
+
+  // Deliver the file in order to stream_functor while downloading, so that the data can be consumed,
+  // such as unpacked or played, before the whole file is downloaded.
+  // stream_functor is called on a dedicated thread with the contiguous data from the begin of file as soon as
+  // it is written to the temp file, including the data downloaded before resuming.
+  // The download result is reported after all data has been delivered, the data is delivered before hash verified.
+  // The slices are started in order and the ones that begin beyond read_ahead_size bytes after the delivered data
+  // wait, the slices are made smaller to keep threads busy in that window. 0 means no limit.
+  // The corrupted chunks are not downloaded again while streaming(see setChunkHashEnabled), since they have been delivered.
+  // Default: nullptr, 67108864(64MB).
+  //
+  Result setStreamOutput(StreamFunctor stream_functor, int64_t read_ahead_size) noexcept;
+  void streamOutput(StreamFunctor& stream_functor, int64_t& read_ahead_size) const noexcept;
+
+  // Decompress the file while downloading, the target file is the decompressed data rather than the downloaded one.
+  // The downloaded data is decoded in order on the stream output thread(see setStreamOutput) as soon as it is written
+  // and read_ahead_size applies too, so the compressed file isn't read back after downloaded.
+  // stream_functor receives the decompressed data if it is set.
+  // codec: COMPRESSION_GZIP(gzip or zlib format) requires zoe built with zlib, COMPRESSION_ZSTD requires zstd,
+  // UNSUPPORTED_CODEC is returned if not. COMPRESSION_CUSTOM decodes by the decoder created by decoder_factory,
+  // which is called each time the download starts.
+  // The hash set by setHashVerifyPolicy is verified with the downloaded data, see setDecompressedHashVerify.
+  // The download fails with DECOMPRESS_FAILED if the data can't be decoded.
+  // A resumed download is decoded from the begin of file again. Not used with memory target.
+  // Default: COMPRESSION_NONE, nullptr.
+  //
+  Result setDecompression(CompressionCodec codec, StreamDecoderFactory decoder_factory) noexcept;
+  void decompression(CompressionCodec& codec, StreamDecoderFactory& decoder_factory) const noexcept;
+
+  // Verify the hash of decompressed data, see setDecompression. It is not verified if hash_value is empty.
+  // Default: MD5, empty.
+  //
+  Result setDecompressedHashVerify(HashType hash_type, const utf8string& hash_value) noexcept;
+  void decompressedHashVerify(HashType& hash_type, utf8string& hash_value) const noexcept;
+
+  // Download into memory rather than target file, the target_file_path passed to start is ignored and can be empty.
+  // buffer: owned by user and must be valid until downloaded, the download fails with TMP_FILE_SIZE_ERROR
+  // if the file is larger than buffer_size. If buffer is nullptr, the memory is allocated by zoe, see memoryData.
+  // Nothing is written to disk, there is no temp file and index file, so the download can't be resumed.
+  // Default: false, nullptr, 0.
+  //
+  Result setMemoryTarget(bool enabled, void* buffer, int64_t buffer_size) noexcept;
+  bool memoryTargetEnabled() const noexcept;
+
+  // The data downloaded into memory, it is the buffer passed to setMemoryTarget or allocated by zoe.
+  // Valid until next start or Zoe destroyed, nullptr if memory target disabled or not downloaded successfully.
+  //
+  const void* memoryData(int64_t& size) const noexcept;
+
+  // Set the urls of the same file on other servers, such as CDNs and origin mirrors.
+  // The slices are downloaded from the url passed to start and the mirrors at the same time,
+  // the faster and more reliable servers get more slices, and a failed slice is retried on another server.
+  // A mirror is not used if its file size, Content-MD5 or ETag differs from the url's, or the url doesn't support range.
+  // Default to empty.
+  //
+  Result setMirrorUrls(const std::vector<utf8string>& urls) noexcept;
+  std::vector<utf8string> mirrorUrls() const noexcept;
+
+  // Spread the connections of slices over the addresses that the server resolves to, such as the edges of a CDN that
+  // limits the speed of each client, at most num addresses of each server(the url passed to start and the mirrors).
+  // The host is resolved once after the file info is fetched, each address is measured and selected as a mirror is,
+  // an address that fails is not used again while the others work. The TLS certificate is still verified by host name.
+  // Not used with proxy or if the server doesn't support range.
+  // Set to 0 or 1 to connect to the address resolved by libcurl only.
+  // Default: 0.
+  //
+  Result setMaxAddressNum(int32_t num) noexcept;
+  int32_t maxAddressNum() const noexcept;
+
+  // Delta update, old_file_path is a previous version of the file, manifest_url is the manifest of the new file made by
+  // MakeDeltaManifest and published beside it. The blocks of the new file found anywhere in the old file are copied
+  // from it, only the ranges between them are downloaded. The old file is searched byte by byte on all CPU cores,
+  // so the blocks moved by insertions or deletions are found too.
+  // old_file_path can be the target file path, since the target file is replaced after downloaded.
+  // The whole file is downloaded if the manifest can't be fetched or is not of the file, or the server doesn't support range.
+  // It's recommended to verify the hash of file, see setHashVerifyPolicy.
+  // Set either to empty to disable.
+  // Default: empty(disabled).
+  //
+  Result setDeltaSource(const utf8string& old_file_path, const utf8string& manifest_url) noexcept;
+  void deltaSource(utf8string& old_file_path, utf8string& manifest_url) const noexcept;
+
+  // Peer mode, for the machines of a LAN that download the same file, so that the servers send it about once rather than
+  // once to each machine.
+  // If listen_port is not 0, the data downloaded is shared to peers by an HTTP server of this process that listens on
+  // listen_port of all interfaces: the slices whose chunks are on disk while downloading, then the whole target file after
+  // downloaded until StopPeerSharing or GlobalUnInit is called. Only one port is listened by a process, the first one set,
+  // the downloads that set another port are not shared.
+  // peers are the machines to fetch from, such as "192.168.1.12:8090" or "http://192.168.1.12:8090". A slice is fetched
+  // from a peer that shares its whole range, otherwise from the servers as usual. The slices that are fetched from peers
+  // are compared with the chunk hashes of peers, the data mismatched is downloaded again from the servers and that peer is
+  // not used anymore, so all the peers should use the same slice policy and thread number to have the same slices.
+  // Only the same version of file is shared, which has the same url, size, ETag and Last-Modified.
+  // Chunk hash is enabled together, see setChunkHashEnabled. Not used with proxy or if the server doesn't support range.
+  // It's recommended to verify the hash of file, see setHashVerifyPolicy.
+  // Set listen_port to 0 and peers to empty to disable.
+  // Default: 0, empty(disabled).
+  //
+  Result setPeerMode(int32_t listen_port, const std::vector<utf8string>& peers) noexcept;
+  void peerMode(int32_t& listen_port, std::vector<utf8string>& peers) const noexcept;
+
+  // Keep the downloaded files in dir, so that downloading the same file again copies it from dir rather than the network.
+  // The file is looked up by the hash set by setHashVerifyPolicy without any request, or by url whose ETag or
+  // Last-Modified is revalidated with the server(If-None-Match / If-Modified-Since).
+  // It is stored after downloaded, keyed by the hash if it is verified, or by url if the server sends ETag or Last-Modified.
+  // The files used least recently are removed when the total size exceeds max_size.
+  // The cached file is copied by reflink if the file system supports it, otherwise by hard link if allow_hardlink is true,
+  // which shares the data between the target file and the cache, so modifying the target file in place corrupts the cache.
+  // With ALWAYS hash verify policy, the copied file is verified, the cached file that does not match is removed and downloaded.
+  // dir can be shared by processes. It is not used with memory target.
+  // Set max_size to 0 or negative to switch to the default - 10737418240(10GB).
+  // Default: empty(disabled), 10GB, false.
+  //
+  Result setDownloadCache(const utf8string& dir, int64_t max_size, bool allow_hardlink) noexcept;
+  void downloadCache(utf8string& dir, int64_t& max_size, bool& allow_hardlink) const noexcept;
+
   // Start to download and state change to DOWNLOADING.
   // Supported url protocol is as same as curl library.
   //
@@ -266,6 +802,8 @@ class ZOE_API Zoe {
       RealtimeSpeedFunctor realtime_speed_functor) noexcept;
 
   // Pause downloading and state change to PAUSED.
+  // The transfers are paused without closing their connections, so resume() goes on immediately,
+  // see setPauseKeepAliveTime for how long the connections are kept.
   //
   void pause() noexcept;
 
@@ -286,8 +824,32 @@ class ZOE_API Zoe {
 
   DownloadState state() const noexcept;
 
+  // Statistics of the current download, sampled at the speed interval(see setProgressInterval).
+  // It is the last sample after the download stopped, and empty before the transfer started.
+  //
+  DownloadStats stats() const noexcept;
+
+  // Counters of the current or last download.
+  // Slice metrics are updated when each transfer of the slice finishes.
+  //
+  DownloadMetrics metrics() const noexcept;
+
   std::shared_future<Result> futureResult() noexcept;
 
+#ifdef ZOE_HAS_COROUTINE
+  class DownloadAwaitable;
+
+  // The awaitable form of start for C++20 coroutines: Result ret = co_await efd.download(url, target_file_path);
+  // The coroutine is resumed with the result on the executor set by setCallbackExecutor, or on the thread of zoe if not set,
+  // where the coroutine must not destroy the Zoe object before it is suspended again, see setCallbackExecutor.
+  // The functors are posted to the executor as start does.
+  //
+  DownloadAwaitable download(const utf8string& url,
+                             const utf8string& target_file_path,
+                             ProgressFunctor progress_functor = nullptr,
+                             RealtimeSpeedFunctor realtime_speed_functor = nullptr) noexcept;
+#endif
+
  protected:
   class ZoeImpl;
   ZoeImpl* impl_;
@@ -295,5 +857,152 @@ class ZOE_API Zoe {
   Zoe(const Zoe&) = delete;
   Zoe& operator=(const Zoe&) = delete;
 };
+
+#ifdef ZOE_HAS_COROUTINE
+// Defined in the header, so that the coroutine support doesn't depend on the standard zoe is built with.
+class Zoe::DownloadAwaitable {
+ public:
+  DownloadAwaitable(Zoe* zoe,
+                    const utf8string& url,
+                    const utf8string& target_file_path,
+                    ProgressFunctor progress_functor,
+                    RealtimeSpeedFunctor realtime_speed_functor)
+      : zoe_(zoe)
+      , url_(url)
+      , target_file_path_(target_file_path)
+      , progress_functor_(progress_functor)
+      , realtime_speed_functor_(realtime_speed_functor)
+      , result_(UNKNOWN_ERROR) {}
+
+  bool await_ready() const noexcept { return false; }
+
+  // The coroutine is resumed in ResultFunctor, on the executor if set, otherwise on the thread of zoe.
+  void await_suspend(std::coroutine_handle<> handle) {
+    zoe_->start(url_, target_file_path_, [this, handle](Result ret) {
+      result_ = ret;
+      handle.resume();
+    }, progress_functor_, realtime_speed_functor_);
+  }
+
+  Result await_resume() const noexcept { return result_; }
+
+ protected:
+  Zoe* zoe_;
+  utf8string url_;
+  utf8string target_file_path_;
+  ProgressFunctor progress_functor_;
+  RealtimeSpeedFunctor realtime_speed_functor_;
+  Result result_;
+};
+
+inline Zoe::DownloadAwaitable Zoe::download(const utf8string& url,
+                                            const utf8string& target_file_path,
+                                            ProgressFunctor progress_functor,
+                                            RealtimeSpeedFunctor realtime_speed_functor) noexcept {
+  return DownloadAwaitable(this, url, target_file_path, progress_functor, realtime_speed_functor);
+}
+#endif
+
+typedef struct _BatchEntry {
+  utf8string url;
+  utf8string target_file_path;
+  HashType hash_type;
+  utf8string hash_value;  // the whole file's hash, empty if not verify
+
+  _BatchEntry()
+      : hash_type(MD5) {}
+} BatchEntry;
+
+typedef struct _BatchStats {
+  int32_t file_num;
+  int32_t completed_num;  // finished, including the failed ones
+  int32_t failed_num;
+  int64_t total;       // sum of the sizes of the files that have been known
+  int64_t downloaded;  // byte
+
+  _BatchStats()
+      : file_num(0)
+      , completed_num(0)
+      , failed_num(0)
+      , total(0L)
+      , downloaded(0L) {}
+} BatchStats;
+
+typedef std::function<void(size_t entry_index, Result ret)> BatchEntryResultFunctor;
+
+// Batch downloads a list of files on one engine owned by itself.
+// The file information of several files is fetched at the same time on the fetch threads,
+// and the slices of all files share one limit of concurrent transfers, see Engine::setMaxConcurrentTransfers.
+// Only a limited number of files are downloading at the same time, the others are waiting in order.
+//
+class ZOE_API Batch {
+ public:
+  // io_thread_num: see Engine.
+  // fetch_thread_num: number of files that fetch file information at the same time.
+  // Set to 0 or negative to switch to the default built-in number - 1 and 4.
+  //
+  Batch(int32_t io_thread_num = 1, int32_t fetch_thread_num = 4);
+
+  // Stop downloading and wait for all files to finish.
+  ~Batch();
+
+  void setVerboseOutput(VerboseOuputFunctor verbose_functor) noexcept;
+
+  // The maximum thread number of each file, see Zoe::setThreadNum.
+  // Set to 0 or negative to switch to the default built-in thread number - 4.
+  //
+  Result setThreadNum(int32_t thread_num) noexcept;
+  int32_t threadNum() const noexcept;
+
+  // The maximum number of slices transferring at the same time, counted across all files.
+  // Set to 0 or negative to switch to the default - 16.
+  //
+  Result setMaxConcurrentTransfers(int32_t num) noexcept;
+  int32_t maxConcurrentTransfers() const noexcept;
+
+  // The maximum number of files downloading at the same time, including the files fetching file information.
+  // Set to 0 or negative to switch to the default - 32.
+  //
+  Result setMaxActiveFileNum(int32_t num) noexcept;
+  int32_t maxActiveFileNum() const noexcept;
+
+  // The disk cache size of each file, see Zoe::setDiskCacheSize.
+  // Set to 0 or negative to switch to the default - 2097152 byte (2MB).
+  //
+  Result setDiskCacheSize(int32_t cache_size) noexcept;
+  int32_t diskCacheSize() const noexcept;
+
+  // The files not larger than this size are downloaded in one slice, see Zoe::setUnslicedFileSize.
+  // Set to 0 or negative to switch to the default - 4194304 byte (4MB).
+  //
+  Result setUnslicedFileSize(int64_t file_size) noexcept;
+  int64_t unslicedFileSize() const noexcept;
+
+  // Start to download the entries.
+  // entry_result_functor is called with the index of entry when each file finished, it should return quickly
+  // and must not start the batch again.
+  // The result is SUCCESSED if all files are downloaded, otherwise the result of the first failed entry,
+  // or CANCELED if stopped.
+  //
+  std::shared_future<Result> start(const std::vector<BatchEntry>& entries,
+                                   BatchEntryResultFunctor entry_result_functor) noexcept;
+
+  // Stop downloading, the files that not finished return CANCELED.
+  //
+  void stop() noexcept;
+
+  BatchStats stats() const noexcept;
+
+  // The results in the order of entries, valid after the batch finished.
+  //
+  std::vector<Result> results() const noexcept;
+
+ protected:
+  class BatchImpl;
+  BatchImpl* impl_;
+
+  Batch(const Batch&) = delete;
+  Batch& operator=(const Batch&) = delete;
+};
 }  // namespace zoe
 #endif  // !ZOE_H_
\ No newline at end of file
@@ -0,0 +1,388 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "zoe/zoe.h"
+#include <assert.h>
+#include <algorithm>
+#include <mutex>
+#include "options.h"
+#include "file_util.h"
+#include "verbose.h"
+
+namespace zoe {
+
+class Batch::BatchImpl {
+ public:
+  typedef struct _Item {
+    BatchEntry entry;
+    std::shared_ptr<Zoe> zoe;
+    std::shared_future<Result> future;
+    Result result;
+    bool done;
+    int64_t total;
+    int64_t downloaded;
+  } Item;
+
+  BatchImpl(int32_t io_thread_num, int32_t fetch_thread_num)
+      : engine_(io_thread_num, fetch_thread_num)
+      , thread_num_(ZOE_DEFAULT_BATCH_THREAD_NUM)
+      , max_transfer_num_(ZOE_DEFAULT_BATCH_MAX_TRANSFER_NUM)
+      , max_active_file_num_(ZOE_DEFAULT_BATCH_MAX_ACTIVE_FILE_NUM)
+      , disk_cache_size_(ZOE_DEFAULT_BATCH_DISK_CACHE_SIZE_BYTE)
+      , unsliced_file_size_(ZOE_DEFAULT_BATCH_UNSLICED_FILE_SIZE_BYTE)
+      , running_(false)
+      , stopping_(false)
+      , next_(0)
+      , active_num_(0)
+      , completed_num_(0)
+      , failed_num_(0) {}
+
+  ~BatchImpl() {
+    stop();
+    if (future_.valid())
+      future_.wait();
+    waitItems();
+  }
+
+  bool isRunning() const {
+    std::lock_guard<std::mutex> lg(mutex_);
+    return running_;
+  }
+
+  std::shared_future<Result> start(const std::vector<BatchEntry>& entries,
+                                   BatchEntryResultFunctor entry_result_functor) {
+    if (isRunning()) {
+      return std::async(std::launch::async, []() { return ALREADY_DOWNLOADING; });
+    }
+
+    // The files of last batch may be returning from their result functor.
+    waitItems();
+
+    std::lock_guard<std::mutex> lg(mutex_);
+    items_.clear();
+    items_.resize(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+      items_[i].entry = entries[i];
+      items_[i].result = UNKNOWN_ERROR;
+      items_[i].done = false;
+      items_[i].total = -1L;
+      items_[i].downloaded = 0L;
+    }
+
+    entry_result_functor_ = entry_result_functor;
+    stopping_ = false;
+    next_ = 0;
+    active_num_ = 0;
+    completed_num_ = 0;
+    failed_num_ = 0;
+    promise_ = std::make_shared<std::promise<Result>>();
+    future_ = promise_->get_future().share();
+
+    if (items_.empty()) {
+      promise_->set_value(SUCCESSED);
+      return future_;
+    }
+
+    running_ = true;
+    engine_.setMaxConcurrentTransfers(max_transfer_num_);
+    OutputVerbose(verbose_functor_, u8"Batch: %d files, max %d active files, max %d transfers.\n",
+                  (int32_t)items_.size(), max_active_file_num_, max_transfer_num_);
+    startPendingItems();
+    return future_;
+  }
+
+  void stop() {
+    std::vector<std::shared_ptr<Zoe>> active;
+    {
+      std::lock_guard<std::mutex> lg(mutex_);
+      if (!running_)
+        return;
+      stopping_ = true;
+      for (size_t i = 0; i < next_; i++) {
+        if (!items_[i].done)
+          active.push_back(items_[i].zoe);
+      }
+    }
+
+    for (auto& zoe : active)
+      zoe->stop();
+  }
+
+  BatchStats stats() const {
+    std::lock_guard<std::mutex> lg(mutex_);
+    BatchStats s;
+    s.file_num = (int32_t)items_.size();
+    s.completed_num = completed_num_;
+    s.failed_num = failed_num_;
+    for (const auto& item : items_) {
+      if (item.total > 0)
+        s.total += item.total;
+      s.downloaded += item.downloaded;
+    }
+    return s;
+  }
+
+  std::vector<Result> results() const {
+    std::lock_guard<std::mutex> lg(mutex_);
+    std::vector<Result> r;
+    r.reserve(items_.size());
+    for (const auto& item : items_)
+      r.push_back(item.result);
+    return r;
+  }
+
+ protected:
+  // Must be called with mutex_ locked.
+  void startPendingItems() {
+    while (active_num_ < max_active_file_num_ && next_ < items_.size()) {
+      const size_t index = next_++;
+      Item& item = items_[index];
+
+      std::shared_ptr<Zoe> zoe = std::make_shared<Zoe>();
+      zoe->setEngine(&engine_);
+      zoe->setThreadNum(thread_num_);
+      zoe->setDiskCacheSize(disk_cache_size_);
+      zoe->setUnslicedFileSize(unsliced_file_size_);
+      if (verbose_functor_)
+        zoe->setVerboseOutput(verbose_functor_);
+      if (item.entry.hash_value.length() > 0)
+        zoe->setHashVerifyPolicy(ALWAYS, item.entry.hash_type, item.entry.hash_value);
+
+      item.zoe = zoe;
+      active_num_++;
+
+      // The functors are never called on this thread, see Zoe::start.
+      item.future = zoe->start(
+          item.entry.url, item.entry.target_file_path,
+          [this, index](Result ret) { onItemDone(index, ret); },
+          [this, index](int64_t total, int64_t downloaded) { onItemProgress(index, total, downloaded); },
+          nullptr);
+    }
+  }
+
+  void onItemProgress(size_t index, int64_t total, int64_t downloaded) {
+    std::lock_guard<std::mutex> lg(mutex_);
+    items_[index].total = total;
+    items_[index].downloaded = downloaded;
+  }
+
+  void onItemDone(size_t index, Result ret) {
+    std::vector<size_t> canceled;
+    std::shared_ptr<std::promise<Result>> finished_promise;
+    Result batch_ret = SUCCESSED;
+    BatchEntryResultFunctor functor;
+    // The progress may not be reported for the files downloaded quickly.
+    const int64_t file_size = ret == SUCCESSED ? FileUtil::GetFileSize(items_[index].zoe->targetFilePath()) : -1L;
+    {
+      std::lock_guard<std::mutex> lg(mutex_);
+      Item& item = items_[index];
+      item.result = ret;
+      item.done = true;
+      if (file_size >= 0) {
+        item.total = file_size;
+        item.downloaded = file_size;
+      }
+      active_num_--;
+      completed_num_++;
+      if (ret != SUCCESSED)
+        failed_num_++;
+
+      if (stopping_) {
+        for (; next_ < items_.size(); next_++) {
+          items_[next_].result = CANCELED;
+          items_[next_].done = true;
+          completed_num_++;
+          failed_num_++;
+          canceled.push_back(next_);
+        }
+      }
+      else {
+        startPendingItems();
+      }
+
+      functor = entry_result_functor_;
+      if (completed_num_ == (int32_t)items_.size()) {
+        running_ = false;
+        finished_promise = promise_;
+        for (const auto& it : items_) {
+          if (it.result != SUCCESSED) {
+            batch_ret = stopping_ ? CANCELED : it.result;
+            break;
+          }
+        }
+      }
+    }
+
+    OutputVerbose(verbose_functor_, u8"Batch: entry<%d> %s.\n", (int32_t)index, GetResultString(ret));
+
+    if (functor) {
+      functor(index, ret);
+      for (size_t i : canceled)
+        functor(i, CANCELED);
+    }
+
+    if (finished_promise)
+      finished_promise->set_value(batch_ret);
+  }
+
+  void waitItems() {
+    std::vector<std::shared_future<Result>> futures;
+    {
+      std::lock_guard<std::mutex> lg(mutex_);
+      for (const auto& item : items_) {
+        if (item.future.valid())
+          futures.push_back(item.future);
+      }
+    }
+
+    for (auto& f : futures)
+      f.wait();
+  }
+
+ public:
+  Engine engine_;
+  VerboseOuputFunctor verbose_functor_;
+  int32_t thread_num_;
+  int32_t max_transfer_num_;
+  int32_t max_active_file_num_;
+  int32_t disk_cache_size_;
+  int64_t unsliced_file_size_;
+
+ protected:
+  mutable std::mutex mutex_;
+  std::vector<Item> items_;
+  BatchEntryResultFunctor entry_result_functor_;
+  std::shared_ptr<std::promise<Result>> promise_;
+  std::shared_future<Result> future_;
+  bool running_;
+  bool stopping_;
+  size_t next_;
+  int32_t active_num_;
+  int32_t completed_num_;
+  int32_t failed_num_;
+};
+
+Batch::Batch(int32_t io_thread_num, int32_t fetch_thread_num) {
+  if (io_thread_num <= 0)
+    io_thread_num = ZOE_DEFAULT_ENGINE_IO_THREAD_NUM;
+  if (fetch_thread_num <= 0)
+    fetch_thread_num = ZOE_DEFAULT_BATCH_FETCH_THREAD_NUM;
+  impl_ = new BatchImpl(io_thread_num, fetch_thread_num);
+}
+
+Batch::~Batch() {
+  if (impl_) {
+    delete impl_;
+    impl_ = nullptr;
+  }
+}
+
+void Batch::setVerboseOutput(VerboseOuputFunctor verbose_functor) noexcept {
+  assert(impl_);
+  impl_->verbose_functor_ = verbose_functor;
+}
+
+Result Batch::setThreadNum(int32_t thread_num) noexcept {
+  assert(impl_);
+  if (impl_->isRunning())
+    return ALREADY_DOWNLOADING;
+  if (thread_num <= 0)
+    thread_num = ZOE_DEFAULT_BATCH_THREAD_NUM;
+  if (thread_num > 100)
+    return INVALID_THREAD_NUM;
+  impl_->thread_num_ = thread_num;
+  return SUCCESSED;
+}
+
+int32_t Batch::threadNum() const noexcept {
+  assert(impl_);
+  return impl_->thread_num_;
+}
+
+Result Batch::setMaxConcurrentTransfers(int32_t num) noexcept {
+  assert(impl_);
+  if (impl_->isRunning())
+    return ALREADY_DOWNLOADING;
+  impl_->max_transfer_num_ = num > 0 ? num : ZOE_DEFAULT_BATCH_MAX_TRANSFER_NUM;
+  return SUCCESSED;
+}
+
+int32_t Batch::maxConcurrentTransfers() const noexcept {
+  assert(impl_);
+  return impl_->max_transfer_num_;
+}
+
+Result Batch::setMaxActiveFileNum(int32_t num) noexcept {
+  assert(impl_);
+  if (impl_->isRunning())
+    return ALREADY_DOWNLOADING;
+  impl_->max_active_file_num_ = num > 0 ? num : ZOE_DEFAULT_BATCH_MAX_ACTIVE_FILE_NUM;
+  return SUCCESSED;
+}
+
+int32_t Batch::maxActiveFileNum() const noexcept {
+  assert(impl_);
+  return impl_->max_active_file_num_;
+}
+
+Result Batch::setDiskCacheSize(int32_t cache_size) noexcept {
+  assert(impl_);
+  if (impl_->isRunning())
+    return ALREADY_DOWNLOADING;
+  impl_->disk_cache_size_ = cache_size > 0 ? cache_size : ZOE_DEFAULT_BATCH_DISK_CACHE_SIZE_BYTE;
+  return SUCCESSED;
+}
+
+int32_t Batch::diskCacheSize() const noexcept {
+  assert(impl_);
+  return impl_->disk_cache_size_;
+}
+
+Result Batch::setUnslicedFileSize(int64_t file_size) noexcept {
+  assert(impl_);
+  if (impl_->isRunning())
+    return ALREADY_DOWNLOADING;
+  impl_->unsliced_file_size_ = file_size > 0 ? file_size : ZOE_DEFAULT_BATCH_UNSLICED_FILE_SIZE_BYTE;
+  return SUCCESSED;
+}
+
+int64_t Batch::unslicedFileSize() const noexcept {
+  assert(impl_);
+  return impl_->unsliced_file_size_;
+}
+
+std::shared_future<Result> Batch::start(const std::vector<BatchEntry>& entries,
+                                        BatchEntryResultFunctor entry_result_functor) noexcept {
+  assert(impl_);
+  return impl_->start(entries, entry_result_functor);
+}
+
+void Batch::stop() noexcept {
+  assert(impl_);
+  impl_->stop();
+}
+
+BatchStats Batch::stats() const noexcept {
+  assert(impl_);
+  return impl_->stats();
+}
+
+std::vector<Result> Batch::results() const noexcept {
+  assert(impl_);
+  return impl_->results();
+}
+}  // namespace zoe
@@ -0,0 +1,233 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "buffer_pool.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <set>
+#include <algorithm>
+#include "options.h"
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace zoe {
+namespace {
+std::mutex budget_mutex;
+int64_t budget_limit = 0L;
+int64_t budget_used = 0L;
+std::set<const BufferPool*> budget_pools;
+
+// The functions below must be called with budget_mutex locked.
+bool IsBudgetPressed(int64_t more) {
+  return budget_limit > 0 && (budget_used + more) * 100 > budget_limit * ZOE_CACHE_MEMORY_PRESSURE_PERCENT;
+}
+
+int64_t BudgetShare(const BufferPool* pool) {
+  double total_weight = 0.0;
+  for (const BufferPool* p : budget_pools)
+    total_weight += (double)std::max(p->weight(), (int64_t)1);
+  if (total_weight <= 0.0)
+    return budget_limit;
+  return (int64_t)((double)budget_limit * (double)std::max(pool->weight(), (int64_t)1) / total_weight);
+}
+
+bool ReserveBudget(const BufferPool* pool, int64_t size) {
+  std::lock_guard<std::mutex> lg(budget_mutex);
+  if (budget_limit > 0) {
+    if (budget_used + size > budget_limit)
+      return false;
+
+    // A pool without any block always gets one if the limit allows, so that every download can cache.
+    const int64_t allocated = pool->allocatedSize();
+    if (allocated > 0 && IsBudgetPressed(size) && allocated + size > BudgetShare(pool))
+      return false;
+  }
+  budget_used += size;
+  return true;
+}
+
+void ReleaseBudget(int64_t size) {
+  std::lock_guard<std::mutex> lg(budget_mutex);
+  budget_used -= size;
+  assert(budget_used >= 0);
+}
+
+bool IsOverBudgetShare(const BufferPool* pool) {
+  std::lock_guard<std::mutex> lg(budget_mutex);
+  return IsBudgetPressed(0) && pool->allocatedSize() > BudgetShare(pool);
+}
+}  // namespace
+
+BufferPool::BufferPool(int64_t block_size, int32_t max_block_num)
+    : block_size_(block_size)
+    , max_block_num_(max_block_num)
+    , allocated_num_(0) {
+  exhausted_.store(false);
+  allocated_size_.store(0L);
+  weight_.store(0L);
+
+  std::lock_guard<std::mutex> lg(budget_mutex);
+  budget_pools.insert(this);
+}
+
+BufferPool::~BufferPool() {
+  {
+    std::lock_guard<std::mutex> lg(budget_mutex);
+    budget_pools.erase(this);
+  }
+
+  std::lock_guard<std::mutex> lg(mutex_);
+  assert((int32_t)free_blocks_.size() == allocated_num_);
+  for (char* p : free_blocks_)
+    AlignedFree(p);
+  free_blocks_.clear();
+  allocated_num_ = 0;
+  ReleaseBudget(allocated_size_.exchange(0L));
+}
+
+char* BufferPool::acquire(bool notify) {
+  std::lock_guard<std::mutex> lg(mutex_);
+  if (!free_blocks_.empty()) {
+    char* p = free_blocks_.back();
+    free_blocks_.pop_back();
+    return p;
+  }
+
+  if (allocated_num_ < max_block_num_ && ReserveBudget(this, block_size_)) {
+    char* p = AlignedAlloc(block_size_);
+    if (p) {
+      allocated_num_++;
+      allocated_size_ += block_size_;
+      return p;
+    }
+    ReleaseBudget(block_size_);
+  }
+
+  if (notify)
+    exhausted_.store(true);
+  return nullptr;
+}
+
+void BufferPool::release(char* block) {
+  if (!block)
+    return;
+
+  std::function<void()> available;
+  std::vector<char*> freed_blocks;
+  {
+    std::lock_guard<std::mutex> lg(mutex_);
+    free_blocks_.push_back(block);
+
+    // Shrink to the share of budget under pressure, the memory is taken by the other pools.
+    while (!free_blocks_.empty() && IsOverBudgetShare(this)) {
+      freed_blocks.push_back(free_blocks_.back());
+      free_blocks_.pop_back();
+      allocated_num_--;
+      allocated_size_ -= block_size_;
+      ReleaseBudget(block_size_);
+    }
+
+    if (exhausted_.load()) {
+      exhausted_.store(false);
+      available = available_functor_;
+    }
+  }
+
+  for (char* p : freed_blocks)
+    AlignedFree(p);
+
+  if (available)
+    available();
+}
+
+int64_t BufferPool::blockSize() const {
+  return block_size_;
+}
+
+int32_t BufferPool::availableNum() const {
+  std::lock_guard<std::mutex> lg(mutex_);
+  return (int32_t)free_blocks_.size() + (max_block_num_ - allocated_num_);
+}
+
+void BufferPool::setAvailableFunctor(std::function<void()> fn) {
+  std::lock_guard<std::mutex> lg(mutex_);
+  available_functor_ = fn;
+}
+
+void BufferPool::setWeight(int64_t weight) {
+  weight_.store(weight);
+}
+
+int64_t BufferPool::weight() const {
+  return weight_.load();
+}
+
+int64_t BufferPool::allocatedSize() const {
+  return allocated_size_.load();
+}
+
+int64_t BufferPool::PageSize() {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  SYSTEM_INFO si;
+  GetSystemInfo(&si);
+  return (int64_t)si.dwPageSize;
+#else
+  return (int64_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+char* BufferPool::AlignedAlloc(int64_t size) {
+  const int64_t page_size = PageSize();
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  return (char*)_aligned_malloc((size_t)size, (size_t)page_size);
+#else
+  void* p = nullptr;
+  if (posix_memalign(&p, (size_t)page_size, (size_t)size) != 0)
+    return nullptr;
+  return (char*)p;
+#endif
+}
+
+void BufferPool::AlignedFree(char* p) {
+  if (!p)
+    return;
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  _aligned_free(p);
+#else
+  free(p);
+#endif
+}
+
+void SetCacheMemoryLimit(int64_t bytes) {
+  std::lock_guard<std::mutex> lg(budget_mutex);
+  budget_limit = std::max(bytes, (int64_t)0);
+}
+
+int64_t GetCacheMemoryLimit() {
+  std::lock_guard<std::mutex> lg(budget_mutex);
+  return budget_limit;
+}
+
+int64_t GetCacheMemoryUsed() {
+  std::lock_guard<std::mutex> lg(budget_mutex);
+  return budget_used;
+}
+}  // namespace zoe
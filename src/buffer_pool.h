@@ -0,0 +1,83 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_BUFFER_POOL_H_
+#define ZOE_BUFFER_POOL_H_
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include "zoe/zoe.h"
+
+namespace zoe {
+
+// Fixed-size, page-aligned disk cache blocks.
+// Blocks are allocated on demand up to max_block_num and reused until the pool is destroyed,
+// so the memory of disk cache is bounded and alignment is suitable for direct io.
+// The blocks of all pools are counted in the cache memory budget of process too, see SetCacheMemoryLimit.
+// Thread safe.
+class BufferPool {
+ public:
+  BufferPool(int64_t block_size, int32_t max_block_num);
+  virtual ~BufferPool();
+
+  // Return nullptr if all of blocks are in use or the budget is used up.
+  // The available functor is called later for the failure only if notify is true.
+  char* acquire(bool notify = true);
+  void release(char* block);
+
+  int64_t blockSize() const;
+  int32_t availableNum() const;
+
+  // Called when a block released after acquire failed.
+  void setAvailableFunctor(std::function<void()> fn);
+
+  // The share of cache memory budget is in proportion to the weight, such as the download speed.
+  void setWeight(int64_t weight);
+  int64_t weight() const;
+
+  // Bytes of the blocks allocated.
+  int64_t allocatedSize() const;
+
+  static int64_t PageSize();
+  static char* AlignedAlloc(int64_t size);
+  static void AlignedFree(char* p);
+
+ protected:
+  const int64_t block_size_;
+  const int32_t max_block_num_;
+  int32_t allocated_num_;
+  std::atomic<int64_t> allocated_size_;  // read by the budget without the lock of pool
+  std::atomic<int64_t> weight_;
+  std::vector<char*> free_blocks_;
+  std::atomic_bool exhausted_;
+  mutable std::mutex mutex_;
+  std::function<void()> available_functor_;
+};
+
+// The memory of disk cache blocks of all Zoe objects in this process, 0 or negative means unlimited.
+// When more than ZOE_CACHE_MEMORY_PRESSURE_PERCENT of the limit is used, a pool can't take more than its share unless
+// it has no block, and the blocks released beyond the share are freed rather than kept by the pool.
+void SetCacheMemoryLimit(int64_t bytes);
+int64_t GetCacheMemoryLimit();
+
+// Bytes of the blocks allocated by all pools.
+int64_t GetCacheMemoryUsed();
+}  // namespace zoe
+#endif  // !ZOE_BUFFER_POOL_H_
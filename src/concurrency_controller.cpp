@@ -0,0 +1,152 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "concurrency_controller.h"
+#include <inttypes.h>
+#include <algorithm>
+#include "options.h"
+#include "verbose.h"
+
+namespace zoe {
+ConcurrencyController::ConcurrencyController(Options* options,
+                                             std::shared_ptr<SliceManager> slice_manager,
+                                             std::shared_ptr<SpeedHandler> speed_handler,
+                                             int32_t min_num,
+                                             int32_t max_num)
+    : options_(options)
+    , slice_manager_(slice_manager)
+    , speed_handler_(speed_handler)
+    , min_num_(std::max(1, std::min(min_num, max_num)))
+    , max_num_(std::max(1, max_num))
+    , concurrency_(min_num_)
+    , direction_(0)
+    , hold_rounds_(0)
+    , last_total_(-1L)
+    , last_throughput_(0L) {}
+
+ConcurrencyController::~ConcurrencyController() {}
+
+int32_t ConcurrencyController::concurrency() const {
+  return concurrency_;
+}
+
+void ConcurrencyController::reset() {
+  last_total_ = -1L;
+  last_throughput_ = 0L;
+  time_meter_.Restart();
+}
+
+void ConcurrencyController::tick(int32_t active_num) {
+  const long elapsed = time_meter_.Elapsed();
+  if (last_total_ >= 0 && elapsed < ZOE_ADAPTIVE_SAMPLE_INTERVAL_MS)
+    return;
+  time_meter_.Restart();
+  sample(elapsed, active_num);
+}
+
+void ConcurrencyController::sample(int64_t elapsed_ms, int32_t active_num) {
+  if (!slice_manager_)
+    return;
+
+  // smoothed per-slice speed, only for the slices that have been sampled by speed handler.
+  int64_t slice_total_speed = 0L;
+  int64_t slice_min_speed = -1L;
+  int32_t slice_num = 0;
+  for (const auto& s : slice_manager_->getSlices(Slice::DOWNLOADING)) {
+    if (!speed_handler_)
+      break;
+    const int64_t speed = speed_handler_->sliceSpeed(s->index());
+    if (speed < 0)
+      continue;
+    slice_total_speed += speed;
+    slice_min_speed = slice_min_speed < 0 ? speed : std::min(slice_min_speed, speed);
+    slice_num++;
+  }
+
+  // The decision compares the throughput of successive intervals, the smoothed speed lags behind a step.
+  const int64_t total = slice_manager_->totalDownloaded();
+  if (last_total_ < 0 || elapsed_ms <= 0) {
+    last_total_ = total;
+    return;
+  }
+
+  const int64_t throughput = std::max((total - last_total_) * 1000 / elapsed_ms, (int64_t)0);
+  last_total_ = total;
+
+  OutputVerbose(options_->verbose_functor,
+                u8"Concurrency %d(active %d), throughput: %" PRId64 " B/s, per slice avg: %" PRId64 " B/s, min: %" PRId64 " B/s.\n",
+                concurrency_, active_num, throughput,
+                slice_num > 0 ? slice_total_speed / slice_num : 0L, std::max(slice_min_speed, (int64_t)0));
+
+  // Not enough slices to fill the concurrency, such as at the tail of download, the sample means nothing.
+  if (active_num < concurrency_) {
+    last_throughput_ = 0L;
+    direction_ = 0;
+    hold_rounds_ = 0;
+    return;
+  }
+
+  if (last_throughput_ <= 0) {
+    last_throughput_ = throughput;
+    step(1);
+    return;
+  }
+
+  const int64_t gain_percent = (throughput - last_throughput_) * 100 / last_throughput_;
+  last_throughput_ = throughput;
+
+  if (direction_ > 0) {
+    // the new connection made it faster, try one more.
+    if (gain_percent >= ZOE_ADAPTIVE_MIN_GAIN_PERCENT) {
+      step(1);
+    }
+    else {
+      // no help or server throttles us, undo and hold.
+      step(-1);
+      direction_ = 0;
+    }
+  }
+  else if (direction_ < 0) {
+    // fewer connections and slower, undo. otherwise keep the fewer connections.
+    if (gain_percent <= -ZOE_ADAPTIVE_MIN_GAIN_PERCENT)
+      step(1);
+    direction_ = 0;
+  }
+  else {
+    if (gain_percent <= -ZOE_ADAPTIVE_MIN_GAIN_PERCENT) {
+      // link changed, check whether there are too many connections.
+      step(-1);
+    }
+    else if (++hold_rounds_ >= ZOE_ADAPTIVE_HOLD_ROUNDS) {
+      step(1);
+    }
+  }
+}
+
+void ConcurrencyController::step(int32_t delta) {
+  hold_rounds_ = 0;
+  const int32_t target = std::max(min_num_, std::min(max_num_, concurrency_ + delta));
+  if (target == concurrency_) {
+    direction_ = 0;
+    return;
+  }
+
+  OutputVerbose(options_->verbose_functor, u8"Concurrency: %d -> %d.\n", concurrency_, target);
+  direction_ = delta > 0 ? 1 : -1;
+  concurrency_ = target;
+}
+}  // namespace zoe
@@ -0,0 +1,74 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_CONCURRENCY_CONTROLLER_H_
+#define ZOE_CONCURRENCY_CONTROLLER_H_
+#pragma once
+
+#include <map>
+#include "zoe/zoe.h"
+#include "slice_manager.h"
+#include "speed_handler.h"
+#include "time_meter.hpp"
+
+namespace zoe {
+typedef struct _Options Options;
+
+// Adjust the number of concurrent slices between min and max number according to the measured throughput.
+// Keep adding a connection while the total throughput increases, undo the step when it doesn't help,
+// then hold for a while and probe again, so that zoe can follow the link changes.
+// All functions must be called on the loop thread.
+class ConcurrencyController {
+ public:
+  // The speed of slices comes from speed_handler.
+  ConcurrencyController(Options* options,
+                        std::shared_ptr<SliceManager> slice_manager,
+                        std::shared_ptr<SpeedHandler> speed_handler,
+                        int32_t min_num,
+                        int32_t max_num);
+  virtual ~ConcurrencyController();
+
+  int32_t concurrency() const;
+
+  // Called periodically with the number of slices that are transferring.
+  void tick(int32_t active_num);
+
+  // Drop the samples, such as after resume.
+  void reset();
+
+ protected:
+  void sample(int64_t elapsed_ms, int32_t active_num);
+  void step(int32_t delta);
+
+ protected:
+  const Options* options_;
+  std::shared_ptr<SliceManager> slice_manager_;
+  std::shared_ptr<SpeedHandler> speed_handler_;
+  const int32_t min_num_;
+  const int32_t max_num_;
+  int32_t concurrency_;
+
+  // +1: probing up, -1: probing down, 0: holding.
+  int32_t direction_;
+  int32_t hold_rounds_;
+
+  TimeMeter time_meter_;
+  int64_t last_total_;
+  int64_t last_throughput_;  // byte per second
+};
+}  // namespace zoe
+#endif  // !ZOE_CONCURRENCY_CONTROLLER_H_
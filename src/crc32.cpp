@@ -1,8 +1,10 @@
 #include "crc32.h"
 #include <stdlib.h>
 #include <stdint.h>
+#include <vector>
 #include "file_util.h"
 #include "options.h"
+#include "hash_accel.h"
 
 namespace zoe {
 namespace crc32_internal {
@@ -52,6 +54,11 @@ void crc32Init(uint32_t* pCrc32) {
 }
 
 void crc32Update(uint32_t* pCrc32, unsigned char* pData, uint32_t uSize) {
+  if (hash_accel::IsEnabled()) {
+    *pCrc32 = hash_accel::Crc32Update(*pCrc32, pData, uSize);
+    return;
+  }
+
   uint32_t i = 0;
 
   for (i = 0; i < uSize; i++)
@@ -62,6 +69,60 @@ void crc32Update(uint32_t* pCrc32, unsigned char* pData, uint32_t uSize) {
 void crc32Finish(uint32_t* pCrc32) {
   *pCrc32 = ~(*pCrc32);
 }
+
+// Appending len2 zero bytes to the first block is a linear operator over GF(2), applied by squaring the operator of
+// one zero bit, as crc32_combine of zlib does.
+static uint32_t gf2MatrixTimes(const uint32_t* mat, uint32_t vec) {
+  uint32_t sum = 0;
+  while (vec) {
+    if (vec & 1)
+      sum ^= *mat;
+    vec >>= 1;
+    mat++;
+  }
+  return sum;
+}
+
+static void gf2MatrixSquare(uint32_t* square, const uint32_t* mat) {
+  for (int n = 0; n < 32; n++)
+    square[n] = gf2MatrixTimes(mat, mat[n]);
+}
+
+uint32_t crc32Combine(uint32_t crc1, uint32_t crc2, int64_t len2) {
+  if (len2 <= 0)
+    return crc1;
+
+  uint32_t even[32];  // even power of two zeros operator
+  uint32_t odd[32];   // odd power of two zeros operator
+
+  // the operator for one zero bit
+  odd[0] = 0xEDB88320UL;
+  uint32_t row = 1;
+  for (int n = 1; n < 32; n++) {
+    odd[n] = row;
+    row <<= 1;
+  }
+
+  gf2MatrixSquare(even, odd);  // two zero bits
+  gf2MatrixSquare(odd, even);  // four zero bits
+
+  // the first square puts the operator for one zero byte, eight zero bits, in even
+  do {
+    gf2MatrixSquare(even, odd);
+    if (len2 & 1)
+      crc1 = gf2MatrixTimes(even, crc1);
+    len2 >>= 1;
+    if (len2 == 0)
+      break;
+
+    gf2MatrixSquare(odd, even);
+    if (len2 & 1)
+      crc1 = gf2MatrixTimes(odd, crc1);
+    len2 >>= 1;
+  } while (len2 != 0);
+
+  return crc1 ^ crc2;
+}
 }  // namespace crc32_internal
 
 Result CalculateFileCRC32(const utf8string& file_path, Options* opt, utf8string& str_hash) {
@@ -73,14 +134,14 @@ Result CalculateFileCRC32(const utf8string& file_path, Options* opt, utf8string&
   crc32_internal::crc32Init(&ulCRC32);
 
   size_t dwReadBytes = 0;
-  unsigned char szData[1024] = {0};
+  std::vector<unsigned char> szData(ZOE_HASH_READ_BUFFER_SIZE);
 
-  while ((dwReadBytes = fread(szData, 1, 1024, f)) > 0) {
+  while ((dwReadBytes = fread(szData.data(), 1, szData.size(), f)) > 0) {
     if (opt && (opt->internal_stop_event.isSetted() || (opt->user_stop_event && opt->user_stop_event->isSetted()))) {
       fclose(f);
       return CANCELED;
     }
-    crc32_internal::crc32Update(&ulCRC32, szData, dwReadBytes);
+    crc32_internal::crc32Update(&ulCRC32, szData.data(), dwReadBytes);
   }
   fclose(f);
 
@@ -102,14 +163,14 @@ Result CalculateFileCRC32(FILE* f, Options* opt, utf8string& str_hash) {
   crc32_internal::crc32Init(&ulCRC32);
 
   size_t dwReadBytes = 0;
-  unsigned char szData[1024] = {0};
+  std::vector<unsigned char> szData(ZOE_HASH_READ_BUFFER_SIZE);
 
-  while ((dwReadBytes = fread(szData, 1, 1024, f)) > 0) {
+  while ((dwReadBytes = fread(szData.data(), 1, szData.size(), f)) > 0) {
     if (opt && (opt->internal_stop_event.isSetted() ||
                 (opt->user_stop_event && opt->user_stop_event->isSetted()))) {
       return CANCELED;
     }
-    crc32_internal::crc32Update(&ulCRC32, szData, dwReadBytes);
+    crc32_internal::crc32Update(&ulCRC32, szData.data(), dwReadBytes);
   }
 
   crc32_internal::crc32Finish(&ulCRC32);
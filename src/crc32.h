@@ -24,6 +24,9 @@ namespace crc32_internal {
 void crc32Init(uint32_t* pCrc32);
 void crc32Update(uint32_t* pCrc32, unsigned char* pData, uint32_t uSize);
 void crc32Finish(uint32_t* pCrc32);
+
+// The CRC32 of two blocks concatenated, from the finished CRC32 of each block and the length of the second one.
+uint32_t crc32Combine(uint32_t crc1, uint32_t crc2, int64_t len2);
 }  // namespace crc32_internal
 
 Result CalculateFileCRC32(const utf8string& file_path, Options* opt, utf8string &str_hash);
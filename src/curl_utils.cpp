@@ -17,6 +17,9 @@
 
 #include "curl_utils.h"
 #include "curl/curl.h"
+#include <mutex>
+#include <vector>
+#include "options.h"
 #ifdef WITH_OPENSSL
 #include <openssl/crypto.h>
 #endif
@@ -79,8 +82,123 @@ int THREAD_cleanup(void) {
   return 1;
 }
 #endif
+
+std::mutex pool_mutex;
+std::vector<CURL*> idle_handles;
+CURLSH* share_handle = nullptr;
+std::mutex share_data_mutex[CURL_LOCK_DATA_LAST];
+
+void ShareLockFunction(CURL* /*handle*/, curl_lock_data data, curl_lock_access /*access*/, void* /*userptr*/) {
+  share_data_mutex[data].lock();
+}
+
+void ShareUnlockFunction(CURL* /*handle*/, curl_lock_data data, void* /*userptr*/) {
+  share_data_mutex[data].unlock();
+}
+
+// must be called with pool_mutex locked.
+CURLSH* GetShareHandle() {
+  if (share_handle)
+    return share_handle;
+
+  share_handle = curl_share_init();
+  if (!share_handle)
+    return nullptr;
+
+  curl_share_setopt(share_handle, CURLSHOPT_LOCKFUNC, ShareLockFunction);
+  curl_share_setopt(share_handle, CURLSHOPT_UNLOCKFUNC, ShareUnlockFunction);
+  curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900  // 7.57.0
+  curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+  return share_handle;
+}
+
+void CleanupCurlHandles() {
+  std::lock_guard<std::mutex> lg(pool_mutex);
+  for (CURL* curl : idle_handles)
+    curl_easy_cleanup(curl);
+  idle_handles.clear();
+
+  if (share_handle) {
+    // The share handle is still used by some easy handles, keep it.
+    if (curl_share_cleanup(share_handle) == CURLSHE_OK)
+      share_handle = nullptr;
+  }
+}
 }  // namespace
 
+CURL* AcquireCurlHandle() {
+  std::lock_guard<std::mutex> lg(pool_mutex);
+  CURL* curl = nullptr;
+  if (!idle_handles.empty()) {
+    curl = idle_handles.back();
+    idle_handles.pop_back();
+  }
+  else {
+    curl = curl_easy_init();
+  }
+
+  if (curl) {
+    CURLSH* share = GetShareHandle();
+    if (share)
+      curl_easy_setopt(curl, CURLOPT_SHARE, share);
+  }
+  return curl;
+}
+
+void ReleaseCurlHandle(CURL* curl) {
+  if (!curl)
+    return;
+
+  ResetCurlHandle(curl);
+
+  std::lock_guard<std::mutex> lg(pool_mutex);
+  if (idle_handles.size() < ZOE_CURL_HANDLE_POOL_MAX_SIZE) {
+    idle_handles.push_back(curl);
+    return;
+  }
+  curl_easy_cleanup(curl);
+}
+
+long GetCurlHttpVersion(HttpVersion version) {
+  switch (version) {
+    case HTTP_VERSION_1_1:
+      return CURL_HTTP_VERSION_1_1;
+    case HTTP_VERSION_2:
+      return CURL_HTTP_VERSION_2TLS;
+    case HTTP_VERSION_2_PRIOR_KNOWLEDGE:
+      return CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE;
+    case HTTP_VERSION_3: {
+#if LIBCURL_VERSION_NUM >= 0x074200  // 7.66.0
+      const curl_version_info_data* info = curl_version_info(CURLVERSION_NOW);
+      if (info && (info->features & CURL_VERSION_HTTP3))
+        return CURL_HTTP_VERSION_3;
+#endif
+      return CURL_HTTP_VERSION_2TLS;
+    }
+    default:
+      return CURL_HTTP_VERSION_NONE;
+  }
+}
+
+bool IsMultiplexedHttpVersion(HttpVersion version) {
+  return version == HTTP_VERSION_2 || version == HTTP_VERSION_2_PRIOR_KNOWLEDGE || version == HTTP_VERSION_3;
+}
+
+void ResetCurlHandle(CURL* curl) {
+  if (!curl)
+    return;
+
+  curl_easy_reset(curl);
+
+  std::lock_guard<std::mutex> lg(pool_mutex);
+  CURLSH* share = GetShareHandle();
+  if (share)
+    curl_easy_setopt(curl, CURLOPT_SHARE, share);
+}
+
 void GlobalCurlInit() {
 #ifdef WITH_OPENSSL
   THREAD_setup();
@@ -89,6 +207,7 @@ void GlobalCurlInit() {
 }
 
 void GlobalCurlUnInit() {
+  CleanupCurlHandles();
   curl_global_cleanup();
 #ifdef WITH_OPENSSL
   THREAD_cleanup();
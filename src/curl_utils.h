@@ -20,16 +20,33 @@
 #pragma once
 
 #include "curl/curl.h"
+#include "zoe/zoe.h"
 
 namespace zoe {
 void GlobalCurlInit();
 void GlobalCurlUnInit();
 
+// Get an easy handle from the process wide pool, or create a new one if the pool is empty.
+// The handle shares DNS cache, SSL sessions and connections with all other handles got from the pool.
+CURL* AcquireCurlHandle();
+
+// Reset the handle and give it back to the pool, the handle must not be in any multi handle.
+void ReleaseCurlHandle(CURL* curl);
+
+// curl_easy_reset also clears CURLOPT_SHARE, use this function to reset the handle got from the pool.
+void ResetCurlHandle(CURL* curl);
+
+// CURL_HTTP_VERSION_XXX of version, CURL_HTTP_VERSION_NONE for HTTP_VERSION_AUTO.
+long GetCurlHttpVersion(HttpVersion version);
+
+// Whether the transfers of version are multiplexed over one connection.
+bool IsMultiplexedHttpVersion(HttpVersion version);
+
 class ScopedCurl {
  public:
-  ScopedCurl() { curl_ = curl_easy_init(); }
+  ScopedCurl() { curl_ = AcquireCurlHandle(); }
 
-  ~ScopedCurl() { curl_easy_cleanup(curl_); }
+  ~ScopedCurl() { ReleaseCurlHandle(curl_); }
 
   CURL* GetCurl() { return curl_; }
 
@@ -0,0 +1,326 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "decompressor.h"
+#include <string.h>
+#include <inttypes.h>
+#include <algorithm>
+#include <vector>
+#include <functional>
+#include "options.h"
+#include "metrics.h"
+#include "file_util.h"
+#include "string_helper.hpp"
+#include "time_meter.hpp"
+#include "verbose.h"
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace zoe {
+namespace {
+#ifdef WITH_ZLIB
+// gzip or zlib format, detected by the header. The members of gzip file are decoded one by one.
+class GzipDecoder : public StreamDecoder {
+ public:
+  GzipDecoder()
+      : buffer_(ZOE_DECOMPRESS_BUFFER_SIZE)
+      , initialized_(false)
+      , stream_end_(false) {
+    memset(&stream_, 0, sizeof(stream_));
+    initialized_ = inflateInit2(&stream_, 15 + 32) == Z_OK;
+  }
+
+  ~GzipDecoder() override {
+    if (initialized_)
+      inflateEnd(&stream_);
+  }
+
+  bool decode(const void* data, int64_t size, const StreamFunctor& output) override {
+    if (!initialized_)
+      return false;
+
+    const unsigned char* p = (const unsigned char*)data;
+    while (size > 0) {
+      const uInt once = (uInt)std::min(size, (int64_t)0x40000000);
+      stream_.next_in = (Bytef*)p;
+      stream_.avail_in = once;
+      p += once;
+      size -= once;
+
+      while (stream_.avail_in > 0) {
+        // the next member of gzip file follows.
+        if (stream_end_) {
+          if (inflateReset(&stream_) != Z_OK)
+            return false;
+          stream_end_ = false;
+        }
+
+        stream_.next_out = (Bytef*)buffer_.data();
+        stream_.avail_out = (uInt)buffer_.size();
+        const int ret = inflate(&stream_, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+          return false;
+
+        const size_t decoded = buffer_.size() - stream_.avail_out;
+        if (decoded > 0)
+          output(buffer_.data(), (int64_t)decoded);
+        if (ret == Z_STREAM_END)
+          stream_end_ = true;
+        else if (ret == Z_BUF_ERROR && decoded == 0)
+          break;  // needs more input
+      }
+    }
+    return true;
+  }
+
+  bool finish(const StreamFunctor& output) override {
+    if (!initialized_)
+      return false;
+
+    // the input has been consumed, only the output left in zlib.
+    while (!stream_end_) {
+      stream_.next_in = nullptr;
+      stream_.avail_in = 0;
+      stream_.next_out = (Bytef*)buffer_.data();
+      stream_.avail_out = (uInt)buffer_.size();
+      const int ret = inflate(&stream_, Z_FINISH);
+      const size_t decoded = buffer_.size() - stream_.avail_out;
+      if (decoded > 0)
+        output(buffer_.data(), (int64_t)decoded);
+      if (ret == Z_STREAM_END)
+        stream_end_ = true;
+      else if (decoded == 0)
+        return false;  // truncated
+    }
+    return true;
+  }
+
+ protected:
+  z_stream stream_;
+  std::vector<char> buffer_;
+  bool initialized_;
+  bool stream_end_;
+};
+#endif
+
+#ifdef WITH_ZSTD
+class ZstdDecoder : public StreamDecoder {
+ public:
+  ZstdDecoder()
+      : stream_(ZSTD_createDStream())
+      , buffer_(ZSTD_DStreamOutSize())
+      , frame_end_(true) {
+    if (stream_)
+      ZSTD_initDStream(stream_);
+  }
+
+  ~ZstdDecoder() override {
+    if (stream_)
+      ZSTD_freeDStream(stream_);
+  }
+
+  bool decode(const void* data, int64_t size, const StreamFunctor& output) override {
+    if (!stream_)
+      return false;
+
+    ZSTD_inBuffer in = {data, (size_t)size, 0};
+    while (in.pos < in.size) {
+      ZSTD_outBuffer out = {buffer_.data(), buffer_.size(), 0};
+      const size_t ret = ZSTD_decompressStream(stream_, &out, &in);
+      if (ZSTD_isError(ret))
+        return false;
+      if (out.pos > 0)
+        output(buffer_.data(), (int64_t)out.pos);
+      frame_end_ = ret == 0;
+    }
+    return true;
+  }
+
+  bool finish(const StreamFunctor& output) override {
+    if (!stream_)
+      return false;
+
+    // the decoder may hold the output that didn't fit in buffer.
+    while (!frame_end_) {
+      ZSTD_inBuffer in = {nullptr, 0, 0};
+      ZSTD_outBuffer out = {buffer_.data(), buffer_.size(), 0};
+      const size_t ret = ZSTD_decompressStream(stream_, &out, &in);
+      if (ZSTD_isError(ret))
+        return false;
+      if (out.pos > 0)
+        output(buffer_.data(), (int64_t)out.pos);
+      frame_end_ = ret == 0;
+      if (!frame_end_ && out.pos == 0)
+        return false;  // truncated
+    }
+    return true;
+  }
+
+ protected:
+  ZSTD_DStream* stream_;
+  std::vector<char> buffer_;
+  bool frame_end_;
+};
+#endif
+}  // namespace
+
+bool IsCodecSupported(CompressionCodec codec) {
+  switch (codec) {
+    case COMPRESSION_NONE:
+    case COMPRESSION_CUSTOM:
+      return true;
+#ifdef WITH_ZLIB
+    case COMPRESSION_GZIP:
+      return true;
+#endif
+#ifdef WITH_ZSTD
+    case COMPRESSION_ZSTD:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+std::shared_ptr<StreamDecoder> CreateStreamDecoder(const Options* options) {
+  switch (options->decompress_codec) {
+    case COMPRESSION_CUSTOM:
+      return options->decoder_factory ? options->decoder_factory() : nullptr;
+#ifdef WITH_ZLIB
+    case COMPRESSION_GZIP:
+      return std::make_shared<GzipDecoder>();
+#endif
+#ifdef WITH_ZSTD
+    case COMPRESSION_ZSTD:
+      return std::make_shared<ZstdDecoder>();
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+Decompressor::Decompressor(Options* options,
+                           std::shared_ptr<StreamDecoder> decoder,
+                           const utf8string& output_path,
+                           std::shared_ptr<Metrics> metrics)
+    : options_(options)
+    , decoder_(decoder)
+    , output_path_(output_path)
+    , metrics_(metrics)
+    , file_(nullptr)
+    , failed_(false)
+    , finished_(false)
+    , decompressed_(0L) {
+  if (options_->decompressed_hash_value.length() > 0)
+    hash_ = std::make_shared<IncrementalHash>(options_->decompressed_hash_type);
+  output_functor_ = std::bind(&Decompressor::onDecoded, this, std::placeholders::_1, std::placeholders::_2);
+}
+
+Decompressor::~Decompressor() {
+  if (file_) {
+    FileUtil::Close(file_);
+    file_ = nullptr;
+  }
+
+  // the output of an unfinished download is decoded again when resumed.
+  if (!finished_)
+    FileUtil::RemoveFile(output_path_);
+}
+
+bool Decompressor::open() {
+  if (!decoder_)
+    return false;
+  file_ = FileUtil::Open(output_path_, u8"wb");
+  return !!file_;
+}
+
+void Decompressor::onData(const void* data, int64_t size) {
+  if (failed_ || !file_)
+    return;
+
+  TimeMeter time_meter;
+  const int64_t decompressed = decompressed_;
+  if (!decoder_->decode(data, size, output_functor_)) {
+    OutputVerbose(options_->verbose_functor, u8"Decode failed after %" PRId64 " bytes decompressed.\n", decompressed_);
+    failed_ = true;
+  }
+  if (metrics_)
+    metrics_->addDecompress(decompressed_ - decompressed, time_meter.ElapsedMicroseconds());
+}
+
+Result Decompressor::finish() {
+  if (!file_)
+    return DECOMPRESS_FAILED;
+
+  if (!failed_) {
+    TimeMeter time_meter;
+    const int64_t decompressed = decompressed_;
+    if (!decoder_->finish(output_functor_)) {
+      OutputVerbose(options_->verbose_functor, u8"Compressed data is truncated.\n");
+      failed_ = true;
+    }
+    if (metrics_)
+      metrics_->addDecompress(decompressed_ - decompressed, time_meter.ElapsedMicroseconds());
+  }
+
+  if (fflush(file_) != 0)
+    failed_ = true;
+  FileUtil::Close(file_);
+  file_ = nullptr;
+
+  if (failed_)
+    return DECOMPRESS_FAILED;
+
+  OutputVerbose(options_->verbose_functor, u8"Decompressed size: %" PRId64 ".\n", decompressed_);
+  if (hash_) {
+    const utf8string str_hash = hash_->final();
+    if (!StringHelper::IsEqual(str_hash, options_->decompressed_hash_value, true)) {
+      OutputVerbose(options_->verbose_functor, u8"Decompressed hash not pass: %s, expected: %s.\n", str_hash.c_str(),
+                    options_->decompressed_hash_value.c_str());
+      return HASH_VERIFY_NOT_PASS;
+    }
+  }
+
+  finished_ = true;
+  return SUCCESSED;
+}
+
+utf8string Decompressor::outputPath() const {
+  return output_path_;
+}
+
+void Decompressor::onDecoded(const void* data, int64_t size) {
+  if (failed_ || size <= 0)
+    return;
+
+  if (fwrite(data, 1, (size_t)size, file_) != (size_t)size) {
+    OutputVerbose(options_->verbose_functor, u8"Write decompressed file failed.\n");
+    failed_ = true;
+    return;
+  }
+
+  decompressed_ += size;
+  if (hash_)
+    hash_->update(data, size);
+  if (options_->stream_functor)
+    options_->stream_functor(data, size);
+}
+}  // namespace zoe
@@ -0,0 +1,74 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_DECOMPRESSOR_H_
+#define ZOE_DECOMPRESSOR_H_
+#pragma once
+
+#include <memory>
+#include "zoe/zoe.h"
+#include "incremental_hash.h"
+
+namespace zoe {
+typedef struct _Options Options;
+class Metrics;
+
+// Whether the decoder of codec is built in, COMPRESSION_NONE and COMPRESSION_CUSTOM are always supported.
+bool IsCodecSupported(CompressionCodec codec);
+
+// The decoder of codec, or the one created by decoder factory of options for COMPRESSION_CUSTOM.
+// nullptr if the codec is not supported.
+std::shared_ptr<StreamDecoder> CreateStreamDecoder(const Options* options);
+
+// Decompress the target file in order while it is being downloaded, see Zoe::setDecompression.
+// It is fed by the stream cursor of target file, so the data is decoded on the delivering thread.
+// The decompressed data is written to the output file, hashed if needed and passed to the stream functor of options.
+class Decompressor {
+ public:
+  // metrics can be nullptr.
+  Decompressor(Options* options, std::shared_ptr<StreamDecoder> decoder, const utf8string& output_path, std::shared_ptr<Metrics> metrics);
+  virtual ~Decompressor();
+
+  // Create the output file, the existing one is truncated.
+  bool open();
+
+  // The next piece of compressed data, it is ignored once decoding failed.
+  void onData(const void* data, int64_t size);
+
+  // All of compressed data has been delivered, flush the decoder, close the output file and verify the hash.
+  // Return DECOMPRESS_FAILED if the data can't be decoded or written, HASH_VERIFY_NOT_PASS if the hash doesn't match.
+  Result finish();
+
+  utf8string outputPath() const;
+
+ protected:
+  void onDecoded(const void* data, int64_t size);
+
+ protected:
+  Options* options_;
+  std::shared_ptr<StreamDecoder> decoder_;
+  const utf8string output_path_;
+  std::shared_ptr<Metrics> metrics_;
+  std::shared_ptr<IncrementalHash> hash_;  // nullptr if the decompressed data is not verified
+  StreamFunctor output_functor_;
+  FILE* file_;
+  bool failed_;
+  bool finished_;
+  int64_t decompressed_;
+};
+}  // namespace zoe
+#endif  // !ZOE_DECOMPRESSOR_H_
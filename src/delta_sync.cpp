@@ -0,0 +1,426 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "delta_sync.h"
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include "options.h"
+#include "file_util.h"
+#include "hash_accel.h"
+
+namespace zoe {
+#define DELTA_MANIFEST_HEADER_SIZE 24  // magic, version, block size and file size
+
+static bool IsStopped(Options* opt) {
+  return opt && (opt->internal_stop_event.isSetted() || (opt->user_stop_event && opt->user_stop_event->isSetted()));
+}
+
+static int32_t GetThreadNum(int32_t thread_num) {
+  if (thread_num > 0)
+    return thread_num;
+  return std::max((int32_t)std::thread::hardware_concurrency(), 1);
+}
+
+static uint32_t WeakChecksum(uint32_t s1, uint32_t s2) {
+  return (s1 & 0xFFFFu) | (s2 << 16);
+}
+
+static uint32_t StrongChecksum(const unsigned char* data, size_t size) {
+  return ~hash_accel::Crc32Update(0xFFFFFFFFu, data, size);
+}
+
+static void PutUint32(std::string& data, uint32_t value) {
+  for (int i = 0; i < 4; i++)
+    data.push_back((char)((value >> (i * 8)) & 0xFF));
+}
+
+static void PutUint64(std::string& data, uint64_t value) {
+  for (int i = 0; i < 8; i++)
+    data.push_back((char)((value >> (i * 8)) & 0xFF));
+}
+
+static uint32_t GetUint32(const unsigned char* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t GetUint64(const unsigned char* p) {
+  return (uint64_t)GetUint32(p) | ((uint64_t)GetUint32(p + 4) << 32);
+}
+
+bool ParseDeltaManifest(const std::string& data, DeltaManifest& manifest) {
+  if (data.size() < DELTA_MANIFEST_HEADER_SIZE || memcmp(data.data(), ZOE_DELTA_MANIFEST_MAGIC, 8) != 0)
+    return false;
+
+  const unsigned char* p = (const unsigned char*)data.data();
+  if (GetUint32(p + 8) != ZOE_DELTA_MANIFEST_VERSION)
+    return false;
+
+  const uint32_t block_size = GetUint32(p + 12);
+  const int64_t file_size = (int64_t)GetUint64(p + 16);
+  if (block_size < ZOE_DELTA_MIN_BLOCK_SIZE_BYTE || block_size > ZOE_DELTA_MAX_BLOCK_SIZE_BYTE || file_size <= 0)
+    return false;
+
+  const int64_t block_num = (file_size + block_size - 1) / block_size;
+  if ((int64_t)(data.size() - DELTA_MANIFEST_HEADER_SIZE) != block_num * 8)
+    return false;
+
+  manifest.file_size = file_size;
+  manifest.block_size = (int32_t)block_size;
+  manifest.weak.resize((size_t)block_num);
+  manifest.strong.resize((size_t)block_num);
+  p += DELTA_MANIFEST_HEADER_SIZE;
+  for (size_t i = 0; i < (size_t)block_num; i++, p += 8) {
+    manifest.weak[i] = GetUint32(p);
+    manifest.strong[i] = GetUint32(p + 4);
+  }
+  return true;
+}
+
+void SerializeDeltaManifest(const DeltaManifest& manifest, std::string& data) {
+  data.clear();
+  data.reserve(DELTA_MANIFEST_HEADER_SIZE + manifest.weak.size() * 8);
+  data.append(ZOE_DELTA_MANIFEST_MAGIC, 8);
+  PutUint32(data, ZOE_DELTA_MANIFEST_VERSION);
+  PutUint32(data, (uint32_t)manifest.block_size);
+  PutUint64(data, (uint64_t)manifest.file_size);
+  for (size_t i = 0; i < manifest.weak.size(); i++) {
+    PutUint32(data, manifest.weak[i]);
+    PutUint32(data, manifest.strong[i]);
+  }
+}
+
+// Checksum the blocks [first, last) of file.
+static bool ChecksumBlocks(const utf8string& file_path, int64_t first, int64_t last, DeltaManifest& manifest) {
+  FILE* f = FileUtil::Open(file_path, "rb");
+  if (!f)
+    return false;
+
+  const int64_t block_size = manifest.block_size;
+  if (FileUtil::Seek(f, first * block_size, SEEK_SET) != 0) {
+    FileUtil::Close(f);
+    return false;
+  }
+
+  std::vector<unsigned char> buffer((size_t)block_size);
+  bool ret = true;
+  for (int64_t i = first; i < last; i++) {
+    const size_t to_read = (size_t)std::min(block_size, manifest.file_size - i * block_size);
+    if (fread(buffer.data(), 1, to_read, f) != to_read) {
+      ret = false;
+      break;
+    }
+    memset(buffer.data() + to_read, 0, buffer.size() - to_read);
+
+    uint32_t s1 = 0;
+    uint32_t s2 = 0;
+    hash_accel::RollsumUpdate(&s1, &s2, buffer.data(), buffer.size());
+    manifest.weak[(size_t)i] = WeakChecksum(s1, s2);
+    manifest.strong[(size_t)i] = StrongChecksum(buffer.data(), buffer.size());
+  }
+  FileUtil::Close(f);
+  return ret;
+}
+
+Result MakeDeltaManifest(const utf8string& file_path, int32_t block_size, int32_t thread_num, DeltaManifest& manifest) {
+  if (block_size < ZOE_DELTA_MIN_BLOCK_SIZE_BYTE || block_size > ZOE_DELTA_MAX_BLOCK_SIZE_BYTE)
+    return INVALID_DELTA_MANIFEST;
+
+  const int64_t file_size = FileUtil::GetFileSize(file_path);
+  if (file_size < 0L)
+    return CALCULATE_HASH_FAILED;
+
+  const int64_t block_num = (file_size + block_size - 1) / block_size;
+  if (file_size == 0L || DELTA_MANIFEST_HEADER_SIZE + block_num * 8 > ZOE_DELTA_MAX_MANIFEST_SIZE_BYTE)
+    return INVALID_DELTA_MANIFEST;
+
+  manifest.file_size = file_size;
+  manifest.block_size = block_size;
+  manifest.weak.assign((size_t)block_num, 0);
+  manifest.strong.assign((size_t)block_num, 0);
+
+  const int64_t max_range_num = std::max((int64_t)1, file_size / ZOE_DELTA_SCAN_BUFFER_SIZE);
+  const int32_t range_num = (int32_t)std::min((int64_t)GetThreadNum(thread_num), max_range_num);
+  const int64_t range_blocks = block_num / range_num;
+
+  std::atomic_bool failed(false);
+  std::vector<std::thread> threads;
+  for (int32_t i = 0; i < range_num; i++) {
+    const int64_t first = range_blocks * i;
+    const int64_t last = (i == range_num - 1) ? block_num : first + range_blocks;
+    threads.emplace_back([&, first, last]() {
+      if (!ChecksumBlocks(file_path, first, last, manifest))
+        failed = true;
+    });
+  }
+
+  for (auto& t : threads)
+    t.join();
+
+  return failed ? CALCULATE_HASH_FAILED : SUCCESSED;
+}
+
+// The blocks of manifest indexed by weak checksum. The positions of old file mostly match no block,
+// a bit filter in front of the hash chains rejects them with one memory access.
+class DeltaBlockIndex {
+ public:
+  explicit DeltaBlockIndex(const DeltaManifest& manifest) : bucket_bits_(1) {
+    const int64_t block_num = (int64_t)manifest.weak.size();
+    while (((int64_t)1 << bucket_bits_) < block_num * 2 && bucket_bits_ < 26)
+      bucket_bits_++;
+    filter_bits_ = bucket_bits_ + 3;
+
+    heads_.assign((size_t)1 << bucket_bits_, -1);
+    next_.assign((size_t)block_num, -1);
+    filter_.assign(((size_t)1 << filter_bits_) / 64 + 1, 0);
+
+    // Insert in reverse order, so that the chains list the blocks in order.
+    for (int64_t b = block_num - 1; b >= 0; b--) {
+      const uint32_t h = mix(manifest.weak[(size_t)b]);
+      const uint32_t bucket = h >> (32 - bucket_bits_);
+      const uint32_t bit = h >> (32 - filter_bits_);
+      next_[(size_t)b] = heads_[bucket];
+      heads_[bucket] = (int32_t)b;
+      filter_[bit >> 6] |= (uint64_t)1 << (bit & 63);
+    }
+  }
+
+  bool mayContain(uint32_t weak) const {
+    const uint32_t bit = mix(weak) >> (32 - filter_bits_);
+    return ((filter_[bit >> 6] >> (bit & 63)) & 1) != 0;
+  }
+
+  // The first block of the chain that the blocks of weak are in, -1 if none. The chain may contain other blocks.
+  int32_t first(uint32_t weak) const { return heads_[mix(weak) >> (32 - bucket_bits_)]; }
+
+  int32_t next(int32_t block) const { return next_[(size_t)block]; }
+
+ protected:
+  static uint32_t mix(uint32_t weak) { return weak * 0x9E3779B1u; }
+
+  int32_t bucket_bits_;
+  int32_t filter_bits_;
+  std::vector<int32_t> heads_;
+  std::vector<int32_t> next_;
+  std::vector<uint64_t> filter_;
+};
+
+// Search the blocks at the positions [begin, end) of old file. The window is rolled byte by byte and is moved a whole
+// block after a match, so the unchanged data is checksummed about once.
+static bool ScanRange(const utf8string& file_path,
+                      int64_t old_size,
+                      int64_t begin,
+                      int64_t end,
+                      const DeltaManifest& manifest,
+                      const DeltaBlockIndex& index,
+                      Options* opt,
+                      std::vector<std::atomic<int64_t>>& offsets,
+                      std::atomic<int64_t>& found_num,
+                      std::atomic_bool& failed) {
+  FILE* f = FileUtil::Open(file_path, "rb");
+  if (!f)
+    return false;
+
+  if (FileUtil::Seek(f, begin, SEEK_SET) != 0) {
+    FileUtil::Close(f);
+    return false;
+  }
+
+  const size_t block_size = (size_t)manifest.block_size;
+  const int64_t block_num = (int64_t)manifest.weak.size();
+
+  // The data after end is only read for the windows beginning before end.
+  const int64_t limit = std::min(old_size, end + (int64_t)block_size - 1);
+  std::vector<unsigned char> buffer(std::max((size_t)ZOE_DELTA_SCAN_BUFFER_SIZE, block_size * 2) + block_size);
+  const size_t capacity = buffer.size() - block_size;  // the rest holds the zeros padded after limit
+  int64_t buffer_pos = begin;  // offset of buffer[0] in file
+  size_t buffer_len = 0;
+  bool limit_reached = false;
+
+  // Make the window [pos, pos + block_size) available in buffer, the data beyond old file is zero.
+  auto fill = [&](int64_t pos) -> bool {
+    const size_t offset = (size_t)(pos - buffer_pos);
+    if (offset + block_size <= buffer_len)
+      return true;
+    if (limit_reached || failed || IsStopped(opt))
+      return false;
+
+    memmove(buffer.data(), buffer.data() + offset, buffer_len - offset);
+    buffer_len -= offset;
+    buffer_pos = pos;
+    while (buffer_len < capacity) {
+      const size_t to_read = (size_t)std::min((int64_t)(capacity - buffer_len), limit - (buffer_pos + (int64_t)buffer_len));
+      if (to_read == 0) {
+        memset(buffer.data() + buffer_len, 0, block_size);
+        buffer_len += block_size;
+        limit_reached = true;
+        break;
+      }
+      const size_t once = fread(buffer.data() + buffer_len, 1, to_read, f);
+      if (once == 0)
+        return false;
+      buffer_len += once;
+    }
+    return block_size <= buffer_len;
+  };
+
+  bool ret = true;
+  bool fresh = true;  // the checksum of window is calculated from scratch rather than rolled
+  uint32_t s1 = 0;
+  uint32_t s2 = 0;
+  int64_t pos = begin;
+  while (pos < end) {
+    if (!fill(pos)) {
+      ret = false;
+      break;
+    }
+
+    const unsigned char* window = buffer.data() + (size_t)(pos - buffer_pos);
+    if (fresh) {
+      s1 = 0;
+      s2 = 0;
+      hash_accel::RollsumUpdate(&s1, &s2, window, block_size);
+      fresh = false;
+    }
+
+    // Roll over the positions that match no block as long as the next window is in buffer, most of the changed
+    // data is passed here.
+    const int64_t rolls = std::min((int64_t)(buffer_len - (size_t)(pos - buffer_pos) - block_size), end - 1 - pos);
+    const unsigned char* const last = window + rolls;
+    while (window < last && !index.mayContain(WeakChecksum(s1, s2))) {
+      s1 = s1 - window[0] + window[block_size];
+      s2 = s2 - (uint32_t)block_size * window[0] + s1;
+      window++;
+    }
+    pos = buffer_pos + (int64_t)(window - buffer.data());
+
+    const uint32_t weak = WeakChecksum(s1, s2);
+    if (index.mayContain(weak)) {
+      bool found = false;
+      bool strong_calculated = false;
+      uint32_t strong = 0;
+      for (int32_t b = index.first(weak); b >= 0; b = index.next(b)) {
+        if (manifest.weak[(size_t)b] != weak)
+          continue;
+        if (!strong_calculated) {
+          strong = StrongChecksum(window, block_size);
+          strong_calculated = true;
+        }
+        if (manifest.strong[(size_t)b] != strong)
+          continue;
+
+        // The same block may be found by several threads, the first one is kept.
+        found = true;
+        int64_t expected = -1L;
+        if (offsets[(size_t)b].compare_exchange_strong(expected, pos))
+          found_num++;
+      }
+
+      if (found) {
+        if (found_num.load() == block_num)
+          break;
+        pos += (int64_t)block_size;
+        fresh = true;
+        continue;
+      }
+    }
+
+    if (pos + 1 >= end)
+      break;
+
+    // fill may move the data in buffer, window is invalid after it.
+    const uint32_t out = window[0];
+    if (!fill(pos + 1)) {
+      ret = false;
+      break;
+    }
+    const uint32_t in = buffer[(size_t)(pos + 1 - buffer_pos) + block_size - 1];
+    s1 = s1 - out + in;
+    s2 = s2 - (uint32_t)block_size * out + s1;
+    pos++;
+  }
+
+  FileUtil::Close(f);
+  return ret;
+}
+
+Result MatchDeltaBlocks(const utf8string& old_file_path,
+                        const DeltaManifest& manifest,
+                        int32_t thread_num,
+                        Options* opt,
+                        std::vector<DeltaRun>& runs) {
+  runs.clear();
+  const int64_t old_size = FileUtil::GetFileSize(old_file_path);
+  if (old_size < 0L)
+    return CALCULATE_HASH_FAILED;
+  if (old_size == 0L || manifest.weak.empty())
+    return SUCCESSED;
+
+  const DeltaBlockIndex index(manifest);
+  std::vector<std::atomic<int64_t>> offsets(manifest.weak.size());
+  for (auto& offset : offsets)
+    offset.store(-1L);
+  std::atomic<int64_t> found_num(0L);
+  std::atomic_bool failed(false);
+
+  // Ranges smaller than the buffer are not worth a thread.
+  const int64_t max_range_num = std::max((int64_t)1, old_size / ZOE_DELTA_SCAN_BUFFER_SIZE);
+  const int32_t range_num = (int32_t)std::min((int64_t)GetThreadNum(thread_num), max_range_num);
+  const int64_t range_size = old_size / range_num;
+
+  std::vector<std::thread> threads;
+  for (int32_t i = 0; i < range_num; i++) {
+    const int64_t begin = range_size * i;
+    const int64_t end = (i == range_num - 1) ? old_size : begin + range_size;
+    threads.emplace_back([&, begin, end]() {
+      if (!ScanRange(old_file_path, old_size, begin, end, manifest, index, opt, offsets, found_num, failed))
+        failed = true;
+    });
+  }
+
+  for (auto& t : threads)
+    t.join();
+
+  if (IsStopped(opt))
+    return CANCELED;
+  if (failed)
+    return CALCULATE_HASH_FAILED;
+
+  const int64_t block_size = manifest.block_size;
+  for (size_t b = 0; b < offsets.size(); b++) {
+    const int64_t offset = offsets[b].load();
+    if (offset < 0L)
+      continue;
+
+    const int64_t begin = (int64_t)b * block_size;
+    const int64_t size = std::min(block_size, manifest.file_size - begin);
+    if (!runs.empty() && runs.back().begin + runs.back().size == begin && runs.back().old_begin + runs.back().size == offset) {
+      runs.back().size += size;
+      continue;
+    }
+
+    DeltaRun run;
+    run.begin = begin;
+    run.old_begin = offset;
+    run.size = size;
+    runs.push_back(run);
+  }
+  return SUCCESSED;
+}
+}  // namespace zoe
@@ -0,0 +1,66 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_DELTA_SYNC_H_
+#define ZOE_DELTA_SYNC_H_
+#pragma once
+
+#include <string>
+#include <vector>
+#include "zoe/zoe.h"
+
+namespace zoe {
+typedef struct _Options Options;
+
+// Block checksums of a file for delta update, see Zoe::MakeDeltaManifest.
+// The file is split into blocks of block_size, the last one is padded with zeros.
+// Each block has a rolling checksum(weak) that can be moved along the old file byte by byte, and a CRC32(strong)
+// that is only calculated for the positions whose weak checksum matches.
+typedef struct _DeltaManifest {
+  int64_t file_size;
+  int32_t block_size;
+  std::vector<uint32_t> weak;
+  std::vector<uint32_t> strong;
+
+  _DeltaManifest() : file_size(0L), block_size(0) {}
+} DeltaManifest;
+
+// A range of new file found in old file.
+typedef struct _DeltaRun {
+  int64_t begin;
+  int64_t old_begin;  // the data beyond the end of old file is zero
+  int64_t size;
+} DeltaRun;
+
+// The manifest is stored little-endian: magic(8 bytes), version(u32), block size(u32), file size(i64),
+// then the weak(u32) and strong(u32) checksums of each block.
+bool ParseDeltaManifest(const std::string& data, DeltaManifest& manifest);
+void SerializeDeltaManifest(const DeltaManifest& manifest, std::string& data);
+
+// Calculate the checksums of file, the blocks are split among thread_num threads, 0 or negative means the number of CPU cores.
+Result MakeDeltaManifest(const utf8string& file_path, int32_t block_size, int32_t thread_num, DeltaManifest& manifest);
+
+// Search the blocks of manifest at every byte of old file, the file is split into thread_num ranges scanned at the same time.
+// The blocks found are returned in runs ordered by begin, the adjacent blocks that are also adjacent in old file are
+// merged into one run. Return CANCELED if the download is stopped.
+Result MatchDeltaBlocks(const utf8string& old_file_path,
+                        const DeltaManifest& manifest,
+                        int32_t thread_num,
+                        Options* opt,
+                        std::vector<DeltaRun>& runs);
+}  // namespace zoe
+#endif  // !ZOE_DELTA_SYNC_H_
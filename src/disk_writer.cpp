@@ -0,0 +1,276 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "disk_writer.h"
+#include <assert.h>
+#include <algorithm>
+#include <chrono>
+#include "options.h"
+#include "trace.h"
+
+namespace zoe {
+DiskWriter::DiskWriter(int32_t thread_num, int64_t max_queued_bytes, int32_t batch_delay_ms, int64_t batch_bytes)
+    : max_queued_bytes_(max_queued_bytes)
+    , batch_delay_ms_(batch_delay_ms)
+    , batch_bytes_(batch_bytes) {
+  waiter_num_.store(0);
+  queued_bytes_.store(0L);
+  blocked_.store(false);
+  stopping_.store(false);
+
+  if (thread_num <= 0)
+    thread_num = 1;
+  for (int32_t i = 0; i < thread_num; i++) {
+    std::shared_ptr<Channel> channel = std::make_shared<Channel>();
+    channel->thread = std::thread(std::bind(&DiskWriter::writerProcess, this, channel.get()));
+    channels_.push_back(channel);
+  }
+}
+
+DiskWriter::~DiskWriter() {
+  stopping_.store(true);
+  for (auto& channel : channels_) {
+    {
+      std::lock_guard<std::mutex> lg(channel->mutex);
+    }
+    channel->cond_var.notify_all();
+    if (channel->thread.joinable())
+      channel->thread.join();
+  }
+  channels_.clear();
+}
+
+bool DiskWriter::post(int32_t channel,
+                      std::shared_ptr<TargetFile> target_file,
+                      int64_t pos,
+                      char* buffer,
+                      int64_t size,
+                      DoneFunctor done) {
+  assert(buffer && size > 0);
+  // Always accept the job when queue is empty, even if it is larger than the limit.
+  const int64_t queued = queued_bytes_.load();
+  if (queued > 0 && queued + size > max_queued_bytes_) {
+    blocked_.store(true);
+    return false;
+  }
+
+  queued_bytes_ += size;
+
+  Job job;
+  job.target_file = target_file;
+  job.pos = pos;
+  job.buffer = buffer;
+  job.size = size;
+  job.done = done;
+
+  Channel* c = channels_[(size_t)channel % channels_.size()].get();
+  {
+    std::lock_guard<std::mutex> lg(c->mutex);
+    c->jobs.push_back(job);
+  }
+  c->cond_var.notify_one();
+  return true;
+}
+
+void DiskWriter::postTask(int32_t channel, std::function<void()> task) {
+  assert(task);
+  Job job;
+  job.pos = 0L;
+  job.buffer = nullptr;
+  job.size = 0L;
+  job.task = task;
+
+  Channel* c = channels_[(size_t)channel % channels_.size()].get();
+  {
+    std::lock_guard<std::mutex> lg(c->mutex);
+    c->jobs.push_back(job);
+  }
+  c->cond_var.notify_one();
+}
+
+void DiskWriter::waitFor(std::function<bool()> pred) {
+  if (batch_delay_ms_ <= 0) {
+    std::unique_lock<std::mutex> ul(done_mutex_);
+    done_cond_var_.wait(ul, pred);
+    return;
+  }
+
+  waiter_num_++;
+  for (auto& channel : channels_) {
+    {
+      std::lock_guard<std::mutex> lg(channel->mutex);
+    }
+    channel->cond_var.notify_all();
+  }
+
+  {
+    std::unique_lock<std::mutex> ul(done_mutex_);
+    done_cond_var_.wait(ul, pred);
+  }
+  waiter_num_--;
+}
+
+bool DiskWriter::hasSpace() const {
+  return queued_bytes_.load() <= max_queued_bytes_ / 2;
+}
+
+int64_t DiskWriter::queuedBytes() const {
+  return queued_bytes_.load();
+}
+
+void DiskWriter::setSpaceAvailableFunctor(std::function<void()> fn) {
+  std::lock_guard<std::mutex> lg(done_mutex_);
+  space_available_functor_ = fn;
+}
+
+void DiskWriter::writerProcess(Channel* channel) {
+  int64_t head = 0L;
+  while (true) {
+    std::vector<Job> batch;
+    {
+      std::unique_lock<std::mutex> ul(channel->mutex);
+      channel->cond_var.wait(ul, [this, channel] { return stopping_.load() || !channel->jobs.empty(); });
+      if (channel->jobs.empty())
+        break;  // stopping, queue has been drained
+
+      if (batch_delay_ms_ > 0 && !channel->jobs.front().task) {
+        channel->cond_var.wait_for(ul, std::chrono::milliseconds(batch_delay_ms_), [this] {
+          return stopping_.load() || blocked_.load() || waiter_num_.load() > 0 || queued_bytes_.load() >= batch_bytes_;
+        });
+      }
+
+      // A task runs after the jobs before it, so the batch ends at the first task.
+      do {
+        batch.push_back(channel->jobs.front());
+        channel->jobs.pop_front();
+      } while (batch_delay_ms_ > 0 && !batch.back().task && !channel->jobs.empty() && !channel->jobs.front().task);
+    }
+
+    if (batch.front().task) {
+      batch.front().task();
+      {
+        std::lock_guard<std::mutex> lg(done_mutex_);
+      }
+      done_cond_var_.notify_all();
+      continue;
+    }
+
+    std::vector<int64_t> written;
+    head = writeBatch(batch, head, written);
+
+    std::function<void()> space_available;
+    {
+      std::lock_guard<std::mutex> lg(done_mutex_);
+      // done may resume the paused transfers, the queue must have shrunk before it.
+      // The jobs are done in the order they were posted, so the data of a slice on disk is always continuous.
+      for (size_t i = 0; i < batch.size(); i++) {
+        queued_bytes_ -= batch[i].size;
+        if (batch[i].done)
+          batch[i].done(written[i]);
+      }
+
+      if (blocked_.load() && hasSpace()) {
+        blocked_.store(false);
+        space_available = space_available_functor_;
+      }
+    }
+    done_cond_var_.notify_all();
+
+    if (space_available)
+      space_available();
+  }
+}
+
+std::shared_ptr<DiskWriter> CreateDiskWriter(StorageClass storage_class, int64_t max_queued_bytes) {
+  int32_t batch_delay_ms = 0;
+  int64_t batch_bytes = 0L;
+  if (storage_class == STORAGE_HDD) {
+    batch_delay_ms = ZOE_HDD_WRITE_BATCH_DELAY_MS;
+    batch_bytes = max_queued_bytes * ZOE_HDD_WRITE_BATCH_PERCENT / 100;
+  }
+  else if (storage_class == STORAGE_NETWORK) {
+    batch_delay_ms = ZOE_NETWORK_WRITE_BATCH_DELAY_MS;
+    batch_bytes = max_queued_bytes * ZOE_NETWORK_WRITE_BATCH_PERCENT / 100;
+  }
+  return std::make_shared<DiskWriter>(ZOE_DEFAULT_DISK_WRITER_THREAD_NUM, max_queued_bytes, batch_delay_ms, batch_bytes);
+}
+
+int64_t DiskWriter::writeBatch(const std::vector<Job>& batch, int64_t head, std::vector<int64_t>& written) {
+  written.assign(batch.size(), 0L);
+
+  // The jobs at or after head go first in ascending offset, then the ones before head from the lowest.
+  std::vector<size_t> order(batch.size());
+  for (size_t i = 0; i < order.size(); i++)
+    order[i] = i;
+  if (order.size() > 1) {
+    std::sort(order.begin(), order.end(), [&batch, head](size_t a, size_t b) {
+      const Job& ja = batch[a];
+      const Job& jb = batch[b];
+      if (ja.target_file != jb.target_file)
+        return ja.target_file < jb.target_file;
+      const bool a_ahead = ja.pos >= head;
+      const bool b_ahead = jb.pos >= head;
+      if (a_ahead != b_ahead)
+        return a_ahead;
+      return ja.pos < jb.pos;
+    });
+  }
+
+  std::vector<WriteBuffer> buffers;
+  size_t i = 0;
+  while (i < order.size()) {
+    const Job& first = batch[order[i]];
+    size_t n = 1;
+    int64_t size = first.size;
+    while (i + n < order.size() && n < ZOE_DISK_WRITER_MAX_MERGE_NUM) {
+      const Job& next = batch[order[i + n]];
+      if (next.target_file != first.target_file || next.pos != first.pos + size)
+        break;
+      size += next.size;
+      n++;
+    }
+
+    int64_t run_written = 0L;
+    if (first.target_file) {
+      TraceScope trace(TRACE_DISK_WRITE, this, -1, size);
+      if (n == 1) {
+        run_written = first.target_file->write(first.pos, first.buffer, first.size);
+      }
+      else {
+        buffers.clear();
+        for (size_t k = 0; k < n; k++) {
+          const Job& job = batch[order[i + k]];
+          WriteBuffer buffer = {job.buffer, job.size};
+          buffers.push_back(buffer);
+        }
+        run_written = first.target_file->writev(first.pos, buffers.data(), (int32_t)n);
+      }
+    }
+
+    // A short write is counted from the first buffer of the run.
+    for (size_t k = 0; k < n; k++) {
+      const size_t index = order[i + k];
+      written[index] = std::max(std::min(run_written, batch[index].size), (int64_t)0L);
+      run_written -= written[index];
+    }
+
+    head = first.pos + size;
+    i += n;
+  }
+  return head;
+}
+}  // namespace zoe
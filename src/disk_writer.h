@@ -0,0 +1,115 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_DISK_WRITER_H_
+#define ZOE_DISK_WRITER_H_
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+#include "target_file.h"
+
+namespace zoe {
+
+// Write the filled cache buffers to target file on background threads,
+// so that libcurl write callbacks never block on disk.
+// The done functors of the same channel are called in order.
+// If batch_delay_ms is greater than 0, the jobs are collected until the queue holds batch_bytes or the delay passed,
+// then written in the order of file offset from the end of last write, and the adjacent ones are merged into one write.
+// Otherwise the jobs are written one by one in order.
+class DiskWriter {
+ public:
+  typedef std::function<void(int64_t written)> DoneFunctor;
+
+  DiskWriter(int32_t thread_num, int64_t max_queued_bytes, int32_t batch_delay_ms = 0, int64_t batch_bytes = 0L);
+  virtual ~DiskWriter();
+
+  // The buffer must be kept alive until done called, done is the place to release it.
+  // Return false if the queue is full, the caller should pause the transfer and try again later.
+  // done is called on writer thread after the buffer written.
+  bool post(int32_t channel,
+            std::shared_ptr<TargetFile> target_file,
+            int64_t pos,
+            char* buffer,
+            int64_t size,
+            DoneFunctor done);
+
+  // Run the task on writer thread after the jobs posted to the same channel before it.
+  // The queue limit doesn't apply to tasks.
+  void postTask(int32_t channel, std::function<void()> task);
+
+  // Block until pred returns true, pred is checked after each job done.
+  // The jobs being collected are written at once.
+  void waitFor(std::function<bool()> pred);
+
+  // Whether the paused transfers can be resumed.
+  bool hasSpace() const;
+
+  // Bytes posted and not written yet.
+  int64_t queuedBytes() const;
+
+  // Called on writer thread when the queue has space again after post failed.
+  void setSpaceAvailableFunctor(std::function<void()> fn);
+
+ protected:
+  typedef struct _Job {
+    std::shared_ptr<TargetFile> target_file;
+    int64_t pos;
+    char* buffer;
+    int64_t size;
+    DoneFunctor done;
+    std::function<void()> task;  // set if the job is not a write
+  } Job;
+
+  typedef struct _Channel {
+    std::mutex mutex;
+    std::condition_variable cond_var;
+    std::deque<Job> jobs;
+    std::thread thread;
+  } Channel;
+
+  void writerProcess(Channel* channel);
+
+  // Write the jobs in elevator order from head, the size written of each job is put into written.
+  // Return the end of the last write.
+  int64_t writeBatch(const std::vector<Job>& batch, int64_t head, std::vector<int64_t>& written);
+
+ protected:
+  const int64_t max_queued_bytes_;
+  const int32_t batch_delay_ms_;
+  const int64_t batch_bytes_;
+  std::atomic<int32_t> waiter_num_;  // threads in waitFor, the batch is not delayed
+  std::atomic<int64_t> queued_bytes_;
+  std::atomic_bool blocked_;
+  std::atomic_bool stopping_;
+  std::vector<std::shared_ptr<Channel>> channels_;
+
+  std::mutex done_mutex_;
+  std::condition_variable done_cond_var_;
+  std::function<void()> space_available_functor_;
+};
+
+// The writes are batched in the order of file offset for the storage that seeks slowly, see StorageClass.
+std::shared_ptr<DiskWriter> CreateDiskWriter(StorageClass storage_class, int64_t max_queued_bytes);
+}  // namespace zoe
+#endif  // !ZOE_DISK_WRITER_H_
@@ -0,0 +1,266 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "download_cache.h"
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include "json.hpp"
+#include "md5.h"
+#include "file_util.h"
+#include "string_helper.hpp"
+#include "filesystem.hpp"
+
+using json = nlohmann::json;
+
+namespace zoe {
+
+namespace {
+#define DOWNLOAD_CACHE_DATA_EXTENSION ".data"
+#define DOWNLOAD_CACHE_META_EXTENSION ".meta"
+#define DOWNLOAD_CACHE_TMP_EXTENSION ".tmp"
+
+// Serializes the changes of entries in this process, other processes only see renamed files.
+std::mutex cache_mutex;
+
+std::atomic<int64_t> hit_num(0L);
+std::atomic<int64_t> miss_num(0L);
+std::atomic<int64_t> hit_bytes(0L);
+std::atomic<int64_t> store_num(0L);
+std::atomic<int64_t> evicted_num(0L);
+
+const char* HashTypeName(HashType type) {
+  switch (type) {
+    case CRC32:
+      return "crc32";
+    case SHA1:
+      return "sha1";
+    case SHA256:
+      return "sha256";
+    default:
+      return "md5";
+  }
+}
+
+utf8string EntryPath(const utf8string& dir, const utf8string& key, const char* extension) {
+  return FileUtil::AppendFileName(dir, key + extension);
+}
+
+bool ReadMeta(const utf8string& path, DownloadCacheEntry& entry) {
+  FILE* f = FileUtil::Open(path, "rb");
+  if (!f)
+    return false;
+  std::string data;
+  char buf[1024];
+  size_t n = 0;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    data.append(buf, n);
+  FileUtil::Close(f);
+
+  try {
+    json j = json::parse(data);
+    entry.url = j["url"].get<utf8string>();
+    entry.etag = j["etag"].get<utf8string>();
+    entry.last_modified = j["last_modified"].get<utf8string>();
+    entry.size = j["size"].get<int64_t>();
+  } catch (const std::exception&) {
+    return false;
+  }
+  return true;
+}
+
+bool WriteMeta(const utf8string& path, const DownloadCacheEntry& entry) {
+  json j;
+  j["url"] = entry.url;
+  j["etag"] = entry.etag;
+  j["last_modified"] = entry.last_modified;
+  j["size"] = entry.size;
+  const std::string data = j.dump();
+
+  FILE* f = FileUtil::Open(path, "wb");
+  if (!f)
+    return false;
+  const bool written = fwrite(data.data(), 1, data.size(), f) == data.size();
+  FileUtil::Close(f);
+  return written;
+}
+
+// Remove the least recently used entries until the cache fits in max_size, the entry of keep_key is never removed.
+// Must be called with cache_mutex locked.
+void EvictEntries(const utf8string& dir, int64_t max_size, const utf8string& keep_key) {
+  const ghc::filesystem::path keep_path = ghc::filesystem::u8path(EntryPath(dir, keep_key, DOWNLOAD_CACHE_DATA_EXTENSION));
+  typedef struct _DataFile {
+    ghc::filesystem::path path;
+    ghc::filesystem::file_time_type last_used;
+    int64_t size;
+  } DataFile;
+
+  std::vector<DataFile> files;
+  int64_t total = 0L;
+  std::error_code ec;
+  for (ghc::filesystem::directory_iterator it(ghc::filesystem::u8path(dir), ec), end; !ec && it != end; it.increment(ec)) {
+    if (it->path().extension() != DOWNLOAD_CACHE_DATA_EXTENSION)
+      continue;
+    std::error_code file_ec;
+    DataFile file;
+    file.path = it->path();
+    file.size = (int64_t)ghc::filesystem::file_size(file.path, file_ec);
+    file.last_used = ghc::filesystem::last_write_time(file.path, file_ec);
+    if (file_ec)
+      continue;
+    total += file.size;
+    files.push_back(file);
+  }
+
+  if (total <= max_size)
+    return;
+
+  std::sort(files.begin(), files.end(), [](const DataFile& a, const DataFile& b) { return a.last_used < b.last_used; });
+  for (const DataFile& file : files) {
+    if (total <= max_size)
+      break;
+    // The time may only have a resolution of seconds, so the order alone can not protect the new entry.
+    if (file.path == keep_path)
+      continue;
+    ghc::filesystem::path meta = file.path;
+    meta.replace_extension(DOWNLOAD_CACHE_META_EXTENSION);
+    std::error_code remove_ec;
+    ghc::filesystem::remove(meta, remove_ec);
+    if (ghc::filesystem::remove(file.path, remove_ec)) {
+      total -= file.size;
+      evicted_num++;
+    }
+  }
+}
+}  // namespace
+
+utf8string DownloadCacheHashKey(HashType type, const utf8string& hash_value) {
+  utf8string key = HashTypeName(type);
+  key += "-";
+  // Only the hex digits, the value is given by user.
+  for (char c : StringHelper::ToLower(hash_value)) {
+    if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))
+      key += c;
+  }
+  return key;
+}
+
+utf8string DownloadCacheUrlKey(const utf8string& url) {
+  unsigned char sig[16] = {0};
+  char str[33] = {0};
+  libmd5_internal::MD5Buffer((const unsigned char*)url.c_str(), (unsigned int)url.length(), sig);
+  libmd5_internal::MD5SigToString(sig, str, sizeof(str));
+  return utf8string("url-") + str;
+}
+
+bool LookupDownloadCache(const utf8string& dir, const utf8string& key, DownloadCacheEntry& entry) {
+  if (dir.empty() || key.empty())
+    return false;
+  std::lock_guard<std::mutex> lg(cache_mutex);
+  if (!ReadMeta(EntryPath(dir, key, DOWNLOAD_CACHE_META_EXTENSION), entry))
+    return false;
+  return FileUtil::GetFileSize(EntryPath(dir, key, DOWNLOAD_CACHE_DATA_EXTENSION)) == entry.size;
+}
+
+bool RestoreDownloadCache(const utf8string& dir, const utf8string& key, const utf8string& path, bool allow_hardlink) {
+  std::lock_guard<std::mutex> lg(cache_mutex);
+  const utf8string data_path = EntryPath(dir, key, DOWNLOAD_CACHE_DATA_EXTENSION);
+  const int64_t size = FileUtil::GetFileSize(data_path);
+  if (size < 0)
+    return false;
+
+  const utf8string tmp_path = path + DOWNLOAD_CACHE_TMP_EXTENSION;
+  if (!FileUtil::CloneFile(data_path, tmp_path, allow_hardlink) || !FileUtil::Rename(tmp_path, path)) {
+    FileUtil::RemoveFile(tmp_path);
+    return false;
+  }
+
+  // The modification time of data file is the last used time.
+  std::error_code ec;
+  ghc::filesystem::last_write_time(ghc::filesystem::u8path(data_path), ghc::filesystem::file_time_type::clock::now(), ec);
+
+  hit_num++;
+  hit_bytes += size;
+  return true;
+}
+
+bool StoreDownloadCache(const utf8string& dir,
+                        const utf8string& key,
+                        const DownloadCacheEntry& entry,
+                        const utf8string& path,
+                        int64_t max_size,
+                        bool allow_hardlink) {
+  if (dir.empty() || key.empty() || entry.size < 0 || entry.size > max_size)
+    return false;
+
+  std::lock_guard<std::mutex> lg(cache_mutex);
+  if (!FileUtil::CreateDirectories(dir) && !FileUtil::IsExist(dir))
+    return false;
+
+  const utf8string data_path = EntryPath(dir, key, DOWNLOAD_CACHE_DATA_EXTENSION);
+  const utf8string meta_path = EntryPath(dir, key, DOWNLOAD_CACHE_META_EXTENSION);
+  const utf8string data_tmp_path = data_path + DOWNLOAD_CACHE_TMP_EXTENSION;
+  const utf8string meta_tmp_path = meta_path + DOWNLOAD_CACHE_TMP_EXTENSION;
+
+  // The data is renamed into place before the meta, so the meta never refers to partial data.
+  bool stored = FileUtil::CloneFile(path, data_tmp_path, allow_hardlink) &&
+                FileUtil::GetFileSize(data_tmp_path) == entry.size &&
+                WriteMeta(meta_tmp_path, entry) &&
+                FileUtil::Rename(data_tmp_path, data_path) &&
+                FileUtil::Rename(meta_tmp_path, meta_path);
+  if (!stored) {
+    FileUtil::RemoveFile(data_tmp_path);
+    FileUtil::RemoveFile(meta_tmp_path);
+    return false;
+  }
+
+  // The data file may be a clone or link that keeps the modification time of the downloaded file.
+  std::error_code ec;
+  ghc::filesystem::last_write_time(ghc::filesystem::u8path(data_path), ghc::filesystem::file_time_type::clock::now(), ec);
+
+  store_num++;
+  EvictEntries(dir, max_size, key);
+  return true;
+}
+
+bool RemoveDownloadCache(const utf8string& dir, const utf8string& key) {
+  if (dir.empty() || key.empty())
+    return false;
+  std::lock_guard<std::mutex> lg(cache_mutex);
+  std::error_code ec;
+  ghc::filesystem::remove(ghc::filesystem::u8path(EntryPath(dir, key, DOWNLOAD_CACHE_META_EXTENSION)), ec);
+  const bool removed = ghc::filesystem::remove(ghc::filesystem::u8path(EntryPath(dir, key, DOWNLOAD_CACHE_DATA_EXTENSION)), ec);
+  if (removed)
+    evicted_num++;
+  return removed;
+}
+
+void CountDownloadCacheMiss() {
+  miss_num++;
+}
+
+DownloadCacheStats GetDownloadCacheStats() {
+  DownloadCacheStats stats;
+  stats.hit_num = hit_num.load();
+  stats.miss_num = miss_num.load();
+  stats.hit_bytes = hit_bytes.load();
+  stats.store_num = store_num.load();
+  stats.evicted_num = evicted_num.load();
+  return stats;
+}
+}  // namespace zoe
@@ -0,0 +1,70 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_DOWNLOAD_CACHE_H_
+#define ZOE_DOWNLOAD_CACHE_H_
+#pragma once
+
+#include "zoe/zoe.h"
+
+namespace zoe {
+// The files downloaded before are kept in a directory, so that downloading the same file again is done by a local copy.
+// An entry is keyed by the expected hash of file(content addressed), or by url whose ETag and Last-Modified are
+// revalidated with the server before use. Each entry is a data file and a meta file named by key.
+// The entries used least recently are evicted when the total size of data files exceeds the limit.
+// Thread safe, the directory can be shared by processes, as the files are renamed into place.
+
+typedef struct _DownloadCacheEntry {
+  utf8string url;  // empty for the entries keyed by hash
+  utf8string etag;
+  utf8string last_modified;
+  int64_t size;
+
+  _DownloadCacheEntry()
+      : size(-1L) {}
+} DownloadCacheEntry;
+
+// Keys are safe as file names.
+utf8string DownloadCacheHashKey(HashType type, const utf8string& hash_value);
+utf8string DownloadCacheUrlKey(const utf8string& url);
+
+// Return false if key is not cached.
+bool LookupDownloadCache(const utf8string& dir, const utf8string& key, DownloadCacheEntry& entry);
+
+// Copy the data of entry to path, see FileUtil::CloneFile. The entry becomes the most recently used.
+// Counted as a hit if succeeded.
+bool RestoreDownloadCache(const utf8string& dir, const utf8string& key, const utf8string& path, bool allow_hardlink);
+
+// Add the file at path as the entry of key, then evict entries until the total size is under max_size.
+// The file larger than max_size is not added.
+bool StoreDownloadCache(const utf8string& dir,
+                        const utf8string& key,
+                        const DownloadCacheEntry& entry,
+                        const utf8string& path,
+                        int64_t max_size,
+                        bool allow_hardlink);
+
+// Remove the entry of key, such as the one whose data doesn't match the expected hash.
+// Counted as evicted if removed.
+bool RemoveDownloadCache(const utf8string& dir, const utf8string& key);
+
+// Called when a download looked up the cache but has to transfer the file.
+void CountDownloadCacheMiss();
+
+DownloadCacheStats GetDownloadCacheStats();
+}  // namespace zoe
+#endif  // !ZOE_DOWNLOAD_CACHE_H_
@@ -0,0 +1,408 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "engine.h"
+#include <assert.h>
+#include <algorithm>
+#include "options.h"
+#include "trace.h"
+
+namespace zoe {
+
+EventLoop::EventLoop(bool poll_when_idle)
+    : multi_(nullptr)
+    , poll_when_idle_(poll_when_idle) {
+  load_.store(0);
+}
+
+EventLoop::~EventLoop() {
+  assert(tasks_.empty());
+  std::lock_guard<std::mutex> lg(multi_mutex_);
+  if (multi_) {
+    curl_multi_cleanup(multi_);
+    multi_ = nullptr;
+  }
+}
+
+bool EventLoop::init() {
+  std::lock_guard<std::mutex> lg(multi_mutex_);
+  if (!multi_) {
+    multi_ = curl_multi_init();
+    // The default since libcurl 7.62.0.
+    if (multi_)
+      curl_multi_setopt(multi_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+  }
+  return multi_ != nullptr;
+}
+
+void* EventLoop::multi() const {
+  return multi_;
+}
+
+void EventLoop::post(std::function<void()> fn) {
+  {
+    std::lock_guard<std::mutex> lg(posted_mutex_);
+    posted_.push_back(fn);
+  }
+  wakeup();
+}
+
+void EventLoop::wakeup() {
+  std::lock_guard<std::mutex> lg(multi_mutex_);
+#if LIBCURL_VERSION_NUM >= 0x074400  // 7.68.0
+  if (multi_)
+    curl_multi_wakeup(multi_);
+#endif
+}
+
+size_t EventLoop::load() const {
+  return load_.load();
+}
+
+void EventLoop::attachTask(LoopTask* task) {
+  assert(task);
+  load_++;
+  post([this, task]() {
+    assert(std::find(tasks_.begin(), tasks_.end(), task) == tasks_.end());
+    tasks_.push_back(task);
+  });
+}
+
+void EventLoop::bindHandle(void* easy, LoopTask* task) {
+  handle_owners_[easy] = task;
+}
+
+void EventLoop::unbindHandle(void* easy) {
+  handle_owners_.erase(easy);
+}
+
+size_t EventLoop::taskNum() const {
+  return tasks_.size();
+}
+
+void EventLoop::runPosted() {
+  std::vector<std::function<void()>> posted;
+  {
+    std::lock_guard<std::mutex> lg(posted_mutex_);
+    posted.swap(posted_);
+  }
+
+  for (auto& fn : posted) {
+    if (fn)
+      fn();
+  }
+}
+
+void EventLoop::dispatchMessages() {
+  struct CURLMsg* m = nullptr;
+  do {
+    int msg_in_queue = 0;
+    m = curl_multi_info_read(multi_, &msg_in_queue);
+    if (m && m->msg == CURLMSG_DONE) {
+      auto it = handle_owners_.find(m->easy_handle);
+      assert(it != handle_owners_.end());
+      if (it == handle_owners_.end())
+        continue;
+
+      LoopTask* owner = it->second;
+      handle_owners_.erase(it);
+
+      owner->onTransferDone(m->easy_handle, m->data.result);
+    }
+  } while (m);
+}
+
+void EventLoop::runOnce(int32_t timeout_ms) {
+  runPosted();
+
+  // Task iterations start new slices, so do it before polling.
+  for (auto it = tasks_.begin(); it != tasks_.end();) {
+    LoopTask* task = *it;
+    if (task->onLoopIteration(multi_)) {
+      const int32_t task_timeout = task->maxPollTimeout();
+      if (task_timeout >= 0 && task_timeout < timeout_ms)
+        timeout_ms = task_timeout;
+      ++it;
+      continue;
+    }
+
+    task->onLoopDetach(multi_);
+
+    for (auto h = handle_owners_.begin(); h != handle_owners_.end();) {
+      if (h->second == task)
+        h = handle_owners_.erase(h);
+      else
+        ++h;
+    }
+
+    it = tasks_.erase(it);
+    load_--;
+  }
+
+  if (tasks_.empty() && load_.load() == 0 && !poll_when_idle_)
+    return;
+
+  int numfds = 0;
+  {
+    TraceScope trace(TRACE_POLL, this, -1);
+#if LIBCURL_VERSION_NUM >= 0x074400  // 7.68.0
+    curl_multi_poll(multi_, nullptr, 0, timeout_ms, &numfds);
+#else
+    curl_multi_wait(multi_, nullptr, 0, timeout_ms, &numfds);
+#endif
+  }
+
+  int still_running = 0;
+  {
+    TraceScope trace(TRACE_PERFORM, this, -1);
+    curl_multi_perform(multi_, &still_running);
+    trace.setArg(still_running);
+  }
+
+  dispatchMessages();
+}
+
+WorkerPool::WorkerPool(int32_t thread_num)
+    : stopping_(false) {
+  if (thread_num <= 0)
+    thread_num = 1;
+  for (int32_t i = 0; i < thread_num; i++)
+    threads_.emplace_back(std::bind(&WorkerPool::workerProcess, this));
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lg(jobs_mutex_);
+    stopping_ = true;
+  }
+  jobs_cond_var_.notify_all();
+
+  for (auto& t : threads_) {
+    if (t.joinable())
+      t.join();
+  }
+}
+
+void WorkerPool::post(std::function<void()> fn) {
+  {
+    std::lock_guard<std::mutex> lg(jobs_mutex_);
+    jobs_.push_back(fn);
+  }
+  jobs_cond_var_.notify_one();
+}
+
+void WorkerPool::workerProcess() {
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> ul(jobs_mutex_);
+      jobs_cond_var_.wait(ul, [this] { return stopping_ || !jobs_.empty(); });
+      if (jobs_.empty())
+        break;  // stopping
+      job = jobs_.front();
+      jobs_.pop_front();
+    }
+
+    if (job)
+      job();
+  }
+}
+
+Engine::EngineImpl::EngineImpl(int32_t io_thread_num, int32_t worker_thread_num) {
+  stopping_.store(false);
+  max_transfer_num_ = 0;
+
+  if (io_thread_num <= 0)
+    io_thread_num = ZOE_DEFAULT_ENGINE_IO_THREAD_NUM;
+  if (worker_thread_num <= 0)
+    worker_thread_num = ZOE_DEFAULT_ENGINE_WORKER_THREAD_NUM;
+
+  for (int32_t i = 0; i < io_thread_num; i++) {
+    std::shared_ptr<EventLoop> loop = std::make_shared<EventLoop>(true);
+    if (!loop->init())
+      continue;
+    loops_.push_back(loop);
+    io_threads_.emplace_back(std::bind(&EngineImpl::loopProcess, this, loop.get()));
+  }
+
+  workers_ = std::make_shared<WorkerPool>(worker_thread_num);
+}
+
+Engine::EngineImpl::~EngineImpl() {
+  stopping_.store(true);
+  wakeupLoops();
+
+  for (auto& t : io_threads_) {
+    if (t.joinable())
+      t.join();
+  }
+
+  workers_.reset();
+
+  // The writers may wake up the loops until they are drained.
+  for (auto& writer : disk_writers_)
+    writer.reset();
+  loops_.clear();
+}
+
+EventLoop* Engine::EngineImpl::selectLoop() {
+  EventLoop* selected = nullptr;
+  for (auto& loop : loops_) {
+    if (!selected || loop->load() < selected->load())
+      selected = loop.get();
+  }
+  return selected;
+}
+
+void Engine::EngineImpl::postWork(std::function<void()> fn) {
+  workers_->post(fn);
+}
+
+void Engine::EngineImpl::setMaxTransferNum(int32_t num) {
+  {
+    std::lock_guard<std::mutex> lg(tasks_mutex_);
+    max_transfer_num_ = std::max(num, 0);
+  }
+  wakeupLoops();
+}
+
+void Engine::EngineImpl::addTask(const void* task, int32_t priority, int32_t weight) {
+  {
+    std::lock_guard<std::mutex> lg(tasks_mutex_);
+    TaskShare& share = task_shares_[task];
+    share.priority = priority;
+    share.weight = std::max(weight, 1);
+    share.transfer_num = 0;
+  }
+  // The tasks of lower priority are preempted in their next iteration.
+  wakeupLoops();
+}
+
+void Engine::EngineImpl::removeTask(const void* task) {
+  {
+    std::lock_guard<std::mutex> lg(tasks_mutex_);
+    task_shares_.erase(task);
+  }
+  wakeupLoops();
+}
+
+bool Engine::EngineImpl::isPreempted(const void* task) const {
+  std::lock_guard<std::mutex> lg(tasks_mutex_);
+  const auto it = task_shares_.find(task);
+  return it != task_shares_.end() && it->second.priority < topPriority();
+}
+
+bool Engine::EngineImpl::acquireTransfer(const void* task) {
+  std::lock_guard<std::mutex> lg(tasks_mutex_);
+  const auto it = task_shares_.find(task);
+  if (it == task_shares_.end())
+    return true;
+
+  TaskShare& share = it->second;
+  const int32_t top_priority = topPriority();
+  if (share.priority < top_priority)
+    return false;
+
+  if (max_transfer_num_ > 0) {
+    // The transfers of preempted tasks are paused, so they are not counted.
+    int32_t transfer_num = 0;
+    int32_t total_weight = 0;
+    for (const auto& t : task_shares_) {
+      if (t.second.priority == top_priority) {
+        transfer_num += t.second.transfer_num;
+        total_weight += t.second.weight;
+      }
+    }
+    if (transfer_num >= max_transfer_num_)
+      return false;
+
+    // Leave the transfers free for the tasks that are below their share.
+    if (share.transfer_num >= std::max((int64_t)max_transfer_num_ * share.weight / total_weight, (int64_t)1L)) {
+      for (const auto& t : task_shares_) {
+        if (t.first == task || t.second.priority != top_priority)
+          continue;
+        if (t.second.transfer_num < std::max((int64_t)max_transfer_num_ * t.second.weight / total_weight, (int64_t)1L))
+          return false;
+      }
+    }
+  }
+
+  share.transfer_num++;
+  return true;
+}
+
+void Engine::EngineImpl::releaseTransfer(const void* task) {
+  bool limited = false;
+  {
+    std::lock_guard<std::mutex> lg(tasks_mutex_);
+    const auto it = task_shares_.find(task);
+    if (it != task_shares_.end())
+      it->second.transfer_num--;
+    limited = max_transfer_num_ > 0;
+  }
+
+  if (limited)
+    wakeupLoops();
+}
+
+std::shared_ptr<DiskWriter> Engine::EngineImpl::diskWriter(StorageClass storage_class) {
+  if (storage_class < STORAGE_SSD || storage_class > STORAGE_NETWORK)
+    storage_class = STORAGE_SSD;
+
+  std::lock_guard<std::mutex> lg(disk_writers_mutex_);
+  std::shared_ptr<DiskWriter>& writer = disk_writers_[storage_class];
+  if (!writer) {
+    writer = CreateDiskWriter(storage_class, ZOE_ENGINE_DISK_WRITER_MAX_QUEUED_BYTES);
+    // The slices paused by any task may be resumed, the functor of a task would be replaced by the others.
+    writer->setSpaceAvailableFunctor(std::bind(&EngineImpl::wakeupLoops, this));
+  }
+  return writer;
+}
+
+int32_t Engine::EngineImpl::topPriority() const {
+  int32_t top_priority = PRIORITY_LOW;
+  for (const auto& t : task_shares_)
+    top_priority = std::max(top_priority, t.second.priority);
+  return top_priority;
+}
+
+void Engine::EngineImpl::wakeupLoops() {
+  for (auto& loop : loops_)
+    loop->wakeup();
+}
+
+void Engine::EngineImpl::loopProcess(EventLoop* loop) {
+  while (!stopping_.load()) {
+    loop->runOnce(ZOE_MULTI_POLL_TIMEOUT_MS);
+  }
+}
+
+Engine::Engine(int32_t io_thread_num, int32_t worker_thread_num)
+    : impl_(new EngineImpl(io_thread_num, worker_thread_num)) {}
+
+Engine::~Engine() {
+  assert(impl_);
+  if (impl_) {
+    delete impl_;
+    impl_ = nullptr;
+  }
+}
+void Engine::setMaxConcurrentTransfers(int32_t num) noexcept {
+  assert(impl_);
+  impl_->setMaxTransferNum(num);
+}
+}  // namespace zoe
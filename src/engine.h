@@ -0,0 +1,178 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_ENGINE_H_
+#define ZOE_ENGINE_H_
+#pragma once
+
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+#include <deque>
+#include "zoe/zoe.h"
+#include "curl/curl.h"
+#include "disk_writer.h"
+
+namespace zoe {
+
+// A download task that transfers its slices on an EventLoop.
+// All of these functions are called on the loop thread.
+class LoopTask {
+ public:
+  virtual ~LoopTask() {}
+
+  // Called every loop round before polling.
+  // Return false when the task has nothing more to transfer, then the task will be detached.
+  virtual bool onLoopIteration(void* multi) = 0;
+
+  // An easy handle bound to this task has finished.
+  virtual void onTransferDone(void* easy, CURLcode result) = 0;
+
+  // The task has been removed from loop, all of its easy handles must be removed from multi.
+  virtual void onLoopDetach(void* multi) = 0;
+
+  // Longest time the loop may block in polling before next iteration of this task, -1 if no limit.
+  virtual int32_t maxPollTimeout() const { return -1; }
+};
+
+// One curl multi handle and the tasks multiplexed on it.
+// Except post/wakeup/load/attachTask, all functions must be called on the loop thread.
+class EventLoop {
+ public:
+  // If poll_when_idle is false, runOnce returns immediately when there isn't any task.
+  EventLoop(bool poll_when_idle);
+  virtual ~EventLoop();
+
+  bool init();
+  void* multi() const;
+
+  // Thread safe, fn will be run on the loop thread in next round.
+  void post(std::function<void()> fn);
+
+  // Thread safe, interrupt curl_multi_poll.
+  void wakeup();
+
+  // Thread safe, number of tasks attached or going to be attached.
+  size_t load() const;
+
+  // Thread safe, the task will be attached in next round.
+  void attachTask(LoopTask* task);
+
+  void bindHandle(void* easy, LoopTask* task);
+  void unbindHandle(void* easy);
+  size_t taskNum() const;
+
+  // Run one round: posted functions, task iterations, poll, perform, dispatch done messages.
+  void runOnce(int32_t timeout_ms);
+
+ protected:
+  void runPosted();
+  void dispatchMessages();
+
+ protected:
+  void* multi_;
+  std::mutex multi_mutex_;
+  const bool poll_when_idle_;
+
+  std::vector<LoopTask*> tasks_;
+  std::map<void*, LoopTask*> handle_owners_;
+
+  std::mutex posted_mutex_;
+  std::vector<std::function<void()>> posted_;
+
+  std::atomic<size_t> load_;
+};
+
+// Fixed number of threads for blocking work, such as fetching file info and verifying hash.
+class WorkerPool {
+ public:
+  WorkerPool(int32_t thread_num);
+  virtual ~WorkerPool();
+
+  void post(std::function<void()> fn);
+
+ protected:
+  void workerProcess();
+
+ protected:
+  bool stopping_;
+  std::mutex jobs_mutex_;
+  std::condition_variable jobs_cond_var_;
+  std::deque<std::function<void()>> jobs_;
+  std::vector<std::thread> threads_;
+};
+
+class Engine::EngineImpl {
+ public:
+  EngineImpl(int32_t io_thread_num, int32_t worker_thread_num);
+  ~EngineImpl();
+
+  // Select the loop that has least tasks.
+  EventLoop* selectLoop();
+
+  void postWork(std::function<void()> fn);
+
+  // Thread safe, limit the number of slices transferring on all loops, 0 means unlimited.
+  void setMaxTransferNum(int32_t num);
+
+  // Thread safe, the tasks transferring on loops, with their priority and weight.
+  void addTask(const void* task, int32_t priority, int32_t weight);
+  void removeTask(const void* task);
+
+  // Thread safe, whether there is a task of higher priority, the slices of a preempted task are paused.
+  bool isPreempted(const void* task) const;
+
+  // Thread safe, a slice must acquire a transfer before starting, and release it when done.
+  // Return false if the task is preempted, the limit is reached, or the task has its share of the limit by weight
+  // while another task hasn't. The loops are woken up when a transfer is released.
+  bool acquireTransfer(const void* task);
+  void releaseTransfer(const void* task);
+
+  // Thread safe, the disk writer shared by the tasks that write to the storage class, created when first used.
+  std::shared_ptr<DiskWriter> diskWriter(StorageClass storage_class);
+
+ protected:
+  void loopProcess(EventLoop* loop);
+
+  // Must be called with tasks_mutex_ locked.
+  int32_t topPriority() const;
+  void wakeupLoops();
+
+ protected:
+  typedef struct _TaskShare {
+    int32_t priority;
+    int32_t weight;
+    int32_t transfer_num;
+  } TaskShare;
+
+  std::atomic_bool stopping_;
+  mutable std::mutex tasks_mutex_;
+  std::map<const void*, TaskShare> task_shares_;
+  int32_t max_transfer_num_;
+  std::vector<std::shared_ptr<EventLoop>> loops_;
+  std::vector<std::thread> io_threads_;
+  std::shared_ptr<WorkerPool> workers_;
+
+  std::mutex disk_writers_mutex_;
+  std::shared_ptr<DiskWriter> disk_writers_[STORAGE_NETWORK + 1];
+};
+}  // namespace zoe
+#endif  // !ZOE_ENGINE_H_
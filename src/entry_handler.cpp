@@ -18,13 +18,18 @@
 #include "entry_handler.h"
 #include <assert.h>
 #include <cinttypes>
+#include <algorithm>
 #include <functional>
 #include <thread>
+#include <chrono>
 #include "file_util.h"
 #include "string_helper.hpp"
 #include "string_encode.h"
 #include "verbose.h"
 #include "time_meter.hpp"
+#include "download_cache.h"
+#include "parallel_hash.h"
+#include "peer_server.h"
 
 #define CHECK_SETOPT2(x)                                                                                  \
   do {                                                                                                   \
@@ -42,11 +47,30 @@ utf8string bool2string(bool b) {
 
 EntryHandler::EntryHandler()
     : options_(nullptr)
+    , engine_(nullptr)
     , slice_manager_(nullptr)
     , progress_handler_(nullptr)
-    , multi_(nullptr)
-    , fetch_file_info_curl_(nullptr)
-    , speed_handler_(nullptr) {
+    , speed_handler_(nullptr)
+    , concurrency_controller_(nullptr)
+    , slice_sizer_(nullptr)
+    , loop_(nullptr)
+    , fetch_file_info_multi_(nullptr)
+    , slices_paused_(false)
+    , preempted_(false)
+    , slices_released_(false)
+    , active_slice_num_(0)
+    , transfer_throttled_(false)
+    , retry_wait_time_(-1L)
+    , random_(std::random_device()())
+    , transfer_started_(false)
+    , transfer_result_(SUCCESSED)
+    , stop_slices_result_(SUCCESSED)
+    , metrics_(std::make_shared<Metrics>())
+    , chunks_repaired_(false)
+    , checkpoint_downloaded_(0L)
+    , slice_completed_(false)
+    , download_cache_hit_(false)
+    , max_transfer_num_(0) {
   user_paused_.store(false);
   user_stopped_.store(false);
   state_.store(DownloadState::STOPPED);
@@ -61,17 +85,34 @@ static size_t __WriteBodyCallback(char* buffer,
                                   size_t size,
                                   size_t nitems,
                                   void* outstream) {
-  return (size * nitems);
+  FileInfoRequest* request = static_cast<FileInfoRequest*>(outstream);
+  if (!request || !(request->range_probe || request->keep_body))
+    return (size * nitems);
+
+  const size_t total = size * nitems;
+  if (request->keep_body) {
+    if (request->info.prefetched.size() + total > ZOE_DELTA_MAX_MANIFEST_SIZE_BYTE)
+      return 0;
+    request->info.prefetched.append(buffer, total);
+    return total;
+  }
+
+  // The server ignored the range and sends the whole file, the headers are enough.
+  if (request->info.prefetched.size() + total > ZOE_RANGE_PROBE_SIZE_BYTE) {
+    request->body_aborted = true;
+    return 0;
+  }
+  request->info.prefetched.append(buffer, total);
+  return total;
 }
 
 static size_t __WriteHeaderCallback(char* buffer,
                                     size_t size,
                                     size_t nitems,
                                     void* userdata) {
-  EntryHandler::FileInfo* pFileInfo =
-      static_cast<EntryHandler::FileInfo*>(userdata);
-  assert(pFileInfo);
-  if (!pFileInfo) {
+  FileInfoRequest* request = static_cast<FileInfoRequest*>(userdata);
+  assert(request);
+  if (!request) {
     return -1;
   }
 
@@ -79,6 +120,17 @@ static size_t __WriteHeaderCallback(char* buffer,
   utf8string header;
   header.assign(buffer, size * nitems);
 
+  // The headers of the responses redirected from are not taken.
+  if (header.compare(0, 5, "HTTP/") == 0) {
+    request->info.acceptRanges = true;
+    request->info.contentMd5.clear();
+    request->info.etag.clear();
+    request->info.lastModified.clear();
+    request->content_length = -1L;
+    request->range_total = -1L;
+    return total;
+  }
+
   size_t pos = header.find(": ");
 
   if (pos == std::string::npos) {
@@ -90,24 +142,61 @@ static size_t __WriteHeaderCallback(char* buffer,
   utf8string value = header.substr(pos + 2, header.length() - pos - 4);
 
   if (key_lowercase == "content-length") {
-    pFileInfo->fileSize = strtoll(value.c_str(), nullptr, 10);
+    request->content_length = strtoll(value.c_str(), nullptr, 10);
+  }
+  else if (key_lowercase == "content-range") {
+    // bytes 0-262143/1048576, or bytes */1048576 if the range is not satisfiable.
+    const size_t slash = value.rfind('/');
+    if (slash != utf8string::npos && value.compare(slash + 1, 1, "*") != 0)
+      request->range_total = strtoll(value.c_str() + slash + 1, nullptr, 10);
   }
   else if (key_lowercase == "content-md5") {
-    pFileInfo->contentMd5 = value;
+    request->info.contentMd5 = value;
+  }
+  else if (key_lowercase == "etag") {
+    request->info.etag = value;
+  }
+  else if (key_lowercase == "last-modified") {
+    request->info.lastModified = value;
   }
   else if (key_lowercase == "accept-ranges") {
     if (StringHelper::IsEqual(value, "none", true)) {
-      pFileInfo->acceptRanges = false;
+      request->info.acceptRanges = false;
     }
   }
 
   return total;
 }
 
-std::shared_future<Result> EntryHandler::start(Options* options) {
+std::shared_future<Result> EntryHandler::start(Options* options, Engine::EngineImpl* engine) {
   options_ = options;
-  async_task_ = std::async(std::launch::async,
-                           std::bind(&EntryHandler::asyncTaskProcess, this));
+  engine_ = engine;
+
+  // reset before return, so that stop() called immediately after start() takes effect.
+  options_->internal_stop_event.unset();
+  user_paused_.store(false);
+  user_stopped_.store(false);
+  slices_paused_ = false;
+  preempted_ = false;
+  slices_released_ = false;
+  active_slice_num_ = 0;
+  transfer_throttled_ = false;
+  transfer_started_ = false;
+  transfer_result_ = SUCCESSED;
+  chunks_repaired_ = false;
+  download_cache_hit_ = false;
+  download_cache_entry_ = DownloadCacheEntry();
+  state_.store(DownloadState::DOWNLODING);
+
+  if (!engine_) {
+    async_task_ = std::async(std::launch::async,
+                             std::bind(&EntryHandler::asyncTaskProcess, this));
+    return async_task_;
+  }
+
+  result_promise_ = std::make_shared<std::promise<Result>>();
+  async_task_ = result_promise_->get_future().share();
+  engine_->postWork(std::bind(&EntryHandler::engineTaskProcess, this));
   return async_task_;
 }
 
@@ -115,6 +204,7 @@ void EntryHandler::pause() {
   if (slice_manager_) {
     user_paused_.store(true);
     state_.store(DownloadState::PAUSED);
+    wakeup();
   }
 }
 
@@ -122,6 +212,7 @@ void EntryHandler::resume() {
   if (slice_manager_) {
     user_paused_.store(false);
     state_.store(DownloadState::DOWNLODING);
+    wakeup();
   }
 }
 
@@ -130,6 +221,7 @@ void EntryHandler::stop() {
   options_->internal_stop_event.set();
   cancelFetchFileInfo();
   state_.store(DownloadState::STOPPED);
+  wakeup();
 }
 
 int64_t EntryHandler::originFileSize() const {
@@ -142,6 +234,15 @@ Options* EntryHandler::options() {
   return options_;
 }
 
+DownloadMetrics EntryHandler::metrics() const {
+  return metrics_->snapshot();
+}
+
+DownloadStats EntryHandler::stats() const {
+  std::lock_guard<std::mutex> lg(stats_mutex_);
+  return stats_;
+}
+
 DownloadState EntryHandler::state() const {
   return state_.load();
 }
@@ -151,14 +252,64 @@ std::shared_future<Result> EntryHandler::futureResult() {
 }
 
 Result EntryHandler::asyncTaskProcess() {
-  options_->internal_stop_event.unset();
-  user_paused_.store(false);
-  user_stopped_.store(false);
-  state_.store(DownloadState::DOWNLODING);
+  Result ret = SUCCESSED;
+  bool need_transfer = false;
+
+  do {
+    ret = prepareDownload(need_transfer);
+    if (!need_transfer)
+      break;
+
+    EventLoop loop(false);
+    if (!loop.init()) {
+      OutputVerbose(options_->verbose_functor, u8"curl_multi_init failed.\n");
+      ret = INIT_CURL_MULTI_FAILED;
+      break;
+    }
+
+    applyMultiOptions(loop.multi());
+    setLoop(&loop);
+    do {
+      loop.attachTask(this);
+      while (loop.load() > 0) {
+        loop.runOnce(ZOE_MULTI_POLL_TIMEOUT_MS);
+      }
 
-  const Result ret = _asyncTaskProcess();
+      ret = finishDownload();
+    } while (ret == HASH_VERIFY_NOT_PASS && repairCorruptedChunks());
+    setLoop(nullptr);
+  } while (false);
 
+  return completeTask(ret);
+}
+
+void EntryHandler::engineTaskProcess() {
+  bool need_transfer = false;
+  const Result ret = prepareDownload(need_transfer);
+  if (!need_transfer) {
+    std::shared_ptr<std::promise<Result>> result_promise = result_promise_;
+    result_promise->set_value(completeTask(ret));
+    return;
+  }
+
+  EventLoop* loop = engine_->selectLoop();
+  if (!loop) {
+    std::shared_ptr<std::promise<Result>> result_promise = result_promise_;
+    result_promise->set_value(completeTask(INIT_CURL_MULTI_FAILED));
+    return;
+  }
+
+  setLoop(loop);
+  engine_->addTask(this, options_->priority, options_->priority_weight);
+  loop->attachTask(this);
+}
+
+Result EntryHandler::completeTask(Result ret) {
   options_->internal_stop_event.set();
+  state_.store(DownloadState::STOPPED);
+
+  if (ret == SUCCESSED && isDownloadCacheEnabled() && !download_cache_hit_)
+    storeToDownloadCache();
 
   if (speed_handler_)
     speed_handler_.reset();
@@ -166,6 +317,26 @@ Result EntryHandler::asyncTaskProcess() {
   if (progress_handler_)
     progress_handler_.reset();
 
+  if (concurrency_controller_)
+    concurrency_controller_.reset();
+
+  if (slice_sizer_)
+    slice_sizer_.reset();
+
+  if (peer_tracker_) {
+    peer_tracker_->stop();
+    peer_tracker_.reset();
+  }
+  peer_sources_.clear();
+  peer_chunks_.clear();
+
+  // The data of a failed download may be wrong, only the file downloaded is still shared.
+  if (!peer_key_.empty() && ret != SUCCESSED)
+    UnsharePeerFile(peer_key_);
+
+  if (source_manager_)
+    source_manager_.reset();
+
   if (slice_manager_) {
     slice_manager_->cleanup();
     slice_manager_.reset();
@@ -177,31 +348,64 @@ Result EntryHandler::asyncTaskProcess() {
   return ret;
 }
 
-Result EntryHandler::_asyncTaskProcess() {
+Result EntryHandler::prepareDownload(bool& need_transfer) {
+  need_transfer = false;
+
   OutputVerbose(options_->verbose_functor, u8"URL: %s.\n", options_->url.c_str());
   OutputVerbose(options_->verbose_functor, u8"Thread number: %d.\n", options_->thread_num);
   OutputVerbose(options_->verbose_functor, u8"Disk Cache Size: %ld.\n", options_->disk_cache_size);
   OutputVerbose(options_->verbose_functor, u8"Target file path: %s.\n", options_->target_file_path.c_str());
 
+  if (isStopped())
+    return CANCELED;
+
+  // The file of expected hash is taken from download cache without any request.
+  if (isDownloadCacheEnabled() && options_->hash_value.length() > 0 &&
+      restoreFromDownloadCache(DownloadCacheHashKey(options_->hash_type, options_->hash_value)))
+    return SUCCESSED;
+
   OutputVerbose(options_->verbose_functor, u8"Fetching file size...\n");
   FileInfo file_info;
   bool fetch_size_ret = false;
   int32_t try_times = 0;
+  TimeMeter fetch_time_meter;
+  int64_t fetch_latency = 0L;  // of the first try
   do {
     fetch_size_ret = fetchFileInfo(file_info);
+    if (try_times == 0)
+      fetch_latency = fetch_time_meter.Elapsed();
     if (fetch_size_ret)
       break;
     OutputVerbose(options_->verbose_functor, u8"Fetching file size failed, retry...\n");
-  } while (++try_times <= options_->fetch_file_info_retry);
+  } while (++try_times <= options_->fetch_file_info_retry && !isStopped());
+  metrics_->addFetchFileInfoTime(fetch_time_meter.Elapsed());
 
   if (!fetch_size_ret) {
     OutputVerbose(options_->verbose_functor, u8"Fetch file size failed.\n");
-    return FETCH_FILE_INFO_FAILED;
+    return isStopped() ? CANCELED : FETCH_FILE_INFO_FAILED;
   }
 
   OutputVerbose(options_->verbose_functor, u8"File size: %" PRId64 ".\n", file_info.fileSize);
 
+  // The file of url is taken from download cache if it's not changed since cached.
+  if (isDownloadCacheEnabled()) {
+    const utf8string url_key = DownloadCacheUrlKey(options_->url);
+    DownloadCacheEntry entry;
+    if (LookupDownloadCache(options_->download_cache_dir, url_key, entry) && isSameVersion(entry, file_info) &&
+        restoreFromDownloadCache(url_key))
+      return SUCCESSED;
+
+    CountDownloadCacheMiss();
+    download_cache_entry_.url = options_->url;
+    download_cache_entry_.etag = file_info.etag;
+    download_cache_entry_.last_modified = file_info.lastModified;
+  }
+
   // If target file is an empty file, create it.
+  if (file_info.fileSize == 0 && options_->memory_target_enabled) {
+    options_->memory_data_size = 0L;
+    return SUCCESSED;
+  }
   if (file_info.fileSize == 0) {
     return FileUtil::CreateFixedSizeFile(options_->target_file_path, 0)
                ? SUCCESSED
@@ -212,7 +416,18 @@ Result EntryHandler::_asyncTaskProcess() {
   OutputVerbose(options_->verbose_functor, u8"Redirect URL: %s.\n", file_info.redirect_url.c_str());
 
   assert(!slice_manager_);
-  slice_manager_ = std::make_shared<SliceManager>(options_, file_info.redirect_url);
+  std::shared_ptr<DiskWriter> shared_disk_writer;
+  if (engine_ && options_->async_disk_write_enabled)
+    shared_disk_writer = engine_->diskWriter(options_->storage_class);
+  slice_manager_ = std::make_shared<SliceManager>(options_, file_info.redirect_url, shared_disk_writer);
+  slice_manager_->setMetrics(metrics_);
+  if (slice_manager_->diskWriter() && !engine_)
+    slice_manager_->diskWriter()->setSpaceAvailableFunctor(std::bind(&EntryHandler::wakeup, this));
+  if (slice_manager_->bufferPool())
+    slice_manager_->bufferPool()->setAvailableFunctor(std::bind(&EntryHandler::wakeup, this));
+
+  if (file_info.rangeConfirmed)
+    slice_manager_->setRangeConfirmed();
 
   if (slice_manager_->loadExistSlice(file_info.fileSize, file_info.contentMd5) != SUCCESSED) {
     slice_manager_->setOriginFileSize(file_info.fileSize);
@@ -222,259 +437,896 @@ Result EntryHandler::_asyncTaskProcess() {
     if (ms_ret != SUCCESSED) {
       return ms_ret;
     }
+
+    if (isDeltaEnabled() && file_info.acceptRanges && !isStopped())
+      applyDelta(file_info);
+
+    // The rest of first slice is requested by range, unless the whole file is prefetched.
+    const bool prefill =
+        file_info.rangeConfirmed || (file_info.fileSize >= 0 && (int64_t)file_info.prefetched.size() >= file_info.fileSize);
+    const int64_t prefilled = prefill ? slice_manager_->prefillFirstSlice(file_info.prefetched) : 0L;
+    if (prefilled > 0)
+      OutputVerbose(options_->verbose_functor, u8"Prefetched size: %" PRId64 ".\n", prefilled);
   }
 
+  if (isPeerModeEnabled() && file_info.acceptRanges && file_info.fileSize > 0 && !slice_manager_->targetFile()->isInMemory())
+    startPeerMode(file_info);
+
   if (slice_manager_->isAllSliceCompletedClearly(false) == SUCCESSED) {
     OutputVerbose(options_->verbose_functor, u8"All of slices have been downloaded.\n");
-    return slice_manager_->finishDownloadProgress(false, multi_);
+    return slice_manager_->finishDownloadProgress(false, nullptr);
   }
 
-  multi_ = curl_multi_init();
-  if (!multi_) {
-    OutputVerbose(options_->verbose_functor, u8"curl_multi_init failed.\n");
-    return INIT_CURL_MULTI_FAILED;
+  // The progress and speed are reported on loop thread, see onLoopIteration.
+  if (options_->progress_functor)
+    progress_handler_ = std::make_shared<ProgressHandler>(options_, slice_manager_);
+
+  max_transfer_num_ = 0;
+  if (options_->max_host_connections > 0) {
+    const int32_t streams = (file_info.multiplexed && IsMultiplexedHttpVersion(options_->http_version)) ? ZOE_MAX_STREAMS_PER_CONNECTION : 1;
+    max_transfer_num_ = options_->max_host_connections * streams * (int32_t)(source_manager_ ? source_manager_->sourceNum() : 1);
+    OutputVerbose(options_->verbose_functor, u8"Max concurrent slices: %d, streams per connection: %d.\n", max_transfer_num_, streams);
   }
 
-  int64_t disk_cache_per_slice = 0L;
-  int64_t max_speed_per_slice = 0L;
-  calculateSliceInfo(
-      std::min(slice_manager_->getUnfetchAndUncompletedSliceNum(), options_->thread_num),
-      &disk_cache_per_slice, &max_speed_per_slice);
+  // Always sample the speed, for stats() and concurrency controller.
+  speed_handler_ = std::make_shared<SpeedHandler>(slice_manager_->totalDownloaded(), options_, slice_manager_);
 
-  OutputVerbose(options_->verbose_functor, u8"Disk cache per slice: %" PRId64 ".\n", disk_cache_per_slice);
-  OutputVerbose(options_->verbose_functor, u8"Max speed per slice: %" PRId64 ".\n", max_speed_per_slice);
+  if (options_->adaptive_concurrency_enabled) {
+    concurrency_controller_ = std::make_shared<ConcurrencyController>(
+        options_, slice_manager_, speed_handler_, options_->adaptive_min_thread_num, options_->thread_num);
+  }
+
+  if (options_->slice_policy == Adaptive && slice_manager_->originFileSize() > 0) {
+    slice_sizer_ = std::make_shared<SliceSizer>(slice_manager_->originFileSize(), options_->thread_num,
+                                                options_->slice_policy_value);
+    slice_sizer_->onRequestLatency(fetch_latency);
+  }
+
+  need_transfer = true;
+  return SUCCESSED;
+}
+
+Result EntryHandler::startInitialSlices(void* multi) {
+  OutputVerbose(options_->verbose_functor, u8"Max speed: %d.\n", options_->max_speed);
 
-  Result ss_ret = SUCCESSED;
   int32_t selected = 0;
+  transfer_throttled_ = false;
   while (true) {
-    if (selected >= options_->thread_num)
+    if (selected >= concurrencyNum())
+      break;
+
+    if (!acquireTransfer())
       break;
 
-    std::shared_ptr<Slice> slice = slice_manager_->getSlice(Slice::UNFETCH);
-    if (!slice)
+    std::shared_ptr<Slice> slice = unfetchedSlice();
+    if (!slice || !isInStreamWindow(slice)) {
+      releaseTransfer();
       break;
+    }
+
+    assignSource(slice);
+    if (!acquireBudget(slice)) {
+      releaseTransfer();
+      break;
+    }
 
     slice->setStatus(Slice::FETCHED);
-    ss_ret = slice->start(multi_, disk_cache_per_slice, max_speed_per_slice);
+    const Result ss_ret = slice->start(multi);
     if (ss_ret != SUCCESSED) {
+      slice->setBudgetTicket(nullptr);
+      releaseTransfer();
       OutputVerbose(options_->verbose_functor,
                     u8"Slice<%d> start downloading failed: %s.\n",
                     slice->index(), GetResultString(ss_ret));
 
       // fatal error, return immediately!
-      curl_multi_cleanup(multi_);
-      multi_ = nullptr;
       return ss_ret;
     }
+    onSliceStarted(slice);
     OutputVerbose(options_->verbose_functor, u8"Slice<%d> start downloading.\n", slice->index());
     selected++;
   }
 
-  if (selected == 0) {
+  // The slices will be started in loop iterations when other tasks release their transfers.
+  if (selected == 0 && !transfer_throttled_) {
     OutputVerbose(options_->verbose_functor, u8"No available slice.\n");
-    curl_multi_cleanup(multi_);
-    multi_ = nullptr;
     return UNKNOWN_ERROR;
   }
 
-  if (options_->progress_functor)
-    progress_handler_ = std::make_shared<ProgressHandler>(options_, slice_manager_);
+  OutputVerbose(options_->verbose_functor, u8"Start downloading.\n");
+  return SUCCESSED;
+}
 
-  if (options_->speed_functor)
-    speed_handler_ = std::make_shared<SpeedHandler>(slice_manager_->totalDownloaded(), options_, slice_manager_);
+std::shared_ptr<Slice> EntryHandler::unfetchedSlice() {
+  std::shared_ptr<Slice> slice = slice_manager_->getSlice(Slice::UNFETCH);
 
-  // https://curl.haxx.se/libcurl/c/curl_multi_fdset.html
-  // https://docs.microsoft.com/en-us/windows/win32/api/winsock2/nf-winsock2-select
-  // https://manpages.courier-mta.org/htmlman2/select.2.html
-  //
-  struct timeval select_timeout;
-  select_timeout.tv_sec = 1;
-  select_timeout.tv_usec = 0;
+  // The data left is shared by the connections.
+  if (slice && slice_sizer_) {
+    const int64_t remaining = slice_manager_->originFileSize() - slice_manager_->totalDownloaded();
+    slice_manager_->cutSlice(slice, slice_sizer_->nextSize(remaining, concurrencyNum()));
+  }
+  return slice;
+}
 
-  long curl_timeo = -1;
-  curl_multi_timeout(multi_, &curl_timeo);
+std::shared_ptr<Slice> EntryHandler::selectNextSlice() {
+  // Get a slice that not be fetched(of cause not completed).
+  std::shared_ptr<Slice> slice = unfetchedSlice();
+  if (slice)
+    return slice;
+
+  // Try to download the slice that is failed previous again, after its retry delay.
+  for (const auto& failed : slice_manager_->getSlices(Slice::DOWNLOAD_FAILED)) {
+    if (failed->failedTimes() >= options_->slice_max_failed_times)
+      return nullptr;
+
+    const long remaining_time = failed->retryRemainingTime();
+    if (remaining_time > 0) {
+      if (retry_wait_time_ < 0 || remaining_time < retry_wait_time_)
+        retry_wait_time_ = remaining_time;
+      continue;
+    }
 
-  if (curl_timeo > 0) {
-    select_timeout.tv_sec = curl_timeo / 1000;
-    if (select_timeout.tv_sec > 1)
-      select_timeout.tv_sec = 1;
-    else
-      select_timeout.tv_usec = (curl_timeo % 1000) * 1000;
-  }
-  else {
-    select_timeout.tv_sec = 0;
-    select_timeout.tv_usec = 100 * 1000;
+    OutputVerbose(options_->verbose_functor, u8"Re-download slice<%d>.\n", failed->index());
+    return failed;
   }
 
-  fd_set fdread;
-  fd_set fdwrite;
-  fd_set fdexcep;
-  int maxfd = -1;
-  int still_running = 0;
+  if (retry_wait_time_ >= 0 || slice_manager_->getSlice(Slice::DOWNLOADING))
+    return nullptr;
 
-  CURLMcode mcode = curl_multi_perform(multi_, &still_running);
-  OutputVerbose(options_->verbose_functor, u8"Start downloading.\n");
+  // only one slice that end_ is -1, so don't need loop
+  slice = slice_manager_->getSlice(Slice::CURL_OK_BUT_COMPLETED_NOT_SURE);
+  if (slice) {
+    if (slice_manager_->originFileSize() == -1 || slice_manager_->isAllSliceCompletedClearly(false) == SUCCESSED) {
+      slice->setStatus(Slice::DOWNLOAD_COMPLETED);
+      return nullptr;
+    }
+    OutputVerbose(options_->verbose_functor, u8"Re-download slice<%d>.\n", slice->index());
+  }
+  return slice;
+}
 
-  TimeMeter flush_time_meter;
+std::shared_ptr<Slice> EntryHandler::selectSlowSlice() {
+  // The hedged request begins in the middle of slice, the server must be known to send ranges.
+  if (!options_->hedge_enabled || !speed_handler_ || !slice_manager_->isRangeConfirmed())
+    return nullptr;
+
+  // The slices at the end of download may all be slow, so the slices completed lately are compared with too.
+  std::vector<std::shared_ptr<Slice>> slices;
+  std::vector<int64_t> speeds;
+  std::vector<int64_t> others_base(completed_slice_speeds_.begin(), completed_slice_speeds_.end());
+  for (const auto& s : slice_manager_->getSlices(Slice::DOWNLOADING)) {
+    const int64_t speed = speed_handler_->sliceSpeed(s->index());
+    if (speed < 0 || s->elapsedSinceStart() < ZOE_HEDGE_MIN_ELAPSED_MS)
+      continue;
+    slices.push_back(s);
+    speeds.push_back(speed);
+  }
 
-  do {
-    if (user_paused_.load()) {
-      while (true) {
-        if (options_->internal_stop_event.wait(50))
-          break;
+  std::shared_ptr<Slice> slowest;
+  int64_t max_remaining_time = ZOE_HEDGE_MIN_REMAINING_TIME_MS;
+  for (size_t i = 0; i < slices.size(); i++) {
+    const std::shared_ptr<Slice>& s = slices[i];
+    const int64_t remaining = s->remainingSize();
+    if (s->isHedged() || s->hedgedTimes() >= ZOE_SLICE_MAX_HEDGED_TIMES || remaining <= 0)
+      continue;
+
+    std::vector<int64_t> others = others_base;
+    for (size_t j = 0; j < speeds.size(); j++) {
+      if (j != i)
+        others.push_back(speeds[j]);
+    }
+    if (others.empty())
+      break;
 
-        if (options_->user_stop_event && options_->user_stop_event->isSetted())
-          break;
+    std::nth_element(others.begin(), others.begin() + others.size() / 2, others.end());
+    const int64_t median = others[others.size() / 2];
+    if (speeds[i] * 100 >= median * options_->hedge_slow_percent)
+      continue;
 
-        if (!user_paused_.load())
-          break;
-      }
+    // The slice that would complete soon is not worth another connection.
+    const int64_t remaining_time = remaining * 1000 / std::max(speeds[i], (int64_t)1L);
+    if (remaining_time > max_remaining_time) {
+      max_remaining_time = remaining_time;
+      slowest = s;
     }
+  }
+  return slowest;
+}
+
+bool EntryHandler::hedgeSlowSlice(void* multi) {
+  std::shared_ptr<Slice> slice = selectSlowSlice();
+  if (!slice)
+    return false;
+
+  // The hedged request prefers another server.
+  utf8string url = slice->url();
+  std::shared_ptr<struct curl_slist> connect_to;
+  if (source_manager_ && source_manager_->sourceNum() > 1) {
+    const int32_t source = source_manager_->select(slice->source());
+    url = source_manager_->url(source);
+    connect_to = source_manager_->connectTo(source);
+  }
+
+  std::shared_ptr<BudgetTicket> ticket;
+  if (!AcquireBudgetTicket(url, ticket)) {
+    transfer_throttled_ = true;
+    return false;
+  }
+
+  const Result ret = slice->startHedge(multi, url, connect_to, ticket);
+  if (ret != SUCCESSED) {
+    OutputVerbose(options_->verbose_functor, u8"Slice<%d> start hedged request failed: %s.\n", slice->index(), GetResultString(ret));
+    return false;
+  }
+
+  active_slice_num_++;
+  loop_->bindHandle(slice->hedgeCurlHandle(), this);
+  metrics_->addHedge();
+  OutputVerbose(options_->verbose_functor, u8"Slice<%d> is slow, start hedged request: %s.\n", slice->index(), url.c_str());
+  return true;
+}
+
+bool EntryHandler::onHedgedTransferDone(std::shared_ptr<Slice> slice, void* easy, CURLcode result) {
+  const bool hedge_done = (easy == slice->hedgeCurlHandle());
+  if (slice->isDataCompletedClearly()) {
+    // The other transfer lost, the slice completes with the transfer done.
+    void* loser = hedge_done ? slice->curlHandle() : slice->hedgeCurlHandle();
+    loop_->unbindHandle(loser);
+    assert(active_slice_num_ > 0);
+    active_slice_num_--;
+    releaseTransfer();
+
+    if (hedge_done)
+      metrics_->addHedgeWon();
+    OutputVerbose(options_->verbose_functor, u8"Slice<%d> is completed by %s request.\n",
+                  slice->index(), hedge_done ? u8"hedged" : u8"original");
+    slice->stopHedge(loop_->multi(), hedge_done);
+    return false;
+  }
+
+  OutputVerbose(options_->verbose_functor, u8"Slice<%d> %s request ended %ld(%s), the other one goes on.\n",
+                slice->index(), hedge_done ? u8"hedged" : u8"original", (long)result, curl_easy_strerror(result));
+  metrics_->onSliceTransferDone(slice->index(), easy, slice->downloadedSize(), slice->failedTimes());
+  slice->stopHedge(loop_->multi(), !hedge_done);
+  return true;
+}
+
+void EntryHandler::onSliceFailed(std::shared_ptr<Slice> slice) {
+  slice->increaseFailedTimes();
+  if (options_->retry_base_delay <= 0)
+    return;
+
+  int64_t delay = options_->retry_base_delay;
+  for (int32_t i = 1; i < slice->failedTimes() && delay < options_->retry_max_delay; i++)
+    delay *= 2;
+  delay = std::min(delay, (int64_t)options_->retry_max_delay);
+
+  // Up to half of the delay is random, so that the slices failed together are not retried at the same time.
+  std::uniform_int_distribution<int64_t> jitter(0L, delay / 2);
+  slice->setRetryDelay((long)(delay - jitter(random_)));
+}
+
+bool EntryHandler::onLoopIteration(void* multi) {
+  if (isStopped())
+    return false;
+
+  if (!transfer_started_) {
+    transfer_started_ = true;
+    transfer_time_meter_.Restart();
+    checkpoint_time_meter_.Restart();
+    checkpoint_downloaded_ = slice_manager_->totalDownloaded();
+    slice_completed_ = false;
+    transfer_result_ = startInitialSlices(multi);
+    if (transfer_result_ != SUCCESSED)
+      return false;
+  }
+
+  if (progress_handler_)
+    progress_handler_->tick();
+
+  // The slices are compared for hedging when their speeds are sampled.
+  const bool speed_sampled = speed_handler_ && speed_handler_->tick();
+  if (speed_sampled) {
+    std::lock_guard<std::mutex> lg(stats_mutex_);
+    stats_ = speed_handler_->stats();
+  }
+
+  // The slices of a preempted task are paused too, so that the received data is kept.
+  const bool preempted = engine_ && engine_->isPreempted(this);
+  if (preempted != preempted_) {
+    OutputVerbose(options_->verbose_functor, preempted ? u8"Preempted by higher priority task.\n"
+                                                       : u8"Resumed from preemption.\n");
+    preempted_ = preempted;
+  }
+
+  // Other tasks on the same multi handle keep transferring, so pause the slices rather than stop performing.
+  const bool paused = user_paused_.load() || preempted;
+  if (paused != slices_paused_) {
+    slice_manager_->pauseAllSlices(paused);
+    slices_paused_ = paused;
+    slices_released_ = false;
+    pause_time_meter_.Restart();
+
+    if (concurrency_controller_)
+      concurrency_controller_->reset();
+  }
+
+  if (paused) {
+    if (pauseReleaseRemainingTime() == 0)
+      releasePausedSlices(multi);
+    return true;
+  }
+
+  slice_manager_->resumeWritePausedSlices();
+  slice_manager_->resumeBandwidthPausedSlices();
+
+  if (isCheckpointDue())
+    checkpoint();
 
-    if (options_->internal_stop_event.isSetted() || (options_->user_stop_event && options_->user_stop_event->isSetted()))
+  if (concurrency_controller_)
+    concurrency_controller_->tick(active_slice_num_);
+
+  transfer_throttled_ = false;
+  retry_wait_time_ = -1L;
+  while (active_slice_num_ < concurrencyNum()) {
+    if (!acquireTransfer())
       break;
 
-    if (flush_time_meter.Elapsed() >= 10000) {  // 10s
-      slice_manager_->flushAllSlices();
-      slice_manager_->flushIndexFile();
-      flush_time_meter.Restart();
+    std::shared_ptr<Slice> slice = selectNextSlice();
+
+    // A slow slice is hedged rather than split, so that none of its range is left on the slow connection.
+    if (!slice && speed_sampled && hedgeSlowSlice(multi))
+      continue;
+
+    // The split slice requests a range that has not been requested, the server must be known to send ranges.
+    if (!slice && options_->slice_split_enabled && slice_manager_->isRangeConfirmed() &&
+        (options_->unsliced_file_size <= 0 || slice_manager_->originFileSize() > options_->unsliced_file_size))
+      slice = slice_manager_->splitSlice(ZOE_MIN_SPLIT_SLICE_SIZE_BYTE);
+    if (!slice || !isInStreamWindow(slice)) {
+      releaseTransfer();
+      break;
     }
 
-    FD_ZERO(&fdread);
-    FD_ZERO(&fdwrite);
-    FD_ZERO(&fdexcep);
-    /*
-    If no file descriptors are set by libcurl, max_fd will contain -1 when this function returns. 
-    Otherwise it will contain the highest descriptor number libcurl set. 
-    When libcurl returns -1 in max_fd, it is because libcurl currently does something 
-    that isn't possible for your application to monitor with a socket and unfortunately 
-    you can then not know exactly when the current action is completed using select(). 
-    You then need to wait a while before you proceed and call curl_multi_perform anyway. 
-    How long to wait? Unless curl_multi_timeout gives you a lower number, we suggest 100 milliseconds or so, 
-    but you may want to test it out in your own particular conditions to find a suitable value.
-    */
-    mcode = curl_multi_fdset(multi_, &fdread, &fdwrite, &fdexcep, &maxfd);
-    if (mcode != CURLM_CALL_MULTI_PERFORM && mcode != CURLM_OK) {
-      OutputVerbose(options_->verbose_functor,
-                    u8"curl_multi_fdset failed, code: %ld(%s).\n", (long)mcode, curl_multi_strerror(mcode));
+    assignSource(slice);
+    if (!acquireBudget(slice)) {
+      releaseTransfer();
       break;
     }
 
-    if (maxfd == -1) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    slice->setStatus(Slice::FETCHED);
+    const Result start_ret = slice->start(multi);
+    if (start_ret != SUCCESSED) {
+      slice->setBudgetTicket(nullptr);
+      releaseTransfer();
+      OutputVerbose(options_->verbose_functor, u8"Slice<%d> start downloading failed: %s.\n", slice->index(), GetResultString(start_ret));
+      onSliceFailed(slice);
+      continue;
+    }
+
+    onSliceStarted(slice);
+    OutputVerbose(options_->verbose_functor, u8"Slice<%d> start downloading.\n", slice->index());
+  }
+
+  return active_slice_num_ > 0 || transfer_throttled_ || retry_wait_time_ >= 0;
+}
+
+int32_t EntryHandler::maxPollTimeout() const {
+  // Wake up in time to report even if no data is received.
+  int32_t timeout = -1;
+  if (progress_handler_)
+    timeout = progress_handler_->remainingTime();
+  if (speed_handler_ && (timeout < 0 || speed_handler_->remainingTime() < timeout))
+    timeout = speed_handler_->remainingTime();
+
+  // The paused slices are resumed by loop iterations when the budget is available.
+  const bool waiting_budget = transfer_throttled_ || (slice_manager_ && slice_manager_->hasBandwidthPausedSlices());
+  if (waiting_budget && (timeout < 0 || ZOE_BUDGET_POLL_INTERVAL_MS < timeout))
+    timeout = ZOE_BUDGET_POLL_INTERVAL_MS;
+
+  // Wake up to retry the failed slice when its delay elapsed.
+  if (retry_wait_time_ >= 0 && (timeout < 0 || retry_wait_time_ < timeout))
+    timeout = (int32_t)retry_wait_time_;
+
+  const long release_time = pauseReleaseRemainingTime();
+  if (release_time >= 0 && (timeout < 0 || release_time < timeout))
+    timeout = (int32_t)release_time;
+  return timeout;
+}
+
+void EntryHandler::releasePausedSlices(void* multi) {
+  slices_released_ = true;
+
+  int32_t released_num = 0;
+  for (const auto& slice : slice_manager_->getSlices(Slice::DOWNLOADING)) {
+    // The slice of unknown size can't be requested from where it stopped.
+    if (slice->end() == -1 || !slice->curlHandle())
+      continue;
+
+    const int32_t transfer_num = slice->isHedged() ? 2 : 1;
+    loop_->unbindHandle(slice->curlHandle());
+    if (slice->hedgeCurlHandle())
+      loop_->unbindHandle(slice->hedgeCurlHandle());
+
+    if (source_manager_)
+      source_manager_->onTransferDone(slice->source(), 0L, 0L, false);
+
+    const Result ret = slice->release(multi);
+    if (ret != SUCCESSED) {
+      OutputVerbose(options_->verbose_functor, u8"Slice<%d> release failed: %s.\n", slice->index(), GetResultString(ret));
+      onSliceFailed(slice);
+    }
+
+    for (int32_t i = 0; i < transfer_num; i++) {
+      assert(active_slice_num_ > 0);
+      active_slice_num_--;
+      releaseTransfer();
+    }
+    released_num++;
+  }
+
+  if (released_num > 0) {
+    OutputVerbose(options_->verbose_functor, u8"Paused for %ld ms, %d slices are released.\n",
+                  pause_time_meter_.Elapsed(), released_num);
+  }
+}
+
+long EntryHandler::pauseReleaseRemainingTime() const {
+  if (!slices_paused_ || slices_released_ || options_->pause_keep_alive_time < 0)
+    return -1L;
+  return std::max((long)options_->pause_keep_alive_time - pause_time_meter_.Elapsed(), 0L);
+}
+
+bool EntryHandler::isCheckpointDue() const {
+  switch (options_->checkpoint_policy) {
+    case CHECKPOINT_BY_BYTES:
+      return slice_manager_->totalDownloaded() - checkpoint_downloaded_ >= options_->checkpoint_policy_value;
+    case CHECKPOINT_ON_SLICE_COMPLETED:
+      return slice_completed_;
+    default:
+      return checkpoint_time_meter_.Elapsed() >= options_->checkpoint_policy_value;
+  }
+}
+
+void EntryHandler::checkpoint() {
+  slice_manager_->checkpoint();
+  checkpoint_time_meter_.Restart();
+  checkpoint_downloaded_ = slice_manager_->totalDownloaded();
+  slice_completed_ = false;
+}
+
+void EntryHandler::onTransferDone(void* easy, CURLcode result) {
+  const std::shared_ptr<Slice> slice = slice_manager_->getSlice(easy);
+  assert(slice);
+  if (!slice)
+    return;
+
+  assert(active_slice_num_ > 0);
+  active_slice_num_--;
+  releaseTransfer();
+
+  if (slice->isHedged() && onHedgedTransferDone(slice, easy, result))
+    return;
+
+  // A split slice is aborted by write callback when its data is completed, so check data size first.
+  // The data from peers must match their chunk hashes, otherwise the slice fails and is downloaded from another source.
+  if (slice->isDataCompletedClearly() && verifyPeerData(slice)) {
+    slice->setStatus(Slice::DOWNLOAD_COMPLETED);
+    slice_completed_ = true;
+
+    if (slice->elapsedSinceStart() > 0) {
+      completed_slice_speeds_.push_back(slice->downloadedSinceStart() * 1000 / slice->elapsedSinceStart());
+      if (completed_slice_speeds_.size() > ZOE_HEDGE_SPEED_HISTORY_NUM)
+        completed_slice_speeds_.pop_front();
+    }
+
+    if (slice_sizer_)
+      slice_sizer_->onSliceCompleted(slice->downloadedSinceStart(), slice->elapsedSinceStart());
+  }
+  else if (result == CURLE_OK) {
+    if (slice->end() == -1) {
+      slice->setStatus(Slice::CURL_OK_BUT_COMPLETED_NOT_SURE);
     }
     else {
-      /*
-      The select function returns the total number of socket handles that are ready and contained in the fd_set structures, 
-      zero if the time limit expired, or SOCKET_ERROR if an error occurred. 
-      If the return value is SOCKET_ERROR, WSAGetLastError can be used to retrieve a specific error code.
-      */
-      const int rc = select(maxfd + 1, &fdread, &fdwrite, &fdexcep, &select_timeout);
-      if (rc == -1) {  // SOCKET_ERROR
-        std::this_thread::sleep_for(std::chrono::milliseconds(50));
-      }
+      slice->setStatus(Slice::DOWNLOAD_FAILED);
+      onSliceFailed(slice);
     }
+  }
+  else {
+    OutputVerbose(options_->verbose_functor,
+                  u8"Slice<%d> download failed %ld(%s).\n",
+                  slice->index(), result,
+                  curl_easy_strerror(result));
 
-    curl_multi_perform(multi_, &still_running);
-
-    if (still_running < options_->thread_num) {
-      updateSliceStatus();
-
-      // Get a slice that not be fetched(of cause not completed).
-      std::shared_ptr<Slice> slice = slice_manager_->getSlice(Slice::UNFETCH);
-      if (!slice) {
-        // Try to download the slice that is failed previous again.
-        slice = slice_manager_->getSlice(Slice::DOWNLOAD_FAILED);
-        if (slice) {
-          if (slice->failedTimes() >= options_->slice_max_failed_times)
-            slice.reset();
-          else
-            OutputVerbose(options_->verbose_functor, u8"Re-download slice<%d>.\n", slice->index());
-        }
-        else {
-          if (!slice_manager_->getSlice(Slice::DOWNLOADING)) {
-            // only one slice that end_ is -1, so don't need loop
-            slice = slice_manager_->getSlice(Slice::CURL_OK_BUT_COMPLETED_NOT_SURE);
-            if (slice) {
-              if (slice_manager_->originFileSize() == -1 || slice_manager_->isAllSliceCompletedClearly(false) == SUCCESSED) {
-                slice->setStatus(Slice::DOWNLOAD_COMPLETED);
-                slice.reset();
-              }
-              else {
-                OutputVerbose(options_->verbose_functor, u8"Re-download slice<%d>.\n", slice->index());
-              }
-            }
-          }
-        }
+    slice->setStatus(Slice::DOWNLOAD_FAILED);
+    onSliceFailed(slice);
+  }
+
+  if (source_manager_) {
+    source_manager_->onTransferDone(slice->source(), slice->downloadedSinceStart(), slice->elapsedSinceStart(),
+                                    slice->status() == Slice::DOWNLOAD_FAILED);
+  }
+
+  // the easy handle is released by stop.
+  metrics_->onSliceTransferDone(slice->index(), easy, slice->downloadedSize(), slice->failedTimes());
+  slice->stop(loop_->multi());
+
+  // Nothing refers to a completed slice anymore, only its record in slice table is kept.
+  slice_manager_->releaseSlice(slice);
+}
+
+void EntryHandler::onLoopDetach(void* multi) {
+  OutputVerbose(options_->verbose_functor, u8"Downloading end.\n");
+  if (transfer_started_)
+    metrics_->addTransferTime(transfer_time_meter_.Elapsed());
+
+  // easy handles must be removed on loop thread.
+  stop_slices_result_ = slice_manager_->stopAllSlices(multi);
+  for (; active_slice_num_ > 0; active_slice_num_--)
+    releaseTransfer();
+  transfer_throttled_ = false;
+  preempted_ = false;
+  state_.store(DownloadState::STOPPED);
+
+  if (engine_) {
+    engine_->removeTask(this);
+    engine_->postWork([this]() {
+      const Result finish_ret = finishDownload();
+      if (finish_ret == HASH_VERIFY_NOT_PASS && repairCorruptedChunks()) {
+        std::lock_guard<std::mutex> lg(loop_mutex_);
+        engine_->addTask(this, options_->priority, options_->priority_weight);
+        loop_->attachTask(this);
+        return;
       }
 
-      if (slice) {
-        slice->setStatus(Slice::FETCHED);
-        disk_cache_per_slice = 0L;
-        max_speed_per_slice = 0L;
-        calculateSliceInfo(still_running + 1, &disk_cache_per_slice, &max_speed_per_slice);
-
-        const Result start_ret = slice->start(multi_, disk_cache_per_slice, max_speed_per_slice);
-        if (still_running <= 0) {
-          if (start_ret == SUCCESSED) {
-            curl_multi_perform(multi_, &still_running);
-            OutputVerbose(options_->verbose_functor, u8"Slice<%d> start downloading.\n", slice->index());
-          }
-          else {
-            still_running = 1;
-            OutputVerbose(options_->verbose_functor, u8"Slice<%d> start downloading failed: %s.\n", slice->index(), GetResultString(start_ret));
-          }
-        }
+      setLoop(nullptr);
+      const Result ret = completeTask(finish_ret);
+      std::shared_ptr<std::promise<Result>> result_promise = result_promise_;
+      result_promise->set_value(ret);
+    });
+  }
+}
+
+void EntryHandler::assignSource(std::shared_ptr<Slice> slice) {
+  if (!source_manager_ || source_manager_->sourceNum() <= 1)
+    return;
+
+  const int32_t failed_source = slice->failedTimes() > 0 ? slice->source() : -1;
+  if (assignPeer(slice, failed_source))
+    return;
+
+  const int32_t source = source_manager_->select(failed_source);
+  if (failed_source != -1 && source != failed_source) {
+    OutputVerbose(options_->verbose_functor, u8"Slice<%d> is moved to source %d: %s %s.\n",
+                  slice->index(), source, source_manager_->url(source).c_str(), source_manager_->address(source).c_str());
+  }
+  slice->setSource(source, source_manager_->url(source), source_manager_->connectTo(source));
+}
+
+bool EntryHandler::isPeerModeEnabled() const {
+  return options_->peer_listen_port > 0 || !options_->peer_urls.empty();
+}
+
+void EntryHandler::startPeerMode(const FileInfo& fileInfo) {
+  peer_key_ = PeerFileKey(options_->url, fileInfo.fileSize, fileInfo.etag, fileInfo.lastModified);
+
+  if (options_->peer_listen_port > 0) {
+    if (StartPeerServer(options_->peer_listen_port)) {
+      slice_manager_->setPeerKey(peer_key_);
+      OutputVerbose(options_->verbose_functor, u8"Share to peers on port %d, key: %s.\n", options_->peer_listen_port, peer_key_.c_str());
+    }
+    else {
+      OutputVerbose(options_->verbose_functor, u8"Listen on port %d for peers failed, or another port is listened by the process.\n", options_->peer_listen_port);
+    }
+  }
+
+  // The peers are in LAN, the proxy may not reach them.
+  if (options_->peer_urls.empty() || !options_->proxy.empty() || !source_manager_)
+    return;
+
+  peer_tracker_ = std::make_shared<PeerTracker>(options_->peer_urls, peer_key_, fileInfo.fileSize, options_->verbose_functor);
+  for (size_t i = 0; i < peer_tracker_->peerNum(); i++) {
+    const int32_t source = source_manager_->addPeer(peer_tracker_->url(i));
+    peer_sources_.push_back(source);
+    OutputVerbose(options_->verbose_functor, u8"Source %d: peer %s.\n", source, peer_tracker_->url(i).c_str());
+  }
+  peer_tracker_->start();
+}
+
+bool EntryHandler::assignPeer(std::shared_ptr<Slice> slice, int32_t failed_source) {
+  if (!peer_tracker_ || slice->end() == -1L)
+    return false;
+
+  std::vector<int32_t> peers;
+  std::vector<std::vector<uint32_t>> peers_chunks;
+  auto find_peers = [&]() {
+    for (size_t i = 0; i < peer_sources_.size(); i++) {
+      std::vector<uint32_t> chunks;
+      if (peer_sources_[i] != failed_source && peer_tracker_->find(i, slice->begin(), slice->end(), chunks)) {
+        peers.push_back(peer_sources_[i]);
+        peers_chunks.push_back(chunks);
       }
     }
-  } while (still_running > 0 || user_paused_.load());
+  };
+  find_peers();
+
+  // The peers downloading the file at the same time only have the beginning of the slice, the rest is cut into another slice.
+  if (peers.empty() && slice->status() == Slice::UNFETCH && slice->capacity() == 0) {
+    int64_t shared_end = -1L;
+    for (size_t i = 0; i < peer_sources_.size(); i++) {
+      if (peer_sources_[i] != failed_source)
+        shared_end = std::max(shared_end, peer_tracker_->sharedEnd(i, slice->begin()));
+    }
+    if (shared_end >= slice->begin() && shared_end < slice->end() && slice_manager_->cutSlice(slice, shared_end + 1 - slice->begin()))
+      find_peers();
+  }
 
-  OutputVerbose(options_->verbose_functor, u8"Downloading end.\n");
+  const int32_t source = source_manager_->selectPeer(peers);
+  if (source == -1)
+    return false;
 
-  Result ret = slice_manager_->finishDownloadProgress(true, multi_);
+  PeerChunks& expected = peer_chunks_[slice->index()];
+  expected.source = source;
+  expected.chunks = peers_chunks[std::find(peers.begin(), peers.end(), source) - peers.begin()];
+  slice->setSource(source, source_manager_->url(source), nullptr);
+  OutputVerbose(options_->verbose_functor, u8"Slice<%d> is fetched from peer: %s.\n", slice->index(), source_manager_->url(source).c_str());
+  return true;
+}
 
-  if (multi_) {
-    curl_multi_cleanup(multi_);
-    multi_ = nullptr;
+bool EntryHandler::verifyPeerData(std::shared_ptr<Slice> slice) {
+  auto it = peer_chunks_.find(slice->index());
+  if (it == peer_chunks_.end())
+    return true;
+
+  const PeerChunks expected = it->second;
+  peer_chunks_.erase(it);
+
+  // The hashes are calculated while receiving, so nothing is read back.
+  const std::vector<uint32_t> received = slice->receivedChunkHashes();
+  if (received.size() <= expected.chunks.size() && std::equal(received.begin(), received.end(), expected.chunks.begin())) {
+    if (source_manager_->isPeer(slice->source()))
+      metrics_->addPeerReceived(slice->downloadedSinceStart());
+    return true;
   }
 
-  state_.store(DownloadState::STOPPED);
+  OutputVerbose(options_->verbose_functor, u8"Slice<%d> doesn't match the chunk hashes of peer %s, the peer is not used anymore.\n",
+                slice->index(), source_manager_->url(expected.source).c_str());
+  source_manager_->disable(expected.source);
+  return false;
+}
+
+void EntryHandler::onSliceStarted(std::shared_ptr<Slice> slice) {
+  active_slice_num_++;
+  loop_->bindHandle(slice->curlHandle(), this);
+  if (source_manager_)
+    source_manager_->onTransferStarted(slice->source());
+
+  slice->setPaused(slices_paused_);
+}
+
+Result EntryHandler::finishDownload() {
+  if (transfer_result_ != SUCCESSED)
+    return transfer_result_;
+
+  TimeMeter finish_time_meter;
+  Result ret = slice_manager_->finishDownloadProgress(true, nullptr);
+  metrics_->addFinishTime(finish_time_meter.Elapsed());
+  if (ret == SUCCESSED && stop_slices_result_ != SUCCESSED)
+    ret = stop_slices_result_;
 
   if (ret == SUCCESSED) {
     OutputVerbose(options_->verbose_functor, u8"All success!\n");
     return ret;
   }
 
-  if (user_stopped_.load() ||
-      (options_->user_stop_event && options_->user_stop_event->isSetted()))
+  if (isStopped())
     ret = CANCELED;  // user cancel, ignore other failed reason
 
   return ret;
 }
 
+bool EntryHandler::repairCorruptedChunks() {
+  // the corrupted data has been delivered to stream functor or decompressed.
+  if (!options_->chunk_hash_enabled || slice_manager_->isStreamOutputEnabled() || chunks_repaired_ || isStopped())
+    return false;
+
+  chunks_repaired_ = true;
+  if (slice_manager_->repairCorruptedChunks() == 0)
+    return false;
+
+  transfer_started_ = false;
+  transfer_result_ = SUCCESSED;
+  stop_slices_result_ = SUCCESSED;
+  state_.store(DownloadState::DOWNLODING);
+  return true;
+}
+
+int32_t EntryHandler::concurrencyNum() const {
+  const int32_t num = concurrency_controller_ ? concurrency_controller_->concurrency() : options_->thread_num;
+  return max_transfer_num_ > 0 ? std::min(num, max_transfer_num_) : num;
+}
+
+bool EntryHandler::acquireTransfer() {
+  if (!engine_ || engine_->acquireTransfer(this))
+    return true;
+  transfer_throttled_ = true;
+  return false;
+}
+
+void EntryHandler::releaseTransfer() {
+  if (engine_)
+    engine_->releaseTransfer(this);
+}
+
+bool EntryHandler::isInStreamWindow(std::shared_ptr<Slice> slice) {
+  const int64_t window_end = slice_manager_->streamWindowEnd();
+  if (window_end < 0 || slice->begin() < window_end)
+    return true;
+
+  // The data can't be delivered any further, let the download end with the failed slice.
+  std::shared_ptr<Slice> failed = slice_manager_->getSlice(Slice::DOWNLOAD_FAILED);
+  if (failed && failed->failedTimes() >= options_->slice_max_failed_times)
+    return false;
+
+  // The slices will be started in loop iterations when the data is delivered.
+  transfer_throttled_ = true;
+  return false;
+}
+
+bool EntryHandler::acquireBudget(std::shared_ptr<Slice> slice) {
+  std::shared_ptr<BudgetTicket> ticket;
+  if (!AcquireBudgetTicket(slice->url(), ticket)) {
+    transfer_throttled_ = true;
+    return false;
+  }
+  slice->setBudgetTicket(ticket);
+  return true;
+}
+
+void EntryHandler::applyMultiOptions(void* multi) {
+  if (options_->max_host_connections > 0)
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)options_->max_host_connections);
+#if LIBCURL_VERSION_NUM >= 0x074300  // 7.67.0
+  if (IsMultiplexedHttpVersion(options_->http_version))
+    curl_multi_setopt(multi, CURLMOPT_MAX_CONCURRENT_STREAMS, (long)ZOE_MAX_STREAMS_PER_CONNECTION);
+#endif
+}
+
+bool EntryHandler::isStopped() const {
+  return user_stopped_.load() ||
+         options_->internal_stop_event.isSetted() ||
+         (options_->user_stop_event && options_->user_stop_event->isSetted());
+}
+
+void EntryHandler::setLoop(EventLoop* loop) {
+  std::lock_guard<std::mutex> lg(loop_mutex_);
+  loop_ = loop;
+}
+
+void EntryHandler::wakeup() {
+  std::lock_guard<std::mutex> lg(loop_mutex_);
+  if (loop_)
+    loop_->wakeup();
+}
+
 bool EntryHandler::fetchFileInfo(FileInfo& fileInfo) {
-  return requestFileInfo(options_->url, fileInfo);
+  std::vector<FileInfoRequest> requests(1 + options_->mirror_urls.size());
+  requests[0].url = options_->url;
+  for (size_t i = 0; i < options_->mirror_urls.size(); i++)
+    requests[i + 1].url = options_->mirror_urls[i];
+
+  for (size_t i = 0; i < requests.size(); i++) {
+    FileInfoRequest& request = requests[i];
+    // Only the data of url is kept for the first slice.
+    request.range_probe = (i == 0 && options_->range_probe_enabled);
+
+    int64_t age = 0L;
+    if (options_->file_info_cache_time >= 0 && LookupFileInfoCache(request.url, request.cached_info, age)) {
+      if (age < (int64_t)options_->file_info_cache_time * 1000L) {
+        OutputVerbose(options_->verbose_functor, u8"Use cached file info: %s.\n", request.url.c_str());
+        request.info = request.cached_info;
+        request.done = true;
+        request.succeeded = true;
+        continue;
+      }
+      request.cached = request.cached_info.etag.length() > 0 || request.cached_info.lastModified.length() > 0;
+    }
+
+    // Revalidate the version in download cache, so that it can be used if not modified.
+    DownloadCacheEntry entry;
+    if (i == 0 && !request.cached && isDownloadCacheEnabled() &&
+        LookupDownloadCache(options_->download_cache_dir, DownloadCacheUrlKey(request.url), entry)) {
+      request.cached_info.clear();
+      request.cached_info.fileSize = entry.size;
+      request.cached_info.etag = entry.etag;
+      request.cached_info.lastModified = entry.last_modified;
+      request.cached = entry.etag.length() > 0 || entry.last_modified.length() > 0;
+    }
+
+    if (!setupFileInfoRequest(request))
+      request.done = true;
+  }
+
+  performFileInfoRequests(requests);
+
+  if (!requests[0].succeeded)
+    return false;
+  fileInfo = requests[0].info;
+
+  source_manager_ = std::make_shared<SourceManager>();
+  source_manager_->addSource(fileInfo.redirect_url.length() > 0 ? fileInfo.redirect_url : options_->url);
+
+  // Mirrors and addresses serve the slices by range.
+  if (!fileInfo.acceptRanges || fileInfo.fileSize <= 0) {
+    if (!options_->mirror_urls.empty())
+      OutputVerbose(options_->verbose_functor, u8"File size is unknown or range is not accepted, mirrors are not used.\n");
+    return true;
+  }
+
+  for (size_t i = 1; i < requests.size(); i++) {
+    const utf8string& mirror = requests[i].url;
+    const FileInfo& mirror_info = requests[i].info;
+    if (!requests[i].succeeded) {
+      OutputVerbose(options_->verbose_functor, u8"Fetch file info from mirror failed: %s.\n", mirror.c_str());
+      continue;
+    }
+
+    if (!isSameFile(fileInfo, mirror_info)) {
+      OutputVerbose(options_->verbose_functor,
+                    u8"Mirror is not the same file, size: %" PRId64 ", md5: %s, etag: %s, url: %s.\n",
+                    mirror_info.fileSize, mirror_info.contentMd5.c_str(), mirror_info.etag.c_str(), mirror.c_str());
+      continue;
+    }
+
+    const int32_t source = source_manager_->addSource(mirror_info.redirect_url.length() > 0 ? mirror_info.redirect_url : mirror);
+    OutputVerbose(options_->verbose_functor, u8"Source %d: %s.\n", source, mirror.c_str());
+  }
+
+  // The proxy resolves the hosts.
+  if (options_->max_address_num > 1 && options_->proxy.empty() && !isStopped())
+    source_manager_->spreadAddresses(options_->max_address_num, options_->verbose_functor);
+  return true;
 }
 
-bool EntryHandler::requestFileInfo(const utf8string& url, FileInfo& fileInfo) {
-  if (!options_)
+bool EntryHandler::isSameFile(const FileInfo& origin, const FileInfo& mirror) const {
+  if (mirror.fileSize != origin.fileSize || !mirror.acceptRanges)
     return false;
 
-  if (!fetch_file_info_curl_)
-    fetch_file_info_curl_ = std::make_shared<ScopedCurl>();
+  // Only compared when both servers send it.
+  if (origin.contentMd5.length() > 0 && mirror.contentMd5.length() > 0 &&
+      !StringHelper::IsEqual(origin.contentMd5, mirror.contentMd5, true))
+    return false;
+  if (origin.etag.length() > 0 && mirror.etag.length() > 0 && origin.etag != mirror.etag)
+    return false;
+  return true;
+}
 
-  CURL* curl = fetch_file_info_curl_->GetCurl();
+bool EntryHandler::setupFileInfoRequest(FileInfoRequest& request) {
+  if (!options_)
+    return false;
+
+  request.curl = std::make_shared<ScopedCurl>();
+  CURL* curl = request.curl->GetCurl();
+  if (!curl)
+    return false;
 
-  curl_easy_reset(curl);
+  ResetCurlHandle(curl);
   CHECK_SETOPT2(curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L));
   CHECK_SETOPT2(curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L));
-  CHECK_SETOPT2(curl_easy_setopt(curl, CURLOPT_URL, url.c_str()));
-  if (options_->use_head_method_fetch_file_info)
+  CHECK_SETOPT2(curl_easy_setopt(curl, CURLOPT_URL, request.url.c_str()));
+  CHECK_SETOPT2(curl_easy_setopt(curl, CURLOPT_PRIVATE, (void*)&request));
+  if (request.range_probe) {
+    const utf8string range = "0-" + std::to_string(ZOE_RANGE_PROBE_SIZE_BYTE - 1);
+    CHECK_SETOPT2(curl_easy_setopt(curl, CURLOPT_NOBODY, 0L));
+    CHECK_SETOPT2(curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str()));
+  }
+  else if (options_->use_head_method_fetch_file_info && !request.keep_body)
     CHECK_SETOPT2(curl_easy_setopt(curl, CURLOPT_NOBODY, 1L));
   else
     CHECK_SETOPT2(curl_easy_setopt(curl, CURLOPT_NOBODY, 0L));
 
   CHECK_SETOPT2(curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L));
+  if (options_->http_version != HTTP_VERSION_AUTO)
+    CHECK_SETOPT2(curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, GetCurlHttpVersion(options_->http_version)));
   CHECK_SETOPT2(curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, options_->verify_peer_host ? 2L : 0L));
   CHECK_SETOPT2(curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, options_->verify_peer_certificate ? 1L : 0L));
   CHECK_SETOPT2(curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, options_->network_conn_timeout));
@@ -484,35 +1336,107 @@ bool EntryHandler::requestFileInfo(const utf8string& url, FileInfo& fileInfo) {
 
   // avoid libcurl failed with "Failed writing body".
   CHECK_SETOPT2(curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, __WriteBodyCallback));
+  CHECK_SETOPT2(curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*)&request));
 
   CHECK_SETOPT2(curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, __WriteHeaderCallback));
-  CHECK_SETOPT2(curl_easy_setopt(curl, CURLOPT_HEADERDATA, (void*)&fileInfo));
+  CHECK_SETOPT2(curl_easy_setopt(curl, CURLOPT_HEADERDATA, (void*)&request));
 
   if (options_->proxy.length() > 0) {
     CHECK_SETOPT2(curl_easy_setopt(curl, CURLOPT_PROXY, options_->proxy.c_str()));
   }
 
-  struct curl_slist* headerChunk = nullptr;
   const HttpHeaders& headers = options_->http_headers;
-  if (headers.size() > 0) {
-    for (const auto& it : headers) {
-      utf8string headerStr = it.first + u8": " + it.second;
-      headerChunk = curl_slist_append(headerChunk, headerStr.c_str());
-    }
-    CHECK_SETOPT2(curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headerChunk));
+  for (const auto& it : headers) {
+    utf8string headerStr = it.first + u8": " + it.second;
+    request.header_chunk = curl_slist_append(request.header_chunk, headerStr.c_str());
+  }
+
+  // The server answers 304 if the cached info is still valid.
+  if (request.cached) {
+    utf8string headerStr = request.cached_info.etag.length() > 0
+                               ? u8"If-None-Match: " + request.cached_info.etag
+                               : u8"If-Modified-Since: " + request.cached_info.lastModified;
+    request.header_chunk = curl_slist_append(request.header_chunk, headerStr.c_str());
   }
 
-  CURLcode ret_code = curl_easy_perform(curl);
+  if (request.header_chunk)
+    CHECK_SETOPT2(curl_easy_setopt(curl, CURLOPT_HTTPHEADER, request.header_chunk));
+
+  return true;
+}
+
+void EntryHandler::performFileInfoRequests(std::vector<FileInfoRequest>& requests) {
+  CURLM* multi = curl_multi_init();
+  if (!multi) {
+    OutputVerbose(options_->verbose_functor, u8"curl_multi_init failed.\n");
+    return;
+  }
+
+  for (FileInfoRequest& request : requests) {
+    if (!request.done)
+      curl_multi_add_handle(multi, request.curl->GetCurl());
+  }
+
+  {
+    std::lock_guard<std::mutex> lg(fetch_file_info_mutex_);
+    fetch_file_info_multi_ = multi;
+  }
+
+  int still_running = 0;
+  do {
+    curl_multi_perform(multi, &still_running);
+
+    int msgs_left = 0;
+    CURLMsg* msg = nullptr;
+    while ((msg = curl_multi_info_read(multi, &msgs_left))) {
+      if (msg->msg != CURLMSG_DONE)
+        continue;
+
+      FileInfoRequest* request = nullptr;
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&request);
+      assert(request);
+      if (!request)
+        continue;
+
+      request->done = true;
+      request->succeeded = parseFileInfoResponse(*request, msg->data.result);
+    }
+
+    if (still_running == 0 || isStopped())
+      break;
+
+#if LIBCURL_VERSION_NUM >= 0x074400  // 7.68.0
+    curl_multi_poll(multi, nullptr, 0, ZOE_MULTI_POLL_TIMEOUT_MS, nullptr);
+#else
+    curl_multi_wait(multi, nullptr, 0, ZOE_MULTI_POLL_TIMEOUT_MS, nullptr);
+#endif
+  } while (true);
+
+  {
+    std::lock_guard<std::mutex> lg(fetch_file_info_mutex_);
+    fetch_file_info_multi_ = nullptr;
+  }
 
-  if (headerChunk) {
-    curl_slist_free_all(headerChunk);
-    headerChunk = nullptr;
+  for (FileInfoRequest& request : requests) {
+    if (request.curl)
+      curl_multi_remove_handle(multi, request.curl->GetCurl());
+    if (request.header_chunk) {
+      curl_slist_free_all(request.header_chunk);
+      request.header_chunk = nullptr;
+    }
+    request.curl.reset();
   }
+  curl_multi_cleanup(multi);
+}
+
+bool EntryHandler::parseFileInfoResponse(FileInfoRequest& request, CURLcode result) {
+  CURL* curl = request.curl->GetCurl();
+  FileInfo& fileInfo = request.info;
 
-  if (ret_code != CURLE_OK) {
+  if (result != CURLE_OK && !(result == CURLE_WRITE_ERROR && request.body_aborted)) {
     OutputVerbose(options_->verbose_functor,
-                  u8"curl_easy_perform failed, CURLcode: %ld(%s).\n",
-                  (long)ret_code, curl_easy_strerror(ret_code));
+                  u8"Fetch file info failed, CURLcode: %ld(%s), url: %s.\n",
+                  (long)result, curl_easy_strerror(result), request.url.c_str());
     return false;
   }
 
@@ -521,7 +1445,8 @@ bool EntryHandler::requestFileInfo(const utf8string& url, FileInfo& fileInfo) {
     fileInfo.redirect_url = redirect_url;
   }
 
-  int http_code = 0;
+  long http_code = 0;
+  CURLcode ret_code = CURLE_OK;
   if ((ret_code = curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code)) != CURLE_OK) {
     OutputVerbose(
         options_->verbose_functor,
@@ -530,89 +1455,159 @@ bool EntryHandler::requestFileInfo(const utf8string& url, FileInfo& fileInfo) {
     return false;
   }
 
-  if (http_code != 200 && http_code != 350) {
+  long http_version = CURL_HTTP_VERSION_NONE;
+  if (curl_easy_getinfo(curl, CURLINFO_HTTP_VERSION, &http_version) == CURLE_OK)
+    fileInfo.multiplexed = (http_version == CURL_HTTP_VERSION_2_0 || http_version == CURL_HTTP_VERSION_3);
+
+  if (http_code == 304 && request.cached) {
+    OutputVerbose(options_->verbose_functor, u8"Cached file info is not modified: %s.\n", request.url.c_str());
+    fileInfo = request.cached_info;
+    if (options_->file_info_cache_time >= 0)
+      UpdateFileInfoCache(request.url, fileInfo);
+    return true;
+  }
+
+  if (http_code == 206 && request.range_total >= 0) {
+    fileInfo.fileSize = request.range_total;
+    fileInfo.acceptRanges = true;
+    fileInfo.rangeConfirmed = true;
+  }
+  else if (http_code == 416 && request.range_total == 0) {
+    // The range of an empty file is never satisfiable.
+    fileInfo.fileSize = 0L;
+    fileInfo.prefetched.clear();
+  }
+  else if (http_code == 200 || http_code == 350) {
     // A 350 response code is sent by the server in response to a file-related command that
     // requires further commands in order for the operation to be completed
+    fileInfo.fileSize = request.content_length;
+    if (request.range_probe)
+      fileInfo.acceptRanges = false;
+  }
+  else {
     OutputVerbose(options_->verbose_functor,
                   u8"HTTP response code error, code: %ld.\n",
                   (long)http_code);
+    RemoveFileInfoCache(request.url);
     return false;
   }
 
+  if (options_->file_info_cache_time >= 0 && !request.keep_body)
+    UpdateFileInfoCache(request.url, fileInfo);
   return true;
 }
 
-void EntryHandler::cancelFetchFileInfo() {
-  CURL* curl = fetch_file_info_curl_->GetCurl();
-  if (curl) {
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, 1L);
-  }
+bool EntryHandler::isDeltaEnabled() const {
+  return options_->delta_old_file_path.length() > 0 && options_->delta_manifest_url.length() > 0;
 }
 
-void EntryHandler::calculateSliceInfo(int32_t concurrency_num,
-                                      int64_t* disk_cache_per_slice,
-                                      int64_t* max_speed_per_slice) const {
-  if (concurrency_num <= 0) {
-    if (disk_cache_per_slice) {
-      *disk_cache_per_slice = options_->disk_cache_size;
-    }
+void EntryHandler::applyDelta(const FileInfo& fileInfo) {
+  std::string data;
+  DeltaManifest manifest;
+  if (!fetchDeltaManifest(data) || !ParseDeltaManifest(data, manifest)) {
+    OutputVerbose(options_->verbose_functor, u8"Fetch delta manifest failed, download the whole file.\n");
+    return;
+  }
 
-    if (max_speed_per_slice) {
-      *max_speed_per_slice = options_->max_speed;
-    }
+  if (manifest.file_size != fileInfo.fileSize) {
+    OutputVerbose(options_->verbose_functor, u8"Delta manifest is not of the file, size: %" PRId64 ".\n", manifest.file_size);
+    return;
   }
-  else {
-    if (disk_cache_per_slice) {
-      *disk_cache_per_slice = (options_->disk_cache_size / concurrency_num);
-    }
 
-    if (max_speed_per_slice) {
-      *max_speed_per_slice =
-          (options_->max_speed == -1 ? -1 : (options_->max_speed / concurrency_num));
-    }
+  TimeMeter scan_time_meter;
+  std::vector<DeltaRun> runs;
+  const Result ret = MatchDeltaBlocks(options_->delta_old_file_path, manifest, 0, options_, runs);
+  const int64_t scan_time = scan_time_meter.Elapsed();
+  if (ret != SUCCESSED) {
+    OutputVerbose(options_->verbose_functor, u8"Scan old file failed: %s.\n", GetResultString(ret));
+    return;
   }
+
+  const int64_t copied = slice_manager_->applyDelta(options_->delta_old_file_path, runs);
+  metrics_->addDelta(copied, scan_time);
+  OutputVerbose(options_->verbose_functor,
+                u8"Delta: %" PRId64 " bytes in %d ranges are copied from old file, scan time: %" PRId64 " ms.\n",
+                copied, (int32_t)runs.size(), scan_time);
 }
 
-void EntryHandler::updateSliceStatus() {
-  struct CURLMsg* m = nullptr;
-  do {
-    int msg_in_queue = 0;
-    m = curl_multi_info_read(multi_, &msg_in_queue);
+bool EntryHandler::fetchDeltaManifest(std::string& data) {
+  std::vector<FileInfoRequest> requests(1);
+  requests[0].url = options_->delta_manifest_url;
+  requests[0].keep_body = true;
+  if (!setupFileInfoRequest(requests[0]))
+    return false;
 
-    if (m && m->msg == CURLMSG_DONE) {
-      const std::shared_ptr<Slice> slice = slice_manager_->getSlice(m->easy_handle);
-      assert(slice);
-      if (!slice)
-        continue;
+  performFileInfoRequests(requests);
+  if (!requests[0].succeeded)
+    return false;
 
-      if (m->data.result == CURLE_OK) {
-        if (slice->isDataCompletedClearly()) {
-          slice->setStatus(Slice::DOWNLOAD_COMPLETED);
-          slice->stop(multi_);
-        }
-        else {
-          if (slice->end() == -1) {
-            slice->setStatus(Slice::CURL_OK_BUT_COMPLETED_NOT_SURE);
-            slice->stop(multi_);
-          }
-          else {
-            slice->setStatus(Slice::DOWNLOAD_FAILED);
-            slice->increaseFailedTimes();
-            slice->stop(multi_);
-          }
-        }
-      }
-      else {
-        OutputVerbose(options_->verbose_functor,
-                      u8"Slice<%d> download failed %ld(%s).\n",
-                      slice->index(), m->data.result,
-                      curl_easy_strerror(m->data.result));
-
-        slice->setStatus(Slice::DOWNLOAD_FAILED);
-        slice->increaseFailedTimes();
-        slice->stop(multi_);
+  data.swap(requests[0].info.prefetched);
+  return true;
+}
+
+bool EntryHandler::isDownloadCacheEnabled() const {
+  // The file decompressed is not the file of url.
+  return options_->download_cache_dir.length() > 0 && !options_->memory_target_enabled &&
+         options_->decompress_codec == COMPRESSION_NONE;
+}
+
+bool EntryHandler::isSameVersion(const DownloadCacheEntry& entry, const FileInfo& fileInfo) const {
+  if (entry.size != fileInfo.fileSize)
+    return false;
+  if (entry.etag.length() > 0 || fileInfo.etag.length() > 0)
+    return entry.etag == fileInfo.etag;
+  return entry.last_modified.length() > 0 && entry.last_modified == fileInfo.lastModified;
+}
+
+bool EntryHandler::restoreFromDownloadCache(const utf8string& key) {
+  if (!RestoreDownloadCache(options_->download_cache_dir, key, options_->target_file_path, options_->download_cache_hardlink))
+    return false;
+
+  // The cached file may be corrupted on disk, it is checked as a downloaded one.
+  if (options_->hash_verify_policy == ALWAYS && options_->hash_value.length() > 0) {
+    utf8string str_hash;
+    const Result calc_ret = CalculateFileHashParallel(options_->target_file_path, options_->hash_type,
+                                                      options_->hash_verify_thread_num, options_, str_hash);
+    if (calc_ret != SUCCESSED || !StringHelper::IsEqual(str_hash, options_->hash_value, true)) {
+      FileUtil::RemoveFile(options_->target_file_path);
+      if (calc_ret != CANCELED) {
+        OutputVerbose(options_->verbose_functor, u8"Hash check of download cache not pass, evict: %s.\n", key.c_str());
+        RemoveDownloadCache(options_->download_cache_dir, key);
       }
+      return false;
     }
-  } while (m);
+  }
+
+  OutputVerbose(options_->verbose_functor, u8"Completed from download cache: %s.\n", key.c_str());
+  download_cache_hit_ = true;
+  metrics_->setDownloadCacheHit();
+  return true;
+}
+
+void EntryHandler::storeToDownloadCache() {
+  DownloadCacheEntry entry = download_cache_entry_;
+  entry.size = FileUtil::GetFileSize(options_->target_file_path);
+
+  // The hash has been verified if it is set with ALWAYS policy.
+  utf8string key;
+  if (options_->hash_verify_policy == ALWAYS && options_->hash_value.length() > 0)
+    key = DownloadCacheHashKey(options_->hash_type, options_->hash_value);
+  else if (entry.etag.length() > 0 || entry.last_modified.length() > 0)
+    key = DownloadCacheUrlKey(options_->url);
+  else
+    return;
+
+  if (StoreDownloadCache(options_->download_cache_dir, key, entry, options_->target_file_path,
+                         options_->download_cache_max_size, options_->download_cache_hardlink))
+    OutputVerbose(options_->verbose_functor, u8"Stored to download cache: %s.\n", key.c_str());
+}
+
+void EntryHandler::cancelFetchFileInfo() {
+  // Without curl_multi_wakeup, the requests are stopped within ZOE_MULTI_POLL_TIMEOUT_MS.
+#if LIBCURL_VERSION_NUM >= 0x074400  // 7.68.0
+  std::lock_guard<std::mutex> lg(fetch_file_info_mutex_);
+  if (fetch_file_info_multi_)
+    curl_multi_wakeup(fetch_file_info_multi_);
+#endif
 }
 }  // namespace zoe
\ No newline at end of file
@@ -20,38 +20,64 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
+#include <future>
+#include <random>
+#include <deque>
+#include <map>
 #include "slice_manager.h"
 #include "progress_handler.h"
 #include "speed_handler.h"
+#include "concurrency_controller.h"
+#include "slice_sizer.h"
+#include "source_manager.h"
+#include "peer_tracker.h"
+#include "file_info_cache.h"
+#include "download_cache.h"
 #include "options.h"
 #include "curl_utils.h"
+#include "engine.h"
+#include "time_meter.hpp"
 
 namespace zoe {
 
-class EntryHandler {
- public:
-  typedef struct _FileInfo {
-    bool acceptRanges;
-    int64_t fileSize;
-    utf8string contentMd5;
-    utf8string redirect_url;
-
-    void clear() {
-      acceptRanges = true;
-      fileSize = -1;
-      contentMd5.clear();
-      redirect_url.clear();
-    }
-    _FileInfo() {
-      acceptRanges = true;
-      fileSize = -1L;
-    }
-  } FileInfo;
+// A request of file info, the requests of url and mirrors are performed together.
+typedef struct _FileInfoRequest {
+  utf8string url;
+  FileInfo info;
+  std::shared_ptr<ScopedCurl> curl;
+  struct curl_slist* header_chunk;
+  bool range_probe;  // GET the beginning of file, the data received is kept in info.prefetched
+  bool keep_body;  // GET the whole file into info.prefetched, such as the manifest of delta update
+  bool body_aborted;  // the body is longer than requested, the server ignored the range
+  int64_t content_length;  // of the last response, -1 if unknown
+  int64_t range_total;  // file size in Content-Range of the last response, -1 if unknown
+
+  bool cached;  // cached_info is revalidated by the request
+  FileInfo cached_info;
+
+  bool done;
+  bool succeeded;
 
+  _FileInfoRequest()
+      : header_chunk(nullptr)
+      , range_probe(false)
+      , keep_body(false)
+      , body_aborted(false)
+      , content_length(-1L)
+      , range_total(-1L)
+      , cached(false)
+      , done(false)
+      , succeeded(false) {}
+} FileInfoRequest;
+
+class EntryHandler : public LoopTask {
+ public:
   EntryHandler();
   virtual ~EntryHandler();
 
-  std::shared_future<Result> start(Options* options);
+  // If engine is nullptr, the download runs on its own thread and multi handle.
+  std::shared_future<Result> start(Options* options, Engine::EngineImpl* engine);
   void pause();
   void resume();
   void stop();
@@ -61,34 +87,200 @@ class EntryHandler {
 
   DownloadState state() const;
 
+  // Thread safe, the last sample of speed handler.
+  DownloadStats stats() const;
+
+  // Thread safe.
+  DownloadMetrics metrics() const;
+
   std::shared_future<Result> futureResult();
+
+  // LoopTask
+  bool onLoopIteration(void* multi) override;
+  void onTransferDone(void* easy, CURLcode result) override;
+  void onLoopDetach(void* multi) override;
+  int32_t maxPollTimeout() const override;
+
  protected:
+  // Standalone mode, runs on the std::async thread.
   Result asyncTaskProcess();
-  Result _asyncTaskProcess();
 
+  // Engine mode, runs on worker thread.
+  void engineTaskProcess();
+
+  // Fetch file info and make slices, need_transfer is false if nothing to download.
+  Result prepareDownload(bool& need_transfer);
+  Result startInitialSlices(void* multi);
+  std::shared_ptr<Slice> selectNextSlice();
+
+  // The UNFETCH slice that has the lowest begin, it is cut to the size of slice sizer if any.
+  std::shared_ptr<Slice> unfetchedSlice();
+
+  // A downloading slice far slower than the median of the others, nullptr if none.
+  std::shared_ptr<Slice> selectSlowSlice();
+
+  // Start a hedged request for the slow slice on the transfer acquired, return false if no slice to hedge.
+  bool hedgeSlowSlice(void* multi);
+
+  // One transfer of a hedged slice is done, the slice goes on with the other one unless its data is completed.
+  // Return true if the slice is still downloading.
+  bool onHedgedTransferDone(std::shared_ptr<Slice> slice, void* easy, CURLcode result);
+
+  // Count the failure and delay the next retry of the slice with jittered exponential backoff.
+  void onSliceFailed(std::shared_ptr<Slice> slice);
+  // Select the source to download the slice from.
+  void assignSource(std::shared_ptr<Slice> slice);
+
+  // See Zoe::setPeerMode.
+  bool isPeerModeEnabled() const;
+
+  // Share the data to peers and add the peers to source manager.
+  void startPeerMode(const FileInfo& fileInfo);
+
+  // Assign the slice to a peer that shares its range, return false if none.
+  bool assignPeer(std::shared_ptr<Slice> slice, int32_t failed_source);
+
+  // Compare the chunks of the completed slice with the chunk hashes of the peer it was fetched from.
+  // If mismatched, the peer is not used anymore and return false, the slice fails so that its data is discarded.
+  bool verifyPeerData(std::shared_ptr<Slice> slice);
+  void onSliceStarted(std::shared_ptr<Slice> slice);
+  Result finishDownload();
+
+  // Called when hash verify not pass, return true if the corrupted chunks need to be downloaded again.
+  bool repairCorruptedChunks();
+  Result completeTask(Result ret);
+  bool isStopped() const;
+
+  // Number of slices that are allowed to transfer at the same time.
+  int32_t concurrencyNum() const;
+
+  // The slices of all tasks on engine share the transfer limit of engine, always succeed in standalone mode.
+  bool acquireTransfer();
+  void releaseTransfer();
+
+  // Whether the slice begins in the read ahead window of stream output, the slice waits if not.
+  bool isInStreamWindow(std::shared_ptr<Slice> slice);
+
+  // The connection budget of process and host of the slice, see transfer_budget.h.
+  bool acquireBudget(std::shared_ptr<Slice> slice);
+
+  // Limit the connections to each server, only for the multi handle owned by this task.
+  void applyMultiOptions(void* multi);
+
+  // Stop the transfers of paused slices and close their connections, the data received is kept.
+  // Called when paused longer than Options::pause_keep_alive_time, so that servers don't time the connections out.
+  void releasePausedSlices(void* multi);
+
+  // ms until the transfers of paused slices are released, -1 if not paused or released.
+  long pauseReleaseRemainingTime() const;
+
+  // Whether the progress should be saved according to checkpoint policy.
+  bool isCheckpointDue() const;
+  void checkpoint();
+
+  // Fetch the file info from url and mirrors at the same time, then add the mirrors that have the same file to source manager.
+  // The info is taken from the cache of process if it is fresh, see file_info_cache.h.
   bool fetchFileInfo(FileInfo& fileInfo);
-  bool requestFileInfo(const utf8string& url, FileInfo& fileInfo);
+  bool isSameFile(const FileInfo& origin, const FileInfo& mirror) const;
   void cancelFetchFileInfo();
-  void calculateSliceInfo(int32_t concurrency_num,
-                          int64_t* disk_cache_per_slice,
-                          int64_t* max_speed_per_slice) const;
-  void updateSliceStatus();
+
+  // Set the options of the request of file info, range_probe requests the beginning of file rather than HEAD.
+  // The cached info is revalidated by the request if it has any validator.
+  bool setupFileInfoRequest(FileInfoRequest& request);
+
+  // Perform the requests together, return when all of them are done or the download is stopped.
+  void performFileInfoRequests(std::vector<FileInfoRequest>& requests);
+
+  // Read the file info from the response of the request that is done, return false if it failed.
+  bool parseFileInfoResponse(FileInfoRequest& request, CURLcode result);
+
+  // See Zoe::setDeltaSource.
+  bool isDeltaEnabled() const;
+
+  // Fetch the manifest of delta update, search its blocks in the old file and copy the blocks found into target file.
+  // Called after the slices are made, the whole file is downloaded if anything fails.
+  void applyDelta(const FileInfo& fileInfo);
+  bool fetchDeltaManifest(std::string& data);
+
+  // See Zoe::setDownloadCache.
+  bool isDownloadCacheEnabled() const;
+  bool isSameVersion(const DownloadCacheEntry& entry, const FileInfo& fileInfo) const;
+
+  // Complete the download by copying the cache entry of key to target file, return false if not cached.
+  // With ALWAYS hash verify policy, the entry that does not match the hash is evicted and false is returned.
+  bool restoreFromDownloadCache(const utf8string& key);
+
+  // Add the downloaded file to download cache, keyed by the hash if it is verified,
+  // or by url if the server sent ETag or Last-Modified.
+  void storeToDownloadCache();
+
+  void setLoop(EventLoop* loop);
+
+  // Interrupt curl_multi_poll of the loop, thread safe.
+  void wakeup();
 
  protected:
   std::shared_future<Result> async_task_;
+  std::shared_ptr<std::promise<Result>> result_promise_;
   Options* options_;
+  Engine::EngineImpl* engine_;
   std::shared_ptr<SliceManager> slice_manager_;
   std::shared_ptr<ProgressHandler> progress_handler_;
   std::shared_ptr<SpeedHandler> speed_handler_;
+  std::shared_ptr<ConcurrencyController> concurrency_controller_;
+  std::shared_ptr<SliceSizer> slice_sizer_;  // SlicePolicy::Adaptive
+  std::shared_ptr<SourceManager> source_manager_;
+
+  // Peer mode, only accessed on loop thread except the tracker.
+  typedef struct _PeerChunks {
+    int32_t source;
+    std::vector<uint32_t> chunks;  // of the range of slice, advertised by the peer
+  } PeerChunks;
+  utf8string peer_key_;
+  std::shared_ptr<PeerTracker> peer_tracker_;
+  std::vector<int32_t> peer_sources_;  // source of each peer of tracker
+  std::map<int32_t, PeerChunks> peer_chunks_;  // slice index -> chunks expected, the slice received data from the peer
 
-  void* multi_;
+  EventLoop* loop_;
+  std::mutex loop_mutex_;
 
-  std::shared_ptr<ScopedCurl> fetch_file_info_curl_;
+  // The multi handle performing the requests of file info, guarded by the mutex so that stop() can wake it up.
+  CURLM* fetch_file_info_multi_;
+  std::mutex fetch_file_info_mutex_;
 
   std::atomic_bool user_stopped_;
   std::atomic_bool user_paused_;
 
   std::atomic<DownloadState> state_;
+
+  mutable std::mutex stats_mutex_;
+  DownloadStats stats_;
+
+  // Only accessed on loop thread.
+  bool slices_paused_;
+  bool preempted_;  // by a task of higher priority on engine
+  bool slices_released_;  // the transfers are released after paused for a while
+  TimeMeter pause_time_meter_;
+  int32_t active_slice_num_;
+  bool transfer_throttled_;  // a slice is waiting for the transfer limit of engine
+  long retry_wait_time_;  // ms until a failed slice can be retried, -1 if no slice is waiting
+  std::minstd_rand random_;  // jitter of retry delay
+  std::deque<int64_t> completed_slice_speeds_;  // the last transfers of completed slices, byte per second
+  bool transfer_started_;
+  Result transfer_result_;
+  Result stop_slices_result_;
+  std::shared_ptr<Metrics> metrics_;
+  bool chunks_repaired_;  // corrupted chunks are only repaired once
+  TimeMeter transfer_time_meter_;
+  TimeMeter checkpoint_time_meter_;
+  int64_t checkpoint_downloaded_;  // downloaded size at last checkpoint
+  bool slice_completed_;  // any slice completed since last checkpoint
+  bool download_cache_hit_;
+  DownloadCacheEntry download_cache_entry_;  // url and validators of the file downloaded, for storing to cache
+
+  // Slices beyond the connections and the streams per connection are queued by libcurl without receiving data,
+  // so they are not started. 0 means unlimited.
+  int32_t max_transfer_num_;
 };
 }  // namespace zoe
 #endif  // !ZOE_ENTRY_HANDLER_H__
\ No newline at end of file
@@ -0,0 +1,72 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "file_info_cache.h"
+#include <map>
+#include <mutex>
+#include "options.h"
+#include "time_meter.hpp"
+
+namespace zoe {
+
+namespace {
+typedef struct _FileInfoCacheEntry {
+  FileInfo info;
+  TimeMeter validated_time_meter;
+} FileInfoCacheEntry;
+
+std::mutex cache_mutex;
+std::map<utf8string, FileInfoCacheEntry> cache_entries;
+}  // namespace
+
+bool LookupFileInfoCache(const utf8string& url, FileInfo& info, int64_t& age) {
+  std::lock_guard<std::mutex> lg(cache_mutex);
+  auto it = cache_entries.find(url);
+  if (it == cache_entries.end())
+    return false;
+  info = it->second.info;
+  age = it->second.validated_time_meter.Elapsed();
+  return true;
+}
+
+void UpdateFileInfoCache(const utf8string& url, const FileInfo& info) {
+  std::lock_guard<std::mutex> lg(cache_mutex);
+  if (cache_entries.size() >= ZOE_FILE_INFO_CACHE_MAX_NUM && cache_entries.find(url) == cache_entries.end()) {
+    auto oldest = cache_entries.begin();
+    for (auto it = cache_entries.begin(); it != cache_entries.end(); ++it) {
+      if (it->second.validated_time_meter.Elapsed() > oldest->second.validated_time_meter.Elapsed())
+        oldest = it;
+    }
+    cache_entries.erase(oldest);
+  }
+
+  FileInfoCacheEntry& entry = cache_entries[url];
+  entry.info = info;
+  entry.info.prefetched.clear();
+  entry.validated_time_meter.Restart();
+}
+
+void RemoveFileInfoCache(const utf8string& url) {
+  std::lock_guard<std::mutex> lg(cache_mutex);
+  cache_entries.erase(url);
+}
+
+void ClearFileInfoCache() {
+  std::lock_guard<std::mutex> lg(cache_mutex);
+  cache_entries.clear();
+}
+}  // namespace zoe
@@ -0,0 +1,71 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_FILE_INFO_CACHE_H_
+#define ZOE_FILE_INFO_CACHE_H_
+#pragma once
+
+#include <string>
+#include "zoe/zoe.h"
+
+namespace zoe {
+typedef struct _FileInfo {
+  bool acceptRanges;
+  bool rangeConfirmed;  // a 206 response was received, acceptRanges is not only assumed
+  int64_t fileSize;
+  utf8string contentMd5;
+  utf8string etag;
+  utf8string lastModified;
+  utf8string redirect_url;
+  bool multiplexed;  // the server responded with HTTP/2 or HTTP/3
+
+  // The beginning of file received by range probe, not cached.
+  std::string prefetched;
+
+  void clear() {
+    acceptRanges = true;
+    rangeConfirmed = false;
+    multiplexed = false;
+    fileSize = -1;
+    contentMd5.clear();
+    etag.clear();
+    lastModified.clear();
+    redirect_url.clear();
+    prefetched.clear();
+  }
+  _FileInfo() {
+    acceptRanges = true;
+    rangeConfirmed = false;
+    multiplexed = false;
+    fileSize = -1L;
+  }
+} FileInfo;
+
+// The file info fetched lately in the process, keyed by url, so that the downloads of the same url skip probing.
+// The oldest entry is dropped when there are ZOE_FILE_INFO_CACHE_MAX_NUM entries.
+// Thread safe.
+
+// Return false if url is not cached, age is the milliseconds since the info was fetched or revalidated.
+bool LookupFileInfoCache(const utf8string& url, FileInfo& info, int64_t& age);
+
+// Cache the info of url, or refresh the entry when it has been revalidated. The age restarts from 0.
+void UpdateFileInfoCache(const utf8string& url, const FileInfo& info);
+
+void RemoveFileInfoCache(const utf8string& url);
+void ClearFileInfoCache();
+}  // namespace zoe
+#endif  // !ZOE_FILE_INFO_CACHE_H_
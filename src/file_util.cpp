@@ -30,6 +30,10 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #endif
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
 #include "string_encode.h"
 #include "filesystem.hpp"
 
@@ -165,6 +169,39 @@ bool FileUtil::Rename(const utf8string& from, const utf8string& to) {
 #endif
 }
 
+bool FileUtil::CloneFile(const utf8string& from, const utf8string& to, bool allow_hardlink) {
+  std::error_code ec;
+  ghc::filesystem::remove(ghc::filesystem::u8path(to), ec);
+
+#if defined(__linux__) && defined(FICLONE)
+  const int src = open(from.c_str(), O_RDONLY);
+  if (src >= 0) {
+    const int dst = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool cloned = false;
+    if (dst >= 0) {
+      cloned = ioctl(dst, FICLONE, src) == 0;
+      close(dst);
+      if (!cloned)
+        unlink(to.c_str());
+    }
+    close(src);
+    if (cloned)
+      return true;
+  }
+#endif
+
+  if (allow_hardlink) {
+    ec.clear();
+    ghc::filesystem::create_hard_link(ghc::filesystem::u8path(from), ghc::filesystem::u8path(to), ec);
+    if (!ec)
+      return true;
+  }
+
+  ec.clear();
+  return ghc::filesystem::copy_file(ghc::filesystem::u8path(from), ghc::filesystem::u8path(to),
+                                    ghc::filesystem::copy_options::overwrite_existing, ec) && !ec;
+}
+
 FILE* FileUtil::Open(const utf8string& path, const utf8string& mode) {
   FILE* f = nullptr;
   if (path.length() == 0 || mode.length() == 0)
@@ -196,7 +233,17 @@ void FileUtil::Close(FILE* f) {
   }
 }
 
-bool FileUtil::CreateFixedSizeFile(const utf8string& path, int64_t fixed_size) {
+bool FileUtil::Sync(FILE* f) {
+  if (!f || fflush(f) != 0)
+    return false;
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  return _commit(_fileno(f)) == 0;
+#else
+  return fsync(fileno(f)) == 0;
+#endif
+}
+
+bool FileUtil::CreateFixedSizeFile(const utf8string& path, int64_t fixed_size, bool skip_zero_fill) {
   utf8string str_dir = GetDirectory(path);
   if (str_dir.length() > 0 && !CreateDirectories(str_dir))
     return false;
@@ -219,6 +266,10 @@ bool FileUtil::CreateFixedSizeFile(const utf8string& path, int64_t fixed_size) {
     if (!SetEndOfFile(h))
       break;
 
+    // Failure is ignored, the space will be zero filled on first write.
+    if (skip_zero_fill && fixed_size > 0)
+      SetFileValidData(h, fixed_size);
+
     prealloc = true;
   } while (false);
 
@@ -265,6 +316,7 @@ bool FileUtil::CreateFixedSizeFile(const utf8string& path, int64_t fixed_size) {
 
   return prealloc;
 #else
+  (void)skip_zero_fill;
   int fd = open(path.c_str(), O_RDWR | O_CREAT,
                 S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
   if (fd == -1) {
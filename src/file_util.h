@@ -36,10 +36,16 @@ namespace zoe {
     static bool IsRW(const utf8string& filepath);
     static bool RemoveFile(const utf8string& filepath);
     static bool Rename(const utf8string& from, const utf8string &to);
+    // Make to a copy of from, by reflink if the file system supports it, then hard link if allowed, then copying data.
+    // A hard link shares the data, so the change of either file is seen by the other.
+    static bool CloneFile(const utf8string& from, const utf8string& to, bool allow_hardlink);
     static FILE* Open(const utf8string& path, const utf8string& mode);
     static int Seek(FILE* f, int64_t offset, int origin);
     static void Close(FILE* f);
-    static bool CreateFixedSizeFile(const utf8string& path, int64_t fixed_size);
+    // Flush the stream and the file data to disk.
+    static bool Sync(FILE* f);
+    // If skip_zero_fill is true, try to mark the allocated space as valid data(requires privilege on Windows).
+    static bool CreateFixedSizeFile(const utf8string& path, int64_t fixed_size, bool skip_zero_fill = false);
     static bool PathFormatting(const utf8string& path, utf8string& formatted);
   };
 }  // namespace zoe
@@ -0,0 +1,525 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "hash_accel.h"
+#include <atomic>
+#ifdef ZOE_HASH_ACCEL_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <immintrin.h>
+#endif
+
+#if defined(ZOE_HASH_ACCEL_X86) && !defined(_MSC_VER)
+#define ZOE_TARGET(x) __attribute__((target(x)))
+#else
+#define ZOE_TARGET(x)
+#endif
+
+namespace zoe {
+namespace hash_accel {
+static std::atomic_bool enabled_(true);
+
+static CpuFeatures DetectCpuFeatures() {
+  CpuFeatures features = {false, false, false, false};
+#ifdef ZOE_HASH_ACCEL_X86
+  unsigned int max_leaf = 0;
+  unsigned int ecx1 = 0;
+  unsigned int ebx7 = 0;
+#if defined(_MSC_VER)
+  int regs[4] = {0};
+  __cpuid(regs, 0);
+  max_leaf = (unsigned int)regs[0];
+  if (max_leaf >= 1) {
+    __cpuid(regs, 1);
+    ecx1 = (unsigned int)regs[2];
+  }
+  if (max_leaf >= 7) {
+    __cpuidex(regs, 7, 0);
+    ebx7 = (unsigned int)regs[1];
+  }
+#else
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+  max_leaf = __get_cpuid_max(0, nullptr);
+  if (max_leaf >= 1 && __get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    ecx1 = ecx;
+  if (max_leaf >= 7) {
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    ebx7 = ebx;
+  }
+#endif
+  features.ssse3 = !!(ecx1 & (1u << 9));
+  features.sse41 = !!(ecx1 & (1u << 19));
+  features.pclmul = !!(ecx1 & (1u << 1));
+  features.sha = !!(ebx7 & (1u << 29));
+#endif
+  return features;
+}
+
+const CpuFeatures& GetCpuFeatures() {
+  static const CpuFeatures features = DetectCpuFeatures();
+  return features;
+}
+
+void SetEnabled(bool enabled) {
+  enabled_.store(enabled);
+}
+
+bool IsEnabled() {
+  return enabled_.load();
+}
+
+bool Sha1Available() {
+  const CpuFeatures& f = GetCpuFeatures();
+  return IsEnabled() && f.sha && f.ssse3 && f.sse41;
+}
+
+bool Sha256Available() {
+  return Sha1Available();
+}
+
+#ifdef ZOE_HASH_ACCEL_X86
+// The message schedule of SHA-NI, see Intel SHA Extensions white paper.
+ZOE_TARGET("sha,ssse3,sse4.1")
+void Sha1Blocks(uint32_t state[5], const unsigned char* data, size_t blocks) {
+  const __m128i MASK = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+  __m128i ABCD = _mm_loadu_si128((const __m128i*)state);
+  __m128i E0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+  __m128i E1;
+  __m128i MSG0, MSG1, MSG2, MSG3;
+  ABCD = _mm_shuffle_epi32(ABCD, 0x1B);
+
+#define SHA1_LOAD(m, i) m = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + (i) * 16)), MASK)
+#define SHA1_ROUNDS4(e_cur, e_next, m, f) \
+  e_cur = _mm_sha1nexte_epu32(e_cur, m);  \
+  e_next = ABCD;                          \
+  ABCD = _mm_sha1rnds4_epu32(ABCD, e_cur, f)
+
+  while (blocks > 0) {
+    const __m128i ABCD_SAVE = ABCD;
+    const __m128i E0_SAVE = E0;
+
+    // Rounds 0-15
+    SHA1_LOAD(MSG0, 0);
+    E0 = _mm_add_epi32(E0, MSG0);
+    E1 = ABCD;
+    ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+
+    SHA1_LOAD(MSG1, 1);
+    SHA1_ROUNDS4(E1, E0, MSG1, 0);
+    MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+
+    SHA1_LOAD(MSG2, 2);
+    SHA1_ROUNDS4(E0, E1, MSG2, 0);
+    MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+    MSG0 = _mm_xor_si128(MSG0, MSG2);
+
+    SHA1_LOAD(MSG3, 3);
+    MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
+    SHA1_ROUNDS4(E1, E0, MSG3, 0);
+    MSG2 = _mm_sha1msg1_epu32(MSG2, MSG3);
+    MSG1 = _mm_xor_si128(MSG1, MSG3);
+
+    // Rounds 16-63, MSGn = schedule(MSGn-4, MSGn-3, MSGn-2, MSGn-1).
+#define SHA1_SCHEDULE_ROUNDS4(e_cur, e_next, m_prev2, m_prev1, m, m_next, f) \
+  m_next = _mm_sha1msg2_epu32(m_next, m);                                    \
+  SHA1_ROUNDS4(e_cur, e_next, m, f);                                         \
+  m_prev1 = _mm_sha1msg1_epu32(m_prev1, m);                                  \
+  m_prev2 = _mm_xor_si128(m_prev2, m)
+
+    SHA1_SCHEDULE_ROUNDS4(E0, E1, MSG2, MSG3, MSG0, MSG1, 0);
+    SHA1_SCHEDULE_ROUNDS4(E1, E0, MSG3, MSG0, MSG1, MSG2, 1);
+    SHA1_SCHEDULE_ROUNDS4(E0, E1, MSG0, MSG1, MSG2, MSG3, 1);
+    SHA1_SCHEDULE_ROUNDS4(E1, E0, MSG1, MSG2, MSG3, MSG0, 1);
+    SHA1_SCHEDULE_ROUNDS4(E0, E1, MSG2, MSG3, MSG0, MSG1, 1);
+    SHA1_SCHEDULE_ROUNDS4(E1, E0, MSG3, MSG0, MSG1, MSG2, 1);
+    SHA1_SCHEDULE_ROUNDS4(E0, E1, MSG0, MSG1, MSG2, MSG3, 2);
+    SHA1_SCHEDULE_ROUNDS4(E1, E0, MSG1, MSG2, MSG3, MSG0, 2);
+    SHA1_SCHEDULE_ROUNDS4(E0, E1, MSG2, MSG3, MSG0, MSG1, 2);
+    SHA1_SCHEDULE_ROUNDS4(E1, E0, MSG3, MSG0, MSG1, MSG2, 2);
+    SHA1_SCHEDULE_ROUNDS4(E0, E1, MSG0, MSG1, MSG2, MSG3, 2);
+    SHA1_SCHEDULE_ROUNDS4(E1, E0, MSG1, MSG2, MSG3, MSG0, 3);
+
+    // Rounds 64-79
+    MSG1 = _mm_sha1msg2_epu32(MSG1, MSG0);
+    SHA1_ROUNDS4(E0, E1, MSG0, 3);
+    MSG3 = _mm_sha1msg1_epu32(MSG3, MSG0);
+    MSG2 = _mm_xor_si128(MSG2, MSG0);
+
+    MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+    SHA1_ROUNDS4(E1, E0, MSG1, 3);
+    MSG3 = _mm_xor_si128(MSG3, MSG1);
+
+    MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+    SHA1_ROUNDS4(E0, E1, MSG2, 3);
+
+    SHA1_ROUNDS4(E1, E0, MSG3, 3);
+
+    E0 = _mm_sha1nexte_epu32(E0, E0_SAVE);
+    ABCD = _mm_add_epi32(ABCD, ABCD_SAVE);
+
+    data += 64;
+    blocks--;
+  }
+
+#undef SHA1_SCHEDULE_ROUNDS4
+#undef SHA1_ROUNDS4
+#undef SHA1_LOAD
+
+  ABCD = _mm_shuffle_epi32(ABCD, 0x1B);
+  _mm_storeu_si128((__m128i*)state, ABCD);
+  state[4] = (uint32_t)_mm_extract_epi32(E0, 3);
+}
+
+static const uint32_t kSha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+ZOE_TARGET("sha,ssse3,sse4.1")
+void Sha256Blocks(uint32_t state[8], const unsigned char* data, size_t blocks) {
+  const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+  __m128i TMP = _mm_loadu_si128((const __m128i*)&state[0]);
+  __m128i STATE1 = _mm_loadu_si128((const __m128i*)&state[4]);
+  __m128i STATE0;
+  __m128i MSG, MSG0, MSG1, MSG2, MSG3;
+
+  TMP = _mm_shuffle_epi32(TMP, 0xB1);           // CDAB
+  STATE1 = _mm_shuffle_epi32(STATE1, 0x1B);     // EFGH
+  STATE0 = _mm_alignr_epi8(TMP, STATE1, 8);     // ABEF
+  STATE1 = _mm_blend_epi16(STATE1, TMP, 0xF0);  // CDGH
+
+#define SHA256_LOAD(m, i) m = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + (i) * 16)), MASK)
+#define SHA256_ROUNDS4_BEGIN(m, i)                                        \
+  MSG = _mm_add_epi32(m, _mm_loadu_si128((const __m128i*)&kSha256K[(i) * 4])); \
+  STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG)
+#define SHA256_ROUNDS4_END()            \
+  MSG = _mm_shuffle_epi32(MSG, 0x0E);   \
+  STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG)
+  // MSGn = schedule(MSGn-4, MSGn-3, MSGn-2, MSGn-1).
+#define SHA256_SCHEDULE2(m_prev, m, m_next)  \
+  TMP = _mm_alignr_epi8(m, m_prev, 4);       \
+  m_next = _mm_add_epi32(m_next, TMP);       \
+  m_next = _mm_sha256msg2_epu32(m_next, m)
+
+  while (blocks > 0) {
+    const __m128i ABEF_SAVE = STATE0;
+    const __m128i CDGH_SAVE = STATE1;
+
+    SHA256_LOAD(MSG0, 0);
+    SHA256_ROUNDS4_BEGIN(MSG0, 0);
+    SHA256_ROUNDS4_END();
+
+    SHA256_LOAD(MSG1, 1);
+    SHA256_ROUNDS4_BEGIN(MSG1, 1);
+    SHA256_ROUNDS4_END();
+    MSG0 = _mm_sha256msg1_epu32(MSG0, MSG1);
+
+    SHA256_LOAD(MSG2, 2);
+    SHA256_ROUNDS4_BEGIN(MSG2, 2);
+    SHA256_ROUNDS4_END();
+    MSG1 = _mm_sha256msg1_epu32(MSG1, MSG2);
+
+    SHA256_LOAD(MSG3, 3);
+    SHA256_ROUNDS4_BEGIN(MSG3, 3);
+    SHA256_SCHEDULE2(MSG2, MSG3, MSG0);
+    SHA256_ROUNDS4_END();
+    MSG2 = _mm_sha256msg1_epu32(MSG2, MSG3);
+
+#define SHA256_SCHEDULE_ROUNDS4(m_prev, m, m_next, i) \
+  SHA256_ROUNDS4_BEGIN(m, i);                         \
+  SHA256_SCHEDULE2(m_prev, m, m_next);                \
+  SHA256_ROUNDS4_END();                               \
+  m_prev = _mm_sha256msg1_epu32(m_prev, m)
+
+    SHA256_SCHEDULE_ROUNDS4(MSG3, MSG0, MSG1, 4);
+    SHA256_SCHEDULE_ROUNDS4(MSG0, MSG1, MSG2, 5);
+    SHA256_SCHEDULE_ROUNDS4(MSG1, MSG2, MSG3, 6);
+    SHA256_SCHEDULE_ROUNDS4(MSG2, MSG3, MSG0, 7);
+    SHA256_SCHEDULE_ROUNDS4(MSG3, MSG0, MSG1, 8);
+    SHA256_SCHEDULE_ROUNDS4(MSG0, MSG1, MSG2, 9);
+    SHA256_SCHEDULE_ROUNDS4(MSG1, MSG2, MSG3, 10);
+    SHA256_SCHEDULE_ROUNDS4(MSG2, MSG3, MSG0, 11);
+    SHA256_SCHEDULE_ROUNDS4(MSG3, MSG0, MSG1, 12);
+
+    SHA256_ROUNDS4_BEGIN(MSG1, 13);
+    SHA256_SCHEDULE2(MSG0, MSG1, MSG2);
+    SHA256_ROUNDS4_END();
+
+    SHA256_ROUNDS4_BEGIN(MSG2, 14);
+    SHA256_SCHEDULE2(MSG1, MSG2, MSG3);
+    SHA256_ROUNDS4_END();
+
+    SHA256_ROUNDS4_BEGIN(MSG3, 15);
+    SHA256_ROUNDS4_END();
+
+    STATE0 = _mm_add_epi32(STATE0, ABEF_SAVE);
+    STATE1 = _mm_add_epi32(STATE1, CDGH_SAVE);
+
+    data += 64;
+    blocks--;
+  }
+
+#undef SHA256_SCHEDULE_ROUNDS4
+#undef SHA256_SCHEDULE2
+#undef SHA256_ROUNDS4_END
+#undef SHA256_ROUNDS4_BEGIN
+#undef SHA256_LOAD
+
+  TMP = _mm_shuffle_epi32(STATE0, 0x1B);        // FEBA
+  STATE1 = _mm_shuffle_epi32(STATE1, 0xB1);     // DCHG
+  STATE0 = _mm_blend_epi16(TMP, STATE1, 0xF0);  // DCBA
+  STATE1 = _mm_alignr_epi8(STATE1, TMP, 8);     // ABEF
+
+  _mm_storeu_si128((__m128i*)&state[0], STATE0);
+  _mm_storeu_si128((__m128i*)&state[4], STATE1);
+}
+#else
+void Sha1Blocks(uint32_t state[5], const unsigned char* data, size_t blocks) {}
+void Sha256Blocks(uint32_t state[8], const unsigned char* data, size_t blocks) {}
+#endif
+
+typedef struct _Crc32Tables {
+  uint32_t t[8][256];
+} Crc32Tables;
+
+static Crc32Tables MakeCrc32Tables() {
+  Crc32Tables tables;
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; k++)
+      c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+    tables.t[0][i] = c;
+  }
+  for (uint32_t i = 0; i < 256; i++) {
+    for (int k = 1; k < 8; k++)
+      tables.t[k][i] = (tables.t[k - 1][i] >> 8) ^ tables.t[0][tables.t[k - 1][i] & 0xFF];
+  }
+  return tables;
+}
+
+static uint32_t Crc32SliceBy8(uint32_t crc, const unsigned char* p, size_t size) {
+  static const Crc32Tables tables = MakeCrc32Tables();
+  const uint32_t(*t)[256] = tables.t;
+
+  while (size >= 8) {
+    const uint32_t one = crc ^ ((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+    const uint32_t two = (uint32_t)p[4] | ((uint32_t)p[5] << 8) | ((uint32_t)p[6] << 16) | ((uint32_t)p[7] << 24);
+    crc = t[7][one & 0xFF] ^ t[6][(one >> 8) & 0xFF] ^ t[5][(one >> 16) & 0xFF] ^ t[4][one >> 24] ^
+          t[3][two & 0xFF] ^ t[2][(two >> 8) & 0xFF] ^ t[1][(two >> 16) & 0xFF] ^ t[0][two >> 24];
+    p += 8;
+    size -= 8;
+  }
+
+  while (size > 0) {
+    crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xFF];
+    p++;
+    size--;
+  }
+  return crc;
+}
+
+#ifdef ZOE_HASH_ACCEL_X86
+// Fold 4x128 bits in parallel and Barrett reduce, see Intel "Fast CRC Computation Using PCLMULQDQ Instruction".
+// size must be a multiple of 16 and not less than 64.
+ZOE_TARGET("pclmul,sse4.1")
+static uint32_t Crc32Pclmul(uint32_t crc, const unsigned char* buf, size_t size) {
+  static const uint64_t k1k2[2] = {0x0154442bd4ULL, 0x01c6e41596ULL};
+  static const uint64_t k3k4[2] = {0x01751997d0ULL, 0x00ccaa009eULL};
+  static const uint64_t k5k0[2] = {0x0163cd6124ULL, 0x0000000000ULL};
+  static const uint64_t poly[2] = {0x01db710641ULL, 0x01f7011641ULL};
+
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+  x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+  x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+  x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+  x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+  x0 = _mm_loadu_si128((const __m128i*)k1k2);
+
+  buf += 64;
+  size -= 64;
+
+  while (size >= 64) {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+    y5 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+    y6 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+    y7 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+    y8 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+    buf += 64;
+    size -= 64;
+  }
+
+  // Fold into 128 bits.
+  x0 = _mm_loadu_si128((const __m128i*)k3k4);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  while (size >= 16) {
+    x2 = _mm_loadu_si128((const __m128i*)buf);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    buf += 16;
+    size -= 16;
+  }
+
+  // Fold 128 bits to 64 bits.
+  x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+  x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+  x1 = _mm_srli_si128(x1, 8);
+  x1 = _mm_xor_si128(x1, x2);
+
+  x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, x3);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  // Barrett reduce to 32 bits.
+  x0 = _mm_loadu_si128((const __m128i*)poly);
+
+  x2 = _mm_and_si128(x1, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+  x2 = _mm_and_si128(x2, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+#endif
+
+uint32_t Crc32Update(uint32_t crc, const unsigned char* data, size_t size) {
+#ifdef ZOE_HASH_ACCEL_X86
+  const CpuFeatures& f = GetCpuFeatures();
+  if (IsEnabled() && f.pclmul && f.sse41 && size >= 64) {
+    const size_t folded = size & ~(size_t)15;
+    crc = Crc32Pclmul(crc, data, folded);
+    data += folded;
+    size -= folded;
+  }
+#endif
+  return Crc32SliceBy8(crc, data, size);
+}
+
+static void RollsumScalar(uint32_t* s1, uint32_t* s2, const unsigned char* p, size_t size) {
+  uint32_t a = *s1;
+  uint32_t b = *s2;
+  while (size >= 4) {
+    a += p[0];
+    b += a;
+    a += p[1];
+    b += a;
+    a += p[2];
+    b += a;
+    a += p[3];
+    b += a;
+    p += 4;
+    size -= 4;
+  }
+  while (size-- > 0) {
+    a += *p++;
+    b += a;
+  }
+  *s1 = a;
+  *s2 = b;
+}
+
+#ifdef ZOE_HASH_ACCEL_X86
+// For each 16 bytes, s2 += 16 * s1 + sum((16 - i) * byte[i]) and s1 += sum(byte[i]), the same as Adler-32 without modulo.
+// The products of a pair of bytes are at most 255 * 31, no saturation in maddubs. size must be a multiple of 16.
+ZOE_TARGET("ssse3")
+static void RollsumSsse3(uint32_t* s1, uint32_t* s2, const unsigned char* p, size_t size) {
+  const __m128i weights = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+  const __m128i ones = _mm_set1_epi16(1);
+  const __m128i zero = _mm_setzero_si128();
+
+  __m128i v_s1 = _mm_cvtsi32_si128((int)*s1);  // in the lowest lane, sad sums into lanes 0 and 2
+  __m128i v_ps = zero;  // sum of s1 before each 16 bytes
+  __m128i v_s2 = zero;
+
+  const size_t blocks = size / 16;
+  for (size_t i = 0; i < blocks; i++) {
+    const __m128i bytes = _mm_loadu_si128((const __m128i*)(p + i * 16));
+    v_ps = _mm_add_epi32(v_ps, v_s1);
+    v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes, zero));
+    v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes, weights), ones));
+  }
+
+  // Horizontal sums, the lanes of v_s1 and v_ps are 32 bits values of 64 bits lanes.
+  v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(1, 0, 3, 2)));
+  v_ps = _mm_add_epi32(v_ps, _mm_shuffle_epi32(v_ps, _MM_SHUFFLE(1, 0, 3, 2)));
+  v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(1, 0, 3, 2)));
+  v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(2, 3, 0, 1)));
+
+  *s2 += (uint32_t)_mm_cvtsi128_si32(v_ps) * 16u + (uint32_t)_mm_cvtsi128_si32(v_s2);
+  *s1 = (uint32_t)_mm_cvtsi128_si32(v_s1);
+}
+#endif
+
+void RollsumUpdate(uint32_t* s1, uint32_t* s2, const unsigned char* data, size_t size) {
+#ifdef ZOE_HASH_ACCEL_X86
+  if (IsEnabled() && GetCpuFeatures().ssse3 && size >= 16) {
+    const size_t vectored = size & ~(size_t)15;
+    RollsumSsse3(s1, s2, data, vectored);
+    data += vectored;
+    size -= vectored;
+  }
+#endif
+  RollsumScalar(s1, s2, data, size);
+}
+}  // namespace hash_accel
+}  // namespace zoe
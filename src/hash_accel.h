@@ -0,0 +1,63 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_HASH_ACCEL_H_
+#define ZOE_HASH_ACCEL_H_
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#if defined(_MSC_VER) || (defined(__GNUC__) && (__GNUC__ >= 5)) || defined(__clang__)
+#define ZOE_HASH_ACCEL_X86
+#endif
+#endif
+
+namespace zoe {
+// Accelerated hash kernels chosen by runtime CPU feature detection.
+// The reference implementations in md5/sha1/sha256/crc32 are used when the CPU doesn't support them.
+namespace hash_accel {
+typedef struct _CpuFeatures {
+  bool ssse3;
+  bool sse41;
+  bool pclmul;
+  bool sha;
+} CpuFeatures;
+
+const CpuFeatures& GetCpuFeatures();
+
+// Only used to compare with the reference implementations, default is true.
+void SetEnabled(bool enabled);
+bool IsEnabled();
+
+bool Sha1Available();
+bool Sha256Available();
+
+// Process blocks * 64 bytes of data, the state is as same as the reference implementations.
+void Sha1Blocks(uint32_t state[5], const unsigned char* data, size_t blocks);
+void Sha256Blocks(uint32_t state[8], const unsigned char* data, size_t blocks);
+
+// Update the CRC32(polynomial 0xEDB88320) register, with PCLMULQDQ folding if supported, otherwise slice-by-8.
+uint32_t Crc32Update(uint32_t crc, const unsigned char* data, size_t size);
+
+// Add the bytes to the rolling checksum of delta update, s1 = sum of bytes, s2 = sum of s1 after each byte.
+// Both are modulo 2^32, only the low 16 bits are used. With SSSE3 16 bytes are summed at once if supported.
+void RollsumUpdate(uint32_t* s1, uint32_t* s2, const unsigned char* data, size_t size);
+}  // namespace hash_accel
+}  // namespace zoe
+#endif  // !ZOE_HASH_ACCEL_H_
@@ -0,0 +1,204 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "hash_cursor.h"
+#include <assert.h>
+#include <algorithm>
+#include "target_file.h"
+#include "metrics.h"
+#include "engine.h"
+#include "options.h"
+#include "time_meter.hpp"
+
+#define HASH_CURSOR_READ_SIZE 1048576
+
+namespace zoe {
+namespace {
+std::mutex hash_pool_mutex;
+std::shared_ptr<WorkerPool> hash_pool;
+
+std::shared_ptr<WorkerPool> GetHashPool() {
+  std::lock_guard<std::mutex> lg(hash_pool_mutex);
+  if (!hash_pool)
+    hash_pool = std::make_shared<WorkerPool>(ZOE_HASH_CURSOR_THREAD_NUM);
+  return hash_pool;
+}
+}  // namespace
+
+void StopHashCursorPool() {
+  std::shared_ptr<WorkerPool> pool;
+  {
+    std::lock_guard<std::mutex> lg(hash_pool_mutex);
+    pool.swap(hash_pool);
+  }
+  // The jobs queued are drained by the destructor.
+  pool.reset();
+}
+
+HashCursor::HashCursor(TargetFile* target_file, HashType type, int64_t file_size, std::shared_ptr<Metrics> metrics)
+    : target_file_(target_file)
+    , metrics_(metrics)
+    , type_(type)
+    , file_size_(file_size)
+    , cursor_(0L)
+    , invalid_(false)
+    , stopping_(false)
+    , scheduled_(false)
+    , hash_(type) {}
+
+HashCursor::~HashCursor() {
+  // The job posted refers to this cursor, it returns at once when stopping.
+  std::unique_lock<std::mutex> ul(mutex_);
+  stopping_ = true;
+  cond_var_.wait(ul, [this] { return !scheduled_; });
+}
+
+HashType HashCursor::hashType() const {
+  return type_;
+}
+
+void HashCursor::onWritten(int64_t pos, const void* data, int64_t size) {
+  if (pos < 0 || size <= 0)
+    return;
+
+  {
+    // the writes of slices are serialized here, record how long they wait.
+    std::unique_lock<std::mutex> ul(mutex_, std::try_to_lock);
+    if (!ul.owns_lock()) {
+      TimeMeter wait_time_meter;
+      ul.lock();
+      if (metrics_)
+        metrics_->addHashLockWaitTime(wait_time_meter.ElapsedMicroseconds());
+    }
+    if (invalid_)
+      return;
+
+    if (pos < cursor_) {
+      invalid_ = true;
+      written_.clear();
+    }
+    else {
+      int64_t begin = pos;
+      int64_t end = pos + size;
+
+      // merge with the ranges overlapped or adjacent.
+      auto it = written_.upper_bound(begin);
+      if (it != written_.begin()) {
+        auto prev = std::prev(it);
+        if (prev->second >= begin) {
+          begin = prev->first;
+          end = std::max(end, prev->second);
+          it = written_.erase(prev);
+        }
+      }
+      while (it != written_.end() && it->first <= end) {
+        end = std::max(end, it->second);
+        it = written_.erase(it);
+      }
+      written_[begin] = end;
+
+      // hash inline if the data is just at cursor.
+      if (data && pos == cursor_) {
+        update(data, size);
+        cursor_ += size;
+      }
+      scheduleLocked();
+    }
+  }
+  cond_var_.notify_all();
+}
+
+void HashCursor::scheduleLocked() {
+  if (scheduled_ || stopping_ || invalid_ || cursor_ >= file_size_ || readableEnd() <= cursor_)
+    return;
+
+  scheduled_ = true;
+  GetHashPool()->post(std::bind(&HashCursor::hashProcess, this));
+}
+
+Result HashCursor::wait(std::function<bool()> is_canceled, utf8string& str_hash) {
+  std::unique_lock<std::mutex> ul(mutex_);
+  while (!invalid_ && cursor_ < file_size_) {
+    if (is_canceled && is_canceled())
+      return CANCELED;
+    cond_var_.wait_for(ul, std::chrono::milliseconds(100));
+  }
+
+  if (invalid_ || cursor_ != file_size_)
+    return CALCULATE_HASH_FAILED;
+
+  str_hash = final();
+  return SUCCESSED;
+}
+
+void HashCursor::hashProcess() {
+  std::vector<char> buffer(HASH_CURSOR_READ_SIZE);
+  for (int32_t i = 0;; i++) {
+    int64_t pos = 0L;
+    int64_t size = 0L;
+    {
+      std::lock_guard<std::mutex> lg(mutex_);
+      if (stopping_ || invalid_ || cursor_ >= file_size_ || readableEnd() <= cursor_ ||
+          i >= ZOE_HASH_CURSOR_JOB_READ_NUM) {
+        scheduled_ = false;
+        scheduleLocked();
+        break;
+      }
+
+      pos = cursor_;
+      size = std::min(readableEnd() - cursor_, (int64_t)buffer.size());
+    }
+
+    const int64_t read = target_file_->read(pos, buffer.data(), size);
+
+    {
+      std::lock_guard<std::mutex> lg(mutex_);
+      if (read != size) {
+        invalid_ = true;
+      }
+      else if (cursor_ == pos) {
+        // otherwise the data has been hashed inline.
+        update(buffer.data(), size);
+        cursor_ += size;
+      }
+    }
+    cond_var_.notify_all();
+  }
+  cond_var_.notify_all();
+}
+
+void HashCursor::update(const void* data, int64_t size) {
+  TimeMeter time_meter;
+  hash_.update(data, size);
+  if (metrics_)
+    metrics_->addStreamingHashTime(time_meter.ElapsedMicroseconds());
+}
+
+utf8string HashCursor::final() {
+  // the digest can only be made once.
+  invalid_ = true;
+  return hash_.final();
+}
+
+int64_t HashCursor::readableEnd() const {
+  auto it = written_.upper_bound(cursor_);
+  if (it == written_.begin())
+    return cursor_;
+  --it;
+  return std::max(it->second, cursor_);
+}
+}  // namespace zoe
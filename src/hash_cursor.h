@@ -0,0 +1,90 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_HASH_CURSOR_H_
+#define ZOE_HASH_CURSOR_H_
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+#include "zoe/zoe.h"
+#include "incremental_hash.h"
+
+namespace zoe {
+class TargetFile;
+class Metrics;
+
+// Hash the target file in order while it is being downloaded, so that hash verification
+// doesn't need to read the whole file again after downloaded.
+// The written ranges are recorded. The data written at the cursor is hashed inline, and the data written
+// ahead of cursor is read back by a job on the hashing pool when the cursor reaches it(it is still in page cache mostly).
+// The hashing pool has a few threads shared by all cursors of process, so the threads don't grow with the downloads.
+// Thread safe.
+class HashCursor {
+ public:
+  // metrics can be nullptr.
+  HashCursor(TargetFile* target_file, HashType type, int64_t file_size, std::shared_ptr<Metrics> metrics);
+  virtual ~HashCursor();
+
+  HashType hashType() const;
+
+  // [pos, pos + size) has been written to target file, data is nullptr if it's not in memory.
+  // If the data before cursor is written again, the cursor becomes invalid.
+  void onWritten(int64_t pos, const void* data, int64_t size);
+
+  // Block until the whole file has been hashed.
+  // Return CANCELED if is_canceled returns true, CALCULATE_HASH_FAILED if cursor is invalid.
+  Result wait(std::function<bool()> is_canceled, utf8string& str_hash);
+
+ protected:
+  // Post a job to read the data ahead of cursor if there is any and no job is posted. Must be called with mutex_ locked.
+  void scheduleLocked();
+
+  // Hash a few blocks of the data ahead of cursor, then the job is posted again if there is more,
+  // so that a cursor doesn't take a thread of pool from the others for long.
+  void hashProcess();
+  void update(const void* data, int64_t size);
+  utf8string final();
+
+  // Must be called with mutex_ locked.
+  int64_t readableEnd() const;
+
+ protected:
+  TargetFile* target_file_;
+  std::shared_ptr<Metrics> metrics_;
+  const HashType type_;
+  const int64_t file_size_;
+
+  int64_t cursor_;
+  bool invalid_;
+  bool stopping_;
+  bool scheduled_;  // a job is posted to the hashing pool or running
+  std::map<int64_t, int64_t> written_;  // begin -> end, disjoint ranges that are written.
+
+  IncrementalHash hash_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cond_var_;
+};
+
+// Stop the threads of hashing pool, they are started again when a cursor needs them. Called by GlobalUnInit.
+void StopHashCursorPool();
+}  // namespace zoe
+#endif  // !ZOE_HASH_CURSOR_H_
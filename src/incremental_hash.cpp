@@ -0,0 +1,82 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "incremental_hash.h"
+#include <stdio.h>
+#include <algorithm>
+
+namespace zoe {
+IncrementalHash::IncrementalHash(HashType type)
+    : type_(type)
+    , crc32_(0) {
+  libmd5_internal::MD5Init(&md5_);
+  crc32_internal::crc32Init(&crc32_);
+  sha1_.Reset();
+  sha256_internal::sha256_init(&sha256_);
+}
+
+IncrementalHash::~IncrementalHash() {}
+
+HashType IncrementalHash::hashType() const {
+  return type_;
+}
+
+void IncrementalHash::update(const void* data, int64_t size) {
+  const unsigned char* p = (const unsigned char*)data;
+  while (size > 0) {
+    const uint32_t once = (uint32_t)std::min(size, (int64_t)0x40000000);
+    if (type_ == MD5)
+      libmd5_internal::MD5Update(&md5_, p, once);
+    else if (type_ == CRC32)
+      crc32_internal::crc32Update(&crc32_, (unsigned char*)p, once);
+    else if (type_ == SHA1)
+      sha1_.Update((unsigned char*)p, once);
+    else if (type_ == SHA256)
+      sha256_internal::sha256_update(&sha256_, p, once);
+    p += once;
+    size -= once;
+  }
+}
+
+utf8string IncrementalHash::final() {
+  utf8string str_hash;
+  if (type_ == MD5) {
+    unsigned char sig[16] = {0};
+    char str[33] = {0};
+    libmd5_internal::MD5Final(sig, &md5_);
+    libmd5_internal::MD5SigToString(sig, str, 33);
+    str_hash = str;
+  }
+  else if (type_ == CRC32) {
+    crc32_internal::crc32Finish(&crc32_);
+    char str[10] = {0};
+    snprintf(str, sizeof(str), "%08x", crc32_);
+    str_hash = str;
+  }
+  else if (type_ == SHA1) {
+    sha1_.Final();
+    char str[256] = {0};
+    sha1_.ReportHash(str, CSHA1::REPORT_HEX);
+    str_hash = str;
+  }
+  else if (type_ == SHA256) {
+    sha256_internal::sha256_final(&sha256_);
+    str_hash = sha256_internal::sha256_digest(&sha256_);
+  }
+  return str_hash;
+}
+}  // namespace zoe
@@ -0,0 +1,51 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_INCREMENTAL_HASH_H_
+#define ZOE_INCREMENTAL_HASH_H_
+#pragma once
+
+#include "zoe/zoe.h"
+#include "md5.h"
+#include "crc32.h"
+#include "sha1.h"
+#include "sha256.h"
+
+namespace zoe {
+// Hash the data that is fed piece by piece.
+// Not thread safe.
+class IncrementalHash {
+ public:
+  explicit IncrementalHash(HashType type);
+  virtual ~IncrementalHash();
+
+  HashType hashType() const;
+
+  void update(const void* data, int64_t size);
+
+  // The digest in lower case hex, it can only be made once.
+  utf8string final();
+
+ protected:
+  const HashType type_;
+  libmd5_internal::MD5Context md5_;
+  uint32_t crc32_;
+  CSHA1 sha1_;
+  sha256_internal::SHA256_CTX sha256_;
+};
+}  // namespace zoe
+#endif  // !ZOE_INCREMENTAL_HASH_H_
@@ -0,0 +1,264 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "index_file.h"
+#include <string.h>
+#include <algorithm>
+#include "json.hpp"
+#include "file_util.h"
+#include "crc32.h"
+#include "verbose.h"
+
+using json = nlohmann::json;
+
+#define INDEX_FILE_JSON_SIGN_STRING "zoe:EASY-FILE-DOWNLOAD(3.0)"
+
+// Binary format, all integers are little endian:
+//   sign(8) version(u32) update_time(i64) file_size(i64)
+//   content_md5, url, redirect_url, target_tmp_file_path: length(u32) + utf8 bytes
+//   slice_num(u32), each slice: index(i32) begin(i64) end(i64) capacity(i64) chunk_num(u32) chunks(u32 * chunk_num)
+//   crc32(u32) of all bytes above
+#define INDEX_FILE_BINARY_SIGN "ZOE:IDX"  // with terminating null, 8 bytes
+#define INDEX_FILE_BINARY_SIGN_SIZE 8
+#define INDEX_FILE_BINARY_VERSION 1
+#define INDEX_FILE_BINARY_MIN_SLICE_SIZE 32  // a slice without chunks
+#define INDEX_FILE_TMP_EXTENSION ".tmp"
+
+namespace zoe {
+namespace {
+void PutU32(std::string& data, uint32_t v) {
+  for (int i = 0; i < 4; i++)
+    data.push_back((char)((v >> (i * 8)) & 0xFF));
+}
+
+void PutU64(std::string& data, uint64_t v) {
+  for (int i = 0; i < 8; i++)
+    data.push_back((char)((v >> (i * 8)) & 0xFF));
+}
+
+void PutString(std::string& data, const utf8string& str) {
+  PutU32(data, (uint32_t)str.size());
+  data.append(str);
+}
+
+class Reader {
+ public:
+  Reader(const char* data, size_t size)
+      : data_((const unsigned char*)data)
+      , size_(size)
+      , pos_(0)
+      , failed_(false) {}
+
+  uint32_t u32() {
+    uint32_t v = 0;
+    if (!require(4))
+      return v;
+    for (int i = 0; i < 4; i++)
+      v |= (uint32_t)data_[pos_ + i] << (i * 8);
+    pos_ += 4;
+    return v;
+  }
+
+  uint64_t u64() {
+    uint64_t v = 0;
+    if (!require(8))
+      return v;
+    for (int i = 0; i < 8; i++)
+      v |= (uint64_t)data_[pos_ + i] << (i * 8);
+    pos_ += 8;
+    return v;
+  }
+
+  utf8string str() {
+    const uint32_t len = u32();
+    if (!require(len))
+      return utf8string();
+    utf8string s((const char*)data_ + pos_, len);
+    pos_ += len;
+    return s;
+  }
+
+  size_t remaining() const { return size_ - pos_; }
+  bool failed() const { return failed_; }
+
+ private:
+  bool require(size_t n) {
+    if (failed_ || size_ - pos_ < n)
+      failed_ = true;
+    return !failed_;
+  }
+
+  const unsigned char* data_;
+  size_t size_;
+  size_t pos_;
+  bool failed_;
+};
+
+uint32_t Crc32Of(const char* data, size_t size) {
+  uint32_t crc = 0;
+  crc32_internal::crc32Init(&crc);
+  crc32_internal::crc32Update(&crc, (unsigned char*)data, (uint32_t)size);
+  crc32_internal::crc32Finish(&crc);
+  return crc;
+}
+}  // namespace
+
+Result IndexFile::Load(const utf8string& path, Content& content, VerboseOuputFunctor verbose_functor) {
+  FILE* file = FileUtil::Open(path, u8"rb");
+  if (!file)
+    return OPEN_INDEX_FILE_FAILED;
+
+  const int64_t file_size = FileUtil::GetFileSize(file);
+  FileUtil::Seek(file, 0, SEEK_SET);
+  std::vector<char> data((size_t)std::max(file_size, (int64_t)0));
+  const size_t read = data.empty() ? 0 : fread(data.data(), 1, data.size(), file);
+  FileUtil::Close(file);
+
+  if (file_size <= 0 || read != data.size())
+    return OPEN_INDEX_FILE_FAILED;
+
+  if (data.size() >= INDEX_FILE_BINARY_SIGN_SIZE && memcmp(data.data(), INDEX_FILE_BINARY_SIGN, INDEX_FILE_BINARY_SIGN_SIZE) == 0)
+    return ParseBinary(data, content);
+
+  const size_t json_sign_size = strlen(INDEX_FILE_JSON_SIGN_STRING);
+  if (data.size() >= json_sign_size && memcmp(data.data(), INDEX_FILE_JSON_SIGN_STRING, json_sign_size) == 0)
+    return ParseJson(data, content, verbose_functor);
+
+  return INVALID_INDEX_FORMAT;
+}
+
+Result IndexFile::ParseBinary(const std::vector<char>& data, Content& content) {
+  // The checksum detects the files damaged by disk, the files written partially never take the place of index file.
+  if (data.size() < INDEX_FILE_BINARY_SIGN_SIZE + 4 + 4)
+    return INVALID_INDEX_FORMAT;
+  const size_t body_size = data.size() - 4;
+  Reader crc_reader(data.data() + body_size, 4);
+  if (crc_reader.u32() != Crc32Of(data.data(), body_size))
+    return INVALID_INDEX_FORMAT;
+
+  Reader reader(data.data() + INDEX_FILE_BINARY_SIGN_SIZE, body_size - INDEX_FILE_BINARY_SIGN_SIZE);
+  if (reader.u32() != INDEX_FILE_BINARY_VERSION)
+    return INVALID_INDEX_FORMAT;
+
+  content.update_time = (int64_t)reader.u64();
+  content.file_size = (int64_t)reader.u64();
+  content.content_md5 = reader.str();
+  content.url = reader.str();
+  content.redirect_url = reader.str();
+  content.target_tmp_file_path = reader.str();
+
+  const uint32_t slice_num = reader.u32();
+  content.slices.clear();
+  content.slices.reserve(std::min((size_t)slice_num, reader.remaining() / INDEX_FILE_BINARY_MIN_SLICE_SIZE));
+  for (uint32_t i = 0; i < slice_num && !reader.failed(); i++) {
+    SliceRecord record;
+    record.index = (int32_t)reader.u32();
+    record.begin = (int64_t)reader.u64();
+    record.end = (int64_t)reader.u64();
+    record.capacity = (int64_t)reader.u64();
+    const uint32_t chunk_num = reader.u32();
+    if (reader.remaining() / 4 < chunk_num)
+      return INVALID_INDEX_FORMAT;
+    record.chunks.resize(chunk_num);
+    for (uint32_t c = 0; c < chunk_num; c++)
+      record.chunks[c] = reader.u32();
+    content.slices.push_back(record);
+  }
+
+  if (reader.failed() || reader.remaining() != 0)
+    return INVALID_INDEX_FORMAT;
+  return SUCCESSED;
+}
+
+Result IndexFile::ParseJson(const std::vector<char>& data, Content& content, VerboseOuputFunctor verbose_functor) {
+  try {
+    const size_t json_sign_size = strlen(INDEX_FILE_JSON_SIGN_STRING);
+    json j = json::parse(data.begin() + json_sign_size, data.end());
+
+    content.update_time = (int64_t)j["update_time"].get<time_t>();
+    content.file_size = j["file_size"].get<int64_t>();
+    content.content_md5 = j["content_md5"].get<utf8string>();
+    content.url = j["url"].get<utf8string>();
+    content.redirect_url = j["redirect_url"].get<utf8string>();
+    content.target_tmp_file_path = j["target_tmp_file_path"].get<utf8string>();
+
+    content.slices.clear();
+    for (auto& it : j["slices"]) {
+      SliceRecord record;
+      record.index = it["index"].get<int32_t>();
+      record.begin = it["begin"].get<int64_t>();
+      record.end = it["end"].get<int64_t>();
+      record.capacity = it["capacity"].get<int64_t>();
+      if (it.find("chunks") != it.end())
+        record.chunks = it["chunks"].get<std::vector<uint32_t>>();
+      content.slices.push_back(record);
+    }
+  } catch (const std::exception& e) {
+    OutputVerbose(verbose_functor, u8"Parse index file exception: %s.\n", e.what() ? e.what() : "");
+    content.slices.clear();
+    return INVALID_INDEX_FORMAT;
+  }
+  return SUCCESSED;
+}
+
+void IndexFile::Serialize(const Content& content, std::string& data) {
+  data.clear();
+  data.append(INDEX_FILE_BINARY_SIGN, INDEX_FILE_BINARY_SIGN_SIZE);
+  PutU32(data, INDEX_FILE_BINARY_VERSION);
+  PutU64(data, (uint64_t)content.update_time);
+  PutU64(data, (uint64_t)content.file_size);
+  PutString(data, content.content_md5);
+  PutString(data, content.url);
+  PutString(data, content.redirect_url);
+  PutString(data, content.target_tmp_file_path);
+
+  PutU32(data, (uint32_t)content.slices.size());
+  for (const SliceRecord& record : content.slices) {
+    PutU32(data, (uint32_t)record.index);
+    PutU64(data, (uint64_t)record.begin);
+    PutU64(data, (uint64_t)record.end);
+    PutU64(data, (uint64_t)record.capacity);
+    PutU32(data, (uint32_t)record.chunks.size());
+    for (uint32_t hash : record.chunks)
+      PutU32(data, hash);
+  }
+
+  PutU32(data, Crc32Of(data.data(), data.size()));
+}
+
+bool IndexFile::Save(const utf8string& path, const Content& content) {
+  if (path.length() == 0)
+    return false;
+
+  std::string data;
+  Serialize(content, data);
+
+  const utf8string tmp_path = path + INDEX_FILE_TMP_EXTENSION;
+  FILE* f = FileUtil::Open(tmp_path, u8"wb");
+  if (!f)
+    return false;
+
+  const bool written = (fwrite(data.data(), 1, data.size(), f) == data.size()) && FileUtil::Sync(f);
+  FileUtil::Close(f);
+
+  if (!written || !FileUtil::Rename(tmp_path, path)) {
+    FileUtil::RemoveFile(tmp_path);
+    return false;
+  }
+  return true;
+}
+}  // namespace zoe
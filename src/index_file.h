@@ -0,0 +1,61 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_INDEX_FILE_H_
+#define ZOE_INDEX_FILE_H_
+#pragma once
+
+#include <vector>
+#include "zoe/zoe.h"
+
+namespace zoe {
+// The index file records the slices of an uncompleted download, so that it can be resumed.
+// It is saved in a versioned binary format, the JSON format of zoe 3.0 can still be loaded.
+class IndexFile {
+ public:
+  typedef struct _SliceRecord {
+    int32_t index;
+    int64_t begin;
+    int64_t end;
+    int64_t capacity;
+    std::vector<uint32_t> chunks;  // chunk hashes, empty if not recorded
+  } SliceRecord;
+
+  typedef struct _Content {
+    int64_t update_time;
+    int64_t file_size;
+    utf8string content_md5;
+    utf8string url;
+    utf8string redirect_url;
+    utf8string target_tmp_file_path;
+    std::vector<SliceRecord> slices;
+  } Content;
+
+  // Return OPEN_INDEX_FILE_FAILED if the file can't be read, INVALID_INDEX_FORMAT if it is neither format or damaged.
+  static Result Load(const utf8string& path, Content& content, VerboseOuputFunctor verbose_functor);
+
+  // The content is written to a temporary file and renamed to path,
+  // so the index file is either the previous one or the new one if the process crashes.
+  static bool Save(const utf8string& path, const Content& content);
+
+ protected:
+  static Result ParseBinary(const std::vector<char>& data, Content& content);
+  static Result ParseJson(const std::vector<char>& data, Content& content, VerboseOuputFunctor verbose_functor);
+  static void Serialize(const Content& content, std::string& data);
+};
+}  // namespace zoe
+#endif  // !ZOE_INDEX_FILE_H_
@@ -1,5 +1,6 @@
 ﻿#include "md5.h"
 #include <memory.h>
+#include <vector>
 #include "file_util.h"
 #include "options.h"
 
@@ -316,15 +317,15 @@ Result CalculateFileMd5(const utf8string& file_path,
   libmd5_internal::MD5Init(&md5Context);
 
   size_t dwReadBytes = 0;
-  unsigned char szData[1024] = {0};
+  std::vector<unsigned char> szData(ZOE_HASH_READ_BUFFER_SIZE);
 
-  while ((dwReadBytes = fread(szData, 1, 1024, f)) > 0) {
+  while ((dwReadBytes = fread(szData.data(), 1, szData.size(), f)) > 0) {
     if (opt && (opt->internal_stop_event.isSetted() ||
                 (opt->user_stop_event && opt->user_stop_event->isSetted()))) {
       FileUtil::Close(f);
       return CANCELED;
     }
-    libmd5_internal::MD5Update(&md5Context, szData, dwReadBytes);
+    libmd5_internal::MD5Update(&md5Context, szData.data(), dwReadBytes);
   }
 
   FileUtil::Close(f);
@@ -348,14 +349,14 @@ Result CalculateFileMd5(FILE* f, Options* opt, utf8string& str_hash) {
   libmd5_internal::MD5Init(&md5Context);
 
   size_t dwReadBytes = 0;
-  unsigned char szData[1024] = {0};
+  std::vector<unsigned char> szData(ZOE_HASH_READ_BUFFER_SIZE);
 
-  while ((dwReadBytes = fread(szData, 1, 1024, f)) > 0) {
+  while ((dwReadBytes = fread(szData.data(), 1, szData.size(), f)) > 0) {
     if (opt && (opt->internal_stop_event.isSetted() ||
                 (opt->user_stop_event && opt->user_stop_event->isSetted()))) {
       return CANCELED;
     }
-    libmd5_internal::MD5Update(&md5Context, szData, dwReadBytes);
+    libmd5_internal::MD5Update(&md5Context, szData.data(), dwReadBytes);
   }
 
   libmd5_internal::MD5Final(szMd5Sig, &md5Context);
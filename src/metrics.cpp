@@ -0,0 +1,186 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "metrics.h"
+#include "curl/curl.h"
+
+namespace zoe {
+Metrics::Metrics() {
+  fetch_file_info_time_ms_.store(0L);
+  transfer_time_ms_.store(0L);
+  finish_time_ms_.store(0L);
+  hash_verify_time_ms_.store(0L);
+  streaming_hash_time_us_.store(0L);
+  hash_lock_wait_time_us_.store(0L);
+  disk_write_num_.store(0L);
+  disk_write_bytes_.store(0L);
+  disk_write_time_us_.store(0L);
+  for (int i = 0; i < ZOE_METRICS_LATENCY_BUCKETS; i++)
+    disk_write_latency_[i].store(0L);
+  write_stall_num_.store(0L);
+  hedge_num_.store(0L);
+  hedge_won_num_.store(0L);
+  download_cache_hit_.store(false);
+  decompressed_bytes_.store(0L);
+  decompress_time_us_.store(0L);
+  delta_copied_bytes_.store(0L);
+  delta_scan_time_ms_.store(0L);
+  peer_received_bytes_.store(0L);
+}
+
+Metrics::~Metrics() {}
+
+void Metrics::addFetchFileInfoTime(int64_t ms) {
+  fetch_file_info_time_ms_ += ms;
+}
+
+void Metrics::addTransferTime(int64_t ms) {
+  transfer_time_ms_ += ms;
+}
+
+void Metrics::addFinishTime(int64_t ms) {
+  finish_time_ms_ += ms;
+}
+
+void Metrics::addHashVerifyTime(int64_t ms) {
+  hash_verify_time_ms_ += ms;
+}
+
+void Metrics::addStreamingHashTime(int64_t us) {
+  streaming_hash_time_us_ += us;
+}
+
+void Metrics::addHashLockWaitTime(int64_t us) {
+  hash_lock_wait_time_us_ += us;
+}
+
+void Metrics::addDiskWrite(int64_t bytes, int64_t us) {
+  disk_write_num_++;
+  disk_write_bytes_ += bytes;
+  disk_write_time_us_ += us;
+
+  // bucket i holds [2^(i-1), 2^i) us.
+  int bucket = 0;
+  while (us > 0 && bucket < ZOE_METRICS_LATENCY_BUCKETS - 1) {
+    us >>= 1;
+    bucket++;
+  }
+  disk_write_latency_[bucket]++;
+}
+
+void Metrics::addWriteStall() {
+  write_stall_num_++;
+}
+
+void Metrics::addHedge() {
+  hedge_num_++;
+}
+
+void Metrics::addHedgeWon() {
+  hedge_won_num_++;
+}
+
+void Metrics::setDownloadCacheHit() {
+  download_cache_hit_.store(true);
+}
+
+void Metrics::addDecompress(int64_t bytes, int64_t us) {
+  decompressed_bytes_ += bytes;
+  decompress_time_us_ += us;
+}
+
+void Metrics::addDelta(int64_t copied_bytes, int64_t scan_ms) {
+  delta_copied_bytes_ += copied_bytes;
+  delta_scan_time_ms_ += scan_ms;
+}
+
+void Metrics::addPeerReceived(int64_t bytes) {
+  peer_received_bytes_ += bytes;
+}
+
+void Metrics::onSliceTransferDone(int32_t index, void* easy, int64_t downloaded, int32_t failed_times) {
+  int64_t connect_time_us = -1L;
+  int64_t tls_time_us = -1L;
+  int64_t first_byte_time_us = -1L;
+  if (easy) {
+#if LIBCURL_VERSION_NUM >= 0x073D00  // 7.61.0
+    curl_off_t t = 0;
+    if (curl_easy_getinfo(easy, CURLINFO_CONNECT_TIME_T, &t) == CURLE_OK)
+      connect_time_us = (int64_t)t;
+    if (curl_easy_getinfo(easy, CURLINFO_APPCONNECT_TIME_T, &t) == CURLE_OK)
+      tls_time_us = (int64_t)t;
+    if (curl_easy_getinfo(easy, CURLINFO_STARTTRANSFER_TIME_T, &t) == CURLE_OK)
+      first_byte_time_us = (int64_t)t;
+#else
+    double t = 0.0;
+    if (curl_easy_getinfo(easy, CURLINFO_CONNECT_TIME, &t) == CURLE_OK)
+      connect_time_us = (int64_t)(t * 1000000.0);
+    if (curl_easy_getinfo(easy, CURLINFO_APPCONNECT_TIME, &t) == CURLE_OK)
+      tls_time_us = (int64_t)(t * 1000000.0);
+    if (curl_easy_getinfo(easy, CURLINFO_STARTTRANSFER_TIME, &t) == CURLE_OK)
+      first_byte_time_us = (int64_t)(t * 1000000.0);
+#endif
+  }
+
+  std::lock_guard<std::mutex> lg(slices_mutex_);
+  auto it = slices_.find(index);
+  if (it == slices_.end()) {
+    SliceMetrics slice_metrics;
+    slice_metrics.index = index;
+    slice_metrics.transfers = 0;
+    it = slices_.insert(std::make_pair(index, slice_metrics)).first;
+  }
+
+  it->second.downloaded = downloaded;
+  it->second.retries = failed_times;
+  it->second.transfers++;
+  it->second.connect_time_us = connect_time_us;
+  it->second.tls_time_us = tls_time_us;
+  it->second.first_byte_time_us = first_byte_time_us;
+}
+
+DownloadMetrics Metrics::snapshot() const {
+  DownloadMetrics m;
+  m.fetch_file_info_time_ms = fetch_file_info_time_ms_.load();
+  m.transfer_time_ms = transfer_time_ms_.load();
+  m.finish_time_ms = finish_time_ms_.load();
+  m.hash_verify_time_ms = hash_verify_time_ms_.load();
+  m.streaming_hash_time_us = streaming_hash_time_us_.load();
+  m.hash_lock_wait_time_us = hash_lock_wait_time_us_.load();
+  m.disk_write_num = disk_write_num_.load();
+  m.disk_write_bytes = disk_write_bytes_.load();
+  m.disk_write_time_us = disk_write_time_us_.load();
+  m.disk_write_latency.resize(ZOE_METRICS_LATENCY_BUCKETS);
+  for (int i = 0; i < ZOE_METRICS_LATENCY_BUCKETS; i++)
+    m.disk_write_latency[i] = disk_write_latency_[i].load();
+  m.write_stall_num = write_stall_num_.load();
+  m.hedge_num = hedge_num_.load();
+  m.hedge_won_num = hedge_won_num_.load();
+  m.download_cache_hit = download_cache_hit_.load();
+  m.decompressed_bytes = decompressed_bytes_.load();
+  m.decompress_time_us = decompress_time_us_.load();
+  m.delta_copied_bytes = delta_copied_bytes_.load();
+  m.delta_scan_time_ms = delta_scan_time_ms_.load();
+  m.peer_received_bytes = peer_received_bytes_.load();
+
+  std::lock_guard<std::mutex> lg(slices_mutex_);
+  m.slices.reserve(slices_.size());
+  for (const auto& it : slices_)
+    m.slices.push_back(it.second);
+  return m;
+}
+}  // namespace zoe
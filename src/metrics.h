@@ -0,0 +1,82 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_METRICS_H_
+#define ZOE_METRICS_H_
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include "zoe/zoe.h"
+
+namespace zoe {
+#define ZOE_METRICS_LATENCY_BUCKETS 24  // the last bucket holds the writes take 2^22 us(about 4s) or more
+
+// Counters of a download, see DownloadMetrics.
+// Thread safe, all of counters are updated without lock except the slice metrics.
+class Metrics {
+ public:
+  Metrics();
+  virtual ~Metrics();
+
+  void addFetchFileInfoTime(int64_t ms);
+  void addTransferTime(int64_t ms);
+  void addFinishTime(int64_t ms);
+  void addHashVerifyTime(int64_t ms);
+  void addStreamingHashTime(int64_t us);
+  void addHashLockWaitTime(int64_t us);
+  void addDiskWrite(int64_t bytes, int64_t us);
+  void addWriteStall();
+  void addHedge();
+  void addHedgeWon();
+  void setDownloadCacheHit();
+  void addDecompress(int64_t bytes, int64_t us);
+  void addDelta(int64_t copied_bytes, int64_t scan_ms);
+  void addPeerReceived(int64_t bytes);
+
+  // Called on loop thread when a transfer of slice finished, easy is the curl handle of the transfer.
+  void onSliceTransferDone(int32_t index, void* easy, int64_t downloaded, int32_t failed_times);
+
+  DownloadMetrics snapshot() const;
+
+ protected:
+  std::atomic<int64_t> fetch_file_info_time_ms_;
+  std::atomic<int64_t> transfer_time_ms_;
+  std::atomic<int64_t> finish_time_ms_;
+  std::atomic<int64_t> hash_verify_time_ms_;
+  std::atomic<int64_t> streaming_hash_time_us_;
+  std::atomic<int64_t> hash_lock_wait_time_us_;
+  std::atomic<int64_t> disk_write_num_;
+  std::atomic<int64_t> disk_write_bytes_;
+  std::atomic<int64_t> disk_write_time_us_;
+  std::atomic<int64_t> disk_write_latency_[ZOE_METRICS_LATENCY_BUCKETS];
+  std::atomic<int64_t> write_stall_num_;
+  std::atomic<int64_t> hedge_num_;
+  std::atomic<int64_t> hedge_won_num_;
+  std::atomic_bool download_cache_hit_;
+  std::atomic<int64_t> decompressed_bytes_;
+  std::atomic<int64_t> decompress_time_us_;
+  std::atomic<int64_t> delta_copied_bytes_;
+  std::atomic<int64_t> delta_scan_time_ms_;
+  std::atomic<int64_t> peer_received_bytes_;
+
+  mutable std::mutex slices_mutex_;
+  std::map<int32_t, SliceMetrics> slices_;
+};
+}  // namespace zoe
+#endif  // !ZOE_METRICS_H_
@@ -29,42 +29,154 @@ namespace zoe {
 #define ZOE_DEFAULT_FETCH_FILE_INFO_RETRY_TIMES 1
 #define ZOE_DEFAULT_THREAD_NUM 1
 #define ZOE_DEFAULT_SLICE_MAX_FAILED_TIMES 3
+#define ZOE_MULTI_POLL_TIMEOUT_MS 1000
+#define ZOE_DEFAULT_ENGINE_IO_THREAD_NUM 1
+#define ZOE_DEFAULT_ENGINE_WORKER_THREAD_NUM 1
+#define ZOE_CURL_HANDLE_POOL_MAX_SIZE 64
+#define ZOE_DEFAULT_DISK_WRITER_THREAD_NUM 1
+#define ZOE_HASH_CURSOR_THREAD_NUM 2  // the threads shared by the streaming hash of all downloads
+#define ZOE_HASH_CURSOR_JOB_READ_NUM 8  // blocks read by a job of streaming hash before the others take the thread
+#define ZOE_ENGINE_DISK_WRITER_MAX_QUEUED_BYTES 134217728  // 128MB, the blocks queued are bounded by the pools of tasks
+#define ZOE_HDD_WRITE_BATCH_DELAY_MS 10  // the disk writer collects the caches for elevator order, see StorageClass
+#define ZOE_HDD_WRITE_BATCH_PERCENT 50  // of the queue limit, the batch starts at once when the queue holds more
+#define ZOE_NETWORK_WRITE_BATCH_DELAY_MS 30
+#define ZOE_NETWORK_WRITE_BATCH_PERCENT 75
+#define ZOE_DISK_WRITER_MAX_MERGE_NUM 64  // buffers gathered in one write
+#define ZOE_CACHE_MEMORY_PRESSURE_PERCENT 75  // the pools are held to their shares of cache memory budget above it
+#define ZOE_MIN_SPLIT_SLICE_SIZE_BYTE 1048576  // 1MB, each half of a split slice is at least this size
+#define ZOE_DEFAULT_SLICE_TARGET_DURATION_MS 10000  // SlicePolicy::Adaptive
+#define ZOE_SLICE_TARGET_LATENCY_TIMES 50  // a request takes at least this times of the request latency
+#define ZOE_SLICE_SIZER_INITIAL_SLICES_PER_THREAD 4
+#define ZOE_SLICE_SIZER_MIN_ELAPSED_MS 50
+#define ZOE_SLICE_SIZER_SPEED_WEIGHT 0.3  // weight of the last completed slice in the throughput of a connection
+#define ZOE_SLICE_SIZER_MAX_SIZE_BYTE 268435456  // 256MB
+#define ZOE_ADAPTIVE_SAMPLE_INTERVAL_MS 2000
+#define ZOE_ADAPTIVE_MIN_GAIN_PERCENT 5
+#define ZOE_ADAPTIVE_HOLD_ROUNDS 5
+#define ZOE_DIRECT_IO_ALIGNMENT 4096  // offset, size and address alignment of unbuffered writes
+#define ZOE_HASH_READ_BUFFER_SIZE 1048576  // 1MB
+#define ZOE_CHUNK_HASH_SIZE_BYTE 4194304  // 4MB
+#define ZOE_DEFAULT_SLICE_COALESCE_GAP_BYTE 131072  // 128KB
+#define ZOE_PARALLEL_HASH_BUFFER_SIZE 4194304  // 4MB
+#define ZOE_PARALLEL_HASH_BUFFER_NUM 4  // buffers read ahead of hashing
+#define ZOE_DEFAULT_HASH_VERIFY_THREAD_NUM 1
+#define ZOE_DELTA_MANIFEST_MAGIC "ZOEDELTA"
+#define ZOE_DELTA_MANIFEST_VERSION 1
+#define ZOE_DELTA_MIN_BLOCK_SIZE_BYTE 512
+#define ZOE_DELTA_MAX_BLOCK_SIZE_BYTE 16777216  // 16MB
+#define ZOE_DELTA_MAX_MANIFEST_SIZE_BYTE 134217728  // 128MB
+#define ZOE_DELTA_SCAN_BUFFER_SIZE 4194304  // 4MB
+#define ZOE_PEER_REFRESH_INTERVAL_MS 2000  // how often the ranges shared by peers are fetched
+#define ZOE_PEER_REQUEST_TIMEOUT_MS 2000
+#define ZOE_PEER_MAX_RANGES_SIZE_BYTE 16777216  // 16MB
+#define ZOE_PEER_SERVER_MAX_CONNECTION_NUM 64
+#define ZOE_PEER_SERVER_IDLE_TIMEOUT_MS 30000
+#define ZOE_PEER_MAX_REQUEST_HEADER_SIZE 16384
+#define ZOE_PEER_SEND_BLOCK_SIZE 262144  // 256KB
+#define ZOE_DEFAULT_CHECKPOINT_INTERVAL_MS 10000
+#define ZOE_DEFAULT_CHECKPOINT_BYTES 67108864  // 64MB
+#define ZOE_DEFAULT_PROGRESS_INTERVAL_MS 500
+#define ZOE_DEFAULT_SPEED_INTERVAL_MS 1000
+#define ZOE_SPEED_HALF_LIFE_MS 3000  // weight of a speed sample halves in this time
+#define ZOE_SOURCE_SPEED_HALF_LIFE_MS 10000
+#define ZOE_SOURCE_ERROR_RATE_WEIGHT 0.2  // weight of the last transfer in the error rate of a source
+#define ZOE_SOURCE_MAX_CONTINUOUS_FAILED_TIMES 3  // the source is not selected while other sources work
+#define ZOE_ADDRESS_MAX_CONTINUOUS_FAILED_TIMES 1  // for the sources of the addresses of one server
+#define ZOE_MAX_STREAMS_PER_CONNECTION 100  // HTTP/2 and HTTP/3
+#define ZOE_BANDWIDTH_BURST_MS 100  // the tokens of bandwidth are capped at the bytes received in this time
+#define ZOE_BANDWIDTH_MIN_BURST_BYTE 65536
+#define ZOE_BUDGET_POLL_INTERVAL_MS 10  // how often the slices waiting for budget are checked
+#define ZOE_DEFAULT_PAUSE_KEEP_ALIVE_MS 30000
+#define ZOE_DEFAULT_BATCH_FETCH_THREAD_NUM 4
+#define ZOE_DEFAULT_BATCH_THREAD_NUM 4
+#define ZOE_DEFAULT_BATCH_MAX_TRANSFER_NUM 16
+#define ZOE_DEFAULT_BATCH_MAX_ACTIVE_FILE_NUM 32
+#define ZOE_DEFAULT_BATCH_DISK_CACHE_SIZE_BYTE 2097152  // 2MB
+#define ZOE_DEFAULT_BATCH_UNSLICED_FILE_SIZE_BYTE 4194304  // 4MB
+#define ZOE_DEFAULT_STREAM_READ_AHEAD_BYTE 67108864  // 64MB
+#define ZOE_STREAM_READ_BUFFER_SIZE 1048576  // 1MB
+#define ZOE_DEFAULT_HEDGE_SLOW_PERCENT 20
+#define ZOE_HEDGE_MIN_ELAPSED_MS 2000  // the speed of a slice is not compared until it has been sampled for this time
+#define ZOE_HEDGE_MIN_REMAINING_TIME_MS 1000  // the slow slice that would complete in this time is not hedged
+#define ZOE_SLICE_MAX_HEDGED_TIMES 2
+#define ZOE_HEDGE_SPEED_HISTORY_NUM 8  // speeds of the slices completed lately, compared with when few slices are downloading
+#define ZOE_DEFAULT_RETRY_BASE_DELAY_MS 500
+#define ZOE_DEFAULT_RETRY_MAX_DELAY_MS 8000
+#define ZOE_RANGE_PROBE_SIZE_BYTE 262144  // 256KB, the beginning of file requested by range probe
+#define ZOE_FILE_INFO_CACHE_MAX_NUM 256
+#define ZOE_DEFAULT_DOWNLOAD_CACHE_MAX_SIZE_BYTE 10737418240LL  // 10GB
+#define ZOE_DECOMPRESS_BUFFER_SIZE 262144  // 256KB, output buffer of codec and decompressed file
+#define ZOE_TRACE_DEFAULT_EVENT_NUM 16384  // events kept by each thread while tracing
 
 typedef struct _Options {
   bool redirected_url_check_enabled;
   bool content_md5_enabled;
   bool use_head_method_fetch_file_info;
+  bool range_probe_enabled;  // fetch the file info with a range request of the beginning of file
   bool verify_peer_certificate;
   bool verify_peer_host;
+  bool slice_split_enabled;
+  bool async_disk_write_enabled;
+  bool adaptive_concurrency_enabled;
+  bool chunk_hash_enabled;
+  int32_t adaptive_min_thread_num;
   int32_t thread_num;
   int32_t disk_cache_size;
   int32_t max_speed;
   int32_t min_speed;
   int32_t min_speed_duration;
+  int32_t progress_interval;
+  int32_t speed_interval;
   int32_t tmp_file_expired_time;
   int32_t fetch_file_info_retry;
+  int32_t file_info_cache_time;  // seconds the cached file info is used without revalidation, -1 means not cached
   int32_t network_conn_timeout;
 
   int32_t slice_max_failed_times;
+  int32_t retry_base_delay;  // ms, 0 means retry at once
+  int32_t retry_max_delay;
+
+  bool hedge_enabled;
+  int32_t hedge_slow_percent;  // a slice is slow below this percent of the median speed of others
 
   SlicePolicy slice_policy;
   int64_t slice_policy_value;
+  int64_t unsliced_file_size;  // 0 means always slice
+
+  CheckpointPolicy checkpoint_policy;
+  int64_t checkpoint_policy_value;
 
   HashVerifyPolicy hash_verify_policy;
   HashType hash_type;
   utf8string hash_value;
+  int32_t hash_verify_thread_num;  // 0 means the number of CPU cores
 
   ResultFunctor result_functor;
   ProgressFunctor progress_functor;
   RealtimeSpeedFunctor speed_functor;
   VerboseOuputFunctor verbose_functor;
+  CallbackExecutor callback_executor;
 
   mutable Event internal_stop_event;
   Event* user_stop_event;
 
+  Engine* engine;
+
   utf8string url;
   utf8string target_file_path;
 
+  // The same file as url on other servers, the slices are downloaded from all of them.
+  std::vector<utf8string> mirror_urls;
+  int32_t max_address_num;  // of each server that the connections are spread over, 1 or less means not spread
+
+  // Delta update, the blocks found in the old file are copied rather than downloaded. Disabled if either is empty.
+  utf8string delta_old_file_path;
+  utf8string delta_manifest_url;
+
+  // Peer mode, the data is shared to peers on the port and the slices are fetched from the peers that have them.
+  int32_t peer_listen_port;  // 0 means not shared
+  std::vector<utf8string> peer_urls;
+
   HttpHeaders http_headers;
 
   utf8string proxy;
@@ -74,32 +186,86 @@ typedef struct _Options {
   utf8string ca_path;
 
   UncompletedSliceSavePolicy uncompleted_slice_save_policy;
+  int64_t slice_coalesce_gap;  // negative means never coalesce
+
+  DiskIoPolicy disk_io_policy;
+  StorageClass storage_class;
+
+  int32_t pause_keep_alive_time;  // ms, negative means never release
+
+  HttpVersion http_version;
+  int32_t max_host_connections;
+
+  TaskPriority priority;
+  int32_t priority_weight;
+
+  StreamFunctor stream_functor;
+  int64_t stream_read_ahead_size;  // 0 means no limit
+
+  bool memory_target_enabled;
+  void* memory_buffer;  // owned by user, nullptr if allocated by zoe
+  int64_t memory_buffer_size;
+  std::shared_ptr<std::vector<char>> memory_storage;  // allocated by zoe
+  int64_t memory_data_size;  // -1 until downloaded
+
+  CompressionCodec decompress_codec;
+  StreamDecoderFactory decoder_factory;  // for COMPRESSION_CUSTOM
+  HashType decompressed_hash_type;
+  utf8string decompressed_hash_value;  // empty means not verified
+
+  utf8string download_cache_dir;  // empty means disabled
+  int64_t download_cache_max_size;
+  bool download_cache_hardlink;
 
   _Options() : internal_stop_event(true) {
     redirected_url_check_enabled = true;
     content_md5_enabled = false;
     use_head_method_fetch_file_info = true;
+    range_probe_enabled = false;
 
     verify_peer_certificate = false;
     verify_peer_host = false;
 
+    slice_split_enabled = true;
+    async_disk_write_enabled = true;
+
+    adaptive_concurrency_enabled = false;
+    adaptive_min_thread_num = 1;
+
+    chunk_hash_enabled = false;
+
     thread_num = ZOE_DEFAULT_THREAD_NUM;
     disk_cache_size = ZOE_DEFAULT_TOTAL_DISK_CACHE_SIZE_BYTE;
 
     slice_policy = Auto;
     slice_policy_value = 0L;
+    unsliced_file_size = 0L;
+
+    checkpoint_policy = CHECKPOINT_BY_TIME;
+    checkpoint_policy_value = ZOE_DEFAULT_CHECKPOINT_INTERVAL_MS;
 
     hash_verify_policy = ALWAYS;
     hash_type = MD5;
+    hash_verify_thread_num = ZOE_DEFAULT_HASH_VERIFY_THREAD_NUM;
 
     max_speed = -1;
     min_speed = -1;
     min_speed_duration = 0;
+    progress_interval = ZOE_DEFAULT_PROGRESS_INTERVAL_MS;
+    speed_interval = ZOE_DEFAULT_SPEED_INTERVAL_MS;
     tmp_file_expired_time = -1;
     fetch_file_info_retry = ZOE_DEFAULT_FETCH_FILE_INFO_RETRY_TIMES;
+    max_address_num = 0;
+    peer_listen_port = 0;
+    file_info_cache_time = -1;
     network_conn_timeout = ZOE_DEFAULT_NETWORK_CONN_TIMEOUT_MS;
 
     slice_max_failed_times = ZOE_DEFAULT_SLICE_MAX_FAILED_TIMES;
+    retry_base_delay = ZOE_DEFAULT_RETRY_BASE_DELAY_MS;
+    retry_max_delay = ZOE_DEFAULT_RETRY_MAX_DELAY_MS;
+
+    hedge_enabled = true;
+    hedge_slow_percent = ZOE_DEFAULT_HEDGE_SLOW_PERCENT;
 
     result_functor = nullptr;
     progress_functor = nullptr;
@@ -108,7 +274,35 @@ typedef struct _Options {
 
     user_stop_event = nullptr;
 
+    engine = nullptr;
+
     uncompleted_slice_save_policy = ALWAYS_DISCARD;
+    slice_coalesce_gap = ZOE_DEFAULT_SLICE_COALESCE_GAP_BYTE;
+
+    disk_io_policy = STANDARD_IO;
+    storage_class = STORAGE_SSD;
+
+    pause_keep_alive_time = ZOE_DEFAULT_PAUSE_KEEP_ALIVE_MS;
+
+    http_version = HTTP_VERSION_AUTO;
+    max_host_connections = 0;
+
+    priority = PRIORITY_NORMAL;
+    priority_weight = 1;
+
+    stream_read_ahead_size = ZOE_DEFAULT_STREAM_READ_AHEAD_BYTE;
+
+    memory_target_enabled = false;
+    memory_buffer = nullptr;
+    memory_buffer_size = 0L;
+    memory_data_size = -1L;
+
+    decompress_codec = COMPRESSION_NONE;
+    decoder_factory = nullptr;
+    decompressed_hash_type = MD5;
+
+    download_cache_max_size = ZOE_DEFAULT_DOWNLOAD_CACHE_MAX_SIZE_BYTE;
+    download_cache_hardlink = false;
 
     
   }
@@ -0,0 +1,207 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "parallel_hash.h"
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <condition_variable>
+#include "options.h"
+#include "crc32.h"
+#include "file_util.h"
+#include "incremental_hash.h"
+
+namespace zoe {
+
+static bool IsStopped(Options* opt) {
+  return opt && (opt->internal_stop_event.isSetted() || (opt->user_stop_event && opt->user_stop_event->isSetted()));
+}
+
+// The CRC32 of [begin, end) of file, return false if failed to read the whole range.
+static bool CalculateRangeCRC32(const utf8string& file_path,
+                                int64_t begin,
+                                int64_t end,
+                                Options* opt,
+                                std::atomic_bool& failed,
+                                uint32_t& crc) {
+  FILE* f = FileUtil::Open(file_path, "rb");
+  if (!f)
+    return false;
+
+  if (FileUtil::Seek(f, begin, SEEK_SET) != 0) {
+    FileUtil::Close(f);
+    return false;
+  }
+
+  crc32_internal::crc32Init(&crc);
+
+  std::vector<unsigned char> buffer(ZOE_PARALLEL_HASH_BUFFER_SIZE);
+  int64_t pos = begin;
+  while (pos < end) {
+    if (failed || IsStopped(opt))
+      break;
+
+    const size_t to_read = (size_t)std::min((int64_t)buffer.size(), end - pos);
+    const size_t once = fread(buffer.data(), 1, to_read, f);
+    if (once == 0)
+      break;
+    crc32_internal::crc32Update(&crc, buffer.data(), (uint32_t)once);
+    pos += (int64_t)once;
+  }
+  FileUtil::Close(f);
+
+  crc32_internal::crc32Finish(&crc);
+  return pos == end;
+}
+
+static Result CalculateFileCRC32Parallel(const utf8string& file_path,
+                                         int64_t file_size,
+                                         int32_t thread_num,
+                                         Options* opt,
+                                         utf8string& str_hash) {
+  // Ranges smaller than the buffer are not worth a thread.
+  const int64_t max_range_num = std::max((int64_t)1, file_size / ZOE_PARALLEL_HASH_BUFFER_SIZE);
+  const int32_t range_num = (int32_t)std::min((int64_t)thread_num, (int64_t)max_range_num);
+  const int64_t range_size = file_size / range_num;
+
+  std::vector<uint32_t> crcs(range_num, 0);
+  std::vector<int64_t> ends(range_num, 0);
+  std::atomic_bool failed(false);
+  std::vector<std::thread> threads;
+
+  for (int32_t i = 0; i < range_num; i++) {
+    const int64_t begin = range_size * i;
+    ends[i] = (i == range_num - 1) ? file_size : begin + range_size;
+    threads.emplace_back([&, i, begin]() {
+      if (!CalculateRangeCRC32(file_path, begin, ends[i], opt, failed, crcs[i]))
+        failed = true;
+    });
+  }
+
+  for (auto& t : threads)
+    t.join();
+
+  if (IsStopped(opt))
+    return CANCELED;
+  if (failed)
+    return CALCULATE_HASH_FAILED;
+
+  uint32_t crc = crcs[0];
+  for (int32_t i = 1; i < range_num; i++)
+    crc = crc32_internal::crc32Combine(crc, crcs[i], ends[i] - ends[i - 1]);
+
+  char szCRC[10] = {0};
+  snprintf(szCRC, sizeof(szCRC), "%08x", crc);
+  str_hash = szCRC;
+  return SUCCESSED;
+}
+
+// The reading thread fills the free buffers and the calling thread hashes the filled ones, in order.
+static Result CalculateFileHashPipelined(const utf8string& file_path, HashType type, Options* opt, utf8string& str_hash) {
+  FILE* f = FileUtil::Open(file_path, "rb");
+  if (!f)
+    return CALCULATE_HASH_FAILED;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::deque<std::vector<unsigned char>> free_buffers(ZOE_PARALLEL_HASH_BUFFER_NUM);
+  std::deque<std::vector<unsigned char>> filled_buffers;
+  bool read_done = false;
+  bool hash_done = false;
+  bool read_failed = false;
+
+  std::thread reader([&]() {
+    while (true) {
+      std::vector<unsigned char> buffer;
+      {
+        std::unique_lock<std::mutex> ul(mutex);
+        cond.wait(ul, [&]() { return !free_buffers.empty() || hash_done; });
+        if (hash_done)
+          break;
+        buffer = std::move(free_buffers.front());
+        free_buffers.pop_front();
+      }
+
+      buffer.resize(ZOE_PARALLEL_HASH_BUFFER_SIZE);
+      const size_t once = IsStopped(opt) ? 0 : fread(buffer.data(), 1, buffer.size(), f);
+      buffer.resize(once);
+
+      std::lock_guard<std::mutex> lg(mutex);
+      if (once == 0) {
+        read_failed = ferror(f) != 0;
+        read_done = true;
+        cond.notify_all();
+        break;
+      }
+      filled_buffers.push_back(std::move(buffer));
+      cond.notify_all();
+    }
+  });
+
+  IncrementalHash hash(type);
+  while (true) {
+    std::vector<unsigned char> buffer;
+    {
+      std::unique_lock<std::mutex> ul(mutex);
+      cond.wait(ul, [&]() { return !filled_buffers.empty() || read_done; });
+      if (filled_buffers.empty())
+        break;
+      buffer = std::move(filled_buffers.front());
+      filled_buffers.pop_front();
+    }
+
+    hash.update(buffer.data(), (int64_t)buffer.size());
+
+    std::lock_guard<std::mutex> lg(mutex);
+    free_buffers.push_back(std::move(buffer));
+    cond.notify_all();
+  }
+
+  {
+    std::lock_guard<std::mutex> lg(mutex);
+    hash_done = true;
+    cond.notify_all();
+  }
+  reader.join();
+  FileUtil::Close(f);
+
+  if (IsStopped(opt))
+    return CANCELED;
+  if (read_failed)
+    return CALCULATE_HASH_FAILED;
+
+  str_hash = hash.final();
+  return SUCCESSED;
+}
+
+Result CalculateFileHashParallel(const utf8string& file_path, HashType type, int32_t thread_num, Options* opt, utf8string& str_hash) {
+  const int64_t file_size = FileUtil::GetFileSize(file_path);
+  if (file_size < 0)
+    return CALCULATE_HASH_FAILED;
+
+  if (thread_num <= 0)
+    thread_num = (int32_t)std::max(1U, std::thread::hardware_concurrency());
+
+  if (type == CRC32)
+    return CalculateFileCRC32Parallel(file_path, file_size, thread_num, opt, str_hash);
+  return CalculateFileHashPipelined(file_path, type, opt, str_hash);
+}
+}  // namespace zoe
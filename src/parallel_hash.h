@@ -0,0 +1,34 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_PARALLEL_HASH_H_
+#define ZOE_PARALLEL_HASH_H_
+#pragma once
+
+#include "zoe/zoe.h"
+
+namespace zoe {
+typedef struct _Options Options;
+
+// Hash the file on several threads, for verifying large files that are not hashed while downloading, such as resumed ones.
+// CRC32: the file is split into thread_num ranges that are hashed at the same time, then the CRC32 of ranges are combined.
+// MD5, SHA1 and SHA256 can't be split, the file is read ahead on another thread while the data read is hashed.
+// thread_num is the number of threads reading the file, 0 or negative means the number of CPU cores.
+// Return CANCELED if the download is stopped.
+Result CalculateFileHashParallel(const utf8string& file_path, HashType type, int32_t thread_num, Options* opt, utf8string& str_hash);
+}  // namespace zoe
+#endif  // !ZOE_PARALLEL_HASH_H_
@@ -0,0 +1,451 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "peer_server.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <map>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <condition_variable>
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#define ClosePeerSocket closesocket
+#define INVALID_PEER_SOCKET INVALID_SOCKET
+#define SHUTDOWN_BOTH SD_BOTH
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#define ClosePeerSocket close
+#define INVALID_PEER_SOCKET (-1)
+#define SHUTDOWN_BOTH SHUT_RDWR
+#endif
+#include "md5.h"
+#include "options.h"
+#include "file_util.h"
+#include "string_helper.hpp"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace zoe {
+
+namespace {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+typedef SOCKET PeerSocket;
+#else
+typedef int PeerSocket;
+#endif
+
+#define PEER_URL_PREFIX "/zoe/peer/"
+#define PEER_RANGES_SUFFIX "/ranges"
+
+typedef struct _SharedFile {
+  int64_t file_size;
+  utf8string path;
+  std::vector<PeerRange> ranges;
+} SharedFile;
+
+std::mutex share_mutex;
+std::map<utf8string, std::shared_ptr<const SharedFile>> shared_files;
+
+std::shared_ptr<const SharedFile> FindSharedFile(const utf8string& key) {
+  std::lock_guard<std::mutex> lg(share_mutex);
+  auto it = shared_files.find(key);
+  return it == shared_files.end() ? nullptr : it->second;
+}
+
+bool SendAll(PeerSocket s, const char* data, size_t size) {
+  while (size > 0) {
+    const int n = (int)send(s, data, (int)std::min(size, (size_t)ZOE_PEER_SEND_BLOCK_SIZE), MSG_NOSIGNAL);
+    if (n <= 0)
+      return false;
+    data += n;
+    size -= (size_t)n;
+  }
+  return true;
+}
+
+bool SendResponse(PeerSocket s, const char* status, const std::string& extra_headers, const std::string& body) {
+  char head[256] = {0};
+  snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Length: %u\r\n", status, (unsigned int)body.size());
+  const std::string response = head + extra_headers + "\r\n" + body;
+  return SendAll(s, response.data(), response.size());
+}
+
+// Serves the shared files with one thread per connection, so that a slow peer doesn't hold up others.
+class PeerServer {
+ public:
+  PeerServer()
+      : listen_socket_(INVALID_PEER_SOCKET)
+      , port_(0)
+      , connection_num_(0) {
+    stopping_.store(false);
+  }
+
+  ~PeerServer() { stop(); }
+
+  bool start(int32_t port) {
+    listen_socket_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listen_socket_ == INVALID_PEER_SOCKET)
+      return false;
+
+    int reuse = 1;
+    setsockopt(listen_socket_, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((unsigned short)port);
+    if (bind(listen_socket_, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_socket_, 128) != 0) {
+      ClosePeerSocket(listen_socket_);
+      listen_socket_ = INVALID_PEER_SOCKET;
+      return false;
+    }
+
+    port_ = port;
+    stopping_.store(false);
+    accept_thread_ = std::thread(&PeerServer::acceptProcess, this);
+    return true;
+  }
+
+  void stop() {
+    if (listen_socket_ == INVALID_PEER_SOCKET)
+      return;
+
+    stopping_.store(true);
+    shutdown(listen_socket_, SHUTDOWN_BOTH);
+    ClosePeerSocket(listen_socket_);
+    listen_socket_ = INVALID_PEER_SOCKET;
+    if (accept_thread_.joinable())
+      accept_thread_.join();
+
+    std::unique_lock<std::mutex> ul(connections_mutex_);
+    for (auto s : connections_)
+      shutdown(s, SHUTDOWN_BOTH);
+    connections_cond_.wait(ul, [this]() { return connection_num_ == 0; });
+  }
+
+  int32_t port() const { return port_; }
+
+ protected:
+  void acceptProcess() {
+    while (!stopping_.load()) {
+      PeerSocket s = accept(listen_socket_, nullptr, nullptr);
+      if (s == INVALID_PEER_SOCKET) {
+        if (stopping_.load())
+          break;
+        continue;
+      }
+
+      std::lock_guard<std::mutex> lg(connections_mutex_);
+      if (connection_num_ >= ZOE_PEER_SERVER_MAX_CONNECTION_NUM) {
+        ClosePeerSocket(s);
+        continue;
+      }
+
+      int nodelay = 1;
+      setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&nodelay, sizeof(nodelay));
+      // The idle connections kept by peers are closed, so that they don't take up the connection limit.
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+      DWORD timeout = ZOE_PEER_SERVER_IDLE_TIMEOUT_MS;
+#else
+      struct timeval timeout;
+      timeout.tv_sec = ZOE_PEER_SERVER_IDLE_TIMEOUT_MS / 1000;
+      timeout.tv_usec = (ZOE_PEER_SERVER_IDLE_TIMEOUT_MS % 1000) * 1000;
+#endif
+      setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+
+      connections_.insert(s);
+      connection_num_++;
+      std::thread(&PeerServer::connectionProcess, this, s).detach();
+    }
+  }
+
+  void connectionProcess(PeerSocket s) {
+    std::string buffer;
+    char recv_buf[4096];
+    while (!stopping_.load()) {
+      const size_t header_end = buffer.find("\r\n\r\n");
+      if (header_end == std::string::npos) {
+        if (buffer.size() > ZOE_PEER_MAX_REQUEST_HEADER_SIZE)
+          break;
+        const int n = (int)recv(s, recv_buf, sizeof(recv_buf), 0);
+        if (n <= 0)
+          break;
+        buffer.append(recv_buf, n);
+        continue;
+      }
+
+      const std::string request = buffer.substr(0, header_end + 4);
+      buffer.erase(0, header_end + 4);
+      if (!handleRequest(s, request))
+        break;
+    }
+
+    // Erased before closed, otherwise the fd may be reused by a new connection that is erased here.
+    std::lock_guard<std::mutex> lg(connections_mutex_);
+    connections_.erase(s);
+    ClosePeerSocket(s);
+    connection_num_--;
+    connections_cond_.notify_all();
+  }
+
+  // Return false if the connection should be closed.
+  bool handleRequest(PeerSocket s, const std::string& request) {
+    const std::string lower = StringHelper::ToLower(request);
+    const size_t path_end = request.find(' ', 4);
+    if (lower.compare(0, 4, "get ") != 0 || path_end == std::string::npos) {
+      SendResponse(s, "400 Bad Request", "Connection: close\r\n", std::string());
+      return false;
+    }
+
+    std::string key = request.substr(4, path_end - 4);
+    if (key.compare(0, strlen(PEER_URL_PREFIX), PEER_URL_PREFIX) != 0)
+      return SendResponse(s, "404 Not Found", std::string(), std::string());
+    key.erase(0, strlen(PEER_URL_PREFIX));
+
+    const bool ranges_requested = StringHelper::IsEndsWith(key, PEER_RANGES_SUFFIX);
+    if (ranges_requested)
+      key.erase(key.size() - strlen(PEER_RANGES_SUFFIX));
+
+    std::shared_ptr<const SharedFile> file = FindSharedFile(key);
+    if (!file)
+      return SendResponse(s, "404 Not Found", std::string(), std::string());
+
+    if (ranges_requested)
+      return SendResponse(s, "200 OK", "Content-Type: text/plain\r\n", FormatPeerRanges(file->file_size, file->ranges));
+
+    int64_t begin = -1L;
+    int64_t end = -1L;
+    const size_t range_pos = lower.find("\r\nrange: bytes=");
+    if (range_pos != std::string::npos) {
+      long long b = -1, e = -1;
+      const int n = sscanf(lower.c_str() + range_pos + 15, "%lld-%lld", &b, &e);
+      if (n >= 1)
+        begin = (int64_t)b;
+      if (n == 2)
+        end = (int64_t)e;
+    }
+
+    // Only the data in one range shared is served, the peer fetches the rest from others.
+    const PeerRange* shared = nullptr;
+    for (const PeerRange& r : file->ranges) {
+      if (begin >= r.begin && begin <= r.end) {
+        shared = &r;
+        break;
+      }
+    }
+    if (end == -1L && shared)
+      end = shared->end;
+
+    if (!shared || end < begin || end > shared->end) {
+      char content_range[64] = {0};
+      snprintf(content_range, sizeof(content_range), "Content-Range: bytes */%" PRId64 "\r\n", file->file_size);
+      return SendResponse(s, "416 Range Not Satisfiable", content_range, std::string());
+    }
+
+    FILE* f = FileUtil::Open(file->path, "rb");
+    if (!f || FileUtil::Seek(f, begin, SEEK_SET) != 0) {
+      if (f)
+        FileUtil::Close(f);
+      return SendResponse(s, "404 Not Found", std::string(), std::string());
+    }
+
+    char head[256] = {0};
+    snprintf(head, sizeof(head),
+             "HTTP/1.1 206 Partial Content\r\nContent-Length: %" PRId64 "\r\nContent-Range: bytes %" PRId64 "-%" PRId64 "/%" PRId64 "\r\n\r\n",
+             end - begin + 1, begin, end, file->file_size);
+    bool ok = SendAll(s, head, strlen(head));
+
+    // The connection is closed if the file can't be read, the peer knows the body is short.
+    std::vector<char> block(ZOE_PEER_SEND_BLOCK_SIZE);
+    for (int64_t pos = begin; ok && pos <= end;) {
+      const size_t want = (size_t)std::min((int64_t)block.size(), end + 1 - pos);
+      const size_t read = fread(block.data(), 1, want, f);
+      ok = read == want && SendAll(s, block.data(), read);
+      pos += (int64_t)read;
+    }
+    FileUtil::Close(f);
+    return ok;
+  }
+
+ protected:
+  PeerSocket listen_socket_;
+  int32_t port_;
+  std::atomic<bool> stopping_;
+  std::thread accept_thread_;
+
+  std::mutex connections_mutex_;
+  std::condition_variable connections_cond_;
+  std::set<PeerSocket> connections_;
+  int32_t connection_num_;
+};
+
+std::mutex server_mutex;
+std::unique_ptr<PeerServer> server;
+}  // namespace
+
+utf8string PeerFileKey(const utf8string& url, int64_t file_size, const utf8string& etag, const utf8string& last_modified) {
+  char size[32] = {0};
+  snprintf(size, sizeof(size), "%" PRId64, file_size);
+  const utf8string version = url + "\n" + size + "\n" + etag + "\n" + last_modified;
+
+  unsigned char sig[16] = {0};
+  char str[33] = {0};
+  libmd5_internal::MD5Buffer((const unsigned char*)version.c_str(), (unsigned int)version.length(), sig);
+  libmd5_internal::MD5SigToString(sig, str, sizeof(str));
+  return str;
+}
+
+std::vector<PeerRange> MakePeerRanges(const IndexFile::Content& content) {
+  std::vector<PeerRange> ranges;
+  for (const IndexFile::SliceRecord& record : content.slices) {
+    if (record.chunks.empty() || record.end == -1L)
+      continue;
+
+    PeerRange range;
+    range.begin = record.begin;
+    range.end = std::min(record.begin + record.capacity, record.begin + (int64_t)record.chunks.size() * ZOE_CHUNK_HASH_SIZE_BYTE);
+    range.end = std::min(range.end - 1, record.end);
+    if (range.end < range.begin)
+      continue;
+
+    range.chunks = record.chunks;
+    range.chunks.resize((size_t)((range.end - range.begin) / ZOE_CHUNK_HASH_SIZE_BYTE + 1));
+    ranges.push_back(range);
+  }
+  return ranges;
+}
+
+std::string FormatPeerRanges(int64_t file_size, const std::vector<PeerRange>& ranges) {
+  std::string text;
+  char buf[64] = {0};
+  snprintf(buf, sizeof(buf), "%" PRId64 "\n", file_size);
+  text += buf;
+
+  for (const PeerRange& r : ranges) {
+    snprintf(buf, sizeof(buf), "%" PRId64 " %" PRId64 " ", r.begin, r.end);
+    text += buf;
+    for (size_t i = 0; i < r.chunks.size(); i++) {
+      snprintf(buf, sizeof(buf), i == 0 ? "%08x" : ",%08x", r.chunks[i]);
+      text += buf;
+    }
+    text += "\n";
+  }
+  return text;
+}
+
+bool ParsePeerRanges(const std::string& text, int64_t& file_size, std::vector<PeerRange>& ranges) {
+  ranges.clear();
+  size_t line_begin = 0;
+  bool size_parsed = false;
+  while (line_begin < text.size()) {
+    size_t line_end = text.find('\n', line_begin);
+    if (line_end == std::string::npos)
+      line_end = text.size();
+    const std::string line = text.substr(line_begin, line_end - line_begin);
+    line_begin = line_end + 1;
+    if (line.empty())
+      continue;
+
+    if (!size_parsed) {
+      long long size = -1;
+      if (sscanf(line.c_str(), "%lld", &size) != 1 || size <= 0)
+        return false;
+      file_size = (int64_t)size;
+      size_parsed = true;
+      continue;
+    }
+
+    long long begin = -1, end = -1;
+    int consumed = 0;
+    if (sscanf(line.c_str(), "%lld %lld %n", &begin, &end, &consumed) != 2 || begin < 0 || end < begin || end >= file_size)
+      return false;
+
+    PeerRange range;
+    range.begin = (int64_t)begin;
+    range.end = (int64_t)end;
+    for (const char* p = line.c_str() + consumed; *p;) {
+      unsigned int crc = 0;
+      int n = 0;
+      if (sscanf(p, "%8x%n", &crc, &n) != 1)
+        return false;
+      range.chunks.push_back((uint32_t)crc);
+      p += n;
+      if (*p == ',')
+        p++;
+    }
+
+    // Each chunk of the range has its hash.
+    const int64_t chunk_num = (range.end - range.begin) / ZOE_CHUNK_HASH_SIZE_BYTE + 1;
+    if ((int64_t)range.chunks.size() != chunk_num)
+      return false;
+    ranges.push_back(range);
+  }
+  return size_parsed;
+}
+
+bool StartPeerServer(int32_t port) {
+  std::lock_guard<std::mutex> lg(server_mutex);
+  if (server)
+    return server->port() == port;
+
+  std::unique_ptr<PeerServer> s(new PeerServer());
+  if (!s->start(port))
+    return false;
+  server = std::move(s);
+  return true;
+}
+
+void StopPeerServer() {
+  std::lock_guard<std::mutex> lg(server_mutex);
+  if (server) {
+    server->stop();
+    server.reset();
+  }
+
+  std::lock_guard<std::mutex> lg_share(share_mutex);
+  shared_files.clear();
+}
+
+void SharePeerFile(const utf8string& key, int64_t file_size, const utf8string& path, const std::vector<PeerRange>& ranges) {
+  std::shared_ptr<SharedFile> file = std::make_shared<SharedFile>();
+  file->file_size = file_size;
+  file->path = path;
+  file->ranges = ranges;
+
+  std::lock_guard<std::mutex> lg(share_mutex);
+  shared_files[key] = file;
+}
+
+void UnsharePeerFile(const utf8string& key) {
+  std::lock_guard<std::mutex> lg(share_mutex);
+  shared_files.erase(key);
+}
+}  // namespace zoe
@@ -0,0 +1,63 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_PEER_SERVER_H_
+#define ZOE_PEER_SERVER_H_
+#pragma once
+
+#include <string>
+#include <vector>
+#include "zoe/zoe.h"
+#include "index_file.h"
+
+namespace zoe {
+// Peer mode, see Zoe::setPeerMode.
+// The instances downloading the same file share the data they have on disk to each other by an HTTP server of process:
+//   GET /zoe/peer/<key>/ranges      the ranges shared, see FormatPeerRanges.
+//   GET /zoe/peer/<key>             with "Range: bytes=begin-end" in one of the ranges shared, 416 otherwise.
+// The data is checked by the CRC32 of each ZOE_CHUNK_HASH_SIZE_BYTE chunk, which is the chunk hash of slices, so the
+// range of a slice fetched from a peer can be compared with the chunks of the same range that the peer downloaded.
+
+// A range on disk, chunks are the hashes of each chunk from begin, the last one may be shorter.
+typedef struct _PeerRange {
+  int64_t begin;
+  int64_t end;
+  std::vector<uint32_t> chunks;
+
+  _PeerRange() : begin(0L), end(-1L) {}
+} PeerRange;
+
+// The same for all the peers downloading the same version of file.
+utf8string PeerFileKey(const utf8string& url, int64_t file_size, const utf8string& etag, const utf8string& last_modified);
+
+// The ranges of the slices recorded with chunk hashes, up to the last chunk on disk of each.
+std::vector<PeerRange> MakePeerRanges(const IndexFile::Content& content);
+
+// One line of file size, then one line of each range: "<begin> <end> <crc>,<crc>,...", the hashes are hex.
+std::string FormatPeerRanges(int64_t file_size, const std::vector<PeerRange>& ranges);
+bool ParsePeerRanges(const std::string& text, int64_t& file_size, std::vector<PeerRange>& ranges);
+
+// Listen on port of all the interfaces, the server is shared by all Zoe objects of process and listens on the first port
+// started. Return false if the port can't be listened or the server listens on another port.
+bool StartPeerServer(int32_t port);
+void StopPeerServer();
+
+// Share the ranges of the file at path, replacing what was shared by key before. Thread safe.
+void SharePeerFile(const utf8string& key, int64_t file_size, const utf8string& path, const std::vector<PeerRange>& ranges);
+void UnsharePeerFile(const utf8string& key);
+}  // namespace zoe
+#endif  // !ZOE_PEER_SERVER_H_
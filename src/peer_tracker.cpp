@@ -0,0 +1,218 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "peer_tracker.h"
+#include <memory>
+#include "options.h"
+#include "verbose.h"
+#include "curl_utils.h"
+
+namespace zoe {
+namespace {
+typedef struct _RangesRequest {
+  size_t peer;
+  std::shared_ptr<ScopedCurl> curl;
+  std::string body;
+} RangesRequest;
+
+size_t RangesWriteCallback(char* buffer, size_t size, size_t nitems, void* outstream) {
+  RangesRequest* request = (RangesRequest*)outstream;
+  const size_t total = size * nitems;
+  if (request->body.size() + total > ZOE_PEER_MAX_RANGES_SIZE_BYTE)
+    return 0;
+  request->body.append(buffer, total);
+  return total;
+}
+}  // namespace
+
+PeerTracker::PeerTracker(const std::vector<utf8string>& peers,
+                         const utf8string& key,
+                         int64_t file_size,
+                         VerboseOuputFunctor verbose_functor)
+    : file_size_(file_size)
+    , verbose_functor_(verbose_functor)
+    , refresh_multi_(nullptr) {
+  stopping_.store(false);
+  for (utf8string url : peers) {
+    while (!url.empty() && url.back() == '/')
+      url.pop_back();
+    if (url.empty())
+      continue;
+    if (url.find("://") == utf8string::npos)
+      url = u8"http://" + url;
+
+    Peer peer;
+    peer.url = url + u8"/zoe/peer/" + key;
+    peer.sharing = false;
+    peers_.push_back(peer);
+  }
+}
+
+PeerTracker::~PeerTracker() {
+  stop();
+}
+
+void PeerTracker::start() {
+  refresh();
+  if (!stopping_.load())
+    refresh_thread_ = std::thread(&PeerTracker::refreshProcess, this);
+}
+
+void PeerTracker::stop() {
+  {
+    std::lock_guard<std::mutex> lg(mutex_);
+    stopping_.store(true);
+#if LIBCURL_VERSION_NUM >= 0x074400  // 7.68.0
+    if (refresh_multi_)
+      curl_multi_wakeup(refresh_multi_);
+#endif
+  }
+  stop_cond_.notify_all();
+  if (refresh_thread_.joinable())
+    refresh_thread_.join();
+}
+
+size_t PeerTracker::peerNum() const {
+  return peers_.size();
+}
+
+utf8string PeerTracker::url(size_t peer) const {
+  return peer < peers_.size() ? peers_[peer].url : utf8string();
+}
+
+bool PeerTracker::find(size_t peer, int64_t begin, int64_t end, std::vector<uint32_t>& chunks) const {
+  std::lock_guard<std::mutex> lg(mutex_);
+  if (peer >= peers_.size() || end < begin)
+    return false;
+
+  for (const PeerRange& r : peers_[peer].ranges) {
+    if (begin < r.begin || end > r.end)
+      continue;
+    if ((begin - r.begin) % ZOE_CHUNK_HASH_SIZE_BYTE != 0 || (end != r.end && (end + 1 - begin) % ZOE_CHUNK_HASH_SIZE_BYTE != 0))
+      return false;
+
+    const size_t first = (size_t)((begin - r.begin) / ZOE_CHUNK_HASH_SIZE_BYTE);
+    const size_t num = (size_t)((end - begin) / ZOE_CHUNK_HASH_SIZE_BYTE + 1);
+    chunks.assign(r.chunks.begin() + first, r.chunks.begin() + first + num);
+    return true;
+  }
+  return false;
+}
+
+int64_t PeerTracker::sharedEnd(size_t peer, int64_t begin) const {
+  std::lock_guard<std::mutex> lg(mutex_);
+  if (peer >= peers_.size())
+    return -1L;
+
+  for (const PeerRange& r : peers_[peer].ranges) {
+    if (begin >= r.begin && begin <= r.end && (begin - r.begin) % ZOE_CHUNK_HASH_SIZE_BYTE == 0)
+      return r.end;
+  }
+  return -1L;
+}
+
+void PeerTracker::refresh() {
+  CURLM* multi = curl_multi_init();
+  if (!multi)
+    return;
+
+  std::vector<RangesRequest> requests(peers_.size());
+  for (size_t i = 0; i < peers_.size(); i++) {
+    RangesRequest& request = requests[i];
+    request.peer = i;
+    request.curl = std::make_shared<ScopedCurl>();
+    CURL* curl = request.curl->GetCurl();
+    const utf8string url = peers_[i].url + u8"/ranges";
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOPROXY, "*");
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)ZOE_PEER_REQUEST_TIMEOUT_MS);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, RangesWriteCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &request);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, (void*)&request);
+    curl_multi_add_handle(multi, curl);
+  }
+
+  {
+    std::lock_guard<std::mutex> lg(mutex_);
+    refresh_multi_ = multi;
+  }
+
+  int still_running = 0;
+  do {
+    curl_multi_perform(multi, &still_running);
+
+    int msgs_left = 0;
+    CURLMsg* msg = nullptr;
+    while ((msg = curl_multi_info_read(multi, &msgs_left))) {
+      if (msg->msg != CURLMSG_DONE)
+        continue;
+
+      RangesRequest* request = nullptr;
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&request);
+      if (!request)
+        continue;
+
+      int64_t file_size = -1L;
+      std::vector<PeerRange> ranges;
+      const bool sharing = msg->data.result == CURLE_OK && ParsePeerRanges(request->body, file_size, ranges) &&
+                           file_size == file_size_;
+      if (!sharing)
+        ranges.clear();
+
+      std::lock_guard<std::mutex> lg(mutex_);
+      Peer& peer = peers_[request->peer];
+      if (sharing != peer.sharing) {
+        OutputVerbose(verbose_functor_, u8"Peer %s %s.\n", peer.url.c_str(), sharing ? u8"shares the file" : u8"stops sharing the file");
+        peer.sharing = sharing;
+      }
+      peer.ranges.swap(ranges);
+    }
+
+    if (still_running == 0 || stopping_.load())
+      break;
+
+#if LIBCURL_VERSION_NUM >= 0x074400  // 7.68.0
+    curl_multi_poll(multi, nullptr, 0, ZOE_MULTI_POLL_TIMEOUT_MS, nullptr);
+#else
+    curl_multi_wait(multi, nullptr, 0, ZOE_MULTI_POLL_TIMEOUT_MS, nullptr);
+#endif
+  } while (true);
+
+  {
+    std::lock_guard<std::mutex> lg(mutex_);
+    refresh_multi_ = nullptr;
+  }
+
+  for (RangesRequest& request : requests)
+    curl_multi_remove_handle(multi, request.curl->GetCurl());
+  curl_multi_cleanup(multi);
+}
+
+void PeerTracker::refreshProcess() {
+  while (true) {
+    {
+      std::unique_lock<std::mutex> ul(mutex_);
+      stop_cond_.wait_for(ul, std::chrono::milliseconds(ZOE_PEER_REFRESH_INTERVAL_MS), [this]() { return stopping_.load(); });
+      if (stopping_.load())
+        break;
+    }
+    refresh();
+  }
+}
+}  // namespace zoe
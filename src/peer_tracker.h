@@ -0,0 +1,80 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_PEER_TRACKER_H_
+#define ZOE_PEER_TRACKER_H_
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include "zoe/zoe.h"
+#include "peer_server.h"
+
+namespace zoe {
+// The ranges that the peers of one file share, see peer_server.h.
+// The ranges of all peers are fetched at the same time, then refreshed on a thread every ZOE_PEER_REFRESH_INTERVAL_MS
+// until stopped. A peer that can't be reached or doesn't have the file shares nothing. Thread safe.
+class PeerTracker {
+ public:
+  // peers are the addresses of peer servers, such as "http://192.168.1.12:8090" or "192.168.1.12:8090".
+  PeerTracker(const std::vector<utf8string>& peers, const utf8string& key, int64_t file_size, VerboseOuputFunctor verbose_functor);
+  virtual ~PeerTracker();
+
+  // Fetch the ranges once, then start refreshing them.
+  void start();
+  void stop();
+
+  size_t peerNum() const;
+
+  // The url of file on peer.
+  utf8string url(size_t peer) const;
+
+  // Whether peer shares [begin, end] in one range, chunks are the hashes of the range from begin.
+  // The chunks must be aligned with begin and the last one must end at end, so that they are the chunks of a slice
+  // of [begin, end] and can be compared with its chunk hashes.
+  bool find(size_t peer, int64_t begin, int64_t end, std::vector<uint32_t>& chunks) const;
+
+  // The end of the range that peer shares from begin, whose chunks are aligned with begin, -1 if none.
+  int64_t sharedEnd(size_t peer, int64_t begin) const;
+
+ protected:
+  void refresh();
+  void refreshProcess();
+
+ protected:
+  typedef struct _Peer {
+    utf8string url;
+    std::vector<PeerRange> ranges;
+    bool sharing;
+  } Peer;
+
+  const int64_t file_size_;
+  VerboseOuputFunctor verbose_functor_;
+
+  mutable std::mutex mutex_;
+  std::vector<Peer> peers_;
+
+  std::atomic<bool> stopping_;
+  std::condition_variable stop_cond_;
+  void* refresh_multi_;  // guarded by mutex, so that stop can wake it up
+  std::thread refresh_thread_;
+};
+}  // namespace zoe
+#endif  // !ZOE_PEER_TRACKER_H_
@@ -17,34 +17,31 @@
 
 #include "progress_handler.h"
 #include <functional>
+#include <algorithm>
 #include "options.h"
 
 namespace zoe {
 ProgressHandler::ProgressHandler(Options* options,
                                  std::shared_ptr<SliceManager> slice_manager)
-    : options_(options), slice_manager_(slice_manager) {
-  if (options_ && slice_manager_) {
-    async_task_ =
-        std::async(std::launch::async,
-                   std::bind(&ProgressHandler::asyncTaskProcess, this));
-  }
+    : options_(options), slice_manager_(slice_manager) {}
+
+ProgressHandler::~ProgressHandler() {}
+
+void ProgressHandler::tick() {
+  if (time_meter_.Elapsed() < options_->progress_interval)
+    return;
+  time_meter_.Restart();
+  report();
 }
 
-ProgressHandler::~ProgressHandler() {
-  if (async_task_.valid())
-    async_task_.get();
+int32_t ProgressHandler::remainingTime() const {
+  return (int32_t)std::max((long)options_->progress_interval - time_meter_.Elapsed(), 0L);
 }
 
-void ProgressHandler::asyncTaskProcess() {
-  while (true) {
-    if (options_->internal_stop_event.wait(500))
-      break;
-    if (options_->user_stop_event && options_->user_stop_event->isSetted())
-      break;
-    if (options_ && options_->progress_functor && slice_manager_) {
-      options_->progress_functor(slice_manager_->originFileSize(),
-                                 slice_manager_->totalDownloaded());
-    }
+void ProgressHandler::report() {
+  if (options_ && options_->progress_functor && slice_manager_) {
+    options_->progress_functor(slice_manager_->originFileSize(),
+                               slice_manager_->totalDownloaded());
   }
 }
 
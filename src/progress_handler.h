@@ -21,23 +21,31 @@
 
 #include "zoe/zoe.h"
 #include "slice_manager.h"
+#include "time_meter.hpp"
 
 namespace zoe {
 typedef struct _Options Options;
 
+// Report progress on the loop thread every options->progress_interval milliseconds.
 class ProgressHandler {
  public:
   ProgressHandler(Options* options,
                   std::shared_ptr<SliceManager> slice_manager);
   virtual ~ProgressHandler();
 
+  // Called on each loop round, it is cheap if not the time to report.
+  void tick();
+
+  // Milliseconds until the next report.
+  int32_t remainingTime() const;
+
  protected:
-  void asyncTaskProcess();
+  void report();
 
  protected:
-  std::shared_future<void> async_task_;
   const Options* options_;
   std::shared_ptr<SliceManager> slice_manager_;
+  TimeMeter time_meter_;
 };
 }  // namespace zoe
 #endif  // !ZOE_PROGRESS_HANDLER_H_
\ No newline at end of file
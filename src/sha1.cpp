@@ -2,8 +2,10 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <vector>
 #include "file_util.h"
 #include "options.h"
+#include "hash_accel.h"
 
 namespace zoe {
 
@@ -107,9 +109,8 @@ void CSHA1::Reset() {
 void CSHA1::Transform(uint32_t state[5], unsigned char buffer[64]) {
   uint32_t a = 0, b = 0, c = 0, d = 0, e = 0;
 
-  SHA1_WORKSPACE_BLOCK* block;
-  static unsigned char workspace[64];
-  block = (SHA1_WORKSPACE_BLOCK*)workspace;
+  SHA1_WORKSPACE_BLOCK workspace;
+  SHA1_WORKSPACE_BLOCK* block = &workspace;
   memcpy(block, buffer, 64);
 
   // Copy state[] to working vars
@@ -229,10 +230,21 @@ void CSHA1::Update(unsigned char* data, unsigned int len) {
 
   if ((j + len) > 63) {
     memcpy(&m_buffer[j], data, (i = 64 - j));
-    Transform(m_state, m_buffer);
 
-    for (; i + 63 < len; i += 64) {
-      Transform(m_state, &data[i]);
+    if (hash_accel::Sha1Available()) {
+      hash_accel::Sha1Blocks(m_state, m_buffer, 1);
+      const uint32_t blocks = (len - i) / 64;
+      if (blocks > 0) {
+        hash_accel::Sha1Blocks(m_state, &data[i], blocks);
+        i += blocks * 64;
+      }
+    }
+    else {
+      Transform(m_state, m_buffer);
+
+      for (; i + 63 < len; i += 64) {
+        Transform(m_state, &data[i]);
+      }
     }
 
     j = 0;
@@ -343,14 +355,14 @@ Result CalculateFileSHA1(const utf8string& file_path, Options* opt, utf8string&
   sha1.Reset();
 
   size_t dwReadBytes = 0;
-  unsigned char szData[1024] = {0};
+  std::vector<unsigned char> szData(ZOE_HASH_READ_BUFFER_SIZE);
 
-  while ((dwReadBytes = fread(szData, 1, 1024, f)) > 0) {
+  while ((dwReadBytes = fread(szData.data(), 1, szData.size(), f)) > 0) {
     if (opt && (opt->internal_stop_event.isSetted() || (opt->user_stop_event && opt->user_stop_event->isSetted()))) {
       fclose(f);
       return CANCELED;
     }
-    sha1.Update(szData, dwReadBytes);
+    sha1.Update(szData.data(), dwReadBytes);
   }
   fclose(f);
 
@@ -374,14 +386,14 @@ Result CalculateFileSHA1(FILE* f, Options* opt, utf8string& str_hash) {
   sha1.Reset();
 
   size_t dwReadBytes = 0;
-  unsigned char szData[1024] = {0};
+  std::vector<unsigned char> szData(ZOE_HASH_READ_BUFFER_SIZE);
 
-  while ((dwReadBytes = fread(szData, 1, 1024, f)) > 0) {
+  while ((dwReadBytes = fread(szData.data(), 1, szData.size(), f)) > 0) {
     if (opt && (opt->internal_stop_event.isSetted() ||
                 (opt->user_stop_event && opt->user_stop_event->isSetted()))) {
       return CANCELED;
     }
-    sha1.Update(szData, dwReadBytes);
+    sha1.Update(szData.data(), dwReadBytes);
   }
 
   sha1.Final();
@@ -1,8 +1,10 @@
 #include "sha256.h"
 #include <stdio.h>
 #include <string.h>
+#include <vector>
 #include "file_util.h"
 #include "options.h"
+#include "hash_accel.h"
 
 namespace zoe {
 namespace sha256_internal {
@@ -178,6 +180,18 @@ void sha256_update(struct sha256_ctx* ctx, const unsigned char* buffer, uint32_t
       length -= left;
     }
   }
+  if (length >= SHA256_DATA_SIZE && hash_accel::Sha256Available()) {
+    const uint32_t blocks = length / SHA256_DATA_SIZE;
+    hash_accel::Sha256Blocks(ctx->state, buffer, blocks);
+
+    /* Update block count */
+    if ((ctx->count_low += blocks) < blocks)
+      ++ctx->count_high;
+
+    buffer += blocks * SHA256_DATA_SIZE;
+    length -= blocks * SHA256_DATA_SIZE;
+  }
+
   while (length >= SHA256_DATA_SIZE) {
     sha256_block(ctx, buffer);
     buffer += SHA256_DATA_SIZE;
@@ -278,14 +292,14 @@ Result CalculateFileSHA256(const utf8string& file_path, Options* opt, utf8string
   sha256_internal::sha256_init(&sha256Ctx);
 
   size_t dwReadBytes = 0;
-  unsigned char szData[1024] = {0};
+  std::vector<unsigned char> szData(ZOE_HASH_READ_BUFFER_SIZE);
 
-  while ((dwReadBytes = fread(szData, 1, 1024, f)) > 0) {
+  while ((dwReadBytes = fread(szData.data(), 1, szData.size(), f)) > 0) {
     if (opt && (opt->internal_stop_event.isSetted() || (opt->user_stop_event && opt->user_stop_event->isSetted()))) {
       fclose(f);
       return CANCELED;
     }
-    sha256_internal::sha256_update(&sha256Ctx, szData, dwReadBytes);
+    sha256_internal::sha256_update(&sha256Ctx, szData.data(), dwReadBytes);
   }
   fclose(f);
 
@@ -306,14 +320,14 @@ Result CalculateFileSHA256(FILE* f, Options* opt, utf8string& str_hash) {
   sha256_internal::sha256_init(&sha256Ctx);
 
   size_t dwReadBytes = 0;
-  unsigned char szData[1024] = {0};
+  std::vector<unsigned char> szData(ZOE_HASH_READ_BUFFER_SIZE);
 
-  while ((dwReadBytes = fread(szData, 1, 1024, f)) > 0) {
+  while ((dwReadBytes = fread(szData.data(), 1, szData.size(), f)) > 0) {
     if (opt && (opt->internal_stop_event.isSetted() ||
                 (opt->user_stop_event && opt->user_stop_event->isSetted()))) {
       return CANCELED;
     }
-    sha256_internal::sha256_update(&sha256Ctx, szData, dwReadBytes);
+    sha256_internal::sha256_update(&sha256Ctx, szData.data(), dwReadBytes);
   }
 
   sha256_internal::sha256_final(&sha256Ctx);
@@ -19,13 +19,18 @@
 #include <assert.h>
 #include <inttypes.h>
 #include <string.h>
+#include <algorithm>
 #include "file_util.h"
 #include "curl_utils.h"
 #include "curl/curl.h"
 #include "options.h"
 #include "string_encode.h"
+#include "string_helper.hpp"
 #include "verbose.h"
 #include "slice_manager.h"
+#include "disk_writer.h"
+#include "crc32.h"
+#include "trace.h"
 
 #define CHECK_SETOPT1(x)                                                                                                  \
   do {                                                                                                                    \
@@ -37,20 +42,36 @@
 
 namespace zoe {
 
-Slice::Slice(int32_t index,
+Slice::Slice(size_t row,
+             int32_t index,
              int64_t begin,
              int64_t end,
              int64_t init_capacity,
-             std::shared_ptr<SliceManager> slice_manager)
-    : index_(index)
+             SliceManager* slice_manager)
+    : row_(row)
+    , index_(index)
     , begin_(begin)
     , end_(end)
     , curl_(nullptr)
     , header_chunk_(nullptr)
+    , source_(0)
+    , primary_receiver_(0)
+    , hedge_curl_(nullptr)
+    , hedge_header_chunk_(nullptr)
+    , hedged_times_(0)
     , disk_cache_size_(0L)
+    , disk_cache_offset_(0L)
+    , write_paused_(false)
+    , bandwidth_paused_(false)
+    , paused_(false)
+    , transfer_paused_(false)
     , disk_cache_buffer_(nullptr)
+    , chunk_crc_(0)
+    , chunk_hashed_(0L)
     , status_(Slice::UNFETCH)
     , failed_times_(0)
+    , retry_delay_ms_(0L)
+    , started_size_(0L)
     , slice_manager_(slice_manager) {
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
   InitializeCriticalSection(&crit_);
@@ -59,6 +80,19 @@ Slice::Slice(int32_t index,
 #endif
   disk_capacity_.store(init_capacity);
   disk_cache_capacity_.store(0L);
+  queued_capacity_.store(0L);
+  downloaded_size_.store(init_capacity);
+  write_failed_.store(false);
+  synced_capacity_ = init_capacity;
+  crc32_internal::crc32Init(&chunk_crc_);
+  for (Receiver& receiver : receivers_) {
+    receiver.slice = this;
+    receiver.pos = begin_ + init_capacity;
+    receiver.range_begin = -1L;
+    receiver.status_code = 0;
+    receiver.content_range_begin = -1L;
+    receiver.response_checked = false;
+  }
 
   assert(end_ == -1 || (end_ + 1 >= begin_ + disk_capacity_.load()));
 
@@ -68,6 +102,7 @@ Slice::Slice(int32_t index,
 
 Slice::~Slice() {
   assert(!curl_);
+  assert(!hedge_curl_);
   freeDiskCacheBuffer();
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
   DeleteCriticalSection(&crit_);
@@ -98,150 +133,403 @@ int64_t Slice::diskCacheCapacity() const {
   return disk_cache_capacity_.load();
 }
 
+int64_t Slice::queuedCapacity() const {
+  return queued_capacity_.load();
+}
+
+int64_t Slice::downloadedSize() const {
+  return downloaded_size_.load();
+}
+
+int64_t Slice::downloadedSinceStart() const {
+  return downloadedSize() - started_size_;
+}
+
+long Slice::elapsedSinceStart() const {
+  return started_time_meter_.Elapsed();
+}
+
 int32_t Slice::index() const {
   return index_;
 }
 
+size_t Slice::row() const {
+  return row_;
+}
+
+void Slice::setSource(int32_t source, const utf8string& url, std::shared_ptr<struct curl_slist> connect_to) {
+  source_ = source;
+  source_url_ = url;
+  source_connect_to_ = connect_to;
+}
+
+int32_t Slice::source() const {
+  return source_;
+}
+
+utf8string Slice::url() const {
+  if (source_url_.length() > 0)
+    return source_url_;
+  const utf8string redirect_url = slice_manager_->redirectUrl();
+  return redirect_url.length() > 0 ? redirect_url : slice_manager_->options()->url;
+}
+
+void Slice::setBudgetTicket(std::shared_ptr<BudgetTicket> ticket) {
+  budget_ticket_ = ticket;
+}
+
 void* Slice::curlHandle() {
   return curl_;
 }
 
+void* Slice::hedgeCurlHandle() {
+  return hedge_curl_;
+}
+
+bool Slice::isHedged() const {
+  return hedge_curl_ != nullptr;
+}
+
+int32_t Slice::hedgedTimes() const {
+  return hedged_times_;
+}
+
 static size_t __SliceWriteBodyCallback(char* buffer,
                                        size_t size,
                                        size_t nitems,
                                        void* outstream) {
-  Slice* pThis = (Slice*)outstream;
+  Slice::Receiver* receiver = (Slice::Receiver*)outstream;
+  return receiver->slice->onTransferData(receiver, buffer, size * nitems);
+}
+
+static size_t __SliceWriteHeaderCallback(char* buffer,
+                                         size_t size,
+                                         size_t nitems,
+                                         void* userdata) {
+  Slice::Receiver* receiver = (Slice::Receiver*)userdata;
+  receiver->slice->onTransferHeader(receiver, buffer, size * nitems);
+  return size * nitems;
+}
+
+void Slice::onTransferHeader(Receiver* receiver, const char* buffer, size_t size) {
+  const utf8string header(buffer, size);
+
+  // Each response redirected from or sent before the final one begins with the status line.
+  if (header.compare(0, 5, "HTTP/") == 0) {
+    const size_t space = header.find(' ');
+    receiver->status_code = (space != utf8string::npos) ? strtol(header.c_str() + space + 1, nullptr, 10) : 0;
+    receiver->content_range_begin = -1L;
+    return;
+  }
+
+  // Content-Range: bytes 262144-524287/1048576
+  const size_t pos = header.find(':');
+  if (pos == utf8string::npos || StringHelper::ToLower(header.substr(0, pos)) != "content-range")
+    return;
+  const size_t unit = header.find("bytes ", pos);
+  if (unit != utf8string::npos && header.compare(unit + 6, 1, "*") != 0)
+    receiver->content_range_begin = strtoll(header.c_str() + unit + 6, nullptr, 10);
+}
+
+bool Slice::isResponseInRange(const Receiver* receiver) const {
+  // Not HTTP, such as FTP, libcurl fails the transfer that can't be resumed.
+  if (receiver->status_code == 0)
+    return true;
+
+  if (receiver->status_code == 206)
+    return receiver->content_range_begin == std::max(receiver->range_begin, (int64_t)0L);
+
+  // The whole file is the data of a range from 0.
+  return receiver->range_begin <= 0L;
+}
 
-  size_t write_size = size * nitems;
-  if (!pThis->onNewData(buffer, write_size)) {
+size_t Slice::onTransferData(Receiver* receiver, char* buffer, size_t write_size) {
+  if (!receiver->response_checked) {
+    if (!isResponseInRange(receiver)) {
+      OutputVerbose(slice_manager_->options()->verbose_functor,
+                    u8"Slice<%d> requested range from %" PRId64 ", but the response is %ld from %" PRId64 ".\n", index_,
+                    receiver->range_begin, receiver->status_code, std::max(receiver->content_range_begin, (int64_t)0L));
+      return 0;  // cause CURLE_WRITE_ERROR
+    }
+    receiver->response_checked = true;
+    if (receiver->status_code == 206)
+      slice_manager_->setRangeConfirmed();
+  }
+
+  // The data before the received position has been taken from the other transfer of a hedged slice.
+  const int64_t received_pos = begin_ + downloadedSize();
+  assert(receiver->pos <= received_pos);
+  const int64_t skipped = std::min((int64_t)write_size, std::max(received_pos - receiver->pos, (int64_t)0L));
+  const int64_t data_size = (int64_t)write_size - skipped;
+
+  // The slice has been split, the range requested is larger than the slice now.
+  const int64_t remaining = remainingSize();
+  const bool overflow = (remaining >= 0 && data_size > remaining);
+
+  // libcurl keeps the data and stops reading from socket, until the bandwidth is refilled.
+  if (!isBandwidthAvailable()) {
+    setBandwidthPaused(true);
+    transfer_paused_ = true;
+    return CURL_WRITEFUNC_PAUSE;
+  }
+
+  if (IsTraceEnabled() && data_size > 0 && downloadedSize() == started_size_)
+    TraceInstant(TRACE_FIRST_BYTE, this, index_, 0L);
+
+  const Slice::DataResult ret = onNewData(buffer + skipped, overflow ? (long)remaining : (long)data_size);
+  if (ret == Slice::DATA_BLOCKED) {
+    // disk writer can't catch up, pause the transfer until it has space.
+    setWritePaused(true);
+    transfer_paused_ = true;
+    return CURL_WRITEFUNC_PAUSE;
+  }
+
+  if (ret != Slice::DATA_ACCEPTED) {
     assert(false);
     return 0;  // cause CURLE_WRITE_ERROR
   }
 
+  const int64_t consumed = skipped + (overflow ? remaining : data_size);
+  takeBandwidth(consumed);
+  receiver->pos += consumed;
+
+  if (overflow)
+    return 0;  // cause CURLE_WRITE_ERROR, slice completion is checked by data size.
+
   return write_size;
 }
 
-Result Slice::start(void* multi, int64_t disk_cache_size, int64_t max_speed) {
+Result Slice::start(void* multi) {
   if (!slice_manager_)
     return UNKNOWN_ERROR;
 
   if (!slice_manager_->options())
     return UNKNOWN_ERROR;
 
-  status_ = DOWNLOADING;
+  setStatus(DOWNLOADING);
+  write_failed_.store(false);
+  write_paused_ = false;
+  transfer_paused_ = false;
+  setBandwidthPaused(false);
 
-  disk_cache_size_ = disk_cache_size;
-  if (disk_cache_size_ > 0) {
-    // TODO: support int64_t
-    disk_cache_buffer_ = (char*)malloc((size_t)disk_cache_size_);
-    if (!disk_cache_buffer_) {
-      disk_cache_size_ = 0L;
-    }
-  }
+  if (isChunkHashEnabled())
+    syncChunkHashes();
+
+  started_size_ = downloadedSize();
+  started_time_meter_.Restart();
+  receivers_[primary_receiver_].pos = begin_ + disk_capacity_.load();
+
+  // The mapping is the cache.
+  // If all of blocks are in use, write to file directly.
+  assert(!disk_cache_buffer_);
+  disk_cache_size_ = 0L;
+  if (!isMappedIo())
+    acquireDiskCache(true);
 
   assert(curl_ == nullptr);
   assert(header_chunk_ == nullptr);
 
-  curl_ = curl_easy_init();
+  // Reuse the easy handle of finished slices, so that DNS cache, connections and SSL sessions can be reused.
+  curl_ = AcquireCurlHandle();
   if (!curl_) {
     OutputVerbose(slice_manager_->options()->verbose_functor, u8"curl_easy_init failed.\n");
     freeDiskCacheBuffer();
-    status_ = DOWNLOAD_FAILED;
+    setStatus(DOWNLOAD_FAILED);
     return INIT_CURL_FAILED;
   }
 
-  CHECK_SETOPT1(curl_easy_setopt(curl_, CURLOPT_VERBOSE, 0L));
-  const utf8string redirect_url = slice_manager_->redirectUrl();
-  const utf8string url = slice_manager_->options()->url;
-  CHECK_SETOPT1(curl_easy_setopt(curl_, CURLOPT_URL, (redirect_url.length() > 0 ? redirect_url.c_str() : url.c_str())));
+  connect_to_ = source_connect_to_;
+  const Result ret =
+      setupTransfer(multi, curl_, &header_chunk_, this->url(), connect_to_.get(), &receivers_[primary_receiver_]);
+  if (ret != SUCCESSED) {
+    removeTransfer(nullptr, &curl_, &header_chunk_);
+    freeDiskCacheBuffer();
+    setStatus(DOWNLOAD_FAILED);
+    return ret;
+  }
+
+  updateTransferPause();
+  TraceAsync(TRACE_SLICE, TRACE_ASYNC_BEGIN, this, index_, 0L);
+
+  return SUCCESSED;
+}
+
+Result Slice::startHedge(void* multi,
+                         const utf8string& url,
+                         std::shared_ptr<struct curl_slist> connect_to,
+                         std::shared_ptr<BudgetTicket> ticket) {
+  if (!curl_ || hedge_curl_ || end_ == -1 || status_ != DOWNLOADING)
+    return UNKNOWN_ERROR;
+
+  hedge_curl_ = AcquireCurlHandle();
+  if (!hedge_curl_) {
+    OutputVerbose(slice_manager_->options()->verbose_functor, u8"curl_easy_init failed.\n");
+    return INIT_CURL_FAILED;
+  }
+
+  // The hedged request begins with the data not yet received.
+  Receiver* receiver = &receivers_[1 - primary_receiver_];
+  receiver->pos = begin_ + downloadedSize();
+  hedge_connect_to_ = connect_to;
+  const Result ret = setupTransfer(multi, hedge_curl_, &hedge_header_chunk_, url, hedge_connect_to_.get(), receiver);
+  if (ret != SUCCESSED) {
+    removeTransfer(nullptr, &hedge_curl_, &hedge_header_chunk_);
+    return ret;
+  }
+
+  if (transfer_paused_)
+    curl_easy_pause(hedge_curl_, CURLPAUSE_ALL);
+
+  hedge_budget_ticket_ = ticket;
+  hedged_times_++;
+  return SUCCESSED;
+}
+
+void Slice::stopHedge(void* multi, bool keep_hedge) {
+  if (!hedge_curl_)
+    return;
+
+  if (!keep_hedge) {
+    removeTransfer(multi, &hedge_curl_, &hedge_header_chunk_);
+    hedge_budget_ticket_.reset();
+    return;
+  }
+
+  removeTransfer(multi, &curl_, &header_chunk_);
+  curl_ = hedge_curl_;
+  header_chunk_ = hedge_header_chunk_;
+  connect_to_ = hedge_connect_to_;
+  budget_ticket_ = hedge_budget_ticket_;
+  primary_receiver_ = 1 - primary_receiver_;
+  hedge_curl_ = nullptr;
+  hedge_header_chunk_ = nullptr;
+  hedge_budget_ticket_.reset();
+}
+
+void Slice::pauseTransfers(int bitmask) {
+  if (curl_)
+    curl_easy_pause(curl_, bitmask);
+  if (hedge_curl_)
+    curl_easy_pause(hedge_curl_, bitmask);
+}
+
+void Slice::setPaused(bool paused) {
+  paused_ = paused;
+  updateTransferPause();
+}
+
+bool Slice::isPaused() const {
+  return paused_;
+}
+
+void Slice::updateTransferPause() {
+  if (!curl_ && !hedge_curl_)
+    return;
+
+  const bool pause = paused_ || write_paused_ || bandwidth_paused_;
+  if (pause == transfer_paused_)
+    return;
+
+  // libcurl may call write callback in curl_easy_pause, the transfer will be paused again by it if needed.
+  transfer_paused_ = pause;
+  pauseTransfers(pause ? CURLPAUSE_ALL : CURLPAUSE_CONT);
+}
+
+Result Slice::setupTransfer(void* multi,
+                            void* curl,
+                            struct curl_slist** header_chunk,
+                            const utf8string& url,
+                            struct curl_slist* connect_to,
+                            Receiver* receiver) {
+  CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L));
+  CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_URL, url.c_str()));
+  if (connect_to)
+    CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_CONNECT_TO, connect_to));
 
   if (slice_manager_->options()->proxy.length() > 0) {
-    CHECK_SETOPT1(curl_easy_setopt(curl_, CURLOPT_PROXY, slice_manager_->options()->proxy.c_str()));
+    CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_PROXY, slice_manager_->options()->proxy.c_str()));
   }
 
-  CHECK_SETOPT1(curl_easy_setopt(curl_, CURLOPT_NOSIGNAL, 1L));
-  CHECK_SETOPT1(curl_easy_setopt(curl_, CURLOPT_FOLLOWLOCATION, 1L));
-  CHECK_SETOPT1(curl_easy_setopt(curl_, CURLOPT_SSL_VERIFYHOST, slice_manager_->options()->verify_peer_host ? 2L : 0L));
-  CHECK_SETOPT1(curl_easy_setopt(curl_, CURLOPT_SSL_VERIFYPEER, slice_manager_->options()->verify_peer_certificate ? 1L : 0L));
+  CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L));
+  CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L));
+  CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, slice_manager_->options()->verify_peer_host ? 2L : 0L));
+  CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, slice_manager_->options()->verify_peer_certificate ? 1L : 0L));
 
   if (slice_manager_->options()->verify_peer_certificate && slice_manager_->options()->ca_path.length() > 0)
-      CHECK_SETOPT1(curl_easy_setopt(curl_, CURLOPT_CAINFO, slice_manager_->options()->ca_path.c_str()));
+      CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_CAINFO, slice_manager_->options()->ca_path.c_str()));
 
   if (slice_manager_->options()->min_speed == -1) {
-    CHECK_SETOPT1(curl_easy_setopt(curl_, CURLOPT_LOW_SPEED_LIMIT, 0L));  // disabled
-    CHECK_SETOPT1(curl_easy_setopt(curl_, CURLOPT_LOW_SPEED_TIME, 0L));   // disabled
+    CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 0L));  // disabled
+    CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 0L));   // disabled
   }
   else {
-    CHECK_SETOPT1(curl_easy_setopt(curl_, CURLOPT_LOW_SPEED_LIMIT, slice_manager_->options()->min_speed));
-    CHECK_SETOPT1(curl_easy_setopt(curl_, CURLOPT_LOW_SPEED_TIME, slice_manager_->options()->min_speed_duration));
+    CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, slice_manager_->options()->min_speed));
+    CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, slice_manager_->options()->min_speed_duration));
   }
-  CHECK_SETOPT1(curl_easy_setopt(curl_, CURLOPT_NOPROGRESS, 1L));
+  CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L));
 
-  if (max_speed > 0) {
-    CHECK_SETOPT1(curl_easy_setopt(curl_, CURLOPT_MAX_RECV_SPEED_LARGE, (curl_off_t)max_speed));
-  }
-  CHECK_SETOPT1(curl_easy_setopt(curl_, CURLOPT_FORBID_REUSE, 0L));
-  CHECK_SETOPT1(curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, __SliceWriteBodyCallback));
-  CHECK_SETOPT1(curl_easy_setopt(curl_, CURLOPT_WRITEDATA, this));
+  CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_FORBID_REUSE, 0L));
+
+  const HttpVersion http_version = slice_manager_->options()->http_version;
+  if (http_version != HTTP_VERSION_AUTO)
+    CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, GetCurlHttpVersion(http_version)));
+  // Wait for the connection that can be multiplexed rather than open a new one.
+  if (IsMultiplexedHttpVersion(http_version))
+    CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L));
+
+  // An error page must not be written into the file, the transfer fails so that it can be moved to another source.
+  CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L));
+  CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, __SliceWriteBodyCallback));
+  CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_WRITEDATA, receiver));
+  CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, __SliceWriteHeaderCallback));
+  CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_HEADERDATA, receiver));
+  CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_PRIVATE, (void*)this));
 
   const HttpHeaders& headers = slice_manager_->options()->http_headers;
   if (headers.size() > 0) {
     for (const auto& it : headers) {
       utf8string headerStr = it.first + u8": " + it.second;
-      header_chunk_ = curl_slist_append(header_chunk_, headerStr.c_str());
+      *header_chunk = curl_slist_append(*header_chunk, headerStr.c_str());
     }
-    CHECK_SETOPT1(curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, header_chunk_));
+    CHECK_SETOPT1(curl_easy_setopt(curl, CURLOPT_HTTPHEADER, *header_chunk));
   }
 
+  receiver->range_begin = (end_ != -1 || receiver->pos > 0) ? receiver->pos : -1L;
+  receiver->status_code = 0;
+  receiver->content_range_begin = -1L;
+  receiver->response_checked = false;
   if (end_ != -1) {
     char range[64] = {0};
-    snprintf(range, sizeof(range), "%" PRId64 "-%" PRId64, begin_ + disk_capacity_, end_);
+    snprintf(range, sizeof(range), "%" PRId64 "-%" PRId64, receiver->pos, end_);
     if (strlen(range) > 0) {
-      const CURLcode err = curl_easy_setopt(curl_, CURLOPT_RANGE, range);
+      const CURLcode err = curl_easy_setopt(curl, CURLOPT_RANGE, range);
       OutputVerbose(slice_manager_->options()->verbose_functor, u8"Slice<%d>, Range: %s.\n", index_, range);
       if (err != CURLE_OK) {
         OutputVerbose(slice_manager_->options()->verbose_functor,
                       u8"CURLOPT_RANGE failed: %ld(%s).\n", (long)err,
                       curl_easy_strerror(err));
-        curl_easy_cleanup(curl_);
-        curl_ = nullptr;
-        freeDiskCacheBuffer();
-        status_ = DOWNLOAD_FAILED;
         return SET_CURL_OPTION_FAILED;
       }
     }
   }
   else {
-    curl_off_t offset = begin_ + disk_capacity_;
-    CURLcode err = curl_easy_setopt(curl_, CURLOPT_RESUME_FROM_LARGE, offset);
+    curl_off_t offset = receiver->pos;
+    CURLcode err = curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, offset);
     OutputVerbose(slice_manager_->options()->verbose_functor,
                   u8"Slice<%d>, Range: %" PRId64 "-INFINITE.\n", index_, offset);
     if (err != CURLE_OK) {
       OutputVerbose(slice_manager_->options()->verbose_functor,
                     u8"CURLOPT_RESUME_FROM_LARGE failed: %ld(%s).\n",
                     (long)err, curl_easy_strerror(err));
-
-      curl_easy_cleanup(curl_);
-      curl_ = nullptr;
-
-      freeDiskCacheBuffer();
-
-      status_ = DOWNLOAD_FAILED;
       return SET_CURL_OPTION_FAILED;
     }
   }
 
-  CURLMcode m_code = curl_multi_add_handle(multi, curl_);
+  CURLMcode m_code = curl_multi_add_handle(multi, curl);
   if (m_code != CURLM_OK) {
     OutputVerbose(slice_manager_->options()->verbose_functor,
                   u8"curl_multi_add_handle failed: %ld(%s).\n",
                   (long)m_code, curl_multi_strerror(m_code));
-    curl_easy_cleanup(curl_);
-    curl_ = nullptr;
-
-    freeDiskCacheBuffer();
-
-    status_ = DOWNLOAD_FAILED;
     return ADD_CURL_HANDLE_FAILED;
   }
 
@@ -250,30 +538,25 @@ Result Slice::start(void* multi, int64_t disk_cache_size, int64_t max_speed) {
 
 Result Slice::stop(void* multi) {
   Result ret = SUCCESSED;
-  if (curl_) {
-    if (multi) {
-      const CURLMcode code = curl_multi_remove_handle(multi, curl_);
-      if (code != CURLM_CALL_MULTI_PERFORM && code != CURLM_OK) {
-        OutputVerbose(slice_manager_->options()->verbose_functor,
-                      u8"curl_multi_remove_handle failed: %ld(%s).\n",
-                      (long)code, curl_multi_strerror(code));
-      }
-    }
-
-    if (header_chunk_) {
-      curl_slist_free_all(header_chunk_);
-      header_chunk_ = nullptr;
-    }
-
-    curl_easy_cleanup(curl_);
-    curl_ = nullptr;
-  }
+  if (curl_)
+    TraceAsync(TRACE_SLICE, TRACE_ASYNC_END, this, index_, downloadedSinceStart());
+  removeTransfer(multi, &hedge_curl_, &hedge_header_chunk_);
+  hedge_budget_ticket_.reset();
+  removeTransfer(multi, &curl_, &header_chunk_);
+
+  // no more data from libcurl, wait for the buffers queued.
+  waitQueuedData();
+  write_paused_ = false;
+  setBandwidthPaused(false);
+  budget_ticket_.reset();
 
   bool discard_downloaded = false;
 
+  // The transfer of a slice of unknown size ended normally, its data is checked by file size later.
   if (status_ == UNFETCH ||
       status_ == FETCHED ||
-      status_ == DOWNLOAD_COMPLETED) {
+      status_ == DOWNLOAD_COMPLETED ||
+      status_ == CURL_OK_BUT_COMPLETED_NOT_SURE) {
     discard_downloaded = false;
   }
   else {
@@ -287,8 +570,11 @@ Result Slice::stop(void* multi) {
   }
 
   if (discard_downloaded) {
+    addDownloadedSize(-(disk_capacity_.load() + disk_cache_capacity_.load()));
     disk_capacity_.store(0);
     disk_cache_capacity_.store(0);
+    synced_capacity_ = 0L;
+    resetChunkHashes(0);
   }
   else if (!flushToDisk()) {
     ret = FLUSH_TMP_FILE_FAILED;
@@ -299,8 +585,55 @@ Result Slice::stop(void* multi) {
   return ret;
 }
 
+Result Slice::release(void* multi) {
+  if (curl_)
+    TraceAsync(TRACE_SLICE, TRACE_ASYNC_END, this, index_, downloadedSinceStart());
+  removeTransfer(multi, &hedge_curl_, &hedge_header_chunk_);
+  hedge_budget_ticket_.reset();
+  removeTransfer(multi, &curl_, &header_chunk_);
+
+  waitQueuedData();
+  write_paused_ = false;
+  transfer_paused_ = false;
+  setBandwidthPaused(false);
+  budget_ticket_.reset();
+
+  Result ret = SUCCESSED;
+  if (!flushToDisk())
+    ret = FLUSH_TMP_FILE_FAILED;
+  freeDiskCacheBuffer();
+
+  setStatus(ret == SUCCESSED ? UNFETCH : DOWNLOAD_FAILED);
+  return ret;
+}
+
+void Slice::removeTransfer(void* multi, void** curl, struct curl_slist** header_chunk) {
+  if (*curl) {
+    if (multi) {
+      const CURLMcode code = curl_multi_remove_handle(multi, *curl);
+      if (code != CURLM_CALL_MULTI_PERFORM && code != CURLM_OK) {
+        OutputVerbose(slice_manager_->options()->verbose_functor,
+                      u8"curl_multi_remove_handle failed: %ld(%s).\n",
+                      (long)code, curl_multi_strerror(code));
+      }
+    }
+
+    ReleaseCurlHandle(*curl);
+    *curl = nullptr;
+  }
+
+  if (*header_chunk) {
+    curl_slist_free_all(*header_chunk);
+    *header_chunk = nullptr;
+  }
+}
+
 void Slice::setStatus(Slice::Status s) {
+  if (status_ == s)
+    return;
+  const Status old_status = status_;
   status_ = s;
+  slice_manager_->onSliceStatusChanged(this, old_status);
 }
 
 Slice::Status Slice::status() const {
@@ -315,110 +648,247 @@ int32_t Slice::failedTimes() const {
   return failed_times_;
 }
 
+void Slice::setRetryDelay(long delay_ms) {
+  retry_delay_ms_ = delay_ms;
+  retry_time_meter_.Restart();
+}
+
+long Slice::retryRemainingTime() const {
+  if (retry_delay_ms_ <= 0)
+    return 0L;
+  return std::max(retry_delay_ms_ - retry_time_meter_.Elapsed(), 0L);
+}
+
 bool Slice::isDataCompletedClearly() const {
   if (end_ == -1)
     return false;
 
-  return (size() == (disk_capacity_.load() + disk_cache_capacity_.load()));
+  return size() == downloaded_size_.load();
 }
 
-bool Slice::flushToDisk() {
-  bool bret = true;
-  if (disk_cache_buffer_) {
+int64_t Slice::remainingSize() const {
+  if (end_ == -1)
+    return -1;
+
+  return size() - downloaded_size_.load();
+}
+
+bool Slice::shrinkEnd(int64_t new_end) {
+  bool bret = false;
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
-    EnterCriticalSection(&crit_);
+  EnterCriticalSection(&crit_);
 #else
-    pthread_mutex_lock(&mutex_);
+  pthread_mutex_lock(&mutex_);
+#endif
+  if (end_ != -1 && new_end < end_ &&
+      new_end + 1 >= begin_ + downloaded_size_.load()) {
+    end_ = new_end;
+    bret = true;
+  }
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  LeaveCriticalSection(&crit_);
+#else
+  pthread_mutex_unlock(&mutex_);
 #endif
+  return bret;
+}
+
+bool Slice::isMappedIo() const {
+  if (end_ == -1)
+    return false;
+  std::shared_ptr<TargetFile> target_file = slice_manager_->targetFile();
+  return target_file && target_file->isMapped();
+}
+
+bool Slice::flushToDisk() {
+  TraceScope trace(TRACE_FLUSH, this, index_);
+  bool bret = true;
+  if (isMappedIo()) {
+    const int64_t capacity = disk_capacity_.load();
+    if (capacity > synced_capacity_) {
+      trace.setArg(capacity - synced_capacity_);
+      bret = slice_manager_->targetFile()->flushMapped(begin_ + synced_capacity_, capacity - synced_capacity_);
+      if (bret)
+        synced_capacity_ = capacity;
+      else
+        OutputVerbose(slice_manager_->options()->verbose_functor, "Slice[%d] synchronize mapping failed.\n", index_);
+    }
+  }
+  else if (disk_cache_buffer_) {
+    waitQueuedData();
+    if (write_failed_.load())
+      bret = false;
+
     int64_t written = 0;
     const int64_t need_write = disk_cache_capacity_.load();
     disk_cache_capacity_ = 0L;
+    trace.setArg(need_write);
+    if (!bret)
+      addDownloadedSize(-need_write);
 
-    if (need_write > 0) {
+    if (bret && need_write > 0) {
       std::shared_ptr<TargetFile> target_file = slice_manager_->targetFile();
       if (target_file) {
-        written = target_file->write(begin_ + disk_capacity_.load(), disk_cache_buffer_, need_write);
+        written = target_file->write(begin_ + disk_capacity_.load(), disk_cache_buffer_ + disk_cache_offset_, need_write);
       }
 
       std::atomic_fetch_add(&disk_capacity_, written);
+      alignDiskCache(begin_ + disk_capacity_.load());
       bret = (written == need_write);
       assert(bret);
       if (!bret) {
+        addDownloadedSize(written - need_write);
         OutputVerbose(slice_manager_->options()->verbose_functor,
                       "Slice[%d] flush to disk failed: %" PRId64 "/%" PRId64 ".\n",
                       index_, written, need_write);
       }
     }
-#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
-    LeaveCriticalSection(&crit_);
-#else
-    pthread_mutex_unlock(&mutex_);
-#endif
   }
 
   return bret;
 }
 
+bool Slice::acquireDiskCache(bool notify) {
+  std::shared_ptr<BufferPool> pool = slice_manager_->bufferPool();
+  if (!pool)
+    return false;
+
+  disk_cache_buffer_ = pool->acquire(notify);
+  if (!disk_cache_buffer_)
+    return false;
+
+  disk_cache_pool_ = pool;
+  disk_cache_size_ = pool->blockSize();
+  disk_cache_capacity_.store(0L);
+  alignDiskCache(begin_ + disk_capacity_.load());
+  return true;
+}
+
 void Slice::freeDiskCacheBuffer() {
   if (disk_cache_buffer_) {
-    free(disk_cache_buffer_);
+    if (disk_cache_pool_)
+      disk_cache_pool_->release(disk_cache_buffer_);
+    disk_cache_pool_.reset();
     disk_cache_buffer_ = nullptr;
     disk_cache_size_ = 0L;
+    disk_cache_offset_ = 0L;
     disk_cache_capacity_.store(0L);
   }
 }
 
-bool Slice::onNewData(const char* p, long data_size) {
-  bool bret = false;
+void Slice::alignDiskCache(int64_t pos) {
+  std::shared_ptr<TargetFile> target_file = slice_manager_->targetFile();
+  if (target_file && target_file->isDirectIo())
+    disk_cache_offset_ = pos % ZOE_DIRECT_IO_ALIGNMENT;
+  else
+    disk_cache_offset_ = 0L;
+}
 
-#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
-  EnterCriticalSection(&crit_);
-#else
-  pthread_mutex_lock(&mutex_);
-#endif
+Slice::DataResult Slice::onNewData(const char* p, long data_size) {
+  DataResult ret = DATA_FAILED;
+  int64_t received = 0L;  // change of the data size this slice holds
 
   do {
     if (!p || data_size <= 0) {
-      bret = true;
+      ret = DATA_ACCEPTED;
       break;
     }
 
+    // a queued buffer failed to write.
+    if (write_failed_.load())
+      break;
+
     std::shared_ptr<TargetFile> target_file = slice_manager_->targetFile();
     if (!target_file) {
       break;
     }
 
+    // copy to the mapping of file.
+    char* mapped = (end_ != -1) ? target_file->mappedData(begin_ + disk_capacity_.load(), data_size) : nullptr;
+    if (mapped) {
+      memcpy(mapped, p, data_size);
+      target_file->markWritten(begin_ + disk_capacity_.load(), p, data_size);
+      std::atomic_fetch_add(&disk_capacity_, (int64_t)data_size);
+      received = data_size;
+      ret = DATA_ACCEPTED;
+      break;
+    }
+
     // no cache buffer, directly write to file.
-    if (!disk_cache_buffer_) {
+    // a block may be available again since the budget of cache memory is shared with other downloads.
+    if (!disk_cache_buffer_ && (isMappedIo() || !acquireDiskCache(false))) {
       int64_t written = target_file->write(begin_ + disk_capacity_.load(), p, data_size);
       std::atomic_fetch_add(&disk_capacity_, written);
+      received = written;
 
-      bret = (written == data_size);
+      ret = (written == data_size) ? DATA_ACCEPTED : DATA_FAILED;
       break;
     }
 
-    if (disk_cache_size_ - disk_cache_capacity_ >= data_size) {
-      memcpy((char*)(disk_cache_buffer_ + disk_cache_capacity_.load()), p, data_size);
+    if (disk_cache_size_ - disk_cache_offset_ - disk_cache_capacity_ >= data_size) {
+      memcpy((char*)(disk_cache_buffer_ + disk_cache_offset_ + disk_cache_capacity_.load()), p, data_size);
       disk_cache_capacity_ += data_size;
-      bret = true;
+      received = data_size;
+      ret = DATA_ACCEPTED;
       break;
     }
 
+    // hand the filled cache to disk writer and go on with a new buffer, so that the loop is not blocked by disk.
+    std::shared_ptr<DiskWriter> disk_writer = slice_manager_->diskWriter();
+    if (disk_writer && disk_cache_pool_ && disk_cache_capacity_.load() > 0) {
+      // libcurl will pass this data again after the transfer resumed.
+      // If nothing is queued, no block will be released to resume it, the cache is written below instead.
+      if (!handOffDiskCache(disk_writer, target_file)) {
+        if (slice_manager_->queuedBytes() > 0) {
+          ret = DATA_BLOCKED;
+          break;
+        }
+      }
+      else if (disk_cache_size_ - disk_cache_offset_ >= data_size) {
+        memcpy(disk_cache_buffer_ + disk_cache_offset_, p, data_size);
+        disk_cache_capacity_.store(data_size);
+        received = data_size;
+        ret = DATA_ACCEPTED;
+        break;
+      }
+    }
+
+    // the data queued must be written before the data following them.
+    waitQueuedData();
+    if (write_failed_.load())
+      break;
+
     const int64_t need_write = disk_cache_capacity_.load();
 
     disk_cache_capacity_.store(0L);
 
-    int64_t written = target_file->write(begin_ + disk_capacity_, disk_cache_buffer_, need_write);
+    // write the cache and the buffer of libcurl in one gathered write, rather than copying the data into cache.
+    // unbuffered writes require aligned buffers, so the data is still copied into the realigned cache for direct io.
+    if (!target_file->isDirectIo()) {
+      const WriteBuffer buffers[2] = {{disk_cache_buffer_ + disk_cache_offset_, need_write}, {p, data_size}};
+      const int64_t written = target_file->writev(begin_ + disk_capacity_.load(), buffers, 2);
+      std::atomic_fetch_add(&disk_capacity_, written);
+      received = written - need_write;
+      alignDiskCache(begin_ + disk_capacity_.load());
+
+      ret = (written == need_write + data_size) ? DATA_ACCEPTED : DATA_FAILED;
+      break;
+    }
+
+    int64_t written = target_file->write(begin_ + disk_capacity_, disk_cache_buffer_ + disk_cache_offset_, need_write);
     std::atomic_fetch_add(&disk_capacity_, written);
+    received = written - need_write;
     if (written != need_write) {
-      bret = false;
+      ret = DATA_FAILED;
       break;
     }
 
-    if (disk_cache_size_ - disk_cache_capacity_ >= data_size) {
-      memcpy((char*)(disk_cache_buffer_ + disk_cache_capacity_.load()), p, data_size);
-      std::atomic_fetch_add(&disk_cache_capacity_, data_size);
-      bret = true;
+    alignDiskCache(begin_ + disk_capacity_.load());
+    if (disk_cache_size_ - disk_cache_offset_ - disk_cache_capacity_ >= data_size) {
+      memcpy((char*)(disk_cache_buffer_ + disk_cache_offset_ + disk_cache_capacity_.load()), p, data_size);
+      std::atomic_fetch_add(&disk_cache_capacity_, (int64_t)data_size);
+      received += data_size;
+      ret = DATA_ACCEPTED;
       break;
     }
 
@@ -430,16 +900,286 @@ bool Slice::onNewData(const char* p, long data_size) {
           written, data_size);
     }
     std::atomic_fetch_add(&disk_capacity_, written);
+    received += written;
 
-    bret = (written == data_size);
+    ret = (written == data_size) ? DATA_ACCEPTED : DATA_FAILED;
   } while (false);
 
+  if (received != 0)
+    addDownloadedSize(received);
+
+  // Data is received in order, so the chunks can be hashed here no matter where the data is written.
+  if (ret == DATA_ACCEPTED && data_size > 0 && isChunkHashEnabled())
+    hashChunkData(p, data_size);
+
+  return ret;
+}
+
+bool Slice::handOffDiskCache(std::shared_ptr<DiskWriter> disk_writer, std::shared_ptr<TargetFile> target_file) {
+  char* new_buffer = disk_cache_pool_->acquire();
+  if (!new_buffer)
+    return false;
+
+  const int64_t need_write = disk_cache_capacity_.load();
+  // disk_capacity_ and queued_capacity_ are changed by disk writer meanwhile, downloaded_size_ is not.
+  const int64_t pos = begin_ + downloaded_size_.load() - need_write;
+  std::shared_ptr<BufferPool> pool = disk_cache_pool_;
+  char* filled_buffer = disk_cache_buffer_;
+  queued_capacity_ += need_write;
+  const bool posted = disk_writer->post(index_, target_file, pos, filled_buffer + disk_cache_offset_, need_write,
+                                        [this, need_write, pool, filled_buffer](int64_t written) {
+                                          std::atomic_fetch_add(&disk_capacity_, written);
+                                          queued_capacity_ -= need_write;
+                                          if (written != need_write) {
+                                            addDownloadedSize(written - need_write);
+                                            write_failed_.store(true);
+                                          }
+                                          pool->release(filled_buffer);
+                                        });
+  if (!posted) {
+    queued_capacity_ -= need_write;
+    disk_cache_pool_->release(new_buffer);
+    return false;
+  }
+
+  disk_cache_buffer_ = new_buffer;
+  disk_cache_capacity_.store(0L);
+  alignDiskCache(pos + need_write);
+  return true;
+}
+
+bool Slice::postDiskCache() {
+  bool bret = false;
+  std::shared_ptr<DiskWriter> disk_writer = slice_manager_->diskWriter();
+  std::shared_ptr<TargetFile> target_file = slice_manager_->targetFile();
+  if (disk_writer && target_file && disk_cache_pool_ && disk_cache_buffer_ && disk_cache_capacity_.load() > 0 &&
+      !write_failed_.load()) {
+    bret = handOffDiskCache(disk_writer, target_file);
+  }
+  return bret;
+}
+
+void Slice::waitQueuedData() {
+  std::shared_ptr<DiskWriter> disk_writer = slice_manager_->diskWriter();
+  if (disk_writer)
+    disk_writer->waitFor([this]() { return queued_capacity_.load() == 0; });
+}
+
+bool Slice::isWritePaused() const {
+  return write_paused_;
+}
+
+void Slice::setWritePaused(bool paused) {
+  if (paused && !write_paused_ && slice_manager_->metrics())
+    slice_manager_->metrics()->addWriteStall();
+  write_paused_ = paused;
+}
+
+bool Slice::isBandwidthAvailable() const {
+  TokenBucket* speed_limiter = slice_manager_->speedLimiter();
+  return (!speed_limiter || speed_limiter->available()) &&
+         (!budget_ticket_ || budget_ticket_->available());
+}
+
+void Slice::takeBandwidth(int64_t bytes) {
+  TokenBucket* speed_limiter = slice_manager_->speedLimiter();
+  if (speed_limiter)
+    speed_limiter->take(bytes);
+  if (budget_ticket_)
+    budget_ticket_->take(bytes);
+}
+
+bool Slice::isBandwidthPaused() const {
+  return bandwidth_paused_;
+}
+
+void Slice::setBandwidthPaused(bool paused) {
+  if (paused != bandwidth_paused_)
+    slice_manager_->onBandwidthPaused(paused);
+  bandwidth_paused_ = paused;
+}
+
+void Slice::addDownloadedSize(int64_t delta) {
+  downloaded_size_ += delta;
+  slice_manager_->addDownloaded(delta);
+}
+
+bool Slice::isChunkHashEnabled() const {
+  return slice_manager_->options()->chunk_hash_enabled;
+}
+
+void Slice::hashChunkData(const char* p, int64_t size) {
+  while (size > 0) {
+    const int64_t chunk_end = (int64_t)(chunk_hashes_.size() + 1) * ZOE_CHUNK_HASH_SIZE_BYTE;
+    const int64_t n = std::min(size, chunk_end - chunk_hashed_);
+    crc32_internal::crc32Update(&chunk_crc_, (unsigned char*)p, (uint32_t)n);
+    chunk_hashed_ += n;
+    p += n;
+    size -= n;
+
+    if (chunk_hashed_ == chunk_end || (end_ != -1 && chunk_hashed_ == this->size())) {
+      uint32_t crc = chunk_crc_;
+      crc32_internal::crc32Finish(&crc);
+      // Only the transfer thread appends, the lock is taken once for each chunk for the checkpoint readers.
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+      EnterCriticalSection(&crit_);
+#else
+      pthread_mutex_lock(&mutex_);
+#endif
+      chunk_hashes_.push_back(crc);
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+      LeaveCriticalSection(&crit_);
+#else
+      pthread_mutex_unlock(&mutex_);
+#endif
+      crc32_internal::crc32Init(&chunk_crc_);
+    }
+  }
+}
+
+void Slice::resetChunkHashes(size_t kept_num) {
+  if (chunk_hashes_.size() > kept_num) {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+    EnterCriticalSection(&crit_);
+#else
+    pthread_mutex_lock(&mutex_);
+#endif
+    chunk_hashes_.resize(kept_num);
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+    LeaveCriticalSection(&crit_);
+#else
+    pthread_mutex_unlock(&mutex_);
+#endif
+  }
+  chunk_hashed_ = (int64_t)chunk_hashes_.size() * ZOE_CHUNK_HASH_SIZE_BYTE;
+  if (end_ != -1)
+    chunk_hashed_ = std::min(chunk_hashed_, this->size());
+  crc32_internal::crc32Init(&chunk_crc_);
+}
+
+void Slice::syncChunkHashes() {
+  const int64_t capacity = disk_capacity_.load();
+  if (chunk_hashed_ == capacity)
+    return;
+
+  // The chunks beyond the data on disk are discarded, such as the data failed to write.
+  if (chunk_hashed_ > capacity)
+    resetChunkHashes((size_t)(capacity / ZOE_CHUNK_HASH_SIZE_BYTE));
+  else if (chunk_hashed_ % ZOE_CHUNK_HASH_SIZE_BYTE != 0)
+    resetChunkHashes(chunk_hashes_.size());
+
+  std::shared_ptr<TargetFile> target_file = slice_manager_->targetFile();
+  std::vector<char> buffer(ZOE_HASH_READ_BUFFER_SIZE);
+  while (target_file && chunk_hashed_ < capacity) {
+    const int64_t want = std::min((int64_t)buffer.size(), capacity - chunk_hashed_);
+    const int64_t read = target_file->read(begin_ + chunk_hashed_, buffer.data(), want);
+    if (read <= 0)
+      break;
+    hashChunkData(buffer.data(), read);
+  }
+
+  // The data can't be hashed will be downloaded again.
+  if (chunk_hashed_ < capacity) {
+    OutputVerbose(slice_manager_->options()->verbose_functor,
+                  u8"Slice<%d> read data to hash failed, discard data from %" PRId64 ".\n", index_, chunk_hashed_);
+    addDownloadedSize(chunk_hashed_ - capacity);
+    disk_capacity_.store(chunk_hashed_);
+    synced_capacity_ = std::min(synced_capacity_, chunk_hashed_);
+  }
+}
+
+std::vector<uint32_t> Slice::chunkHashes() const {
+  std::vector<uint32_t> hashes;
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  EnterCriticalSection(&crit_);
+#else
+  pthread_mutex_lock(&mutex_);
+#endif
+  const int64_t capacity = disk_capacity_.load();
+  for (size_t i = 0; i < chunk_hashes_.size(); i++) {
+    int64_t chunk_end = (int64_t)(i + 1) * ZOE_CHUNK_HASH_SIZE_BYTE;
+    if (end_ != -1)
+      chunk_end = std::min(chunk_end, size());
+    if (chunk_end > capacity)
+      break;
+    hashes.push_back(chunk_hashes_[i]);
+  }
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
   LeaveCriticalSection(&crit_);
 #else
   pthread_mutex_unlock(&mutex_);
 #endif
+  return hashes;
+}
 
-  return bret;
+std::vector<uint32_t> Slice::receivedChunkHashes() const {
+  return chunk_hashes_;
+}
+
+void Slice::setChunkHashes(const std::vector<uint32_t>& hashes) {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  EnterCriticalSection(&crit_);
+#else
+  pthread_mutex_lock(&mutex_);
+#endif
+  chunk_hashes_ = hashes;
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  LeaveCriticalSection(&crit_);
+#else
+  pthread_mutex_unlock(&mutex_);
+#endif
+  resetChunkHashes(hashes.size());
+}
+
+bool Slice::verifyChunks(const std::vector<uint32_t>& hashes) {
+  TraceScope trace(TRACE_CHUNK_VERIFY, this, index_);
+  std::shared_ptr<TargetFile> target_file = slice_manager_->targetFile();
+  if (!target_file)
+    return false;
+
+  const int64_t capacity = disk_capacity_.load();
+  std::vector<char> buffer(ZOE_HASH_READ_BUFFER_SIZE);
+  bool matched = true;
+
+  resetChunkHashes(0);
+  for (size_t i = 0; i < hashes.size() && matched; i++) {
+    const int64_t chunk_begin = (int64_t)i * ZOE_CHUNK_HASH_SIZE_BYTE;
+    int64_t chunk_end = chunk_begin + ZOE_CHUNK_HASH_SIZE_BYTE;
+    if (end_ != -1)
+      chunk_end = std::min(chunk_end, size());
+    if (chunk_end > capacity)
+      break;
+
+    uint32_t crc = 0;
+    crc32_internal::crc32Init(&crc);
+    matched = false;
+    for (int64_t pos = chunk_begin; pos < chunk_end;) {
+      const int64_t read = target_file->read(begin_ + pos, buffer.data(), std::min((int64_t)buffer.size(), chunk_end - pos));
+      if (read <= 0)
+        break;
+      crc32_internal::crc32Update(&crc, (unsigned char*)buffer.data(), (uint32_t)read);
+      pos += read;
+      if (pos == chunk_end) {
+        crc32_internal::crc32Finish(&crc);
+        matched = (crc == hashes[i]);
+      }
+    }
+
+    if (matched) {
+      chunk_hashes_.push_back(hashes[i]);
+      chunk_hashed_ = chunk_end;
+    }
+    else {
+      OutputVerbose(slice_manager_->options()->verbose_functor,
+                    u8"Slice<%d> chunk %d is corrupted, discard data from %" PRId64 ".\n", index_, (int)i, chunk_begin);
+      addDownloadedSize(chunk_begin - capacity);
+      disk_capacity_.store(chunk_begin);
+      synced_capacity_ = std::min(synced_capacity_, chunk_begin);
+    }
+  }
+
+  if (!matched && status_ == DOWNLOAD_COMPLETED)
+    setStatus(UNFETCH);
+  return matched;
 }
 }  // namespace zoe
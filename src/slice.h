@@ -20,10 +20,14 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <mutex>
 #include <memory>
 #include <atomic>
 #include "target_file.h"
+#include "buffer_pool.h"
+#include "time_meter.hpp"
+#include "transfer_budget.h"
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
 #include <windows.h>
 #else
@@ -33,7 +37,8 @@
 struct curl_slist;
 namespace zoe {
 class SliceManager;
-class Slice {
+class DiskWriter;
+class Slice : public std::enable_shared_from_this<Slice> {
  public:
   enum Status {
     UNFETCH = 0,
@@ -44,11 +49,13 @@ class Slice {
     CURL_OK_BUT_COMPLETED_NOT_SURE = 5
   };
 
-  Slice(int32_t index,
+  // row is where the slice is recorded in the slice table of slice_manager, which outlives the slice.
+  Slice(size_t row,
+        int32_t index,
         int64_t begin,
         int64_t end,
         int64_t init_capacity,
-        std::shared_ptr<SliceManager> slice_manager);
+        SliceManager* slice_manager);
   virtual ~Slice();
 
   int64_t begin() const;
@@ -59,47 +66,243 @@ class Slice {
   int64_t diskCacheSize() const;
   int64_t diskCacheCapacity() const;
 
+  // Data received, including the data in cache and disk writer queue.
+  int64_t downloadedSize() const;
+
+  // Data received and milliseconds elapsed since the last start, used to measure the speed of a new transfer.
+  int64_t downloadedSinceStart() const;
+  long elapsedSinceStart() const;
+
   int32_t index() const;
+  size_t row() const;
+  // The easy handle records this slice as CURLOPT_PRIVATE while transferring.
   void* curlHandle();
 
-  Result start(void* multi, int64_t disk_cache_size, int64_t max_speed);
+  // The easy handle of the hedged request, nullptr if the slice is not hedged.
+  void* hedgeCurlHandle();
+  bool isHedged() const;
+
+  // The source where the slice is downloaded from next time, the url is empty for the url of options.
+  // connect_to is CURLOPT_CONNECT_TO of the source, nullptr to connect to the address resolved by libcurl.
+  void setSource(int32_t source, const utf8string& url, std::shared_ptr<struct curl_slist> connect_to);
+  int32_t source() const;
+
+  // The url of source, or the redirected url of options.
+  utf8string url() const;
+
+  // The transfer budget of process and host taken for next transfer, released when the slice stops.
+  void setBudgetTicket(std::shared_ptr<BudgetTicket> ticket);
+
+  // The disk cache is a block of the buffer pool of slice manager.
+  Result start(void* multi);
   Result stop(void* multi); // must setStatus first
 
+  // Request the remaining range of the downloading slice again on another connection, which is the hedged request.
+  // Both transfers go on, the data is taken from whichever receives it first, so the slice completes with the faster one.
+  // The ticket is the connection budget of the hedged request.
+  Result startHedge(void* multi,
+                    const utf8string& url,
+                    std::shared_ptr<struct curl_slist> connect_to,
+                    std::shared_ptr<BudgetTicket> ticket);
+
+  // Remove one transfer of a hedged slice, the other one goes on as the only transfer of slice.
+  // If keep_hedge is true, the original transfer is removed and the hedged request takes its place.
+  void stopHedge(void* multi, bool keep_hedge);
+  int32_t hedgedTimes() const;
+
+  // Pause or resume the slice on its own, such as the task is paused or preempted.
+  // The connections are kept, the transfers go on from where they were paused.
+  void setPaused(bool paused);
+  bool isPaused() const;
+
+  // Pause the transfers if the slice is paused or waiting for disk writer or bandwidth, otherwise resume them.
+  // curl_easy_pause is only called when the state changes, must be called on the thread that performs multi.
+  void updateTransferPause();
+
+  // Stop the transfers and close the connections but keep the data received whatever the uncompleted slice save policy
+  // is, the slice becomes UNFETCH and will be downloaded from where it stopped.
+  Result release(void* multi);
+
+  // The slice manager is notified, so that it can find the slices by status without scanning.
   void setStatus(Slice::Status s);
   Status status() const;
 
   void increaseFailedTimes();
   int32_t failedTimes() const;
 
+  // The failed slice is not retried until the delay elapsed.
+  void setRetryDelay(long delay_ms);
+  long retryRemainingTime() const;
+
   // if end_ is -1, this function will return false.
   bool isDataCompletedClearly() const;
 
-  bool onNewData(const char* p, long size);
+  // Size of data that not yet received, return -1 if end_ is -1.
+  int64_t remainingSize() const;
+
+  // Move end_ forward to new_end, the data after new_end will be discarded.
+  // Used to split the slice, new_end must not be less than the received position.
+  bool shrinkEnd(int64_t new_end);
+
+  enum DataResult {
+    DATA_ACCEPTED = 0,
+    DATA_FAILED = 1,
+    DATA_BLOCKED = 2  // disk writer queue is full or buffer pool is exhausted, the data is not consumed
+  };
+
+  // Data received by the transfer that writes to receiver, the part received by another transfer is skipped.
+  // Return the size consumed, CURL_WRITEFUNC_PAUSE or a smaller size to abort the transfer, see CURLOPT_WRITEFUNCTION.
+  typedef struct _Receiver {
+    Slice* slice;
+    int64_t pos;  // file position of the next data received by the transfer
+    int64_t range_begin;  // the first byte requested by Range header, -1 if not requested
+    long status_code;  // of the last HTTP response, 0 if none
+    int64_t content_range_begin;  // the first byte in Content-Range of the last HTTP response, -1 if none
+    bool response_checked;
+  } Receiver;
+  size_t onTransferData(Receiver* receiver, char* buffer, size_t size);
+  void onTransferHeader(Receiver* receiver, const char* buffer, size_t size);
+
+  // Whether the response is the data of the range requested. A server that ignores Range sends the file from byte 0,
+  // which must not be written at the position requested.
+  bool isResponseInRange(const Receiver* receiver) const;
+
+  // The cache is only touched by the thread that transfers the slice, so that the write callback takes no lock.
+  // The filled cache is handed to disk writer and replaced by another block, disk writer drains it meanwhile.
+  DataResult onNewData(const char* p, long size);
   bool flushToDisk();
+
+  // Hand the data in cache to disk writer without waiting, used by checkpoint on the transfer thread.
+  // Return false if there is nothing to hand off or the buffer pool is exhausted.
+  bool postDiskCache();
+
+  // Size of data that has been handed to disk writer but not written yet.
+  int64_t queuedCapacity() const;
+
+  // The transfer is paused by write callback because of disk writer backpressure.
+  bool isWritePaused() const;
+  void setWritePaused(bool paused);
+
+  // The bandwidth of task, process and host, received data is taken from all of them.
+  bool isBandwidthAvailable() const;
+  void takeBandwidth(int64_t bytes);
+
+  // The transfer is paused by write callback because of no bandwidth left.
+  bool isBandwidthPaused() const;
+  void setBandwidthPaused(bool paused);
+
+  // CRC32 of each ZOE_CHUNK_HASH_SIZE_BYTE block from begin_, the last chunk may be shorter.
+  // Hashes are calculated from received data, only the chunks that are completely on disk are returned.
+  std::vector<uint32_t> chunkHashes() const;
+
+  // The hashes of all the chunks received, including the data in cache and disk writer queue. Only called on the
+  // thread that transfers the slice.
+  std::vector<uint32_t> receivedChunkHashes() const;
+
+  // Read the chunks back from disk and compare with the hashes,
+  // data from the first mismatched chunk is discarded so that it will be downloaded again.
+  // Return false if any data is discarded.
+  bool verifyChunks(const std::vector<uint32_t>& hashes);
+
+  // Take the hashes of chunks on disk that are known to be right, such as verified before, without reading the data.
+  void setChunkHashes(const std::vector<uint32_t>& hashes);
  protected:
+  // Take a block of buffer pool as disk cache, return false if none is available.
+  bool acquireDiskCache(bool notify);
   void freeDiskCacheBuffer();
+  void waitQueuedData();
+
+  // Post the cache to disk writer and replace it with a new buffer of pool.
+  bool handOffDiskCache(std::shared_ptr<DiskWriter> disk_writer, std::shared_ptr<TargetFile> target_file);
+
+  // Called when the cache is empty and the next data will be written at pos.
+  // For direct io, the data is put at the same offset in cache as pos in alignment,
+  // so that the cache can be written without copy.
+  void alignDiskCache(int64_t pos);
+
+  // Set the options of a transfer from receiver's position and add it to multi.
+  Result setupTransfer(void* multi,
+                       void* curl,
+                       struct curl_slist** header_chunk,
+                       const utf8string& url,
+                       struct curl_slist* connect_to,
+                       Receiver* receiver);
+  void removeTransfer(void* multi, void** curl, struct curl_slist** header_chunk);
+
+  // Pause or resume all of the transfers of slice, bitmask is CURLPAUSE_ALL or CURLPAUSE_CONT.
+  void pauseTransfers(int bitmask);
+
+  // Data is copied into the mapping of target file directly, the size of slice must be known.
+  bool isMappedIo() const;
+
+  bool isChunkHashEnabled() const;
+  void hashChunkData(const char* p, int64_t size);
+
+  // Make the chunk hashes cover all data on disk, the data not hashed is read back from target file.
+  void syncChunkHashes();
+  void resetChunkHashes(size_t kept_num);
+
+  // Change downloaded_size_ and the total of slice manager together.
+  void addDownloadedSize(int64_t delta);
  protected:
+  const size_t row_;
   int32_t index_;
   int64_t begin_; // data range is [begin_, end_]
   int64_t end_;
   std::atomic<int64_t> disk_capacity_;  // data size in disk file
+  int64_t synced_capacity_;  // data size that has been synchronized to disk, used by memory mapped io
 
   void* curl_;
   struct curl_slist* header_chunk_;
+  int32_t source_;
+  utf8string source_url_;
+  std::shared_ptr<struct curl_slist> source_connect_to_;
+  std::shared_ptr<struct curl_slist> connect_to_;  // used by curl_, libcurl doesn't copy it
+  std::shared_ptr<BudgetTicket> budget_ticket_;
+
+  // Both transfers of a hedged slice are on the loop thread, each writes to a receiver.
+  Receiver receivers_[2];
+  int32_t primary_receiver_;  // the receiver of curl_, hedge_curl_ writes to the other one
+  void* hedge_curl_;
+  struct curl_slist* hedge_header_chunk_;
+  std::shared_ptr<struct curl_slist> hedge_connect_to_;
+  std::shared_ptr<BudgetTicket> hedge_budget_ticket_;
+  int32_t hedged_times_;
 
   int64_t disk_cache_size_;  // byte
   std::atomic<int64_t> disk_cache_capacity_; // data size in cache.
+  int64_t disk_cache_offset_;  // data in cache starts at disk_cache_buffer_ + disk_cache_offset_.
+  std::atomic<int64_t> queued_capacity_;  // data size in disk writer queue.
+  // disk_capacity_ + queued_capacity_ + disk_cache_capacity_, which are changed one by one,
+  // observers read this instead so that the data moving between them is not counted twice or missed.
+  std::atomic<int64_t> downloaded_size_;
+  std::atomic_bool write_failed_;
+  bool write_paused_;
+  bool bandwidth_paused_;
+  bool paused_;
+  bool transfer_paused_;  // by curl_easy_pause or write callback
   char* disk_cache_buffer_;
+  std::shared_ptr<BufferPool> disk_cache_pool_;  // where disk_cache_buffer_ comes from.
+
+  std::vector<uint32_t> chunk_hashes_;  // completed chunks, guarded by lock for checkpoint
+  uint32_t chunk_crc_;  // CRC32 register of the chunk being received
+  int64_t chunk_hashed_;  // data size that has been hashed
 
   Status status_;
   int32_t failed_times_;
+  long retry_delay_ms_;
+  TimeMeter retry_time_meter_;  // restarted when the retry delay is set
+
+  int64_t started_size_;  // downloadedSize() when started
+  TimeMeter started_time_meter_;
 
-  std::shared_ptr<SliceManager> slice_manager_;
+  SliceManager* slice_manager_;
 
+  // Guards end_ and chunk_hashes_ against the readers on other threads, not taken for each data received.
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
-  CRITICAL_SECTION crit_;
+  mutable CRITICAL_SECTION crit_;
 #else
-  pthread_mutex_t mutex_;
+  mutable pthread_mutex_t mutex_;
 #endif
 };
 }  // namespace zoe
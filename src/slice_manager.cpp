@@ -16,12 +16,13 @@
 ******************************************************************************/
 
 #include "slice_manager.h"
+#include <assert.h>
 #include <array>
 #include <algorithm>
 #include <inttypes.h>
+#include <string.h>
 #include <sstream>
 #include <iostream>
-#include "json.hpp"
 #include "file_util.h"
 #include "string_helper.hpp"
 #include "curl/curl.h"
@@ -29,40 +30,272 @@
 #include "options.h"
 #include "string_encode.h"
 #include "verbose.h"
+#include "peer_server.h"
+#include "trace.h"
 
-using json = nlohmann::json;
-
-#define INDEX_FILE_SIGN_STRING "zoe:EASY-FILE-DOWNLOAD(3.0)"
 #define TMP_FILE_EXTENSION ".zoe"
+#define DECOMPRESSED_FILE_EXTENSION ".zoed"
 
 namespace zoe {
-SliceManager::SliceManager(Options* options, const utf8string& redirect_url)
+SliceManager::SliceManager(Options* options,
+                           const utf8string& redirect_url,
+                           std::shared_ptr<DiskWriter> shared_disk_writer)
     : options_(options)
     , redirect_url_(redirect_url)
     , origin_file_size_(0L)
-    , target_file_(nullptr) {
-  index_file_path_ = makeIndexFilePath();
+    , target_file_(nullptr)
+    , buffer_pool_(nullptr)
+    , bandwidth_paused_num_(0)
+    , disk_writer_(nullptr) {
+  checkpoint_pending_.store(false);
+  range_confirmed_.store(false);
+  downloaded_.store(0L);
+  // There is nothing to resume from with memory target.
+  if (!options_->memory_target_enabled)
+    index_file_path_ = makeIndexFilePath();
+
+  // The slices take the bandwidth as they receive data, so the bandwidth left by a slice is used by the others.
+  if (options_->max_speed > 0) {
+    speed_limiter_ = std::make_shared<TokenBucket>();
+    speed_limiter_->setRate(options_->max_speed);
+  }
+
+  // The slices copy into the memory target directly.
+  if (options_->disk_cache_size > 0 && !options_->memory_target_enabled) {
+    const bool async_write = options_->async_disk_write_enabled;
+    const int32_t thread_num = std::max(options_->thread_num, 1);
+
+    // Each slice holds one block, and the same number of blocks can be queued on disk writer.
+    // Blocks are page aligned and not less than the size libcurl passes in one write callback.
+    const int32_t min_block_num = async_write ? thread_num * 2 : thread_num;
+    const int64_t page_size = BufferPool::PageSize();
+    int64_t block_size = std::max((int64_t)options_->disk_cache_size / min_block_num, (int64_t)CURL_MAX_WRITE_SIZE);
+    block_size = (block_size + page_size - 1) / page_size * page_size;
+    const int32_t max_block_num =
+        std::max((int32_t)(options_->disk_cache_size / block_size), async_write ? thread_num + 1 : thread_num);
+
+    buffer_pool_ = std::make_shared<BufferPool>(block_size, max_block_num);
+    OutputVerbose(options_->verbose_functor, u8"Disk cache block size: %" PRId64 ", max block number: %d.\n",
+                  block_size, max_block_num);
+
+    // The queued blocks are bounded by buffer pool already.
+    // The tasks on an engine share the disk writer of engine, so that the threads don't grow with the tasks.
+    if (async_write)
+      disk_writer_ = shared_disk_writer ? shared_disk_writer
+                                        : CreateDiskWriter(options_->storage_class, block_size * max_block_num);
+  }
 }
 
 SliceManager::~SliceManager() {
+  waitDiskWriter();
+  disk_writer_.reset();
   target_file_.reset();
 }
 
+void SliceManager::setMetrics(std::shared_ptr<Metrics> metrics) {
+  metrics_ = metrics;
+}
+
+std::shared_ptr<Metrics> SliceManager::metrics() const {
+  return metrics_;
+}
+
+std::shared_ptr<DiskWriter> SliceManager::diskWriter() const {
+  return disk_writer_;
+}
+
+std::shared_ptr<BufferPool> SliceManager::bufferPool() const {
+  return buffer_pool_;
+}
+
 std::shared_ptr<Slice> SliceManager::getSlice(void* curlHandle) {
-  for (auto& s : slices_) {
-    if (s->curlHandle() == curlHandle)
-      return s;
-  }
-  return nullptr;
+  if (!curlHandle)
+    return nullptr;
+
+  char* p = nullptr;
+  if (curl_easy_getinfo(curlHandle, CURLINFO_PRIVATE, &p) != CURLE_OK || !p)
+    return nullptr;
+
+  Slice* slice = reinterpret_cast<Slice*>(p);
+  if (slice->curlHandle() != curlHandle && slice->hedgeCurlHandle() != curlHandle)
+    return nullptr;
+  return slice->shared_from_this();
 }
 
 std::shared_ptr<Slice> SliceManager::getSlice(Slice::Status status) {
-  for (auto& s : slices_) {
-    if (s && s->status() == status) {
-      return s;
+  size_t row = 0;
+  {
+    std::lock_guard<std::mutex> lg(status_index_mutex_);
+    const std::set<std::pair<int64_t, size_t>>& rows = status_index_[status];
+    if (rows.empty())
+      return nullptr;
+    row = rows.begin()->second;
+  }
+  return materialize(row);
+}
+
+std::vector<std::shared_ptr<Slice>> SliceManager::getSlices(Slice::Status status) {
+  std::vector<size_t> rows;
+  {
+    std::lock_guard<std::mutex> lg(status_index_mutex_);
+    rows.reserve(status_index_[status].size());
+    for (const auto& r : status_index_[status])
+      rows.push_back(r.second);
+  }
+
+  std::vector<std::shared_ptr<Slice>> slices;
+  slices.reserve(rows.size());
+  for (size_t row : rows)
+    slices.push_back(materialize(row));
+  return slices;
+}
+
+void SliceManager::onSliceStatusChanged(Slice* slice, Slice::Status old_status) {
+  const std::pair<int64_t, size_t> key(slice->begin(), slice->row());
+  std::lock_guard<std::mutex> lg(status_index_mutex_);
+  // not added to slice table yet, the completed rows are looked up in table since they are not indexed.
+  if (old_status == Slice::DOWNLOAD_COMPLETED) {
+    if (key.second >= table_.size() || table_.begin(key.second) != key.first || table_.status(key.second) != old_status)
+      return;
+  }
+  else if (status_index_[old_status].erase(key) == 0) {
+    return;
+  }
+
+  if (slice->status() != Slice::DOWNLOAD_COMPLETED)
+    status_index_[slice->status()].insert(key);
+  table_.setStatus(key.second, slice->status());
+}
+
+void SliceManager::clearSlices() {
+  materialized_.clear();
+  table_.clear();
+
+  std::lock_guard<std::mutex> lg(status_index_mutex_);
+  for (auto& rows : status_index_)
+    rows.clear();
+}
+
+size_t SliceManager::appendSlice(int32_t index, int64_t begin, int64_t end, int64_t capacity) {
+  const size_t row = table_.append(index, begin, end, capacity);
+  if (table_.status(row) != Slice::DOWNLOAD_COMPLETED) {
+    std::lock_guard<std::mutex> lg(status_index_mutex_);
+    status_index_[table_.status(row)].insert(std::make_pair(begin, row));
+  }
+  return row;
+}
+
+void SliceManager::rebuildStatusIndex() {
+  std::vector<std::pair<int64_t, size_t>> rows[ZOE_SLICE_STATUS_NUM];
+  for (size_t row = 0; row < table_.size(); row++) {
+    if (table_.status(row) != Slice::DOWNLOAD_COMPLETED)
+      rows[table_.status(row)].push_back(std::make_pair(table_.begin(row), row));
+  }
+
+  // The set is built in linear time from sorted rows, the rows are mostly sorted already.
+  std::lock_guard<std::mutex> lg(status_index_mutex_);
+  for (int32_t status = 0; status < ZOE_SLICE_STATUS_NUM; status++) {
+    std::sort(rows[status].begin(), rows[status].end());
+    status_index_[status] = std::set<std::pair<int64_t, size_t>>(rows[status].begin(), rows[status].end());
+  }
+}
+
+std::shared_ptr<Slice> SliceManager::materialize(size_t row) {
+  auto it = materialized_.find(row);
+  if (it != materialized_.end())
+    return it->second;
+
+  // Only completed slices are released, so the status of a new Slice object is the same as the row's.
+  std::shared_ptr<Slice> slice = std::make_shared<Slice>(
+      row, table_.index(row), table_.begin(row), table_.end(row), table_.capacity(row), this);
+  assert(slice->status() == table_.status(row));
+  materialized_[row] = slice;
+  return slice;
+}
+
+Slice* SliceManager::materialized(size_t row) const {
+  auto it = materialized_.find(row);
+  return it != materialized_.end() ? it->second.get() : nullptr;
+}
+
+void SliceManager::releaseSlice(const std::shared_ptr<Slice>& slice) {
+  // Disk writer still refers to the slice until its data is written.
+  if (!slice || slice->status() != Slice::DOWNLOAD_COMPLETED || slice->curlHandle() ||
+      slice->queuedCapacity() > 0 || slice->diskCacheCapacity() > 0)
+    return;
+
+  auto it = materialized_.find(slice->row());
+  if (it == materialized_.end() || it->second != slice)
+    return;
+
+  table_.update(slice->row(), slice->end(), slice->capacity(),
+                options_->chunk_hash_enabled ? slice->chunkHashes() : std::vector<uint32_t>());
+  materialized_.erase(it);
+}
+
+size_t SliceManager::sliceNum() const {
+  return table_.size();
+}
+
+void SliceManager::sliceInfo(size_t row, SliceInfo& info) const {
+  Slice* slice = materialized(row);
+  info.index = table_.index(row);
+  info.begin = table_.begin(row);
+  info.end = slice ? slice->end() : table_.end(row);
+  info.downloaded = slice ? slice->downloadedSize() : table_.capacity(row);
+  info.status = table_.status(row);
+  info.slice = slice;
+}
+
+std::shared_ptr<Slice> SliceManager::splitSlice(int64_t min_slice_size) {
+  std::shared_ptr<Slice> victim;
+  int64_t max_remaining = 0L;
+  for (const auto& s : getSlices(Slice::DOWNLOADING)) {
+    const int64_t remaining = s->remainingSize();
+    if (remaining > max_remaining) {
+      max_remaining = remaining;
+      victim = s;
     }
   }
-  return nullptr;
+
+  if (!victim || max_remaining < min_slice_size * 2)
+    return nullptr;
+
+  const int64_t old_end = victim->end();
+  int64_t new_begin = old_end + 1 - max_remaining / 2;
+
+  // The slice fetched from a peer is compared with the chunk hashes of peer, so its chunks are kept whole.
+  if (!options_->peer_urls.empty()) {
+    const int64_t chunks_size = (new_begin - victim->begin() + ZOE_CHUNK_HASH_SIZE_BYTE - 1) / ZOE_CHUNK_HASH_SIZE_BYTE * ZOE_CHUNK_HASH_SIZE_BYTE;
+    new_begin = victim->begin() + chunks_size;
+    if (old_end + 1 - new_begin < min_slice_size)
+      return nullptr;
+  }
+
+  if (!victim->shrinkEnd(new_begin - 1))
+    return nullptr;
+
+  std::shared_ptr<Slice> slice = materialize(appendSlice(table_.maxIndex() + 1, new_begin, old_end, 0L));
+
+  OutputVerbose(options_->verbose_functor, u8"Split slice<%d> [%" PRId64 "~%" PRId64 "], new slice<%d> [%" PRId64 "~%" PRId64 "].\n",
+                victim->index(), victim->begin(), victim->end(), slice->index(), slice->begin(), slice->end());
+  return slice;
+}
+
+std::shared_ptr<Slice> SliceManager::cutSlice(std::shared_ptr<Slice> slice, int64_t size) {
+  if (!slice || slice->status() != Slice::UNFETCH || slice->end() == -1L || size <= 0L)
+    return nullptr;
+
+  // The range left must be worth a request.
+  const int64_t cut_begin = slice->begin() + slice->capacity() + size;
+  const int64_t old_end = slice->end();
+  if (old_end + 1 - cut_begin < size / 2 || !slice->shrinkEnd(cut_begin - 1))
+    return nullptr;
+
+  std::shared_ptr<Slice> rest = materialize(appendSlice(table_.maxIndex() + 1, cut_begin, old_end, 0L));
+  OutputVerbose(options_->verbose_functor, u8"Cut slice<%d> [%" PRId64 "~%" PRId64 "], the rest is slice<%d> [%" PRId64 "~%" PRId64 "].\n",
+                slice->index(), slice->begin(), slice->end(), rest->index(), rest->begin(), rest->end());
+  return rest;
 }
 
 const Options* SliceManager::options() const {
@@ -79,94 +312,91 @@ utf8string SliceManager::indexFilePath() const {
 
 Result SliceManager::loadExistSlice(int64_t cur_file_size,
                                     const utf8string& cur_content_md5) {
-  FILE* file = FileUtil::Open(index_file_path_, u8"rb");
-  if (!file)
+  if (index_file_path_.empty())
     return OPEN_INDEX_FILE_FAILED;
 
-  const int64_t file_size = FileUtil::GetFileSize(file);
-  FileUtil::Seek(file, 0, SEEK_SET);
-  std::vector<char> file_content((size_t)(file_size + 1), 0);
-  fread(file_content.data(), 1, (size_t)file_size, file);
-  FileUtil::Close(file);
-
-  try {
-    utf8string str_sign(file_content.data(), strlen(INDEX_FILE_SIGN_STRING));
-    if (str_sign != INDEX_FILE_SIGN_STRING)
-      return INVALID_INDEX_FORMAT;
-
-    utf8string str_json(file_content.data() + strlen(INDEX_FILE_SIGN_STRING));
-    json j = json::parse(str_json);
-
-    time_t last_update_time = j["update_time"].get<time_t>();
-    if (options_->tmp_file_expired_time >= 0) {
-      time_t now = time(nullptr);
-      if (now - last_update_time > options_->tmp_file_expired_time)
-        return TMP_FILE_EXPIRED;
-    }
+  IndexFile::Content content;
+  const Result load_ret = IndexFile::Load(index_file_path_, content, options_->verbose_functor);
+  if (load_ret != SUCCESSED)
+    return load_ret;
 
-    int64_t pre_file_size = j["file_size"];
-    if (pre_file_size != cur_file_size) {
-      OutputVerbose(
-          options_->verbose_functor,
-          u8"File size has changed, tmp file expired: %lld -> %lld.\n",
-          pre_file_size, cur_file_size);
-      return TMP_FILE_EXPIRED;
-    }
-    utf8string pre_content_md5 = j["content_md5"].get<utf8string>();
-    if (!StringHelper::IsEqual(pre_content_md5, cur_content_md5, true) && options_->content_md5_enabled) {
-      OutputVerbose(
-          options_->verbose_functor,
-          u8"Content md5 has changed, tmp file expired: %s -> %s.\n",
-          pre_content_md5.c_str(), cur_content_md5.c_str());
+  if (options_->tmp_file_expired_time >= 0) {
+    time_t now = time(nullptr);
+    if (now - content.update_time > options_->tmp_file_expired_time)
       return TMP_FILE_EXPIRED;
-    }
-    utf8string tmp_file_path = j["target_tmp_file_path"].get<utf8string>();
+  }
 
-    if (!FileUtil::IsRW(tmp_file_path))
-      return TMP_FILE_CANNOT_RW;
+  if (content.file_size != cur_file_size) {
+    OutputVerbose(
+        options_->verbose_functor,
+        u8"File size has changed, tmp file expired: %lld -> %lld.\n",
+        content.file_size, cur_file_size);
+    return TMP_FILE_EXPIRED;
+  }
+  if (!StringHelper::IsEqual(content.content_md5, cur_content_md5, true) && options_->content_md5_enabled) {
+    OutputVerbose(
+        options_->verbose_functor,
+        u8"Content md5 has changed, tmp file expired: %s -> %s.\n",
+        content.content_md5.c_str(), cur_content_md5.c_str());
+    return TMP_FILE_EXPIRED;
+  }
 
-    std::shared_ptr<TargetFile> target_file =
-        std::make_shared<TargetFile>(tmp_file_path);
+  if (!FileUtil::IsRW(content.target_tmp_file_path))
+    return TMP_FILE_CANNOT_RW;
 
-    if (!target_file->open())
-      return OPEN_TMP_FILE_FAILED;
+  std::shared_ptr<TargetFile> target_file =
+      std::make_shared<TargetFile>(content.target_tmp_file_path);
 
-    if (target_file->fileSize() != cur_file_size)
-      return TMP_FILE_SIZE_ERROR;
+  if (!target_file->open())
+    return OPEN_TMP_FILE_FAILED;
 
-    if (j["url"].get<utf8string>() != options_->url)
-      return URL_DIFFERENT;
+  if (target_file->fileSize() != cur_file_size)
+    return TMP_FILE_SIZE_ERROR;
 
-    if (j["redirect_url"].get<utf8string>() != redirect_url_ &&
-        options_->redirected_url_check_enabled)
-      return REDIRECT_URL_DIFFERENT;
+  if (content.url != options_->url)
+    return URL_DIFFERENT;
 
-    if (options_->url.length() == 0)
-      options_->url = j["url"].get<utf8string>();
+  if (content.redirect_url != redirect_url_ &&
+      options_->redirected_url_check_enabled)
+    return REDIRECT_URL_DIFFERENT;
 
-    slices_.clear();
+  if (options_->url.length() == 0)
+    options_->url = content.url;
 
-    for (auto& it : j["slices"]) {
-      std::shared_ptr<Slice> slice = std::make_shared<Slice>(
-          it["index"].get<int32_t>(),
-          it["begin"].get<int64_t>(),
-          it["end"].get<int64_t>(),
-          it["capacity"].get<int64_t>(),
-          shared_from_this());
-      slices_.push_back(slice);
-    }
+  clearSlices();
 
-    target_file_ = target_file;
-  } catch (const std::exception& e) {
-    OutputVerbose(options_->verbose_functor,
-                  u8"Load exist slice exception: %s.\n",
-                  e.what() ? e.what() : "");
-    slices_.clear();
-    return INVALID_INDEX_FORMAT;
+  table_.reserve(content.slices.size());
+  for (const auto& record : content.slices) {
+    const size_t row = table_.append(record.index, record.begin, record.end, record.capacity);
+    if (options_->chunk_hash_enabled && !record.chunks.empty())
+      table_.setChunks(row, record.chunks);
+  }
+  rebuildStatusIndex();
+
+  target_file_ = target_file;
+  target_file_->setMetrics(metrics_);
+
+  // Only the chunks recorded are verified, the data following them is trusted as before.
+  // The uncompleted slices keep their Slice objects, so that the verified hashes are kept.
+  if (options_->chunk_hash_enabled) {
+    for (size_t row = 0; row < table_.size(); row++) {
+      if (table_.chunks(row).empty())
+        continue;
+      std::shared_ptr<Slice> slice = materialize(row);
+      if (!slice->verifyChunks(table_.chunks(row)))
+        OutputVerbose(options_->verbose_functor, u8"Slice<%d> will be downloaded again from %" PRId64 ".\n",
+                      slice->index(), slice->begin() + slice->capacity());
+      releaseSlice(slice);
+    }
   }
+  coalesceSlices();
 
   content_md5_ = cur_content_md5;
   origin_file_size_ = cur_file_size;
+  applyDiskIoPolicy();
+  applyStreamingHash();
+  applyStreamOutput();
+  downloaded_.store(countDownloaded());
   OutputVerbose(options_->verbose_functor, u8"Load exist slice success.\n");
   dumpSlice();
   return SUCCESSED;
@@ -174,11 +404,15 @@ Result SliceManager::loadExistSlice(int64_t cur_file_size,
 
 bool SliceManager::flushAllSlices() {
   bool bret = true;
-  for (auto& s : slices_) {
-    if (!s->flushToDisk()) {
+  for (auto& it : materialized_) {
+    if (!it.second->flushToDisk()) {
       bret = false;  // not break
     }
   }
+
+  // checkpoint, the data must be on disk before index file records it.
+  if (target_file_ && !target_file_->flush())
+    bret = false;
   return bret;
 }
 
@@ -203,13 +437,26 @@ std::shared_ptr<TargetFile> SliceManager::targetFile() const {
 }
 
 Result SliceManager::makeSlices(bool accept_ranges) {
-  slices_.clear();
-  utf8string tmp_file_path = options_->target_file_path + TMP_FILE_EXTENSION;
+  clearSlices();
+  downloaded_.store(0L);
   if (target_file_)
     target_file_.reset();
-  target_file_ = std::make_shared<TargetFile>(tmp_file_path);
 
-  if (!target_file_->createNew(origin_file_size_)) {
+  if (options_->memory_target_enabled) {
+    target_file_ = std::make_shared<TargetFile>(u8"");
+    target_file_->setMetrics(metrics_);
+    if (!target_file_->createInMemory(origin_file_size_, options_->memory_buffer, options_->memory_buffer_size,
+                                      options_->memory_storage)) {
+      OutputVerbose(options_->verbose_functor, u8"Memory target is smaller than file size.\n");
+      return TMP_FILE_SIZE_ERROR;
+    }
+  }
+  else {
+    target_file_ = std::make_shared<TargetFile>(options_->target_file_path + TMP_FILE_EXTENSION);
+    target_file_->setMetrics(metrics_);
+  }
+
+  if (!target_file_->isInMemory() && !target_file_->createNew(origin_file_size_, options_->disk_io_policy == DIRECT_IO)) {
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
     OutputVerbose(options_->verbose_functor,
                   u8"Create target file failed, GLE: %d.\n", GetLastError());
@@ -219,12 +466,17 @@ Result SliceManager::makeSlices(bool accept_ranges) {
     return CREATE_TARGET_FILE_FAILED;
   }
 
+  applyDiskIoPolicy();
+  applyStreamingHash();
+  applyStreamOutput();
+
   assert(origin_file_size_ > 0L || origin_file_size_ == -1L);
 
   if (origin_file_size_ == -1L || !accept_ranges) {
-    std::shared_ptr<Slice> slice =
-        std::make_shared<Slice>(0L, 0L, -1L, 0L, shared_from_this());
-    slices_.push_back(slice);
+    appendSlice(0, 0L, -1L, 0L);
+  }
+  else if (origin_file_size_ <= options_->unsliced_file_size) {
+    appendSlice(1, 0L, origin_file_size_ - 1L, 0L);
   }
   else {
     int64_t slice_size = 0L;
@@ -247,6 +499,21 @@ Result SliceManager::makeSlices(bool accept_ranges) {
         slice_size = ZOE_DEFAULT_FIXED_SLICE_SIZE_BYTE;
       }
     }
+    else if (options_->slice_policy == Adaptive) {
+      // The slices are cut from the whole file when they are about to be downloaded, see cutSlice.
+      slice_size = origin_file_size_;
+    }
+
+    // Stream output starts the slices in read ahead window only, keep all threads busy in it.
+    bool fixed_num = options_->slice_policy == FixedNum;
+    if (isStreamOutputEnabled() && options_->stream_read_ahead_size > 0 && slice_size > 0L) {
+      const int64_t window_slice_size = std::max(options_->stream_read_ahead_size / std::max(options_->thread_num, 1),
+                                                 (int64_t)ZOE_MIN_SPLIT_SLICE_SIZE_BYTE);
+      if (slice_size > window_slice_size) {
+        slice_size = window_slice_size;
+        fixed_num = false;
+      }
+    }
 
     if (slice_size > 0L) {
       bool is_last = false;
@@ -255,8 +522,7 @@ Result SliceManager::makeSlices(bool accept_ranges) {
 
         cur_end = std::min(cur_begin + slice_size - 1, origin_file_size_ - 1);
         // final slice contains all of remainder space.
-        if (options_->slice_policy == FixedNum &&
-            slice_index == options_->slice_policy_value) {
+        if (fixed_num && slice_index == options_->slice_policy_value) {
           cur_end = origin_file_size_ - 1L;
         }
 
@@ -266,9 +532,7 @@ Result SliceManager::makeSlices(bool accept_ranges) {
         //if (is_last)
         //  cur_end = -1L;
 
-        std::shared_ptr<Slice> slice = std::make_shared<Slice>(
-            slice_index, cur_begin, cur_end, 0L, shared_from_this());
-        slices_.push_back(slice);
+        appendSlice(slice_index, cur_begin, cur_end, 0L);
 
         cur_begin = cur_end + 1L;
       } while (!is_last);
@@ -279,10 +543,43 @@ Result SliceManager::makeSlices(bool accept_ranges) {
   return SUCCESSED;
 }
 
+int64_t SliceManager::prefillFirstSlice(const std::string& data) {
+  if (data.empty())
+    return 0L;
+
+  std::shared_ptr<Slice> slice = getSlice(Slice::UNFETCH);
+  if (!slice || slice->begin() != 0L || slice->end() == -1L || slice->capacity() > 0L)
+    return 0L;
+
+  const int64_t size = std::min((int64_t)data.size(), slice->size());
+  if (slice->onNewData(data.data(), (long)size) != Slice::DATA_ACCEPTED) {
+    OutputVerbose(options_->verbose_functor, u8"Write the prefetched data to slice failed.\n");
+    return 0L;
+  }
+
+  // The slice starts with its cache empty, the data is flushed to disk.
+  if (slice->release(nullptr) != SUCCESSED) {
+    OutputVerbose(options_->verbose_functor, u8"Flush the prefetched data to disk failed.\n");
+    return 0L;
+  }
+
+  if (slice->isDataCompletedClearly())
+    slice->setStatus(Slice::DOWNLOAD_COMPLETED);
+  return size;
+}
+
 int64_t SliceManager::totalDownloaded() const {
-  int64_t total = 0L;
-  for (auto& s : slices_) {
-    total += (s->capacity() + s->diskCacheCapacity());
+  return downloaded_.load();
+}
+
+void SliceManager::addDownloaded(int64_t delta) {
+  downloaded_ += delta;
+}
+
+int64_t SliceManager::countDownloaded() const {
+  int64_t total = table_.totalCapacity();
+  for (auto& it : materialized_) {
+    total += it.second->downloadedSize() - table_.capacity(it.first);
   }
   return total;
 }
@@ -291,14 +588,11 @@ Result SliceManager::isAllSliceCompletedClearly(bool try_check_hash) const {
   Result ret = NOT_CLEARLY_RESULT;
 
   do {
-    const bool can_check_hash =
-        try_check_hash &&
-        (options_->hash_verify_policy == ALWAYS || (options_->hash_verify_policy == ONLY_NO_FILESIZE && origin_file_size_ == -1L)) &&
-        (options_->hash_value.length() > 0 || (content_md5_.length() > 0 && options_->content_md5_enabled));
+    const bool can_check_hash = try_check_hash && canCheckHash();
 
     // check file size
     if (origin_file_size_ != -1L) {
-      const int64_t totalDwn = totalDownloaded();
+      const int64_t totalDwn = countDownloaded();
       if (totalDwn != origin_file_size_) {
         OutputVerbose(options_->verbose_functor, u8"Slices total size(%" PRId64 ") not qualified(%" PRId64 ").\n", totalDwn, origin_file_size_);
         ret = SLICE_DOWNLOAD_FAILED;
@@ -312,13 +606,22 @@ Result SliceManager::isAllSliceCompletedClearly(bool try_check_hash) const {
 
     // check hash
     if (can_check_hash) {
+      TraceScope trace(TRACE_HASH_VERIFY, this, -1);
+      TimeMeter hash_time_meter;
       if (options_->hash_value.length() > 0) {
         if (options_->hash_verify_policy == ALWAYS || (options_->hash_verify_policy == ONLY_NO_FILESIZE && origin_file_size_ == -1L)) {
           if (target_file_) {
             utf8string str_hash;
             OutputVerbose(options_->verbose_functor, u8"Start calculate temp file hash.\n");
 
-            if (target_file_->calculateFileHash(options_, str_hash) == SUCCESSED) {
+            Result calc_ret = target_file_->calculateFileHash(options_, str_hash);
+            if (calc_ret == SUCCESSED && !StringHelper::IsEqual(str_hash, options_->hash_value, true) &&
+                target_file_->isStreamingHash()) {
+              OutputVerbose(options_->verbose_functor, u8"Streaming hash not match, calculate temp file hash again.\n");
+              calc_ret = target_file_->calculateFileHash(options_, str_hash, false);
+            }
+
+            if (calc_ret == SUCCESSED) {
               OutputVerbose(options_->verbose_functor, u8"Temp file hash: %s.\n", str_hash.c_str());
 
               if (!StringHelper::IsEqual(str_hash, options_->hash_value, true)) {
@@ -340,7 +643,14 @@ Result SliceManager::isAllSliceCompletedClearly(bool try_check_hash) const {
       else if (content_md5_.length() > 0 && options_->content_md5_enabled) {
         OutputVerbose(options_->verbose_functor, u8"Start calculate temp file md5.\n");
         utf8string str_md5;
-        if (target_file_->calculateFileMd5(options_, str_md5) == SUCCESSED) {
+        Result calc_ret = target_file_->calculateFileMd5(options_, str_md5);
+        if (calc_ret == SUCCESSED && !StringHelper::IsEqual(str_md5, content_md5_, true) &&
+            target_file_->isStreamingHash()) {
+          OutputVerbose(options_->verbose_functor, u8"Streaming md5 not match, calculate temp file md5 again.\n");
+          calc_ret = target_file_->calculateFileMd5(options_, str_md5, false);
+        }
+
+        if (calc_ret == SUCCESSED) {
           OutputVerbose(options_->verbose_functor, u8"Temp file md5: %s.\n", str_md5.c_str());
 
           if (!StringHelper::IsEqual(str_md5, content_md5_, true)) {
@@ -357,27 +667,88 @@ Result SliceManager::isAllSliceCompletedClearly(bool try_check_hash) const {
           ret = CALCULATE_HASH_FAILED;
         }
       }
+
+      if (metrics_)
+        metrics_->addHashVerifyTime(hash_time_meter.Elapsed());
     }
   } while (false);
 
   return ret;
 }
 
-Result SliceManager::finishDownloadProgress(bool need_check_completed, void* mult) {
-  // first of all, flush buffer to disk
-  OutputVerbose(options_->verbose_functor, u8"Start flushing cache to disk.\n");
+Result SliceManager::stopAllSlices(void* mult) {
   Result stop_ret = SUCCESSED;
-  for (auto& s : slices_) {
-    assert(s);
-    if (s) {
-      const Result r = s->stop(mult);
-      if (r != SUCCESSED)
-        stop_ret = r;
+  for (auto& it : materialized_) {
+    const Result r = it.second->stop(mult);
+    if (r != SUCCESSED)
+      stop_ret = r;
+  }
+  return stop_ret;
+}
+
+void SliceManager::pauseAllSlices(bool pause) {
+  for (auto& it : materialized_) {
+    const std::shared_ptr<Slice>& s = it.second;
+    if (s->curlHandle())
+      s->setPaused(pause);
+  }
+}
+
+void SliceManager::resumeWritePausedSlices() {
+  if (!disk_writer_)
+    return;
+
+  // The queue of disk writer is bounded by buffer pool, so free blocks are all that paused transfers wait for.
+  if (buffer_pool_ ? buffer_pool_->availableNum() == 0 : !disk_writer_->hasSpace())
+    return;
+
+  for (auto& it : materialized_) {
+    const std::shared_ptr<Slice>& s = it.second;
+    if (s->curlHandle() && s->isWritePaused()) {
+      s->setWritePaused(false);
+      // libcurl may call write callback in curl_easy_pause, the slice will be paused again if the queue is full.
+      s->updateTransferPause();
     }
   }
+}
+
+TokenBucket* SliceManager::speedLimiter() const {
+  return speed_limiter_.get();
+}
+
+void SliceManager::resumeBandwidthPausedSlices() {
+  if (bandwidth_paused_num_ == 0)
+    return;
+
+  for (auto& it : materialized_) {
+    const std::shared_ptr<Slice>& s = it.second;
+    if (s->curlHandle() && s->isBandwidthPaused() && s->isBandwidthAvailable()) {
+      s->setBandwidthPaused(false);
+      // libcurl may call write callback in curl_easy_pause, the slice will be paused again if no bandwidth.
+      s->updateTransferPause();
+    }
+  }
+}
+
+bool SliceManager::hasBandwidthPausedSlices() const {
+  return bandwidth_paused_num_ > 0;
+}
+
+void SliceManager::onBandwidthPaused(bool paused) {
+  bandwidth_paused_num_ += paused ? 1 : -1;
+}
+
+Result SliceManager::finishDownloadProgress(bool need_check_completed, void* mult) {
+  // first of all, flush buffer to disk
+  OutputVerbose(options_->verbose_functor, u8"Start flushing cache to disk.\n");
+  // the index file may be removed below, a late checkpoint must not create it again.
+  waitCheckpoint();
+  const Result stop_ret = stopAllSlices(mult);
+  if (target_file_)
+    target_file_->flush();
 
   // then flush index file.
-  if (!flushIndexFile()) {
+  if (!index_file_path_.empty() && !flushIndexFile()) {
     OutputVerbose(options_->verbose_functor, u8"Flush index file failed.\n");
   }
 
@@ -394,7 +765,25 @@ Result SliceManager::finishDownloadProgress(bool need_check_completed, void* mul
     }
   }
 
-  if (!target_file_->renameTo(options_, options_->target_file_path, false)) {
+  // the file is renamed and closed below, the data must be delivered before.
+  const Result stream_ret = target_file_->waitStreamOutput(options_, origin_file_size_ > 0 ? origin_file_size_ : totalDownloaded());
+  if (stream_ret != SUCCESSED) {
+    OutputVerbose(options_->verbose_functor, u8"Stream output failed: %s.\n", GetResultString(stream_ret));
+    return stream_ret;
+  }
+
+  if (target_file_->isInMemory()) {
+    options_->memory_data_size = target_file_->fileSize();
+    OutputVerbose(options_->verbose_functor, u8"Downloaded into memory: %" PRId64 ".\n", options_->memory_data_size);
+    return SUCCESSED;
+  }
+
+  if (decompressor_) {
+    const Result decompress_ret = finishDecompression();
+    if (decompress_ret != SUCCESSED)
+      return decompress_ret;
+  }
+  else if (!target_file_->renameTo(options_, options_->target_file_path, false)) {
     unsigned int error_code = 0;
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
     error_code = GetLastError();
@@ -406,6 +795,13 @@ Result SliceManager::finishDownloadProgress(bool need_check_completed, void* mul
     return RENAME_TMP_FILE_FAILED;
   }
 
+  // The peers go on fetching from the target file.
+  if (!peer_key_.empty() && !decompressor_) {
+    IndexFile::Content content;
+    makeIndexContent(content);
+    SharePeerFile(peer_key_, origin_file_size_, options_->target_file_path, MakePeerRanges(content));
+  }
+
   if (!FileUtil::RemoveFile(index_file_path_)) {
     // do not return failed
     OutputVerbose(options_->verbose_functor, u8"Remove index file failed.\n");
@@ -416,48 +812,334 @@ Result SliceManager::finishDownloadProgress(bool need_check_completed, void* mul
   return SUCCESSED;
 }
 
+Result SliceManager::finishDecompression() {
+  const Result ret = decompressor_->finish();
+  if (ret != SUCCESSED) {
+    OutputVerbose(options_->verbose_functor, u8"Decompress failed: %s.\n", GetResultString(ret));
+    return ret;
+  }
+
+  if (!FileUtil::Rename(decompressor_->outputPath(), options_->target_file_path)) {
+    OutputVerbose(options_->verbose_functor, u8"Rename file failed, %s => %s.\n", decompressor_->outputPath().c_str(),
+                  options_->target_file_path.c_str());
+    return RENAME_TMP_FILE_FAILED;
+  }
+
+  // The downloaded file is not needed once decompressed.
+  if (!peer_key_.empty())
+    UnsharePeerFile(peer_key_);
+  target_file_->close();
+  if (!FileUtil::RemoveFile(target_file_->filePath()))
+    OutputVerbose(options_->verbose_functor, u8"Remove downloaded file failed.\n");
+  return SUCCESSED;
+}
+
+int32_t SliceManager::repairCorruptedChunks() {
+  if (!options_->chunk_hash_enabled || !target_file_)
+    return 0;
+
+  int32_t num = 0;
+  for (size_t row = 0; row < table_.size(); row++) {
+    const Slice* existing = materialized(row);
+    const std::vector<uint32_t> hashes = existing ? existing->chunkHashes() : table_.chunks(row);
+    if (!existing && hashes.empty())
+      continue;
+
+    std::shared_ptr<Slice> s = materialize(row);
+    if (!s->verifyChunks(hashes)) {
+      s->setStatus(Slice::UNFETCH);
+      num++;
+    }
+    else {
+      releaseSlice(s);
+    }
+  }
+
+  if (num > 0) {
+    OutputVerbose(options_->verbose_functor, u8"%d slices have corrupted chunks, download them again.\n", num);
+    coalesceSlices();
+    flushIndexFile();
+  }
+  return num;
+}
+
+int32_t SliceManager::coalesceSlices() {
+  // The data received again can't be delivered twice.
+  const int64_t gap = isStreamOutputEnabled() ? std::min(options_->slice_coalesce_gap, (int64_t)0L) : options_->slice_coalesce_gap;
+  if (gap < 0 || !target_file_ || table_.size() < 2)
+    return 0;
+
+  for (const auto& it : materialized_) {
+    const std::shared_ptr<Slice>& s = it.second;
+    if (s->curlHandle() || s->queuedCapacity() > 0 || s->diskCacheCapacity() > 0)
+      return 0;
+  }
+
+  IndexFile::Content content;
+  makeIndexContent(content);
+
+  // The merged slices are not larger than the largest one, so that the slices are still downloaded in parallel and the
+  // servers limiting the size of range still accept them.
+  int64_t max_size = 0L;
+  std::vector<size_t> order(content.slices.size());
+  for (size_t i = 0; i < content.slices.size(); i++) {
+    if (content.slices[i].end == -1L)
+      return 0;
+    max_size = std::max(max_size, content.slices[i].end - content.slices[i].begin + 1);
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&content](size_t a, size_t b) {
+    return content.slices[a].begin < content.slices[b].begin;
+  });
+
+  // Walk the slices by begin, hole is the last one missing data at its end.
+  std::vector<bool> merged(content.slices.size(), false);
+  IndexFile::SliceRecord* hole = nullptr;
+  int32_t num = 0;
+  for (size_t i : order) {
+    IndexFile::SliceRecord& record = content.slices[i];
+    const bool missing = record.capacity < record.end - record.begin + 1;
+    if (hole && missing && record.begin == hole->end + 1 && record.capacity <= gap &&
+        record.end - (hole->begin + hole->capacity) + 1 <= max_size) {
+      hole->end = record.end;
+      merged[i] = true;
+      num++;
+      continue;
+    }
+    hole = missing ? &record : nullptr;
+  }
+
+  if (num == 0)
+    return 0;
+
+  clearSlices();
+  table_.reserve(content.slices.size() - num);
+  for (size_t i = 0; i < content.slices.size(); i++) {
+    if (merged[i])
+      continue;
+    const IndexFile::SliceRecord& record = content.slices[i];
+    const size_t row = table_.append(record.index, record.begin, record.end, record.capacity);
+    if (options_->chunk_hash_enabled && !record.chunks.empty())
+      table_.setChunks(row, record.chunks);
+  }
+  rebuildStatusIndex();
+
+  // The chunks of the uncompleted slices have been hashed, so they are not read back when the slices start.
+  if (options_->chunk_hash_enabled) {
+    for (size_t row = 0; row < table_.size(); row++) {
+      if (table_.status(row) != Slice::DOWNLOAD_COMPLETED && !table_.chunks(row).empty())
+        materialize(row)->setChunkHashes(table_.chunks(row));
+    }
+  }
+  downloaded_.store(countDownloaded());
+
+  OutputVerbose(options_->verbose_functor, u8"%d slices are merged into the adjacent slices missing data.\n", num);
+  return num;
+}
+
+int64_t SliceManager::applyDelta(const utf8string& old_file_path, std::vector<DeltaRun> runs) {
+  if (!target_file_ || origin_file_size_ <= 0L || runs.empty() || !materialized_.empty())
+    return 0L;
+
+  int64_t max_size = 0L;
+  for (size_t row = 0; row < table_.size(); row++) {
+    if (table_.end(row) == -1L || table_.capacity(row) > 0L)
+      return 0L;
+    max_size = std::max(max_size, table_.end(row) - table_.begin(row) + 1);
+  }
+
+  FILE* f = FileUtil::Open(old_file_path, "rb");
+  if (!f)
+    return 0L;
+  const int64_t old_size = FileUtil::GetFileSize(f);
+
+  std::vector<char> buffer(ZOE_DELTA_SCAN_BUFFER_SIZE);
+  int64_t copied = 0L;
+  size_t run_num = 0;
+  for (; run_num < runs.size(); run_num++) {
+    DeltaRun& run = runs[run_num];
+    int64_t done = 0L;
+    while (done < run.size) {
+      if (options_->internal_stop_event.isSetted() || (options_->user_stop_event && options_->user_stop_event->isSetted()))
+        break;
+
+      const int64_t size = std::min((int64_t)buffer.size(), run.size - done);
+      const int64_t old_pos = run.old_begin + done;
+      const int64_t available = std::max(std::min(old_size - old_pos, size), (int64_t)0L);
+      if (available > 0L &&
+          (FileUtil::Seek(f, old_pos, SEEK_SET) != 0 || fread(buffer.data(), 1, (size_t)available, f) != (size_t)available))
+        break;
+      memset(buffer.data() + available, 0, (size_t)(size - available));
+
+      if (target_file_->write(run.begin + done, buffer.data(), size) != size)
+        break;
+      done += size;
+    }
+
+    copied += done;
+    if (done < run.size) {
+      // The part copied is kept, the rest of runs is downloaded.
+      run.size = done;
+      if (done > 0L)
+        run_num++;
+      break;
+    }
+  }
+  FileUtil::Close(f);
+  runs.resize(run_num);
+
+  if (copied == 0L)
+    return 0L;
+
+  clearSlices();
+  int32_t index = 0;
+  int64_t pos = 0L;
+  auto appendMissing = [&](int64_t end) {
+    while (pos < end) {
+      const int64_t size = std::min(max_size, end - pos);
+      table_.append(++index, pos, pos + size - 1, 0L);
+      pos += size;
+    }
+  };
+  for (const DeltaRun& run : runs) {
+    appendMissing(run.begin);
+    table_.append(++index, run.begin, run.begin + run.size - 1, run.size);
+    pos = run.begin + run.size;
+  }
+  appendMissing(origin_file_size_);
+  rebuildStatusIndex();
+  downloaded_.store(countDownloaded());
+
+  return copied;
+}
+
 int32_t SliceManager::getUnfetchAndUncompletedSliceNum() const {
+  std::lock_guard<std::mutex> lg(status_index_mutex_);
   int32_t num = 0;
-  for (auto& it : slices_) {
-    if (it && !it->isDataCompletedClearly() && it->status() == Slice::UNFETCH)
+  for (const auto& r : status_index_[Slice::UNFETCH]) {
+    const Slice* s = materialized(r.second);
+    if (s ? !s->isDataCompletedClearly() : !table_.isDataCompletedClearly(r.second))
       num++;
   }
   return num;
 }
 
 bool SliceManager::flushIndexFile() {
-  if (index_file_path_.length() == 0)
-    return false;
-  FILE* f = FileUtil::Open(index_file_path_, u8"wb");
-  if (!f)
+  if (index_file_path_.length() == 0 || !target_file_)
     return false;
 
-  json j;
-  j["update_time"] = time(nullptr);
-  j["file_size"] = origin_file_size_;
-  j["content_md5"] = content_md5_;
-  j["url"] = options_->url;
-  j["redirect_url"] = redirect_url_;
-  j["target_tmp_file_path"] = target_file_->filePath();
+  IndexFile::Content content;
+  makeIndexContent(content);
+  return saveIndexContent(content);
+}
+
+void SliceManager::checkpoint() {
+  if (index_file_path_.length() == 0 || !target_file_)
+    return;
 
-  json s;
-  for (auto& slice : slices_) {
-    s.push_back({{"index", slice->index()},
-                 {"begin", slice->begin()},
-                 {"end", slice->end()},
-                 {"capacity", slice->capacity()}});
+  if (!disk_writer_) {
+    flushAllSlices();
+    flushIndexFile();
+    return;
   }
-  j["slices"] = s;
 
-  utf8string str_json = j.dump();
+  // The last one is still running, disk is slower than the policy expects.
+  if (checkpoint_pending_.exchange(true))
+    return;
+
+  // Skip the slice if the buffer pool is exhausted, its cache will be recorded by next checkpoint.
+  // The slices without Slice object have nothing in cache, the records from slice table are final.
+  std::vector<std::pair<size_t, std::shared_ptr<Slice>>> slices(materialized_.begin(), materialized_.end());
+  for (auto& it : slices)
+    it.second->postDiskCache();
+
+  IndexFile::Content content;
+  makeIndexContent(content);
+
+  std::shared_ptr<TargetFile> target_file = target_file_;
+  const bool chunk_hash_enabled = options_->chunk_hash_enabled;
+  disk_writer_->postTask(0, [this, content, slices, target_file, chunk_hash_enabled]() mutable {
+    // Only the data that has been written is recorded, the caches handed off above may not be written yet.
+    for (auto& it : slices) {
+      if (it.first >= content.slices.size())
+        continue;
+      content.slices[it.first].capacity = it.second->capacity();
+      if (chunk_hash_enabled)
+        content.slices[it.first].chunks = it.second->chunkHashes();
+    }
 
-  fwrite(INDEX_FILE_SIGN_STRING, 1, strlen(INDEX_FILE_SIGN_STRING), f);
-  fwrite(str_json.c_str(), 1, str_json.size(), f);
-  fflush(f);
+    // The data must reach disk before the index file that records it.
+    bool synced = true;
+    if (target_file->isMapped())
+      synced = target_file->flushMapped(0, target_file->fileSize());
+    synced = target_file->flush() && synced;
 
-  FileUtil::Close(f);
+    if (!synced || !saveIndexContent(content))
+      OutputVerbose(options_->verbose_functor, u8"Checkpoint failed.\n");
+
+    checkpoint_pending_.store(false);
+  });
+}
+
+void SliceManager::waitCheckpoint() {
+  if (disk_writer_)
+    disk_writer_->waitFor([this]() { return !checkpoint_pending_.load(); });
+}
 
-  return true;
+int64_t SliceManager::queuedBytes() const {
+  int64_t total = 0L;
+  for (auto& it : materialized_)
+    total += it.second->queuedCapacity();
+  return total;
+}
+
+void SliceManager::waitDiskWriter() {
+  if (disk_writer_)
+    disk_writer_->waitFor([this]() { return !checkpoint_pending_.load() && queuedBytes() == 0L; });
+}
+
+void SliceManager::makeIndexContent(IndexFile::Content& content) const {
+  content.update_time = (int64_t)time(nullptr);
+  content.file_size = origin_file_size_;
+  content.content_md5 = content_md5_;
+  content.url = options_->url;
+  content.redirect_url = redirect_url_;
+  content.target_tmp_file_path = target_file_->filePath();
+
+  // One record per row, the checkpoint finds the record of a slice by its row.
+  content.slices.reserve(table_.size());
+  for (size_t row = 0; row < table_.size(); row++) {
+    const Slice* slice = materialized(row);
+    IndexFile::SliceRecord record;
+    record.index = table_.index(row);
+    record.begin = table_.begin(row);
+    record.end = slice ? slice->end() : table_.end(row);
+    record.capacity = slice ? slice->capacity() : table_.capacity(row);
+    if (options_->chunk_hash_enabled)
+      record.chunks = slice ? slice->chunkHashes() : table_.chunks(row);
+    content.slices.push_back(record);
+  }
+}
+
+bool SliceManager::saveIndexContent(const IndexFile::Content& content) {
+  TraceScope trace(TRACE_CHECKPOINT, this, -1);
+  std::lock_guard<std::mutex> lg(index_file_mutex_);
+  // The data recorded is on disk, so it can be served to peers.
+  if (!peer_key_.empty())
+    SharePeerFile(peer_key_, content.file_size, content.target_tmp_file_path, MakePeerRanges(content));
+  return IndexFile::Save(index_file_path_, content);
+}
+
+void SliceManager::setPeerKey(const utf8string& key) {
+  peer_key_ = key;
+}
+
+void SliceManager::setRangeConfirmed() {
+  range_confirmed_.store(true);
+}
+
+bool SliceManager::isRangeConfirmed() const {
+  return range_confirmed_.load();
 }
 
 utf8string SliceManager::makeIndexFilePath() const {
@@ -466,17 +1148,113 @@ utf8string SliceManager::makeIndexFilePath() const {
   return FileUtil::AppendFileName(target_dir, target_filename + u8".efdindex");
 }
 
+void SliceManager::applyDiskIoPolicy() {
+  if (options_->disk_io_policy == STANDARD_IO || origin_file_size_ <= 0 || target_file_->isInMemory())
+    return;
+
+  if (options_->disk_io_policy == DIRECT_IO) {
+    // The unbuffered writes come from aligned cache blocks only.
+    if (buffer_pool_ && target_file_->enableDirectIo()) {
+      OutputVerbose(options_->verbose_functor, u8"Target file is written bypassing page cache.\n");
+    }
+    else {
+      OutputVerbose(options_->verbose_functor, u8"Direct io is not available, fallback to standard io.\n");
+    }
+    return;
+  }
+
+  if (target_file_->map()) {
+    OutputVerbose(options_->verbose_functor, u8"Target file is mapped into memory.\n");
+  }
+  else {
+    OutputVerbose(options_->verbose_functor, u8"Map target file failed, fallback to standard io.\n");
+  }
+}
+
+bool SliceManager::canCheckHash() const {
+  return (options_->hash_verify_policy == ALWAYS || (options_->hash_verify_policy == ONLY_NO_FILESIZE && origin_file_size_ == -1L)) &&
+         (options_->hash_value.length() > 0 || (content_md5_.length() > 0 && options_->content_md5_enabled));
+}
+
+void SliceManager::applyStreamingHash() {
+  if (!canCheckHash() || origin_file_size_ <= 0)
+    return;
+
+  const HashType type = options_->hash_value.length() > 0 ? options_->hash_type : MD5;
+  target_file_->enableStreamingHash(type, origin_file_size_);
+  if (!target_file_->isStreamingHash())
+    return;
+
+  for (size_t row = 0; row < table_.size(); row++) {
+    const Slice* s = materialized(row);
+    const int64_t capacity = s ? s->capacity() : table_.capacity(row);
+    if (capacity > 0)
+      target_file_->markWritten(table_.begin(row), nullptr, capacity);
+  }
+  OutputVerbose(options_->verbose_functor, u8"Hash target file while downloading.\n");
+}
+
+void SliceManager::applyStreamOutput() {
+  decompressor_.reset();
+  if (!isStreamOutputEnabled())
+    return;
+
+  StreamFunctor functor = options_->stream_functor;
+  if (isDecompressionEnabled()) {
+    decompressor_ = std::make_shared<Decompressor>(options_, CreateStreamDecoder(options_),
+                                                   options_->target_file_path + DECOMPRESSED_FILE_EXTENSION, metrics_);
+    if (!decompressor_->open()) {
+      OutputVerbose(options_->verbose_functor, u8"Create decompressed file failed.\n");
+      return;
+    }
+    functor = std::bind(&Decompressor::onData, decompressor_.get(), std::placeholders::_1, std::placeholders::_2);
+  }
+
+  target_file_->enableStreamOutput(functor, origin_file_size_);
+  if (!target_file_->isStreamOutput())
+    return;
+
+  for (size_t row = 0; row < table_.size(); row++) {
+    const Slice* s = materialized(row);
+    const int64_t capacity = s ? s->capacity() : table_.capacity(row);
+    if (capacity > 0)
+      target_file_->markWritten(table_.begin(row), nullptr, capacity);
+  }
+  OutputVerbose(options_->verbose_functor, u8"Stream target file while downloading.\n");
+}
+
+int64_t SliceManager::streamWindowEnd() const {
+  if (!isStreamOutputEnabled() || options_->stream_read_ahead_size <= 0 || !target_file_ || !target_file_->isStreamOutput())
+    return -1L;
+  return target_file_->streamPosition() + options_->stream_read_ahead_size;
+}
+
+bool SliceManager::isStreamOutputEnabled() const {
+  return options_->stream_functor || isDecompressionEnabled();
+}
+
+bool SliceManager::isDecompressionEnabled() const {
+  return options_->decompress_codec != COMPRESSION_NONE && !options_->memory_target_enabled;
+}
+
 void SliceManager::dumpSlice() const {
+  if (!options_->verbose_functor)
+    return;
+
   std::stringstream ss;
-  for (auto& s : slices_) {
-    ss << "<" << s->index() << "> [" << s->begin() << "~" << s->end();
-    if (s->end() == -1) {
-      ss << "] (*), Disk: " << s->capacity()
-         << ", Buffer: " << s->diskCacheCapacity() << "\r\n";
+  SliceInfo info;
+  for (size_t row = 0; row < table_.size(); row++) {
+    sliceInfo(row, info);
+    const int64_t capacity = info.slice ? info.slice->capacity() : table_.capacity(row);
+    const int64_t buffer = info.slice ? info.slice->diskCacheCapacity() : 0L;
+    ss << "<" << info.index << "> [" << info.begin << "~" << info.end;
+    if (info.end == -1) {
+      ss << "] (*), Disk: " << capacity
+         << ", Buffer: " << buffer << "\r\n";
     }
     else {
-      ss << "] (" << s->size() << "), Disk: " << s->capacity()
-         << ", Buffer: " << s->diskCacheCapacity() << "\r\n";
+      ss << "] (" << info.end - info.begin + 1 << "), Disk: " << capacity
+         << ", Buffer: " << buffer << "\r\n";
     }
   }
 
@@ -484,8 +1262,11 @@ void SliceManager::dumpSlice() const {
 }
 
 void SliceManager::cleanup() {
-  slices_.clear();
+  waitDiskWriter();
+  disk_writer_.reset();
+  clearSlices();
   target_file_.reset();
+  decompressor_.reset();
 }
 
 }  // namespace zoe
@@ -19,18 +19,34 @@
 #define ZOE_SLICE_MANAGE_H_
 #pragma once
 
+#include <map>
+#include <set>
 #include <vector>
 #include <atomic>
+#include <mutex>
 #include "zoe/zoe.h"
 #include "target_file.h"
 #include "slice.h"
+#include "slice_table.h"
+#include "disk_writer.h"
+#include "buffer_pool.h"
+#include "index_file.h"
+#include "metrics.h"
+#include "decompressor.h"
+#include "delta_sync.h"
+#include "time_meter.hpp"
 
 namespace zoe {
+#define ZOE_SLICE_STATUS_NUM (Slice::CURL_OK_BUT_COMPLETED_NOT_SURE + 1)
+
 typedef struct _Options Options;
 
 class SliceManager : public std::enable_shared_from_this<SliceManager> {
  public:
-  SliceManager(Options* options, const utf8string& redirect_url);
+  // If shared_disk_writer is not nullptr, the data is written by it rather than a disk writer of this download.
+  SliceManager(Options* options,
+               const utf8string& redirect_url,
+               std::shared_ptr<DiskWriter> shared_disk_writer = nullptr);
   virtual ~SliceManager();
 
   Result loadExistSlice(int64_t cur_file_size,
@@ -39,6 +55,17 @@ class SliceManager : public std::enable_shared_from_this<SliceManager> {
   bool flushAllSlices();
   bool flushIndexFile();
 
+  // Save the progress to index file, called by checkpoint policy on the thread that performs multi.
+  // With disk writer, the caches are handed to it and the target file and index file are synchronized on writer thread,
+  // so the transfers don't wait for disk. Otherwise, it is the same as flushAllSlices and flushIndexFile.
+  void checkpoint();
+
+  // Block until the checkpoint running on writer thread finished.
+  void waitCheckpoint();
+
+  // Block until the checkpoint and the data of slices queued on disk writer are written.
+  void waitDiskWriter();
+
   void setOriginFileSize(int64_t file_size);
   int64_t originFileSize() const;
 
@@ -49,38 +76,198 @@ class SliceManager : public std::enable_shared_from_this<SliceManager> {
 
   Result makeSlices(bool accept_ranges);
 
+  // Write the beginning of file received while fetching file info into the first slice, so that it is not requested again.
+  // Called after makeSlices and before any slice starts, return the size taken.
+  int64_t prefillFirstSlice(const std::string& data);
+
+  // Thread safe, data size received by all slices, including the data in cache and disk writer queue.
   int64_t totalDownloaded() const;
 
+  // Thread safe, called by slices when the data size they hold changes.
+  void addDownloaded(int64_t delta);
+
   Result isAllSliceCompletedClearly(bool try_check_hash) const;
 
+  // Remove easy handles from multi and flush cache to disk, can be called repeatedly.
+  Result stopAllSlices(void* mult);
+
+  // Pause or resume the slices that are transferring, must be called on the thread that performs multi.
+  void pauseAllSlices(bool pause);
+
+  // Resume the slices paused by disk writer backpressure if the writer has space and free cache blocks.
+  void resumeWritePausedSlices();
+
+  // Bandwidth of this download, nullptr if the speed is not limited.
+  TokenBucket* speedLimiter() const;
+
+  // Resume the slices paused for bandwidth if their bandwidth is refilled.
+  void resumeBandwidthPausedSlices();
+  bool hasBandwidthPausedSlices() const;
+  void onBandwidthPaused(bool paused);
+
+  // Set before loading or making slices.
+  void setMetrics(std::shared_ptr<Metrics> metrics);
+  std::shared_ptr<Metrics> metrics() const;
+
+  // nullptr if async disk write disabled.
+  std::shared_ptr<DiskWriter> diskWriter() const;
+
+  // Size of data of the slices that has been handed to disk writer but not written yet.
+  // The disk writer may be shared by other downloads, its queue is not all of this download.
+  int64_t queuedBytes() const;
+
+  // Disk cache blocks of slices, nullptr if disk cache disabled.
+  std::shared_ptr<BufferPool> bufferPool() const;
+
   Result finishDownloadProgress(bool need_check_completed, void* mult);
 
+  // Read the downloaded data back and verify with the chunk hashes calculated while downloading,
+  // the corrupted chunks are discarded, return the number of slices that need to be downloaded again.
+  int32_t repairCorruptedChunks();
+
+  // Merge the slices whose missing data are adjacent or separated by no more than Options::slice_coalesce_gap bytes
+  // received, so that they are requested at once. The slices are rebuilt from their records, so it is only done when
+  // no slice is transferring or holding data not written. Return the number of slices merged into others.
+  int32_t coalesceSlices();
+
+  // Copy the runs of delta update from old file into target file, then rebuild the slices so that each run is a completed
+  // slice and the ranges between runs are UNFETCH slices no larger than the slices made. Only done after makeSlices and
+  // before any slice starts. If the old file can't be read, the runs not copied yet are downloaded.
+  // Return the size copied.
+  int64_t applyDelta(const utf8string& old_file_path, std::vector<DeltaRun> runs);
+
   int32_t getUnfetchAndUncompletedSliceNum() const;
+
+  // The slice that has the lowest begin in status, nullptr if none.
+  // The Slice object is created if the slice only exists in slice table.
   std::shared_ptr<Slice> getSlice(Slice::Status status);
 
+  // Slices in status ordered by begin, the Slice objects are created if needed.
+  // The completed slices are not indexed, so that resuming a download doesn't index the rows that are done.
+  std::vector<std::shared_ptr<Slice>> getSlices(Slice::Status status);
+
+  // The slice recorded in CURLOPT_PRIVATE of curlHandle, nullptr if it isn't transferring a slice.
   std::shared_ptr<Slice> getSlice(void* curlHandle);
 
+  // Called by Slice::setStatus, move the slice to the set of its new status.
+  void onSliceStatusChanged(Slice* slice, Slice::Status old_status);
+
+  typedef struct _SliceInfo {
+    int32_t index;
+    int64_t begin;
+    int64_t end;
+    int64_t downloaded;
+    Slice::Status status;
+    Slice* slice;  // nullptr if the Slice object doesn't exist
+  } SliceInfo;
+
+  // Number of slices, including the slices only exist in slice table.
+  size_t sliceNum() const;
+  void sliceInfo(size_t row, SliceInfo& info) const;
+
+  // Destroy the Slice object of a stopped and completed slice, its progress is kept in slice table.
+  void releaseSlice(const std::shared_ptr<Slice>& slice);
+
+  // The slices beginning at or after it wait for stream output, -1 if no limit.
+  int64_t streamWindowEnd() const;
+
+  // Whether the target file is delivered in order while downloading, for stream functor or decompression.
+  bool isStreamOutputEnabled() const;
+
+  // Whether the target file is decompressed while downloading, see Zoe::setDecompression.
+  bool isDecompressionEnabled() const;
+
+  // Split the downloading slice that has the largest remaining range,
+  // return the new UNFETCH slice that holds the second half, or nullptr if no slice can be split.
+  std::shared_ptr<Slice> splitSlice(int64_t min_slice_size);
+
+  // Shrink the UNFETCH slice to size from its received position, the range after it becomes a new UNFETCH slice.
+  // Return the new slice, nullptr if the slice isn't cut because the range left would be less than half of size.
+  std::shared_ptr<Slice> cutSlice(std::shared_ptr<Slice> slice, int64_t size);
+
   const Options* options() const;
 
   utf8string redirectUrl() const;
 
   utf8string indexFilePath() const;
 
+  // Share the data recorded by each index file saved to peers by key, and the target file after downloaded,
+  // see peer_server.h. Called before any slice starts.
+  void setPeerKey(const utf8string& key);
+
+  // A 206 response of the range requested was received, rather than the range support assumed from the headers.
+  // The ranges not requested at the beginning, such as the split slices and hedged requests, wait for it. Thread safe.
+  void setRangeConfirmed();
+  bool isRangeConfirmed() const;
+
   void cleanup();
  protected:
   utf8string makeIndexFilePath() const;
   void dumpSlice() const;
+
+  // Sum the data size of each slice, used when the slices are rebuilt.
+  int64_t countDownloaded() const;
+  void applyDiskIoPolicy();
+
+  void makeIndexContent(IndexFile::Content& content) const;
+
+  void clearSlices();
+  size_t appendSlice(int32_t index, int64_t begin, int64_t end, int64_t capacity);
+
+  // Index all rows of slice table by status at once, faster than appending the rows one by one.
+  void rebuildStatusIndex();
+
+  // Return the Slice object of row, create it if not exist.
+  std::shared_ptr<Slice> materialize(size_t row);
+  Slice* materialized(size_t row) const;
+
+  // Thread safe, checkpoint saves index file on writer thread.
+  bool saveIndexContent(const IndexFile::Content& content);
+
+  // Whether hash will be verified after downloaded.
+  bool canCheckHash() const;
+
+  // Hash the target file while downloading if hash will be verified, the existing data is hashed too.
+  void applyStreamingHash();
+
+  // Deliver the target file to stream functor or decompressor while downloading, the existing data is delivered too.
+  void applyStreamOutput();
+
+  // Verify the decompressed file and move it to target file path, the downloaded file is removed.
+  Result finishDecompression();
  protected:
   utf8string redirect_url_;
   int64_t origin_file_size_;
   utf8string content_md5_;
 
   utf8string index_file_path_;
+  utf8string peer_key_;  // empty if not shared to peers
 
-  std::vector<std::shared_ptr<Slice>> slices_;
+  SliceTable table_;
+  std::map<size_t, std::shared_ptr<Slice>> materialized_;  // row -> Slice object
+
+  // (begin, row) of slices in each status except DOWNLOAD_COMPLETED, so that picking the next slice doesn't scan slice table.
+  mutable std::mutex status_index_mutex_;
+  std::set<std::pair<int64_t, size_t>> status_index_[ZOE_SLICE_STATUS_NUM];
+  std::atomic<int64_t> downloaded_;  // so that progress doesn't walk the slices
   std::shared_ptr<TargetFile> target_file_;
 
+  // Fed by the stream output of target file, so it is destroyed after target file.
+  std::shared_ptr<Decompressor> decompressor_;
+
   Options* options_;
+
+  std::shared_ptr<BufferPool> buffer_pool_;
+  std::shared_ptr<Metrics> metrics_;
+  std::shared_ptr<TokenBucket> speed_limiter_;
+  int32_t bandwidth_paused_num_;  // only accessed on the thread that performs multi
+
+  std::mutex index_file_mutex_;
+  std::atomic_bool checkpoint_pending_;
+  std::atomic_bool range_confirmed_;
+
+  // destroyed first, the jobs refer to slices.
+  std::shared_ptr<DiskWriter> disk_writer_;
 };
 }  // namespace zoe
 
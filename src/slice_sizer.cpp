@@ -0,0 +1,76 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "slice_sizer.h"
+#include <algorithm>
+#include "options.h"
+
+namespace zoe {
+
+SliceSizer::SliceSizer(int64_t file_size, int32_t thread_num, int64_t target_duration_ms)
+    : file_size_(file_size)
+    , thread_num_(std::max(thread_num, 1))
+    , target_duration_ms_(target_duration_ms > 0 ? target_duration_ms : ZOE_DEFAULT_SLICE_TARGET_DURATION_MS)
+    , throughput_(0L) {}
+
+SliceSizer::~SliceSizer() {}
+
+void SliceSizer::onRequestLatency(int64_t latency_ms) {
+  // The connection is idle for about one latency between requests, keep it a small part of the request.
+  if (latency_ms > 0)
+    target_duration_ms_ = std::max(target_duration_ms_, latency_ms * ZOE_SLICE_TARGET_LATENCY_TIMES);
+}
+
+void SliceSizer::onSliceCompleted(int64_t bytes, int64_t elapsed_ms) {
+  // The slice that completed quickly is mostly latency, its speed is not reliable.
+  if (bytes <= 0 || elapsed_ms < ZOE_SLICE_SIZER_MIN_ELAPSED_MS)
+    return;
+
+  const int64_t speed = bytes * 1000 / elapsed_ms;
+  if (throughput_ == 0L)
+    throughput_ = speed;
+  else
+    throughput_ = (int64_t)(throughput_ * (1.0 - ZOE_SLICE_SIZER_SPEED_WEIGHT) + speed * ZOE_SLICE_SIZER_SPEED_WEIGHT);
+}
+
+int64_t SliceSizer::nextSize(int64_t remaining, int32_t concurrency) const {
+  int64_t size = 0L;
+  if (throughput_ > 0L) {
+    size = throughput_ * target_duration_ms_ / 1000;
+  }
+  else {
+    // Several slices for each connection, so that the slow connections don't hold too much.
+    size = std::min(file_size_ / (thread_num_ * ZOE_SLICE_SIZER_INITIAL_SLICES_PER_THREAD),
+                    (int64_t)ZOE_DEFAULT_FIXED_SLICE_SIZE_BYTE);
+  }
+
+  // Near the end of file the slices get smaller, so that the connections complete at about the same time.
+  if (remaining > 0L)
+    size = std::min(size, remaining / std::max(concurrency, 1));
+
+  return clamp(size);
+}
+
+int64_t SliceSizer::throughput() const {
+  return throughput_;
+}
+
+int64_t SliceSizer::clamp(int64_t size) const {
+  size = std::min(size, (int64_t)ZOE_SLICE_SIZER_MAX_SIZE_BYTE);
+  return std::max(size, (int64_t)ZOE_MIN_SPLIT_SLICE_SIZE_BYTE);
+}
+}  // namespace zoe
@@ -0,0 +1,59 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_SLICE_SIZER_H_
+#define ZOE_SLICE_SIZER_H_
+#pragma once
+
+#include <stdint.h>
+
+namespace zoe {
+
+// Decide the size of slices for SlicePolicy::Adaptive, the slices are cut from the remaining range of file one by one
+// when they are about to be downloaded, so that each request takes about the target duration on its connection.
+// Before any slice completed, the size comes from file size and thread number.
+// All functions must be called on the loop thread.
+class SliceSizer {
+ public:
+  // target_duration_ms is the duration of each request expected, 0 or negative means the default.
+  SliceSizer(int64_t file_size, int32_t thread_num, int64_t target_duration_ms);
+  virtual ~SliceSizer();
+
+  // The latency of the first request to server, such as the request of file info.
+  // The target duration is extended to cover it many times.
+  void onRequestLatency(int64_t latency_ms);
+
+  // A slice completed, the bytes received in elapsed_ms by its connection.
+  void onSliceCompleted(int64_t bytes, int64_t elapsed_ms);
+
+  // The size of the next slice, the data of remaining size is left to download by concurrency connections.
+  int64_t nextSize(int64_t remaining, int32_t concurrency) const;
+
+  // Throughput of one connection, byte per second, 0 if not measured yet.
+  int64_t throughput() const;
+
+ protected:
+  int64_t clamp(int64_t size) const;
+
+ protected:
+  const int64_t file_size_;
+  const int32_t thread_num_;
+  int64_t target_duration_ms_;
+  int64_t throughput_;
+};
+}  // namespace zoe
+#endif  // !ZOE_SLICE_SIZER_H_
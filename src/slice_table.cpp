@@ -0,0 +1,117 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "slice_table.h"
+#include <assert.h>
+#include <algorithm>
+
+namespace zoe {
+SliceTable::SliceTable()
+    : max_index_(0) {}
+
+SliceTable::~SliceTable() {}
+
+void SliceTable::clear() {
+  indexes_.clear();
+  begins_.clear();
+  ends_.clear();
+  capacities_.clear();
+  statuses_.clear();
+  chunks_.clear();
+  max_index_ = 0;
+}
+
+void SliceTable::reserve(size_t num) {
+  indexes_.reserve(num);
+  begins_.reserve(num);
+  ends_.reserve(num);
+  capacities_.reserve(num);
+  statuses_.reserve(num);
+  chunks_.reserve(num);
+}
+
+size_t SliceTable::size() const {
+  return indexes_.size();
+}
+
+size_t SliceTable::append(int32_t index, int64_t begin, int64_t end, int64_t capacity) {
+  assert(end == -1 || (end + 1 >= begin + capacity));
+  indexes_.push_back(index);
+  begins_.push_back(begin);
+  ends_.push_back(end);
+  capacities_.push_back(capacity);
+  chunks_.push_back(std::vector<uint32_t>());
+  max_index_ = std::max(max_index_, index);
+
+  const size_t row = indexes_.size() - 1;
+  statuses_.push_back((uint8_t)(isDataCompletedClearly(row) ? Slice::DOWNLOAD_COMPLETED : Slice::UNFETCH));
+  return row;
+}
+
+int32_t SliceTable::index(size_t row) const {
+  return indexes_[row];
+}
+
+int64_t SliceTable::begin(size_t row) const {
+  return begins_[row];
+}
+
+int64_t SliceTable::end(size_t row) const {
+  return ends_[row];
+}
+
+int64_t SliceTable::capacity(size_t row) const {
+  return capacities_[row];
+}
+
+Slice::Status SliceTable::status(size_t row) const {
+  return (Slice::Status)statuses_[row];
+}
+
+const std::vector<uint32_t>& SliceTable::chunks(size_t row) const {
+  return chunks_[row];
+}
+
+int32_t SliceTable::maxIndex() const {
+  return max_index_;
+}
+
+int64_t SliceTable::totalCapacity() const {
+  int64_t total = 0L;
+  for (int64_t capacity : capacities_)
+    total += capacity;
+  return total;
+}
+
+bool SliceTable::isDataCompletedClearly(size_t row) const {
+  return ends_[row] != -1 && capacities_[row] == ends_[row] - begins_[row] + 1;
+}
+
+void SliceTable::setStatus(size_t row, Slice::Status status) {
+  statuses_[row] = (uint8_t)status;
+}
+
+void SliceTable::update(size_t row, int64_t end, int64_t capacity, const std::vector<uint32_t>& chunks) {
+  ends_[row] = end;
+  capacities_[row] = capacity;
+  chunks_[row] = chunks;
+}
+
+void SliceTable::setChunks(size_t row, const std::vector<uint32_t>& chunks) {
+  chunks_[row] = chunks;
+}
+}  // namespace zoe
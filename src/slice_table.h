@@ -0,0 +1,77 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_SLICE_TABLE_H_
+#define ZOE_SLICE_TABLE_H_
+#pragma once
+
+#include <vector>
+#include "zoe/zoe.h"
+#include "slice.h"
+
+namespace zoe {
+
+// Records of all slices of a download, one row per slice, each field is stored in its own array.
+// A Slice object holding curl handle, cache and lock is only created for the rows that are transferred or touched,
+// so the memory of a file split into millions of slices mostly stays here.
+// The end, capacity and chunks of a row are out of date while its Slice object exists, the object is authoritative.
+// Not thread safe.
+class SliceTable {
+ public:
+  SliceTable();
+  virtual ~SliceTable();
+
+  void clear();
+  void reserve(size_t num);
+  size_t size() const;
+
+  // Return the row, rows are never removed until clear.
+  size_t append(int32_t index, int64_t begin, int64_t end, int64_t capacity);
+
+  int32_t index(size_t row) const;
+  int64_t begin(size_t row) const;
+  int64_t end(size_t row) const;
+  int64_t capacity(size_t row) const;
+  Slice::Status status(size_t row) const;
+  const std::vector<uint32_t>& chunks(size_t row) const;
+
+  // Largest slice index, 0 if empty.
+  int32_t maxIndex() const;
+
+  // Sum of capacity of all rows.
+  int64_t totalCapacity() const;
+
+  // Whether the row holds all of its data, return false if end is -1.
+  bool isDataCompletedClearly(size_t row) const;
+
+  void setStatus(size_t row, Slice::Status status);
+
+  // Called when the Slice object of row is destroyed, the progress is saved back.
+  void update(size_t row, int64_t end, int64_t capacity, const std::vector<uint32_t>& chunks);
+  void setChunks(size_t row, const std::vector<uint32_t>& chunks);
+
+ protected:
+  std::vector<int32_t> indexes_;
+  std::vector<int64_t> begins_;
+  std::vector<int64_t> ends_;
+  std::vector<int64_t> capacities_;
+  std::vector<uint8_t> statuses_;
+  std::vector<std::vector<uint32_t>> chunks_;  // empty if chunk hash is disabled
+  int32_t max_index_;
+};
+}  // namespace zoe
+#endif  // !ZOE_SLICE_TABLE_H_
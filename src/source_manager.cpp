@@ -0,0 +1,250 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "source_manager.h"
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#endif
+#include "curl/curl.h"
+#include "options.h"
+#include "verbose.h"
+#include "transfer_budget.h"
+
+namespace zoe {
+SourceManager::Source::_Source(const utf8string& u)
+    : url(u)
+    , speed(ZOE_SOURCE_SPEED_HALF_LIFE_MS)
+    , error_rate(0.0)
+    , active_num(0)
+    , continuous_failed(0)
+    , peer(false)
+    , disabled(false) {}
+
+SourceManager::SourceManager() {}
+
+SourceManager::~SourceManager() {}
+
+int32_t SourceManager::addSource(const utf8string& url) {
+  sources_.push_back(Source(url));
+  return (int32_t)sources_.size() - 1;
+}
+
+int32_t SourceManager::addPeer(const utf8string& url) {
+  Source source(url);
+  source.peer = true;
+  sources_.push_back(source);
+  return (int32_t)sources_.size() - 1;
+}
+
+bool SourceManager::isPeer(int32_t source) const {
+  return source >= 0 && source < (int32_t)sources_.size() && sources_[source].peer;
+}
+
+void SourceManager::disable(int32_t source) {
+  if (source >= 0 && source < (int32_t)sources_.size())
+    sources_[source].disabled = true;
+}
+
+// The numeric addresses of host in the order of resolver, without duplicates.
+static std::vector<utf8string> ResolveHostAddresses(const utf8string& host) {
+  std::vector<utf8string> addresses;
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  struct addrinfo* result = nullptr;
+  if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0 || !result)
+    return addresses;
+
+  for (struct addrinfo* ai = result; ai; ai = ai->ai_next) {
+    char address[NI_MAXHOST] = {0};
+    if (getnameinfo(ai->ai_addr, (socklen_t)ai->ai_addrlen, address, sizeof(address), nullptr, 0, NI_NUMERICHOST) != 0)
+      continue;
+    if (std::find(addresses.begin(), addresses.end(), utf8string(address)) == addresses.end())
+      addresses.push_back(address);
+  }
+  freeaddrinfo(result);
+  return addresses;
+}
+
+// HOST:PORT:CONNECT-TO-HOST:CONNECT-TO-PORT, the port is kept and IPv6 address is bracketed.
+// The redirected requests to other hosts are not affected.
+static std::shared_ptr<struct curl_slist> MakeConnectTo(const utf8string& host, const utf8string& address) {
+  const utf8string entry = host + u8"::" + (address.find(':') != utf8string::npos ? u8"[" + address + u8"]" : address) + u8":";
+  struct curl_slist* list = curl_slist_append(nullptr, entry.c_str());
+  if (!list)
+    return nullptr;
+  return std::shared_ptr<struct curl_slist>(list, curl_slist_free_all);
+}
+
+void SourceManager::spreadAddresses(int32_t max_num, VerboseOuputFunctor verbose_functor) {
+  if (max_num <= 1)
+    return;
+
+  std::vector<Source> sources;
+  for (const Source& s : sources_) {
+    const utf8string host = GetUrlHost(s.url);
+    std::vector<utf8string> addresses;
+    if (!s.peer && s.address.empty() && host.length() > 0 && host[0] != '[')
+      addresses = ResolveHostAddresses(host);
+
+    if (addresses.size() <= 1) {
+      sources.push_back(s);
+      continue;
+    }
+
+    if (addresses.size() > (size_t)max_num)
+      addresses.resize((size_t)max_num);
+
+    for (const utf8string& address : addresses) {
+      Source source(s.url);
+      source.address = address;
+      source.connect_to = MakeConnectTo(host, address);
+      if (!source.connect_to)
+        continue;
+      OutputVerbose(verbose_functor, u8"Source %d: %s, address: %s.\n", (int)sources.size(), s.url.c_str(), address.c_str());
+      sources.push_back(source);
+    }
+  }
+  sources_.swap(sources);
+}
+
+utf8string SourceManager::address(int32_t source) const {
+  if (source < 0 || source >= (int32_t)sources_.size())
+    return utf8string();
+  return sources_[source].address;
+}
+
+std::shared_ptr<struct curl_slist> SourceManager::connectTo(int32_t source) const {
+  if (source < 0 || source >= (int32_t)sources_.size())
+    return nullptr;
+  return sources_[source].connect_to;
+}
+
+size_t SourceManager::sourceNum() const {
+  return sources_.size();
+}
+
+utf8string SourceManager::url(int32_t source) const {
+  if (source < 0 || source >= (int32_t)sources_.size())
+    return utf8string();
+  return sources_[source].url;
+}
+
+double SourceManager::score(const Source& source) const {
+  if (!source.speed.hasSample())
+    return -1.0;
+  // The bandwidth of a server is shared by its transfers.
+  return (double)source.speed.speed() * (1.0 - source.error_rate) / (source.active_num + 1);
+}
+
+bool SourceManager::isFailing(const Source& source) const {
+  // Another address of the same server is as good, so a failed address is not retried while others work.
+  return source.continuous_failed >=
+         (source.address.empty() ? ZOE_SOURCE_MAX_CONTINUOUS_FAILED_TIMES : ZOE_ADDRESS_MAX_CONTINUOUS_FAILED_TIMES);
+}
+
+int32_t SourceManager::select(int32_t failed_source) const {
+  if (sources_.size() <= 1)
+    return 0;
+
+  // The sources failed continuously are only used when all of them do.
+  bool has_working = false;
+  for (size_t i = 0; i < sources_.size(); i++) {
+    if (sources_[i].peer)
+      continue;
+    if ((int32_t)i != failed_source && !isFailing(sources_[i])) {
+      has_working = true;
+      break;
+    }
+  }
+
+  int32_t selected = -1;
+  for (size_t i = 0; i < sources_.size(); i++) {
+    const Source& s = sources_[i];
+    if (s.peer || (has_working && ((int32_t)i == failed_source || isFailing(s))))
+      continue;
+
+    if (selected == -1) {
+      selected = (int32_t)i;
+      continue;
+    }
+
+    const Source& cur = sources_[selected];
+    if (!has_working) {
+      if (s.continuous_failed < cur.continuous_failed)
+        selected = (int32_t)i;
+      continue;
+    }
+
+    if (isBetter(s, cur))
+      selected = (int32_t)i;
+  }
+
+  return selected == -1 ? 0 : selected;
+}
+
+int32_t SourceManager::selectPeer(const std::vector<int32_t>& peers) const {
+  int32_t selected = -1;
+  for (int32_t i : peers) {
+    if (!isPeer(i) || sources_[i].disabled || isFailing(sources_[i]))
+      continue;
+    if (selected == -1 || isBetter(sources_[i], sources_[selected]))
+      selected = i;
+  }
+  return selected;
+}
+
+bool SourceManager::isBetter(const Source& s, const Source& cur) const {
+  const double s_score = score(s);
+  const double cur_score = score(cur);
+  if (s_score < 0 || cur_score < 0)
+    return s_score < 0 && (cur_score >= 0 || s.active_num < cur.active_num);
+  return s_score > cur_score;
+}
+
+void SourceManager::onTransferStarted(int32_t source) {
+  if (source < 0 || source >= (int32_t)sources_.size())
+    return;
+  sources_[source].active_num++;
+}
+
+void SourceManager::onTransferDone(int32_t source, int64_t bytes, int64_t elapsed_ms, bool failed) {
+  if (source < 0 || source >= (int32_t)sources_.size())
+    return;
+
+  Source& s = sources_[source];
+  assert(s.active_num > 0);
+  if (s.active_num > 0)
+    s.active_num--;
+
+  if (elapsed_ms > 0 && (bytes > 0 || !s.speed.hasSample()))
+    s.speed.sample(bytes, elapsed_ms);
+
+  s.error_rate = s.error_rate * (1.0 - ZOE_SOURCE_ERROR_RATE_WEIGHT) + (failed ? ZOE_SOURCE_ERROR_RATE_WEIGHT : 0.0);
+  s.continuous_failed = failed ? s.continuous_failed + 1 : 0;
+}
+}  // namespace zoe
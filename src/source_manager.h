@@ -0,0 +1,105 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_SOURCE_MANAGER_H_
+#define ZOE_SOURCE_MANAGER_H_
+#pragma once
+
+#include <vector>
+#include <memory>
+#include "zoe/zoe.h"
+#include "speed_estimator.h"
+
+struct curl_slist;
+
+namespace zoe {
+// The urls one file is downloaded from, the first source is the origin url and the others are mirrors.
+// A slice is assigned to the source that gives the most throughput to one more transfer, measured from the
+// transfers done on each source and discounted by its error rate, so that faster mirrors get more slices.
+// A slice that failed on a source is moved to another one if any.
+// A server that resolves to several addresses can be split into one source per address, so that the connections are
+// spread over the addresses and each address is measured on its own. An address that fails is left at once.
+// The peers of peer mode only have some ranges of file, so they are only selected for the slices they have, see selectPeer.
+// All functions must be called on the loop thread.
+class SourceManager {
+ public:
+  SourceManager();
+  virtual ~SourceManager();
+
+  // Return the index of the source.
+  int32_t addSource(const utf8string& url);
+  size_t sourceNum() const;
+  utf8string url(int32_t source) const;
+
+  // Return the index of the source, see Zoe::setPeerMode.
+  int32_t addPeer(const utf8string& url);
+  bool isPeer(int32_t source) const;
+
+  // The peer sent data that doesn't match its chunk hashes, it's not selected anymore.
+  void disable(int32_t source);
+
+  // Resolve the host of each source and replace the source by the sources of its addresses, at most max_num of each.
+  // The sources resolved to one address are kept. Called before any transfer, it blocks while resolving.
+  void spreadAddresses(int32_t max_num, VerboseOuputFunctor verbose_functor);
+
+  // The IP address the connections of source go to, empty if the address is resolved by libcurl.
+  utf8string address(int32_t source) const;
+
+  // CURLOPT_CONNECT_TO of the transfers of source, nullptr if the source has no address.
+  // The list is kept alive by the transfers that use it.
+  std::shared_ptr<struct curl_slist> connectTo(int32_t source) const;
+
+  // failed_source is the source where the slice failed last time, -1 if none. Peers are not selected.
+  int32_t select(int32_t failed_source) const;
+
+  // Select one of the peers that have the slice, -1 if all of them are failing.
+  int32_t selectPeer(const std::vector<int32_t>& peers) const;
+
+  void onTransferStarted(int32_t source);
+
+  // bytes received in elapsed_ms by the transfer.
+  void onTransferDone(int32_t source, int64_t bytes, int64_t elapsed_ms, bool failed);
+
+ protected:
+  typedef struct _Source {
+    utf8string url;
+    utf8string address;
+    std::shared_ptr<struct curl_slist> connect_to;
+    SpeedEstimator speed;  // of one transfer
+    double error_rate;
+    int32_t active_num;
+    int32_t continuous_failed;
+    bool peer;
+    bool disabled;
+
+    _Source(const utf8string& u);
+  } Source;
+
+  // Expected throughput for one more transfer on source, -1 if not measured yet.
+  double score(const Source& source) const;
+
+  // The source has failed too many times in a row to be selected while others work.
+  bool isFailing(const Source& source) const;
+
+  // Whether s is preferred to cur by score, the sources not measured yet are tried first, one transfer after another.
+  bool isBetter(const Source& s, const Source& cur) const;
+
+ protected:
+  std::vector<Source> sources_;
+};
+}  // namespace zoe
+#endif  // !ZOE_SOURCE_MANAGER_H_
@@ -0,0 +1,60 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "speed_estimator.h"
+#include <math.h>
+
+namespace zoe {
+SpeedEstimator::SpeedEstimator(int64_t half_life_ms)
+    : half_life_ms_(half_life_ms > 0 ? half_life_ms : 1)
+    , has_sample_(false)
+    , speed_(0.0)
+    , last_speed_(0L) {}
+
+void SpeedEstimator::sample(int64_t bytes, int64_t elapsed_ms) {
+  if (elapsed_ms <= 0)
+    return;
+
+  last_speed_ = bytes * 1000 / elapsed_ms;
+  if (!has_sample_) {
+    has_sample_ = true;
+    speed_ = (double)last_speed_;
+    return;
+  }
+
+  const double alpha = 1.0 - pow(0.5, (double)elapsed_ms / (double)half_life_ms_);
+  speed_ += alpha * ((double)last_speed_ - speed_);
+}
+
+void SpeedEstimator::reset() {
+  has_sample_ = false;
+  speed_ = 0.0;
+  last_speed_ = 0L;
+}
+
+bool SpeedEstimator::hasSample() const {
+  return has_sample_;
+}
+
+int64_t SpeedEstimator::speed() const {
+  return (int64_t)(speed_ + 0.5);
+}
+
+int64_t SpeedEstimator::lastSpeed() const {
+  return last_speed_;
+}
+}  // namespace zoe
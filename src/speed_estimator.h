@@ -0,0 +1,48 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_SPEED_ESTIMATOR_H_
+#define ZOE_SPEED_ESTIMATOR_H_
+#pragma once
+
+#include <stdint.h>
+
+namespace zoe {
+// Exponentially weighted moving average of the transfer speed.
+// The weight of a sample halves every half_life_ms, so the samples taken at any interval are weighted by time.
+class SpeedEstimator {
+ public:
+  explicit SpeedEstimator(int64_t half_life_ms);
+
+  // bytes received in the last elapsed_ms.
+  void sample(int64_t bytes, int64_t elapsed_ms);
+  void reset();
+
+  bool hasSample() const;
+
+  // byte per second.
+  int64_t speed() const;
+  int64_t lastSpeed() const;
+
+ protected:
+  int64_t half_life_ms_;
+  bool has_sample_;
+  double speed_;
+  int64_t last_speed_;
+};
+}  // namespace zoe
+#endif  // !ZOE_SPEED_ESTIMATOR_H_
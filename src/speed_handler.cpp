@@ -17,44 +17,110 @@
 
 #include "speed_handler.h"
 #include <functional>
+#include <algorithm>
 #include "options.h"
+#include "buffer_pool.h"
 
 namespace zoe {
 SpeedHandler::SpeedHandler(int64_t already_download,
                            Options* options,
                            std::shared_ptr<SliceManager> slice_manager)
     : already_download_(already_download)
-    , last_download_(0L)
+    , last_download_(already_download)
     , options_(options)
-    , slice_manager_(slice_manager) {
-  if (options_ && slice_manager_) {
-    async_task_ = std::async(std::launch::async,
-                             std::bind(&SpeedHandler::asyncTaskProcess, this));
-  }
+    , slice_manager_(slice_manager)
+    , estimator_(ZOE_SPEED_HALF_LIFE_MS) {}
+
+SpeedHandler::~SpeedHandler() {}
+
+bool SpeedHandler::tick() {
+  const long elapsed = time_meter_.Elapsed();
+  if (elapsed < options_->speed_interval)
+    return false;
+  time_meter_.Restart();
+  sample(elapsed);
+
+  if (options_->speed_functor)
+    options_->speed_functor(estimator_.speed());
+  return true;
+}
+
+int32_t SpeedHandler::remainingTime() const {
+  return (int32_t)std::max((long)options_->speed_interval - time_meter_.Elapsed(), 0L);
+}
+
+int64_t SpeedHandler::speed() const {
+  return estimator_.speed();
+}
+
+int64_t SpeedHandler::sliceSpeed(int32_t index) const {
+  auto it = slice_samples_.find(index);
+  if (it == slice_samples_.end() || !it->second.estimator.hasSample())
+    return -1L;
+  return it->second.estimator.speed();
 }
 
-SpeedHandler::~SpeedHandler() {
-  if (async_task_.valid())
-    async_task_.get();
+const DownloadStats& SpeedHandler::stats() const {
+  return stats_;
 }
 
-void SpeedHandler::asyncTaskProcess() {
-  last_download_ = already_download_;
-  while (true) {
-    if (options_->internal_stop_event.wait(1000))
-      break;
-    if (options_->user_stop_event && options_->user_stop_event->isSetted())
-      break;
-    if (options_ && slice_manager_) {
-      const int64_t now = slice_manager_->totalDownloaded();
-
-      if (now >= last_download_) {
-        const int64_t downloaded = now - last_download_;
-        last_download_ = now;
-        options_->speed_functor(downloaded);
+void SpeedHandler::sample(long elapsed_ms) {
+  if (!slice_manager_ || elapsed_ms <= 0)
+    return;
+
+  // the data is discarded if the slice is downloaded again, it is not counted as negative speed.
+  const int64_t now = slice_manager_->totalDownloaded();
+  estimator_.sample(std::max(now - last_download_, (int64_t)0), elapsed_ms);
+  last_download_ = now;
+
+  stats_.total = slice_manager_->originFileSize();
+  stats_.downloaded = now;
+  stats_.speed = estimator_.speed();
+  stats_.instant_speed = estimator_.lastSpeed();
+  stats_.eta = (stats_.total > 0 && stats_.speed > 0) ? std::max(stats_.total - now, (int64_t)0) / stats_.speed : -1L;
+
+  // The faster downloads take the more of cache memory budget.
+  std::shared_ptr<BufferPool> pool = slice_manager_->bufferPool();
+  if (pool)
+    pool->setWeight(stats_.speed);
+  stats_.active_slice_num = 0;
+  stats_.slices.clear();
+
+  std::map<int32_t, SliceSample> slice_samples;
+  SliceManager::SliceInfo info;
+  const size_t slice_num = slice_manager_->sliceNum();
+  stats_.slices.reserve(slice_num);
+  for (size_t row = 0; row < slice_num; row++) {
+    slice_manager_->sliceInfo(row, info);
+    SliceStats slice_stats;
+    slice_stats.index = info.index;
+    slice_stats.begin = info.begin;
+    slice_stats.end = info.end;
+    slice_stats.downloaded = info.downloaded;
+    slice_stats.downloading = (info.status == Slice::DOWNLOADING && info.slice);
+    slice_stats.speed = 0L;
+
+    if (slice_stats.downloading) {
+      const Slice* s = info.slice;
+      stats_.active_slice_num++;
+
+      SliceSample& slice_sample = slice_samples[s->index()];
+      auto it = slice_samples_.find(s->index());
+      if (it != slice_samples_.end()) {
+        slice_sample = it->second;
+        slice_sample.estimator.sample(std::max(slice_stats.downloaded - slice_sample.downloaded, (int64_t)0), elapsed_ms);
       }
+      else {
+        // started in this interval.
+        slice_sample.estimator.sample(std::max(s->downloadedSinceStart(), (int64_t)0), s->elapsedSinceStart());
+      }
+      slice_stats.speed = slice_sample.estimator.speed();
+      slice_sample.downloaded = slice_stats.downloaded;
     }
+
+    stats_.slices.push_back(slice_stats);
   }
+  slice_samples_.swap(slice_samples);
 }
 
-}  // namespace zoe
\ No newline at end of file
+}  // namespace zoe
@@ -19,12 +19,18 @@
 #define ZOE_SPEED_HANDLER_H_
 #pragma once
 
+#include <map>
 #include "zoe/zoe.h"
 #include "slice_manager.h"
+#include "options.h"
+#include "speed_estimator.h"
+#include "time_meter.hpp"
 
 namespace zoe {
 typedef struct _Options Options;
 
+// Sample the speed of download and each slice every options->speed_interval milliseconds on the loop thread,
+// and report the smoothed speed to speed functor.
 class SpeedHandler {
  public:
   SpeedHandler(int64_t already_download,
@@ -32,15 +38,40 @@ class SpeedHandler {
                std::shared_ptr<SliceManager> slice_manager);
   virtual ~SpeedHandler();
 
+  // Called on each loop round, it is cheap if not the time to sample.
+  // Return true if sampled, then stats() is updated.
+  bool tick();
+
+  // Milliseconds until the next sample.
+  int32_t remainingTime() const;
+
+  // Smoothed speed of download, byte per second.
+  int64_t speed() const;
+
+  // Smoothed speed of the downloading slice, -1 if the slice has not been sampled.
+  int64_t sliceSpeed(int32_t index) const;
+
+  // The last sample.
+  const DownloadStats& stats() const;
+
  protected:
-  void asyncTaskProcess();
+  void sample(long elapsed_ms);
+
+  typedef struct _SliceSample {
+    int64_t downloaded;
+    SpeedEstimator estimator;
+    _SliceSample() : downloaded(0L), estimator(ZOE_SPEED_HALF_LIFE_MS) {}
+  } SliceSample;
 
  protected:
-  std::shared_future<void> async_task_;
   const int64_t already_download_;
   int64_t last_download_;
   const Options* options_;
   std::shared_ptr<SliceManager> slice_manager_;
+  TimeMeter time_meter_;
+  SpeedEstimator estimator_;
+  std::map<int32_t, SliceSample> slice_samples_;  // downloading slices only
+  DownloadStats stats_;
 };
 }  // namespace zoe
-#endif  // !ZOE_SPEED_HANDLER_H_
\ No newline at end of file
+#endif  // !ZOE_SPEED_HANDLER_H_
@@ -0,0 +1,138 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "stream_cursor.h"
+#include <assert.h>
+#include <vector>
+#include <algorithm>
+#include "target_file.h"
+#include "options.h"
+
+namespace zoe {
+StreamCursor::StreamCursor(TargetFile* target_file, StreamFunctor functor, int64_t file_size)
+    : target_file_(target_file)
+    , functor_(functor)
+    , file_size_(file_size)
+    , cursor_(0L)
+    , invalid_(false)
+    , stopping_(false) {
+  thread_ = std::thread(std::bind(&StreamCursor::deliverProcess, this));
+}
+
+StreamCursor::~StreamCursor() {
+  {
+    std::lock_guard<std::mutex> lg(mutex_);
+    stopping_ = true;
+  }
+  cond_var_.notify_all();
+  if (thread_.joinable())
+    thread_.join();
+}
+
+void StreamCursor::onWritten(int64_t pos, int64_t size) {
+  if (pos < 0 || size <= 0)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lg(mutex_);
+    if (invalid_)
+      return;
+
+    if (pos < cursor_) {
+      invalid_ = true;
+      written_.clear();
+    }
+    else {
+      int64_t begin = pos;
+      int64_t end = pos + size;
+
+      // merge with the ranges overlapped or adjacent.
+      auto it = written_.upper_bound(begin);
+      if (it != written_.begin()) {
+        auto prev = std::prev(it);
+        if (prev->second >= begin) {
+          begin = prev->first;
+          end = std::max(end, prev->second);
+          it = written_.erase(prev);
+        }
+      }
+      while (it != written_.end() && it->first <= end) {
+        end = std::max(end, it->second);
+        it = written_.erase(it);
+      }
+      written_[begin] = end;
+    }
+  }
+  cond_var_.notify_all();
+}
+
+int64_t StreamCursor::position() const {
+  std::lock_guard<std::mutex> lg(mutex_);
+  return cursor_;
+}
+
+Result StreamCursor::wait(int64_t end, std::function<bool()> is_canceled) {
+  std::unique_lock<std::mutex> ul(mutex_);
+  while (!invalid_ && cursor_ < end) {
+    if (is_canceled && is_canceled())
+      return CANCELED;
+    cond_var_.wait_for(ul, std::chrono::milliseconds(100));
+  }
+
+  return invalid_ ? TMP_FILE_CANNOT_RW : SUCCESSED;
+}
+
+void StreamCursor::deliverProcess() {
+  std::vector<char> buffer(ZOE_STREAM_READ_BUFFER_SIZE);
+  while (true) {
+    int64_t pos = 0L;
+    int64_t size = 0L;
+    {
+      std::unique_lock<std::mutex> ul(mutex_);
+      cond_var_.wait(ul, [this] {
+        return stopping_ || invalid_ || (file_size_ > 0 && cursor_ >= file_size_) || readableEnd() > cursor_;
+      });
+      if (stopping_ || invalid_ || (file_size_ > 0 && cursor_ >= file_size_))
+        break;
+
+      pos = cursor_;
+      size = std::min(readableEnd() - cursor_, (int64_t)buffer.size());
+    }
+
+    const int64_t read = target_file_->read(pos, buffer.data(), size);
+    if (read == size && functor_)
+      functor_(buffer.data(), size);
+
+    {
+      std::lock_guard<std::mutex> lg(mutex_);
+      if (read != size)
+        invalid_ = true;
+      else
+        cursor_ += size;
+    }
+    cond_var_.notify_all();
+  }
+}
+
+int64_t StreamCursor::readableEnd() const {
+  auto it = written_.upper_bound(cursor_);
+  if (it == written_.begin())
+    return cursor_;
+  --it;
+  return std::max(it->second, cursor_);
+}
+}  // namespace zoe
@@ -0,0 +1,74 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_STREAM_CURSOR_H_
+#define ZOE_STREAM_CURSOR_H_
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+#include "zoe/zoe.h"
+
+namespace zoe {
+class TargetFile;
+
+// Deliver the target file in order to StreamFunctor while it is being downloaded.
+// The written ranges are recorded, and the data from cursor to the end of the range that contains it
+// is read back on the delivering thread(it is still in page cache mostly), so the functor never runs on the loop thread.
+// Thread safe.
+class StreamCursor {
+ public:
+  // file_size is -1 if unknown, the end is given by wait then.
+  StreamCursor(TargetFile* target_file, StreamFunctor functor, int64_t file_size);
+  virtual ~StreamCursor();
+
+  // [pos, pos + size) has been written to target file.
+  // The data before cursor has been delivered, if it is written again, the cursor becomes invalid.
+  void onWritten(int64_t pos, int64_t size);
+
+  // The position that the data before it has been delivered.
+  int64_t position() const;
+
+  // Block until the data before end has been delivered.
+  // Return CANCELED if is_canceled returns true, TMP_FILE_CANNOT_RW if cursor is invalid.
+  Result wait(int64_t end, std::function<bool()> is_canceled);
+
+ protected:
+  void deliverProcess();
+
+  // Must be called with mutex_ locked.
+  int64_t readableEnd() const;
+
+ protected:
+  TargetFile* target_file_;
+  StreamFunctor functor_;
+  const int64_t file_size_;
+
+  int64_t cursor_;
+  bool invalid_;
+  bool stopping_;
+  std::map<int64_t, int64_t> written_;  // begin -> end, disjoint ranges that are written.
+
+  mutable std::mutex mutex_;
+  std::condition_variable cond_var_;
+  std::thread thread_;
+};
+}  // namespace zoe
+#endif  // !ZOE_STREAM_CURSOR_H_
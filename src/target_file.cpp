@@ -18,66 +18,230 @@
 #include "target_file.h"
 #include "file_util.h"
 #include <assert.h>
+#include <algorithm>
+#if !(defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__))
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <limits.h>
+#endif
+#include "string_encode.h"
 #include "options.h"
 #include "md5.h"
 #include "crc32.h"
 #include "sha1.h"
 #include "sha256.h"
+#include "parallel_hash.h"
+#include "hash_cursor.h"
+#include "stream_cursor.h"
+#include "metrics.h"
+#include "time_meter.hpp"
 #include "filesystem.hpp"
 
 namespace zoe {
 
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#define TARGET_FILE_OPENED (file_ != INVALID_HANDLE_VALUE)
+#define DIRECT_FILE_OPENED (direct_file_ != INVALID_HANDLE_VALUE)
+typedef HANDLE NativeFile;
+#else
+#define TARGET_FILE_OPENED (fd_ != -1)
+#define DIRECT_FILE_OPENED (direct_fd_ != -1)
+typedef int NativeFile;
+#endif
+
+static int64_t WriteAt(NativeFile f, int64_t pos, const void* data, int64_t data_size) {
+  int64_t written = 0L;
+  while (written < data_size) {
+    const char* p = (const char*)data + written;
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+    OVERLAPPED overlapped = {0};
+    const int64_t offset = pos + written;
+    overlapped.Offset = (DWORD)(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD once = 0;
+    const DWORD to_write = (DWORD)std::min(data_size - written, (int64_t)0x40000000);
+    if (!WriteFile(f, p, to_write, &once, &overlapped) || once == 0)
+      break;
+#else
+    const ssize_t once = pwrite(f, p, (size_t)(data_size - written), (off_t)(pos + written));
+    if (once < 0 && errno == EINTR)
+      continue;
+    if (once <= 0)
+      break;
+#endif
+    written += once;
+  }
+  return written;
+}
+
+#if !(defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__))
+static int64_t WriteGatheredAt(NativeFile f, int64_t pos, std::vector<struct iovec>& iov) {
+  int64_t written = 0L;
+  size_t first = 0;
+  while (first < iov.size()) {
+    const int count = (int)std::min(iov.size() - first, (size_t)IOV_MAX);
+    const ssize_t once = pwritev(f, &iov[first], count, (off_t)(pos + written));
+    if (once < 0 && errno == EINTR)
+      continue;
+    if (once <= 0)
+      break;
+    written += once;
+
+    // Skip the buffers written, the first one left may be written partially.
+    size_t left = (size_t)once;
+    while (first < iov.size() && left >= iov[first].iov_len) {
+      left -= iov[first].iov_len;
+      first++;
+    }
+    if (left > 0) {
+      iov[first].iov_base = (char*)iov[first].iov_base + left;
+      iov[first].iov_len -= left;
+    }
+  }
+  return written;
+}
+#endif
+
 TargetFile::TargetFile(const utf8string& file_path)
-    : file_path_(file_path), f_(nullptr), fixed_size_(0L), file_seek_pos_(0L) {}
+    : file_path_(file_path)
+    , fixed_size_(0L)
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+    , file_(INVALID_HANDLE_VALUE)
+    , direct_file_(INVALID_HANDLE_VALUE)
+#else
+    , fd_(-1)
+    , direct_fd_(-1)
+#endif
+    , mapped_base_(nullptr)
+    , mapped_size_(0L)
+    , in_memory_(false)
+    , memory_data_size_(0L) {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  mapping_ = NULL;
+#endif
+}
 
 TargetFile::~TargetFile() {
   close();
 }
 
-bool TargetFile::createNew(int64_t fixed_size) {
+bool TargetFile::createNew(int64_t fixed_size, bool skip_zero_fill) {
   std::lock_guard<std::recursive_mutex> lg(file_mutex_);
-  assert(f_ == nullptr);
-  if (f_)
+  assert(!TARGET_FILE_OPENED);
+  if (TARGET_FILE_OPENED)
     return false;
 
   if (fixed_size < 0)
     fixed_size = 0;
 
-  if (!FileUtil::CreateFixedSizeFile(file_path_, fixed_size))
+  if (!FileUtil::CreateFixedSizeFile(file_path_, fixed_size, skip_zero_fill))
     return false;
-  f_ = FileUtil::Open(file_path_, "rb+");
-  if (!f_)
+
+  fixed_size_ = fixed_size;
+  return open();
+}
+
+bool TargetFile::createInMemory(int64_t fixed_size,
+                                void* buffer,
+                                int64_t buffer_size,
+                                std::shared_ptr<std::vector<char>> storage) {
+  std::lock_guard<std::recursive_mutex> lg(file_mutex_);
+  assert(!isOpened());
+  if (isOpened())
     return false;
 
-  if (f_) {
-    file_seek_pos_ = 0L;
-    FileUtil::Seek(f_, 0L, SEEK_SET);
+  if (buffer) {
+    if (fixed_size > buffer_size)
+      return false;
+    mapped_base_ = (char*)buffer;
+    mapped_size_ = fixed_size >= 0 ? fixed_size : buffer_size;
   }
+  else {
+    if (!storage || (uint64_t)std::max(fixed_size, (int64_t)0L) > (uint64_t)SIZE_MAX)
+      return false;
+    storage->resize((size_t)std::max(fixed_size, (int64_t)0L));
+    mapped_base_ = storage->data();
+    mapped_size_ = (int64_t)storage->size();
+    memory_storage_ = storage;
+  }
+
+  fixed_size_ = fixed_size;
+  memory_data_size_ = 0L;
+  in_memory_ = true;
+  return true;
+}
 
-  return (f_ != nullptr);
+bool TargetFile::isInMemory() const {
+  return in_memory_;
 }
 
 bool TargetFile::open() {
   std::lock_guard<std::recursive_mutex> lg(file_mutex_);
-  assert(f_ == nullptr);
-  if (f_)
+  assert(!TARGET_FILE_OPENED);
+  if (TARGET_FILE_OPENED)
     return false;
 
-  f_ = FileUtil::Open(file_path_, "rb+");
-  if (f_) {
-    file_seek_pos_ = 0L;
-    FileUtil::Seek(f_, 0L, SEEK_SET);
-  }
-  return (f_ != nullptr);
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  file_ = CreateFileW(Utf8ToUnicode(file_path_).c_str(), GENERIC_READ | GENERIC_WRITE,
+                      FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                      FILE_ATTRIBUTE_NORMAL, NULL);
+#else
+  fd_ = ::open(file_path_.c_str(), O_RDWR);
+#endif
+  return TARGET_FILE_OPENED;
 }
 
 void TargetFile::close() {
   std::lock_guard<std::recursive_mutex> lg(file_mutex_);
-  if (f_) {
-    fflush(f_);
-    FileUtil::Close(f_);
-    f_ = nullptr;
+  if (!isOpened())
+    return;
+
+  // stop hashing and delivering threads before the file closed.
+  hash_cursor_.reset();
+  stream_cursor_.reset();
+
+  // the memory is owned by user or storage.
+  if (in_memory_) {
+    mapped_base_ = nullptr;
+    mapped_size_ = 0L;
+    memory_storage_.reset();
+    in_memory_ = false;
+    return;
   }
+
+  if (mapped_base_) {
+    flushMapped(0L, mapped_size_);
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+    UnmapViewOfFile(mapped_base_);
+    CloseHandle(mapping_);
+    mapping_ = NULL;
+#else
+    munmap(mapped_base_, (size_t)mapped_size_);
+#endif
+    mapped_base_ = nullptr;
+    mapped_size_ = 0L;
+  }
+
+  flush();
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  if (DIRECT_FILE_OPENED) {
+    CloseHandle(direct_file_);
+    direct_file_ = INVALID_HANDLE_VALUE;
+  }
+  CloseHandle(file_);
+  file_ = INVALID_HANDLE_VALUE;
+#else
+  if (DIRECT_FILE_OPENED) {
+    ::close(direct_fd_);
+    direct_fd_ = -1;
+  }
+  ::close(fd_);
+  fd_ = -1;
+#endif
 }
 
 bool TargetFile::renameTo(Options* opt,
@@ -92,86 +256,413 @@ bool TargetFile::renameTo(Options* opt,
 
   bool ret = FileUtil::Rename(file_path_, new_file_path);
 
-  if (reopen && open()) {
-    FileUtil::Seek(f_, file_seek_pos_, SEEK_SET);
-  }
+  if (reopen)
+    open();
 
   return ret;
 }
 
-Result TargetFile::calculateFileHash(Options* opt, utf8string& str_hash) {
+static Result WaitStreamingHash(std::shared_ptr<HashCursor> cursor, Options* opt, utf8string& str_hash) {
+  return cursor->wait([opt]() {
+    return opt && (opt->internal_stop_event.isSetted() || (opt->user_stop_event && opt->user_stop_event->isSetted()));
+  }, str_hash);
+}
+
+// The data in memory is hashed inline by a cursor that has been written entirely.
+static Result CalculateMemoryHash(TargetFile* file, const char* data, HashType type, Options* opt, utf8string& str_hash) {
+  const int64_t size = file->fileSize();
+  if (!data || size <= 0)
+    return CALCULATE_HASH_FAILED;
+
+  std::shared_ptr<HashCursor> cursor = std::make_shared<HashCursor>(file, type, size, nullptr);
+  cursor->onWritten(0L, data, size);
+  return WaitStreamingHash(cursor, opt, str_hash);
+}
+
+Result TargetFile::calculateFileHash(Options* opt, utf8string& str_hash, bool allow_streaming) {
   std::lock_guard<std::recursive_mutex> lg(file_mutex_);
 
+  if (allow_streaming && hash_cursor_ && hash_cursor_->hashType() == opt->hash_type) {
+    const Result ret = WaitStreamingHash(hash_cursor_, opt, str_hash);
+    if (ret != CALCULATE_HASH_FAILED)
+      return ret;
+  }
+
+  if (in_memory_)
+    return CalculateMemoryHash(this, mapped_base_, opt->hash_type, opt, str_hash);
+
+  // The data written by pwrite is visible to other descriptors, so read the file by path.
+  if (opt->hash_verify_thread_num != 1)
+    return CalculateFileHashParallel(file_path_, opt->hash_type, opt->hash_verify_thread_num, opt, str_hash);
+
   Result ret = CALCULATE_HASH_FAILED;
   if (opt->hash_type == MD5) {
-    ret = f_ ? CalculateFileMd5(f_, opt, str_hash)
-             : CalculateFileMd5(file_path_, opt, str_hash);
+    ret = CalculateFileMd5(file_path_, opt, str_hash);
   }
   else if (opt->hash_type == CRC32) {
-    ret = f_ ? CalculateFileCRC32(f_, opt, str_hash)
-             : CalculateFileCRC32(file_path_, opt, str_hash);
+    ret = CalculateFileCRC32(file_path_, opt, str_hash);
   }
   else if (opt->hash_type == SHA1) {
-    ret = f_ ? CalculateFileSHA1(f_, opt, str_hash)
-             : CalculateFileSHA1(file_path_, opt, str_hash);
+    ret = CalculateFileSHA1(file_path_, opt, str_hash);
   }
   else if (opt->hash_type == SHA256) {
-    ret = f_ ? CalculateFileSHA256(f_, opt, str_hash)
-             : CalculateFileSHA256(file_path_, opt, str_hash);
+    ret = CalculateFileSHA256(file_path_, opt, str_hash);
   }
   return ret;
 }
 
-Result TargetFile::calculateFileMd5(Options* opt, utf8string& str_hash) {
+Result TargetFile::calculateFileMd5(Options* opt, utf8string& str_hash, bool allow_streaming) {
   std::lock_guard<std::recursive_mutex> lg(file_mutex_);
-  Result ret = CALCULATE_HASH_FAILED;
 
-  ret = f_ ? CalculateFileMd5(f_, opt, str_hash)
-           : CalculateFileMd5(file_path_, opt, str_hash);
+  if (allow_streaming && hash_cursor_ && hash_cursor_->hashType() == MD5) {
+    const Result ret = WaitStreamingHash(hash_cursor_, opt, str_hash);
+    if (ret != CALCULATE_HASH_FAILED)
+      return ret;
+  }
 
-  return ret;
+  if (in_memory_)
+    return CalculateMemoryHash(this, mapped_base_, MD5, opt, str_hash);
+
+  if (opt->hash_verify_thread_num != 1)
+    return CalculateFileHashParallel(file_path_, MD5, opt->hash_verify_thread_num, opt, str_hash);
+
+  return CalculateFileMd5(file_path_, opt, str_hash);
 }
 
-int64_t TargetFile::fileSize() {
+void TargetFile::enableStreamingHash(HashType type, int64_t file_size) {
   std::lock_guard<std::recursive_mutex> lg(file_mutex_);
-  int64_t ret = 0L;
-  if (isOpened()) {
-    ret = FileUtil::GetFileSize(f_);
-    FileUtil::Seek(f_, file_seek_pos_, SEEK_SET);
+  if (!isOpened() || file_size <= 0)
+    return;
+  hash_cursor_ = std::make_shared<HashCursor>(this, type, file_size, metrics_);
+}
+
+bool TargetFile::isStreamingHash() const {
+  return !!hash_cursor_;
+}
+
+void TargetFile::enableStreamOutput(StreamFunctor functor, int64_t file_size) {
+  std::lock_guard<std::recursive_mutex> lg(file_mutex_);
+  if (!isOpened() || !functor)
+    return;
+  stream_cursor_ = std::make_shared<StreamCursor>(this, functor, file_size);
+}
+
+bool TargetFile::isStreamOutput() const {
+  return !!stream_cursor_;
+}
+
+int64_t TargetFile::streamPosition() const {
+  return stream_cursor_ ? stream_cursor_->position() : 0L;
+}
+
+Result TargetFile::waitStreamOutput(Options* opt, int64_t end) {
+  std::lock_guard<std::recursive_mutex> lg(file_mutex_);
+  if (!stream_cursor_)
+    return SUCCESSED;
+
+  return stream_cursor_->wait(end, [opt]() {
+    return opt && (opt->internal_stop_event.isSetted() || (opt->user_stop_event && opt->user_stop_event->isSetted()));
+  });
+}
+
+void TargetFile::markWritten(int64_t pos, const void* data, int64_t size) {
+  if (hash_cursor_)
+    hash_cursor_->onWritten(pos, data, size);
+  if (stream_cursor_)
+    stream_cursor_->onWritten(pos, size);
+}
+
+int64_t TargetFile::read(int64_t pos, void* buffer, int64_t size) {
+  if (in_memory_) {
+    // the memory may be reallocated by write.
+    std::lock_guard<std::recursive_mutex> lg(file_mutex_);
+    if (!buffer || size <= 0 || pos < 0 || pos >= mapped_size_)
+      return 0L;
+    const int64_t once = std::min(size, mapped_size_ - pos);
+    memcpy(buffer, mapped_base_ + pos, (size_t)once);
+    return once;
   }
-  else {
-    ret = FileUtil::GetFileSize(file_path_);
+
+  if (!TARGET_FILE_OPENED || !buffer || size <= 0 || pos < 0)
+    return 0L;
+
+  int64_t total = 0L;
+  while (total < size) {
+    char* p = (char*)buffer + total;
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+    OVERLAPPED overlapped = {0};
+    const int64_t offset = pos + total;
+    overlapped.Offset = (DWORD)(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD once = 0;
+    const DWORD to_read = (DWORD)std::min(size - total, (int64_t)0x40000000);
+    if (!ReadFile(file_, p, to_read, &once, &overlapped) || once == 0)
+      break;
+#else
+    const ssize_t once = pread(fd_, p, (size_t)(size - total), (off_t)(pos + total));
+    if (once < 0 && errno == EINTR)
+      continue;
+    if (once <= 0)
+      break;
+#endif
+    total += once;
   }
-  return ret;
+  return total;
 }
 
-int64_t TargetFile::write(int64_t pos, const void* data, int64_t data_size) {
+int64_t TargetFile::fileSize() {
   std::lock_guard<std::recursive_mutex> lg(file_mutex_);
-  assert(f_);
+  if (in_memory_)
+    return fixed_size_ >= 0 ? fixed_size_ : memory_data_size_;
+  if (!isOpened())
+    return FileUtil::GetFileSize(file_path_);
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file_, &size))
+    return -1L;
+  return size.QuadPart;
+#else
+  struct stat st;
+  if (fstat(fd_, &st) != 0)
+    return -1L;
+  return st.st_size;
+#endif
+}
+
+int64_t TargetFile::write(int64_t pos, const void* data, int64_t data_size) {
+  if (in_memory_)
+    return writeMemory(pos, data, data_size);
+
+  assert(TARGET_FILE_OPENED);
+  if (!TARGET_FILE_OPENED || !data || data_size <= 0 || pos < 0)
+    return 0L;
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  NativeFile buffered = file_;
+  NativeFile direct = direct_file_;
+#else
+  NativeFile buffered = fd_;
+  NativeFile direct = direct_fd_;
+#endif
+
+  TimeMeter time_meter;
   int64_t written = 0L;
-  do {
-    if (!f_)
-      break;
-    if (!data || data_size == 0)
-      break;
-    if (pos < 0)
-      break;
+  if (DIRECT_FILE_OPENED) {
+    const int64_t alignment = ZOE_DIRECT_IO_ALIGNMENT;
+    const int64_t head = std::min((alignment - pos % alignment) % alignment, data_size);
+    const int64_t middle = (data_size - head) / alignment * alignment;
+    const char* middle_data = (const char*)data + head;
+    if (middle > 0 && (uintptr_t)middle_data % alignment == 0) {
+      if (head > 0)
+        written = WriteAt(buffered, pos, data, head);
 
-    if (file_seek_pos_ != pos) {
-      if (FileUtil::Seek(f_, pos, SEEK_SET) != 0) {
-        assert(false);
-        break;
+      if (written == head) {
+        written += WriteAt(direct, pos + head, middle_data, middle);
+        // Such as the file system doesn't support unbuffered io, write the rest through buffered descriptor.
+        if (written < head + middle)
+          written += WriteAt(buffered, pos + written, (const char*)data + written, head + middle - written);
       }
-      file_seek_pos_ = pos;
     }
+  }
+
+  if (written < data_size)
+    written += WriteAt(buffered, pos + written, (const char*)data + written, data_size - written);
+
+  if (metrics_)
+    metrics_->addDiskWrite(written, time_meter.ElapsedMicroseconds());
+
+  if (written > 0)
+    markWritten(pos, data, written);
+
+  assert(written == data_size);
+  return written;
+}
+
+int64_t TargetFile::writev(int64_t pos, const WriteBuffer* buffers, int32_t count) {
+  if (!buffers || count <= 0 || pos < 0)
+    return 0L;
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  const bool gathered = false;
+#else
+  // The unbuffered descriptor requires each buffer to be aligned, so it's only gathered through the buffered one.
+  const bool gathered = count > 1 && !in_memory_ && !DIRECT_FILE_OPENED;
+#endif
+  if (!gathered) {
+    int64_t written = 0L;
+    for (int32_t i = 0; i < count; i++) {
+      if (buffers[i].size <= 0)
+        continue;
+      const int64_t once = write(pos + written, buffers[i].data, buffers[i].size);
+      written += once;
+      if (once != buffers[i].size)
+        break;
+    }
+    return written;
+  }
 
-    written = fwrite(data, 1, (long)data_size, f_);
-    assert(written == data_size);
-    fflush(f_);
-    file_seek_pos_ += written;
-  } while (false);
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  return 0L;
+#else
+  assert(TARGET_FILE_OPENED);
+  if (!TARGET_FILE_OPENED)
+    return 0L;
 
+  std::vector<struct iovec> iov;
+  iov.reserve(count);
+  int64_t data_size = 0L;
+  for (int32_t i = 0; i < count; i++) {
+    if (!buffers[i].data || buffers[i].size <= 0)
+      continue;
+    struct iovec one;
+    one.iov_base = (void*)buffers[i].data;
+    one.iov_len = (size_t)buffers[i].size;
+    iov.push_back(one);
+    data_size += buffers[i].size;
+  }
+
+  TimeMeter time_meter;
+  const int64_t written = WriteGatheredAt(fd_, pos, iov);
+
+  if (metrics_)
+    metrics_->addDiskWrite(written, time_meter.ElapsedMicroseconds());
+
+  int64_t marked = 0L;
+  for (int32_t i = 0; i < count && marked < written; i++) {
+    if (!buffers[i].data || buffers[i].size <= 0)
+      continue;
+    const int64_t size = std::min(buffers[i].size, written - marked);
+    markWritten(pos + marked, buffers[i].data, size);
+    marked += size;
+  }
+
+  assert(written == data_size);
   return written;
+#endif
+}
+
+void TargetFile::setMetrics(std::shared_ptr<Metrics> metrics) {
+  metrics_ = metrics;
+}
+
+int64_t TargetFile::writeMemory(int64_t pos, const void* data, int64_t data_size) {
+  if (!data || data_size <= 0 || pos < 0)
+    return 0L;
+
+  {
+    std::lock_guard<std::recursive_mutex> lg(file_mutex_);
+    if (pos + data_size > mapped_size_) {
+      // only the storage of unknown size grows, there is only one slice then.
+      if (!memory_storage_ || fixed_size_ >= 0 || (uint64_t)(pos + data_size) > (uint64_t)SIZE_MAX)
+        return 0L;
+      memory_storage_->resize((size_t)std::max(pos + data_size, mapped_size_ * 2));
+      mapped_base_ = memory_storage_->data();
+      mapped_size_ = (int64_t)memory_storage_->size();
+    }
+
+    memcpy(mapped_base_ + pos, data, (size_t)data_size);
+    memory_data_size_ = std::max(memory_data_size_, pos + data_size);
+  }
+
+  markWritten(pos, data, data_size);
+  return data_size;
+}
+
+bool TargetFile::flush() {
+  if (in_memory_)
+    return true;
+  if (!TARGET_FILE_OPENED)
+    return false;
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  return !!FlushFileBuffers(file_);
+#else
+  return fsync(fd_) == 0;
+#endif
+}
+
+bool TargetFile::map() {
+  std::lock_guard<std::recursive_mutex> lg(file_mutex_);
+  if (mapped_base_ || in_memory_)
+    return true;
+  if (!TARGET_FILE_OPENED)
+    return false;
+
+  const int64_t size = fileSize();
+  if (size <= 0 || (uint64_t)size > (uint64_t)SIZE_MAX)
+    return false;
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  mapping_ = CreateFileMappingW(file_, NULL, PAGE_READWRITE, 0, 0, NULL);
+  if (!mapping_)
+    return false;
+  mapped_base_ = (char*)MapViewOfFile(mapping_, FILE_MAP_WRITE, 0, 0, 0);
+  if (!mapped_base_) {
+    CloseHandle(mapping_);
+    mapping_ = NULL;
+    return false;
+  }
+#else
+  void* p = mmap(nullptr, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (p == MAP_FAILED)
+    return false;
+  mapped_base_ = (char*)p;
+#endif
+  mapped_size_ = size;
+  return true;
+}
+
+bool TargetFile::isMapped() const {
+  return mapped_base_ != nullptr;
+}
+
+char* TargetFile::mappedData(int64_t pos, int64_t size) const {
+  if (!mapped_base_ || pos < 0 || size < 0 || pos + size > mapped_size_)
+    return nullptr;
+  return mapped_base_ + pos;
+}
+
+bool TargetFile::flushMapped(int64_t pos, int64_t size) {
+  if (!mapped_base_ || in_memory_ || size <= 0)
+    return true;
+  if (pos < 0 || pos + size > mapped_size_)
+    return false;
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  return !!FlushViewOfFile(mapped_base_ + pos, (SIZE_T)size);
+#else
+  // msync requires the address aligned to page size.
+  static const int64_t page_size = (int64_t)sysconf(_SC_PAGESIZE);
+  const int64_t aligned_pos = pos - (pos % page_size);
+  return msync(mapped_base_ + aligned_pos, (size_t)(pos + size - aligned_pos), MS_SYNC) == 0;
+#endif
+}
+
+bool TargetFile::enableDirectIo() {
+  std::lock_guard<std::recursive_mutex> lg(file_mutex_);
+  if (DIRECT_FILE_OPENED)
+    return true;
+  if (!TARGET_FILE_OPENED || in_memory_)
+    return false;
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  direct_file_ = CreateFileW(Utf8ToUnicode(file_path_).c_str(), GENERIC_READ | GENERIC_WRITE,
+                             FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH, NULL);
+#elif defined(O_DIRECT)
+  direct_fd_ = ::open(file_path_.c_str(), O_RDWR | O_DIRECT);
+#elif defined(F_NOCACHE)
+  direct_fd_ = ::open(file_path_.c_str(), O_RDWR);
+  if (direct_fd_ != -1 && fcntl(direct_fd_, F_NOCACHE, 1) == -1) {
+    ::close(direct_fd_);
+    direct_fd_ = -1;
+  }
+#endif
+  return DIRECT_FILE_OPENED;
+}
+
+bool TargetFile::isDirectIo() const {
+  return DIRECT_FILE_OPENED;
 }
 
 utf8string TargetFile::filePath() const {
@@ -183,7 +674,7 @@ int64_t TargetFile::fixedSize() const {
 }
 
 bool TargetFile::isOpened() const {
-  return f_ != nullptr;
+  return TARGET_FILE_OPENED || in_memory_;
 }
 
 }  // namespace zoe
\ No newline at end of file
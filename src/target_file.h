@@ -21,38 +21,140 @@
 
 #include "zoe/zoe.h"
 #include <mutex>
+#include <memory>
+#include <vector>
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#include <windows.h>
+#endif
 
 namespace zoe {
 typedef struct _Options Options;
+class HashCursor;
+class StreamCursor;
+class Metrics;
+
+typedef struct _WriteBuffer {
+  const void* data;
+  int64_t size;
+} WriteBuffer;
 
 class TargetFile {
  public:
   TargetFile(const utf8string& file_path);
   virtual ~TargetFile();
 
-  bool createNew(int64_t fixed_size);
+  // If skip_zero_fill is true, the allocated space is marked as valid data if possible,
+  // so that unbuffered writes don't wait for zero filling.
+  bool createNew(int64_t fixed_size, bool skip_zero_fill = false);
+
+  // Keep the data in memory rather than a file, fixed_size is -1 if unknown.
+  // If buffer is nullptr, storage is resized to fixed_size and holds the data, it grows as written if the size is unknown.
+  // Otherwise the data is written to buffer, return false if buffer_size is less than fixed_size.
+  // The memory is used as the mapping of file, so the slices copy their data into it directly.
+  bool createInMemory(int64_t fixed_size, void* buffer, int64_t buffer_size, std::shared_ptr<std::vector<char>> storage);
+  bool isInMemory() const;
   bool open();
   void close();
   bool renameTo(Options* opt,
                 const utf8string& new_file_path,
                 bool need_reopen);
-  Result calculateFileHash(Options* opt, utf8string& str_hash);
-  Result calculateFileMd5(Options* opt, utf8string& str_hash);
+  // If streaming hash of the same type is enabled and allow_streaming is true, wait for it instead of reading the file.
+  Result calculateFileHash(Options* opt, utf8string& str_hash, bool allow_streaming = true);
+  Result calculateFileMd5(Options* opt, utf8string& str_hash, bool allow_streaming = true);
+
+  // Hash the file in order while it is being written, the file size must be greater than 0.
+  // The written ranges are reported by write() and markWritten().
+  // It is disabled when file closed.
+  void enableStreamingHash(HashType type, int64_t file_size);
+  bool isStreamingHash() const;
+
+  // Deliver the file in order to functor while it is being written, the file size is -1 if unknown.
+  // The written ranges are reported by write() and markWritten().
+  // It is disabled when file closed, so the data not delivered yet is dropped.
+  void enableStreamOutput(StreamFunctor functor, int64_t file_size);
+  bool isStreamOutput() const;
+
+  // The size of data delivered from the begin of file, 0 if stream output disabled.
+  int64_t streamPosition() const;
+
+  // Block until the data before end has been delivered, SUCCESSED if stream output disabled.
+  Result waitStreamOutput(Options* opt, int64_t end);
+
+  // Report the range written without write(), such as the data copied into mapping or existing before.
+  // data is nullptr if it's not in memory.
+  void markWritten(int64_t pos, const void* data, int64_t size);
+
+  // Positional read, return the size of data read.
+  int64_t read(int64_t pos, void* buffer, int64_t size);
 
   int64_t fileSize();
 
+  // Positional write, no seek and no lock, so slices can write their disjoint ranges in parallel.
+  // Data is not flushed to disk until flush() is called.
   int64_t write(int64_t pos, const void* data, int64_t data_size);
 
+  // Write the buffers one after another from pos, return the total size written.
+  // They are gathered into one pwritev if possible, otherwise written one by one.
+  int64_t writev(int64_t pos, const WriteBuffer* buffers, int32_t count);
+
+  // Make sure the written data is durable, called at checkpoints.
+  bool flush();
+
+  // Map the whole file into memory, the file must be opened and its size must be greater than 0.
+  // The mapping is released when file closed.
+  bool map();
+  bool isMapped() const;
+
+  // Return nullptr if not mapped or [pos, pos + size) is out of mapping.
+  char* mappedData(int64_t pos, int64_t size) const;
+
+  // Synchronize the dirty range of mapping to disk.
+  bool flushMapped(int64_t pos, int64_t size);
+
+  // Open another descriptor that bypasses the page cache of OS, the file must be opened.
+  // After that, write() sends the ZOE_DIRECT_IO_ALIGNMENT aligned part of data through it
+  // if the address of that part is aligned too, the unaligned head and tail are still buffered.
+  // The descriptor is closed when file closed.
+  bool enableDirectIo();
+  bool isDirectIo() const;
+
+  // The write latency and hashing time are recorded if set, must be set before writing.
+  void setMetrics(std::shared_ptr<Metrics> metrics);
+
   utf8string filePath() const;
   int64_t fixedSize() const;
   bool isOpened() const;
 
  protected:
-  int64_t file_seek_pos_;
+  int64_t writeMemory(int64_t pos, const void* data, int64_t data_size);
+
+ protected:
   int64_t fixed_size_;
 
   utf8string file_path_;
-  FILE* f_;
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  HANDLE file_;
+  HANDLE direct_file_;
+#else
+  int fd_;
+  int direct_fd_;
+#endif
+
+  char* mapped_base_;
+  int64_t mapped_size_;
+
+  bool in_memory_;
+  int64_t memory_data_size_;  // the end of data written, used if fixed size is unknown
+  std::shared_ptr<std::vector<char>> memory_storage_;
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  HANDLE mapping_;
+#endif
+
+  std::shared_ptr<HashCursor> hash_cursor_;
+  std::shared_ptr<StreamCursor> stream_cursor_;
+  std::shared_ptr<Metrics> metrics_;
+
+  // Protect open/close/rename, write doesn't require it.
   std::recursive_mutex file_mutex_;
 };
 }  // namespace zoe
@@ -19,28 +19,28 @@
 #define ZOE_TIME_METER_H_
 #pragma once
 #include <stdint.h>
-#include <time.h>
-#include <ctime>
-#include <limits>
+#include <chrono>
 
 namespace zoe {
+// Wall clock meter, std::clock() measures CPU time on POSIX and stops while blocked in curl_multi_poll.
 class TimeMeter {
  public:
-  TimeMeter() { lStartTime_ = std::clock(); }
+  TimeMeter() { start_time_ = std::chrono::steady_clock::now(); }
 
-  void Restart() { lStartTime_ = std::clock(); }
+  void Restart() { start_time_ = std::chrono::steady_clock::now(); }
 
   // ms
-  long Elapsed() const { return std::clock() - lStartTime_; }
-
-  long ElapsedMax() const {
-    return (std::numeric_limits<std::clock_t>::max)() - lStartTime_;
+  long Elapsed() const {
+    return (long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time_).count();
   }
 
-  long ElapsedMin() const { return 1L; }
+  // us
+  int64_t ElapsedMicroseconds() const {
+    return (int64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time_).count();
+  }
 
  private:
-  std::clock_t lStartTime_;
+  std::chrono::steady_clock::time_point start_time_;
 };
 }  // namespace zoe
 
@@ -0,0 +1,206 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "trace.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <inttypes.h>
+#include "options.h"
+#include "file_util.h"
+
+namespace zoe {
+std::atomic_bool trace_enabled(false);
+
+namespace {
+typedef struct _TraceRecord {
+  int64_t time_us;
+  int64_t duration_us;  // TRACE_COMPLETE
+  int64_t arg;
+  const void* id;
+  int32_t index;
+  uint8_t event;
+  uint8_t phase;
+} TraceRecord;
+
+// Written by its thread only, the exporter reads it without lock and drops the records that may be overwritten.
+typedef struct _TraceRing {
+  std::vector<TraceRecord> records;
+  std::atomic<uint64_t> written;  // number of records ever written
+  int32_t tid;
+  uint32_t session;
+} TraceRing;
+
+typedef struct _TraceEventName {
+  const char* name;
+  const char* arg_name;  // nullptr if the event has no arg
+} TraceEventName;
+
+const TraceEventName trace_event_names[TRACE_EVENT_NUM] = {
+    {"Slice", "bytes"},  // of the end
+    {"FirstByte", nullptr},
+    {"Flush", "bytes"},
+    {"DiskWrite", "bytes"},
+    {"Poll", nullptr},
+    {"Perform", "running"},
+    {"HashVerify", nullptr},
+    {"ChunkVerify", nullptr},
+    {"Checkpoint", nullptr},
+};
+
+std::mutex trace_mutex;
+std::vector<std::shared_ptr<TraceRing>> trace_rings;  // of current session
+int32_t trace_ring_capacity = ZOE_TRACE_DEFAULT_EVENT_NUM;
+int32_t trace_tid = 0;
+std::atomic<uint32_t> trace_session(0);
+
+thread_local std::shared_ptr<TraceRing> thread_ring;
+
+TraceRing* ThreadRing() {
+  const uint32_t session = trace_session.load(std::memory_order_relaxed);
+  if (thread_ring && thread_ring->session == session)
+    return thread_ring.get();
+
+  std::lock_guard<std::mutex> lg(trace_mutex);
+  std::shared_ptr<TraceRing> ring = std::make_shared<TraceRing>();
+  ring->records.resize(trace_ring_capacity);
+  ring->written.store(0);
+  ring->tid = ++trace_tid;
+  ring->session = session;
+  trace_rings.push_back(ring);
+  thread_ring = ring;
+  return ring.get();
+}
+
+void AppendJsonEvent(std::string& out, const TraceRecord& r, int32_t tid) {
+  const TraceEventName& name = trace_event_names[r.event];
+  char buf[512];
+  int len = 0;
+  if (r.event == TRACE_SLICE) {
+    len = snprintf(buf, sizeof(buf),
+                   "{\"name\":\"Slice<%d>\",\"cat\":\"zoe\",\"ph\":\"%c\",\"ts\":%" PRId64
+                   ",\"pid\":1,\"tid\":%d,\"id\":\"0x%" PRIx64 "\"",
+                   r.index, (char)r.phase, r.time_us, tid, (uint64_t)(uintptr_t)r.id);
+    if (r.phase == TRACE_ASYNC_END)
+      len += snprintf(buf + len, sizeof(buf) - len, ",\"args\":{\"%s\":%" PRId64 "}", name.arg_name, r.arg);
+    len += snprintf(buf + len, sizeof(buf) - len, "}");
+  }
+  else {
+    len = snprintf(buf, sizeof(buf), "{\"name\":\"%s\",\"cat\":\"zoe\",\"ph\":\"%c\",\"ts\":%" PRId64 ",\"pid\":1,\"tid\":%d",
+                   name.name, (char)r.phase, r.time_us, tid);
+    if (r.phase == TRACE_COMPLETE)
+      len += snprintf(buf + len, sizeof(buf) - len, ",\"dur\":%" PRId64, r.duration_us);
+    else if (r.phase == TRACE_INSTANT)
+      len += snprintf(buf + len, sizeof(buf) - len, ",\"s\":\"t\"");
+
+    len += snprintf(buf + len, sizeof(buf) - len, ",\"args\":{");
+    const char* sep = "";
+    if (r.index >= 0) {
+      len += snprintf(buf + len, sizeof(buf) - len, "\"slice\":%d", r.index);
+      sep = ",";
+    }
+    if (name.arg_name)
+      len += snprintf(buf + len, sizeof(buf) - len, "%s\"%s\":%" PRId64, sep, name.arg_name, r.arg);
+    len += snprintf(buf + len, sizeof(buf) - len, "}}");
+  }
+
+  if (len > 0) {
+    if (out.back() != '[')
+      out += ",\n";
+    out.append(buf, std::min((size_t)len, sizeof(buf) - 1));
+  }
+}
+}  // namespace
+
+int64_t TraceNow() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void AddTraceEvent(TraceEvent event, TracePhase phase, const void* id, int32_t index, int64_t arg, int64_t time_us,
+                   int64_t duration_us) {
+  TraceRing* ring = ThreadRing();
+  const uint64_t seq = ring->written.load(std::memory_order_relaxed);
+  TraceRecord& r = ring->records[seq % ring->records.size()];
+  r.time_us = time_us;
+  r.duration_us = duration_us;
+  r.arg = arg;
+  r.id = id;
+  r.index = index;
+  r.event = (uint8_t)event;
+  r.phase = (uint8_t)phase;
+  ring->written.store(seq + 1, std::memory_order_release);
+}
+
+void StartTrace(int32_t events_per_thread) {
+  std::lock_guard<std::mutex> lg(trace_mutex);
+  trace_ring_capacity = events_per_thread > 0 ? events_per_thread : ZOE_TRACE_DEFAULT_EVENT_NUM;
+  trace_rings.clear();
+  trace_tid = 0;
+  trace_session++;
+  trace_enabled.store(true);
+}
+
+void StopTrace() {
+  trace_enabled.store(false);
+}
+
+bool ExportTrace(const utf8string& path) {
+  std::vector<std::shared_ptr<TraceRing>> rings;
+  {
+    std::lock_guard<std::mutex> lg(trace_mutex);
+    rings = trace_rings;
+  }
+
+  std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  std::vector<TraceRecord> records;
+  for (const std::shared_ptr<TraceRing>& ring : rings) {
+    const uint64_t capacity = ring->records.size();
+    const uint64_t end = ring->written.load(std::memory_order_acquire);
+    uint64_t begin = end > capacity ? end - capacity : 0;
+    records.assign(capacity, TraceRecord());
+    for (uint64_t seq = begin; seq < end; seq++)
+      records[seq % capacity] = ring->records[seq % capacity];
+
+    // The thread may have gone on writing meanwhile, the record being written is counted too.
+    const uint64_t written = ring->written.load(std::memory_order_acquire);
+    if (written + 1 > begin + capacity)
+      begin = std::min(written + 1 - capacity, end);
+
+    char name[128];
+    snprintf(name, sizeof(name),
+             "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"zoe thread %d\"}}",
+             ring->tid, ring->tid);
+    if (out.back() != '[')
+      out += ",\n";
+    out += name;
+
+    for (uint64_t seq = begin; seq < end; seq++)
+      AppendJsonEvent(out, records[seq % capacity], ring->tid);
+  }
+  out += "]}\n";
+
+  FILE* f = FileUtil::Open(path, "wb");
+  if (!f)
+    return false;
+  const bool written = fwrite(out.data(), 1, out.size(), f) == out.size();
+  FileUtil::Close(f);
+  return written;
+}
+}  // namespace zoe
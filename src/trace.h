@@ -0,0 +1,109 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_TRACE_H_
+#define ZOE_TRACE_H_
+#pragma once
+
+#include <atomic>
+#include "zoe/zoe.h"
+
+namespace zoe {
+// The events of download timeline, see Zoe::StartTracing.
+enum TraceEvent {
+  TRACE_SLICE = 0,     // the transfer of slice, from started to stopped
+  TRACE_FIRST_BYTE,    // the first data of the transfer of slice
+  TRACE_FLUSH,         // the cache of slice written to disk on loop thread, arg is bytes
+  TRACE_DISK_WRITE,    // a cache buffer written by disk writer, arg is bytes
+  TRACE_POLL,          // curl_multi_poll of event loop
+  TRACE_PERFORM,       // curl_multi_perform of event loop, arg is the number of running transfers
+  TRACE_HASH_VERIFY,   // hash of the whole file
+  TRACE_CHUNK_VERIFY,  // chunk hashes of slice read back from disk
+  TRACE_CHECKPOINT,    // index file saved
+  TRACE_EVENT_NUM
+};
+
+// The phases of Chrome trace event format.
+enum TracePhase {
+  TRACE_COMPLETE = 'X',
+  TRACE_INSTANT = 'i',
+  TRACE_ASYNC_BEGIN = 'b',
+  TRACE_ASYNC_END = 'e'
+};
+
+// Don't read it directly, see IsTraceEnabled.
+extern std::atomic_bool trace_enabled;
+
+// The only cost of trace points when tracing is off.
+inline bool IsTraceEnabled() {
+  return trace_enabled.load(std::memory_order_relaxed);
+}
+
+// Microseconds of steady clock.
+int64_t TraceNow();
+
+// Append the event to the ring buffer of calling thread without lock, the oldest events are overwritten when full.
+// id tells the async events of different slices apart, index is the slice index or -1.
+void AddTraceEvent(TraceEvent event, TracePhase phase, const void* id, int32_t index, int64_t arg, int64_t time_us,
+                   int64_t duration_us);
+
+inline void TraceInstant(TraceEvent event, const void* id, int32_t index, int64_t arg) {
+  if (IsTraceEnabled())
+    AddTraceEvent(event, TRACE_INSTANT, id, index, arg, TraceNow(), 0L);
+}
+
+inline void TraceAsync(TraceEvent event, TracePhase phase, const void* id, int32_t index, int64_t arg) {
+  if (IsTraceEnabled())
+    AddTraceEvent(event, phase, id, index, arg, TraceNow(), 0L);
+}
+
+// Record a complete event from construction to destruction, if tracing is on at construction.
+class TraceScope {
+ public:
+  TraceScope(TraceEvent event, const void* id, int32_t index, int64_t arg = 0L)
+      : event_(event)
+      , id_(id)
+      , index_(index)
+      , arg_(arg)
+      , start_us_(IsTraceEnabled() ? TraceNow() : -1L) {}
+
+  ~TraceScope() {
+    if (start_us_ >= 0 && IsTraceEnabled())
+      AddTraceEvent(event_, TRACE_COMPLETE, id_, index_, arg_, start_us_, TraceNow() - start_us_);
+  }
+
+  void setArg(int64_t arg) { arg_ = arg; }
+
+ protected:
+  const TraceEvent event_;
+  const void* id_;
+  const int32_t index_;
+  int64_t arg_;
+  const int64_t start_us_;
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+};
+
+// Drop the events recorded and start recording, each thread keeps the last events_per_thread events.
+void StartTrace(int32_t events_per_thread);
+void StopTrace();
+
+// Write the events recorded to path in Chrome trace json, it can be called while recording.
+bool ExportTrace(const utf8string& path);
+}  // namespace zoe
+#endif  // !ZOE_TRACE_H_
@@ -0,0 +1,206 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "transfer_budget.h"
+#include <map>
+#include <atomic>
+#include <algorithm>
+#include "options.h"
+#include "string_helper.hpp"
+
+namespace zoe {
+
+typedef struct _HostBudget {
+  TokenBucket bucket;
+  int32_t max_connections;
+  int32_t connections;
+
+  _HostBudget()
+      : max_connections(0)
+      , connections(0) {}
+} HostBudget;
+
+namespace {
+std::mutex budget_mutex;
+TokenBucket global_bucket;
+int32_t global_max_connections = 0;
+int32_t global_connections = 0;
+std::map<utf8string, std::shared_ptr<HostBudget>> host_budgets;
+
+// Whether any limit is set, the transfers don't take tickets otherwise.
+std::atomic_bool budget_limited(false);
+
+// Must be called with budget_mutex locked.
+void UpdateBudgetLimited() {
+  bool limited = global_bucket.rate() > 0 || global_max_connections > 0;
+  for (const auto& it : host_budgets) {
+    if (it.second->bucket.rate() > 0 || it.second->max_connections > 0)
+      limited = true;
+  }
+  budget_limited.store(limited);
+}
+}  // namespace
+
+TokenBucket::TokenBucket()
+    : rate_(0L)
+    , capacity_(0L)
+    , tokens_(0.0) {}
+
+TokenBucket::~TokenBucket() {}
+
+void TokenBucket::setRate(int64_t rate) {
+  std::lock_guard<std::mutex> lg(mutex_);
+  rate_ = std::max(rate, (int64_t)0L);
+  capacity_ = std::max(rate_ * ZOE_BANDWIDTH_BURST_MS / 1000, (int64_t)ZOE_BANDWIDTH_MIN_BURST_BYTE);
+  tokens_ = (double)capacity_;
+  refill_time_meter_.Restart();
+}
+
+int64_t TokenBucket::rate() const {
+  std::lock_guard<std::mutex> lg(mutex_);
+  return rate_;
+}
+
+bool TokenBucket::available() {
+  std::lock_guard<std::mutex> lg(mutex_);
+  if (rate_ <= 0)
+    return true;
+  refill();
+  return tokens_ > 0.0;
+}
+
+void TokenBucket::take(int64_t bytes) {
+  std::lock_guard<std::mutex> lg(mutex_);
+  if (rate_ <= 0)
+    return;
+  refill();
+  tokens_ -= (double)bytes;
+}
+
+void TokenBucket::refill() {
+  const int64_t elapsed_us = refill_time_meter_.ElapsedMicroseconds();
+  if (elapsed_us <= 0)
+    return;
+  refill_time_meter_.Restart();
+  tokens_ = std::min(tokens_ + (double)rate_ * elapsed_us / 1000000.0, (double)capacity_);
+}
+
+BudgetTicket::BudgetTicket(std::shared_ptr<HostBudget> host)
+    : host_(host) {}
+
+BudgetTicket::~BudgetTicket() {
+  std::lock_guard<std::mutex> lg(budget_mutex);
+  global_connections--;
+  if (host_)
+    host_->connections--;
+}
+
+bool BudgetTicket::available() {
+  return global_bucket.available() && (!host_ || host_->bucket.available());
+}
+
+void BudgetTicket::take(int64_t bytes) {
+  global_bucket.take(bytes);
+  if (host_)
+    host_->bucket.take(bytes);
+}
+
+void SetBudgetMaxSpeed(int64_t byte_per_seconds) {
+  std::lock_guard<std::mutex> lg(budget_mutex);
+  global_bucket.setRate(byte_per_seconds);
+  UpdateBudgetLimited();
+}
+
+int64_t GetBudgetMaxSpeed() {
+  return global_bucket.rate();
+}
+
+void SetBudgetMaxConnections(int32_t num) {
+  std::lock_guard<std::mutex> lg(budget_mutex);
+  global_max_connections = std::max(num, 0);
+  UpdateBudgetLimited();
+}
+
+int32_t GetBudgetMaxConnections() {
+  std::lock_guard<std::mutex> lg(budget_mutex);
+  return global_max_connections;
+}
+
+void SetBudgetHostLimit(const utf8string& host, int64_t max_speed, int32_t max_connections) {
+  std::lock_guard<std::mutex> lg(budget_mutex);
+  // The tickets taken refer to the host budget, so it is never removed.
+  std::shared_ptr<HostBudget>& host_budget = host_budgets[StringHelper::ToLower(host)];
+  if (!host_budget)
+    host_budget = std::make_shared<HostBudget>();
+  host_budget->bucket.setRate(max_speed);
+  host_budget->max_connections = std::max(max_connections, 0);
+  UpdateBudgetLimited();
+}
+
+bool AcquireBudgetTicket(const utf8string& url, std::shared_ptr<BudgetTicket>& ticket) {
+  ticket.reset();
+  if (!budget_limited.load())
+    return true;
+
+  const utf8string host = GetUrlHost(url);
+
+  std::lock_guard<std::mutex> lg(budget_mutex);
+  std::shared_ptr<HostBudget> host_budget;
+  const auto it = host_budgets.find(host);
+  if (it != host_budgets.end())
+    host_budget = it->second;
+
+  if (global_max_connections > 0 && global_connections >= global_max_connections)
+    return false;
+  if (host_budget && host_budget->max_connections > 0 && host_budget->connections >= host_budget->max_connections)
+    return false;
+
+  global_connections++;
+  if (host_budget)
+    host_budget->connections++;
+  ticket = std::make_shared<BudgetTicket>(host_budget);
+  return true;
+}
+
+utf8string GetUrlHost(const utf8string& url) {
+  size_t begin = url.find("://");
+  begin = (begin == utf8string::npos) ? 0 : begin + 3;
+
+  size_t end = url.find_first_of("/?#", begin);
+  if (end == utf8string::npos)
+    end = url.length();
+
+  const size_t at = url.rfind('@', end);
+  if (at != utf8string::npos && at >= begin)
+    begin = at + 1;
+
+  // IPv6 address, such as [::1]:8080
+  size_t port = utf8string::npos;
+  if (begin < end && url[begin] == '[') {
+    const size_t bracket = url.find(']', begin);
+    if (bracket != utf8string::npos && bracket < end)
+      port = url.find(':', bracket);
+  }
+  else {
+    port = url.find(':', begin);
+  }
+  if (port != utf8string::npos && port < end)
+    end = port;
+
+  return StringHelper::ToLower(url.substr(begin, end - begin));
+}
+}  // namespace zoe
@@ -0,0 +1,89 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_TRANSFER_BUDGET_H_
+#define ZOE_TRANSFER_BUDGET_H_
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include "zoe/zoe.h"
+#include "time_meter.hpp"
+
+namespace zoe {
+// The tokens are bytes, refilled at rate and capped at the bytes of ZOE_BANDWIDTH_BURST_MS.
+// A transfer takes tokens after receiving data, so the tokens may be negative, the debt is paid by later refill.
+// Thread safe.
+class TokenBucket {
+ public:
+  TokenBucket();
+  virtual ~TokenBucket();
+
+  // byte per second, 0 or negative means unlimited.
+  void setRate(int64_t rate);
+  int64_t rate() const;
+
+  // Whether any token is left.
+  bool available();
+  void take(int64_t bytes);
+
+ protected:
+  void refill();
+
+ protected:
+  mutable std::mutex mutex_;
+  int64_t rate_;
+  int64_t capacity_;
+  double tokens_;
+  TimeMeter refill_time_meter_;
+};
+
+typedef struct _HostBudget HostBudget;
+
+// One transfer counted in the connection budget of process and its host, released when destroyed.
+class BudgetTicket {
+ public:
+  BudgetTicket(std::shared_ptr<HostBudget> host);
+  virtual ~BudgetTicket();
+
+  // The bandwidth of process and host.
+  bool available();
+  void take(int64_t bytes);
+
+ protected:
+  std::shared_ptr<HostBudget> host_;
+
+  BudgetTicket(const BudgetTicket&) = delete;
+  BudgetTicket& operator=(const BudgetTicket&) = delete;
+};
+
+// The budget shared by all slices of all Zoe objects in the process.
+// The limits only apply to the transfers started after they are set.
+void SetBudgetMaxSpeed(int64_t byte_per_seconds);
+int64_t GetBudgetMaxSpeed();
+void SetBudgetMaxConnections(int32_t num);
+int32_t GetBudgetMaxConnections();
+void SetBudgetHostLimit(const utf8string& host, int64_t max_speed, int32_t max_connections);
+
+// Return false if the connection limit of process or host of url is reached.
+// ticket is nullptr if there isn't any limit.
+bool AcquireBudgetTicket(const utf8string& url, std::shared_ptr<BudgetTicket>& ticket);
+
+// Lower case host name of url, without user info and port.
+utf8string GetUrlHost(const utf8string& url);
+}  // namespace zoe
+#endif  // !ZOE_TRANSFER_BUDGET_H_
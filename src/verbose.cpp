@@ -35,6 +35,10 @@ void OutputVerbose(VerboseOuputFunctor functor, const char* fmt, ...) {
     return;
 
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#if !defined(DEBUG) && !defined(_DEBUG)
+  if (!functor)
+    return;
+#endif
   char* pMsgBuffer = NULL;
   unsigned int iMsgBufCount = 0;
 
@@ -81,10 +85,21 @@ void OutputVerbose(VerboseOuputFunctor functor, const char* fmt, ...) {
     char msgBuf[1024] = {0};
     va_list arglist;
     va_start(arglist, fmt);
-    int err = vsnprintf(msgBuf, 1024, fmt, arglist);
+    va_list arglist_copy;
+    va_copy(arglist_copy, arglist);
+    int len = vsnprintf(msgBuf, sizeof(msgBuf), fmt, arglist);
     va_end(arglist);
 
-    functor(msgBuf);
+    if (len >= (int)sizeof(msgBuf)) {
+      std::string longMsg(len + 1, '\0');
+      vsnprintf(&longMsg[0], longMsg.size(), fmt, arglist_copy);
+      longMsg.resize(len);
+      functor(longMsg);
+    }
+    else if (len >= 0) {
+      functor(msgBuf);
+    }
+    va_end(arglist_copy);
   }
 #endif
 }
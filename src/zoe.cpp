@@ -22,6 +22,15 @@
 #include "slice_manager.h"
 #include "options.h"
 #include "entry_handler.h"
+#include "transfer_budget.h"
+#include "buffer_pool.h"
+#include "file_info_cache.h"
+#include "download_cache.h"
+#include "decompressor.h"
+#include "delta_sync.h"
+#include "peer_server.h"
+#include "hash_cursor.h"
+#include "trace.h"
 #include "string_helper.hpp"
 
 namespace zoe {
@@ -59,7 +68,10 @@ const char* GetResultString(int enumVal) {
                                       u8"CALCULATE_HASH_FAILED",
                                       u8"FETCH_FILE_INFO_FAILED",
                                       u8"REDIRECT_URL_DIFFERENT",
-                                      u8"NOT_CLEARLY_RESULT"};
+                                      u8"NOT_CLEARLY_RESULT",
+                                      u8"DECOMPRESS_FAILED",
+                                      u8"UNSUPPORTED_CODEC",
+                                      u8"INVALID_DELTA_MANIFEST"};
   return EnumStrings[enumVal];
 }
 
@@ -99,9 +111,84 @@ void Zoe::GlobalInit() {
 }
 
 void Zoe::GlobalUnInit() {
+  StopPeerServer();
+  StopHashCursorPool();
   GlobalCurlUnInit();
 }
 
+void Zoe::SetGlobalMaxDownloadSpeed(int64_t byte_per_seconds) noexcept {
+  SetBudgetMaxSpeed(byte_per_seconds);
+}
+
+int64_t Zoe::GlobalMaxDownloadSpeed() noexcept {
+  return GetBudgetMaxSpeed();
+}
+
+void Zoe::SetGlobalMaxConnections(int32_t num) noexcept {
+  SetBudgetMaxConnections(num);
+}
+
+int32_t Zoe::GlobalMaxConnections() noexcept {
+  return GetBudgetMaxConnections();
+}
+
+void Zoe::SetGlobalCacheMemoryLimit(int64_t bytes) noexcept {
+  SetCacheMemoryLimit(bytes);
+}
+
+int64_t Zoe::GlobalCacheMemoryLimit() noexcept {
+  return GetCacheMemoryLimit();
+}
+
+int64_t Zoe::GlobalCacheMemoryUsed() noexcept {
+  return GetCacheMemoryUsed();
+}
+
+void Zoe::SetHostLimit(const utf8string& host, int64_t max_speed, int32_t max_connections) noexcept {
+  SetBudgetHostLimit(host, max_speed, max_connections);
+}
+
+void Zoe::ClearFileInfoCache() noexcept {
+  zoe::ClearFileInfoCache();
+}
+
+DownloadCacheStats Zoe::GlobalDownloadCacheStats() noexcept {
+  return GetDownloadCacheStats();
+}
+
+void Zoe::StopPeerSharing() noexcept {
+  StopPeerServer();
+}
+
+void Zoe::StartTracing(int32_t events_per_thread) noexcept {
+  StartTrace(events_per_thread);
+}
+
+void Zoe::StopTracing() noexcept {
+  StopTrace();
+}
+
+Result Zoe::ExportTrace(const utf8string& json_path) noexcept {
+  return zoe::ExportTrace(json_path) ? SUCCESSED : CREATE_TARGET_FILE_FAILED;
+}
+
+Result Zoe::MakeDeltaManifest(const utf8string& file_path, const utf8string& manifest_path, int32_t block_size) noexcept {
+  DeltaManifest manifest;
+  const Result ret = zoe::MakeDeltaManifest(file_path, block_size, 0, manifest);
+  if (ret != SUCCESSED)
+    return ret;
+
+  std::string data;
+  SerializeDeltaManifest(manifest, data);
+
+  FILE* f = FileUtil::Open(manifest_path, "wb");
+  if (!f)
+    return CREATE_TARGET_FILE_FAILED;
+  const bool written = fwrite(data.data(), 1, data.size(), f) == data.size();
+  FileUtil::Close(f);
+  return written ? SUCCESSED : CREATE_TARGET_FILE_FAILED;
+}
+
 void Zoe::setVerboseOutput(VerboseOuputFunctor verbose_functor) noexcept {
   assert(impl_);
   impl_->options_.verbose_functor = verbose_functor;
@@ -124,6 +211,25 @@ int32_t Zoe::threadNum() const noexcept {
   return impl_->options_.thread_num;
 }
 
+Result Zoe::setAdaptiveConcurrency(bool enabled, int32_t min_thread_num) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+  if (min_thread_num <= 0)
+    min_thread_num = 1;
+  if (enabled && min_thread_num > impl_->options_.thread_num)
+    return INVALID_THREAD_NUM;
+  impl_->options_.adaptive_concurrency_enabled = enabled;
+  impl_->options_.adaptive_min_thread_num = min_thread_num;
+  return SUCCESSED;
+}
+
+void Zoe::adaptiveConcurrency(bool& enabled, int32_t& min_thread_num) const noexcept {
+  assert(impl_);
+  enabled = impl_->options_.adaptive_concurrency_enabled;
+  min_thread_num = impl_->options_.adaptive_min_thread_num;
+}
+
 utf8string Zoe::url() const noexcept {
   assert(impl_);
   return impl_->options_.url;
@@ -149,6 +255,20 @@ DownloadState Zoe::state() const noexcept {
   return DownloadState::STOPPED;
 }
 
+DownloadStats Zoe::stats() const noexcept {
+  assert(impl_);
+  if (impl_ && impl_->entry_handler_)
+    return impl_->entry_handler_->stats();
+  return DownloadStats();
+}
+
+DownloadMetrics Zoe::metrics() const noexcept {
+  assert(impl_);
+  if (impl_ && impl_->entry_handler_)
+    return impl_->entry_handler_->metrics();
+  return Metrics().snapshot();
+}
+
 std::shared_future<Result> Zoe::futureResult() noexcept {
   assert(impl_);
   if (impl_ && impl_->entry_handler_)
@@ -193,6 +313,30 @@ bool Zoe::fetchFileInfoHeadMethod() const noexcept {
   return impl_->options_.use_head_method_fetch_file_info;
 }
 
+Result Zoe::setFetchFileInfoRangeProbe(bool enabled) noexcept {
+  assert(impl_);
+  impl_->options_.range_probe_enabled = enabled;
+  return SUCCESSED;
+}
+
+bool Zoe::fetchFileInfoRangeProbe() const noexcept {
+  assert(impl_);
+  return impl_->options_.range_probe_enabled;
+}
+
+Result Zoe::setFileInfoCacheTime(int32_t seconds) noexcept {
+  assert(impl_);
+  if (seconds < 0)
+    seconds = -1;
+  impl_->options_.file_info_cache_time = seconds;
+  return SUCCESSED;
+}
+
+int32_t Zoe::fileInfoCacheTime() const noexcept {
+  assert(impl_);
+  return impl_->options_.file_info_cache_time;
+}
+
 Result Zoe::setTmpFileExpiredTime(int32_t seconds) noexcept {
   assert(impl_);
   impl_->options_.tmp_file_expired_time = seconds;
@@ -244,6 +388,42 @@ int32_t Zoe::minDownloadSpeedDuration() const noexcept {
   return impl_->options_.min_speed_duration;
 }
 
+Result Zoe::setCallbackExecutor(CallbackExecutor executor) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+  impl_->options_.callback_executor = executor;
+  return SUCCESSED;
+}
+
+CallbackExecutor Zoe::callbackExecutor() const noexcept {
+  assert(impl_);
+  return impl_->options_.callback_executor;
+}
+
+Result Zoe::setProgressInterval(int32_t progress_interval_ms, int32_t speed_interval_ms) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+  if (progress_interval_ms <= 0)
+    progress_interval_ms = ZOE_DEFAULT_PROGRESS_INTERVAL_MS;
+  if (speed_interval_ms <= 0)
+    speed_interval_ms = ZOE_DEFAULT_SPEED_INTERVAL_MS;
+  impl_->options_.progress_interval = progress_interval_ms;
+  impl_->options_.speed_interval = speed_interval_ms;
+  return SUCCESSED;
+}
+
+int32_t Zoe::progressInterval() const noexcept {
+  assert(impl_);
+  return impl_->options_.progress_interval;
+}
+
+int32_t Zoe::speedInterval() const noexcept {
+  assert(impl_);
+  return impl_->options_.speed_interval;
+}
+
 Result Zoe::setDiskCacheSize(int32_t cache_size) noexcept {
   assert(impl_);
   if (impl_->isDownloading())
@@ -259,6 +439,19 @@ int32_t Zoe::diskCacheSize() const noexcept {
   return impl_->options_.disk_cache_size;
 }
 
+Result Zoe::setAsyncDiskWriteEnabled(bool enabled) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+  impl_->options_.async_disk_write_enabled = enabled;
+  return SUCCESSED;
+}
+
+bool Zoe::asyncDiskWriteEnabled() const noexcept {
+  assert(impl_);
+  return impl_->options_.async_disk_write_enabled;
+}
+
 Result Zoe::setStopEvent(Event* stop_event) noexcept {
   assert(impl_);
   impl_->options_.user_stop_event = stop_event;
@@ -270,6 +463,19 @@ Event* Zoe::stopEvent() noexcept {
   return impl_->options_.user_stop_event;
 }
 
+Result Zoe::setEngine(Engine* engine) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+  impl_->options_.engine = engine;
+  return SUCCESSED;
+}
+
+Engine* Zoe::engine() noexcept {
+  assert(impl_);
+  return impl_->options_.engine;
+}
+
 Result Zoe::setRedirectedUrlCheckEnabled(bool enabled) noexcept {
   assert(impl_);
   impl_->options_.redirected_url_check_enabled = enabled;
@@ -314,6 +520,13 @@ Result Zoe::setSlicePolicy(SlicePolicy policy,
     impl_->options_.slice_policy_value = 0L;
     return SUCCESSED;
   }
+  else if (policy == Adaptive) {
+    if (policy_value <= 0)
+      policy_value = ZOE_DEFAULT_SLICE_TARGET_DURATION_MS;
+    impl_->options_.slice_policy = policy;
+    impl_->options_.slice_policy_value = policy_value;
+    return SUCCESSED;
+  }
   assert(false);
   return INVALID_SLICE_POLICY;
 }
@@ -325,6 +538,66 @@ void Zoe::slicePolicy(SlicePolicy& policy, int64_t& policy_value) const
   policy_value = impl_->options_.slice_policy_value;
 }
 
+Result Zoe::setSliceSplitEnabled(bool enabled) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+  impl_->options_.slice_split_enabled = enabled;
+  return SUCCESSED;
+}
+
+bool Zoe::sliceSplitEnabled() const noexcept {
+  assert(impl_);
+  return impl_->options_.slice_split_enabled;
+}
+
+Result Zoe::setHedgeEnabled(bool enabled, int32_t slow_percent) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+  if (slow_percent <= 0 || slow_percent >= 100)
+    slow_percent = ZOE_DEFAULT_HEDGE_SLOW_PERCENT;
+  impl_->options_.hedge_enabled = enabled;
+  impl_->options_.hedge_slow_percent = slow_percent;
+  return SUCCESSED;
+}
+
+void Zoe::hedge(bool& enabled, int32_t& slow_percent) const noexcept {
+  assert(impl_);
+  enabled = impl_->options_.hedge_enabled;
+  slow_percent = impl_->options_.hedge_slow_percent;
+}
+
+Result Zoe::setSliceRetryDelay(int32_t base_delay, int32_t max_delay) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+  if (base_delay < 0)
+    base_delay = ZOE_DEFAULT_RETRY_BASE_DELAY_MS;
+  impl_->options_.retry_base_delay = base_delay;
+  impl_->options_.retry_max_delay = std::max(max_delay, base_delay);
+  return SUCCESSED;
+}
+
+void Zoe::sliceRetryDelay(int32_t& base_delay, int32_t& max_delay) const noexcept {
+  assert(impl_);
+  base_delay = impl_->options_.retry_base_delay;
+  max_delay = impl_->options_.retry_max_delay;
+}
+
+Result Zoe::setUnslicedFileSize(int64_t file_size) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+  impl_->options_.unsliced_file_size = std::max(file_size, (int64_t)0L);
+  return SUCCESSED;
+}
+
+int64_t Zoe::unslicedFileSize() const noexcept {
+  assert(impl_);
+  return impl_->options_.unsliced_file_size;
+}
+
 Result Zoe::setHashVerifyPolicy(HashVerifyPolicy policy,
                                   HashType hash_type,
                                   const utf8string& hash_value) noexcept {
@@ -348,6 +621,19 @@ void Zoe::hashVerifyPolicy(HashVerifyPolicy& policy,
   hash_value = impl_->options_.hash_value;
 }
 
+Result Zoe::setHashVerifyThreadNum(int32_t thread_num) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+  impl_->options_.hash_verify_thread_num = thread_num < 0 ? ZOE_DEFAULT_HASH_VERIFY_THREAD_NUM : thread_num;
+  return SUCCESSED;
+}
+
+int32_t Zoe::hashVerifyThreadNum() const noexcept {
+  assert(impl_);
+  return impl_->options_.hash_verify_thread_num;
+}
+
 Result Zoe::setHttpHeaders(const HttpHeaders& headers) noexcept {
   assert(impl_);
   impl_->options_.http_headers = headers;
@@ -414,6 +700,297 @@ UncompletedSliceSavePolicy Zoe::uncompletedSliceSavePolicy() const noexcept {
   return impl_->options_.uncompleted_slice_save_policy;
 }
 
+Result Zoe::setSliceCoalesceGap(int64_t gap) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+  impl_->options_.slice_coalesce_gap = std::max(gap, (int64_t)-1L);
+  return SUCCESSED;
+}
+
+int64_t Zoe::sliceCoalesceGap() const noexcept {
+  assert(impl_);
+  return impl_->options_.slice_coalesce_gap;
+}
+
+Result Zoe::setDiskIoPolicy(DiskIoPolicy policy) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+  impl_->options_.disk_io_policy = policy;
+  return SUCCESSED;
+}
+
+DiskIoPolicy Zoe::diskIoPolicy() const noexcept {
+  assert(impl_);
+  return impl_->options_.disk_io_policy;
+}
+
+Result Zoe::setStorageClass(StorageClass storage_class) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+  impl_->options_.storage_class = storage_class;
+  return SUCCESSED;
+}
+
+StorageClass Zoe::storageClass() const noexcept {
+  assert(impl_);
+  return impl_->options_.storage_class;
+}
+
+Result Zoe::setChunkHashEnabled(bool enabled) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+  impl_->options_.chunk_hash_enabled = enabled;
+  return SUCCESSED;
+}
+
+bool Zoe::chunkHashEnabled() const noexcept {
+  assert(impl_);
+  return impl_->options_.chunk_hash_enabled;
+}
+
+Result Zoe::setCheckpointPolicy(CheckpointPolicy policy, int64_t policy_value) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+
+  if (policy == CHECKPOINT_BY_TIME) {
+    if (policy_value <= 0)
+      policy_value = ZOE_DEFAULT_CHECKPOINT_INTERVAL_MS;
+  }
+  else if (policy == CHECKPOINT_BY_BYTES) {
+    if (policy_value <= 0)
+      policy_value = ZOE_DEFAULT_CHECKPOINT_BYTES;
+  }
+  else if (policy == CHECKPOINT_ON_SLICE_COMPLETED) {
+    policy_value = 0L;
+  }
+  else {
+    assert(false);
+    return UNKNOWN_ERROR;
+  }
+
+  impl_->options_.checkpoint_policy = policy;
+  impl_->options_.checkpoint_policy_value = policy_value;
+  return SUCCESSED;
+}
+
+void Zoe::checkpointPolicy(CheckpointPolicy& policy, int64_t& policy_value) const noexcept {
+  assert(impl_);
+  policy = impl_->options_.checkpoint_policy;
+  policy_value = impl_->options_.checkpoint_policy_value;
+}
+
+Result Zoe::setHttpVersion(HttpVersion version, int32_t max_host_connections) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+
+  impl_->options_.http_version = version;
+  impl_->options_.max_host_connections = std::max(max_host_connections, 0);
+  return SUCCESSED;
+}
+
+void Zoe::httpVersion(HttpVersion& version, int32_t& max_host_connections) const noexcept {
+  assert(impl_);
+  version = impl_->options_.http_version;
+  max_host_connections = impl_->options_.max_host_connections;
+}
+
+Result Zoe::setPriority(TaskPriority priority, int32_t weight) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+
+  impl_->options_.priority = priority;
+  impl_->options_.priority_weight = std::max(weight, 1);
+  return SUCCESSED;
+}
+
+void Zoe::priority(TaskPriority& priority, int32_t& weight) const noexcept {
+  assert(impl_);
+  priority = impl_->options_.priority;
+  weight = impl_->options_.priority_weight;
+}
+
+Result Zoe::setPauseKeepAliveTime(int32_t milliseconds) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+  impl_->options_.pause_keep_alive_time = milliseconds;
+  return SUCCESSED;
+}
+
+int32_t Zoe::pauseKeepAliveTime() const noexcept {
+  assert(impl_);
+  return impl_->options_.pause_keep_alive_time;
+}
+
+Result Zoe::setStreamOutput(StreamFunctor stream_functor, int64_t read_ahead_size) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+
+  impl_->options_.stream_functor = stream_functor;
+  impl_->options_.stream_read_ahead_size = std::max(read_ahead_size, (int64_t)0L);
+  return SUCCESSED;
+}
+
+void Zoe::streamOutput(StreamFunctor& stream_functor, int64_t& read_ahead_size) const noexcept {
+  assert(impl_);
+  stream_functor = impl_->options_.stream_functor;
+  read_ahead_size = impl_->options_.stream_read_ahead_size;
+}
+
+Result Zoe::setDecompression(CompressionCodec codec, StreamDecoderFactory decoder_factory) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+
+  if (!IsCodecSupported(codec) || (codec == COMPRESSION_CUSTOM && !decoder_factory))
+    return UNSUPPORTED_CODEC;
+
+  impl_->options_.decompress_codec = codec;
+  impl_->options_.decoder_factory = decoder_factory;
+  return SUCCESSED;
+}
+
+void Zoe::decompression(CompressionCodec& codec, StreamDecoderFactory& decoder_factory) const noexcept {
+  assert(impl_);
+  codec = impl_->options_.decompress_codec;
+  decoder_factory = impl_->options_.decoder_factory;
+}
+
+Result Zoe::setDecompressedHashVerify(HashType hash_type, const utf8string& hash_value) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+
+  impl_->options_.decompressed_hash_type = hash_type;
+  impl_->options_.decompressed_hash_value = hash_value;
+  return SUCCESSED;
+}
+
+void Zoe::decompressedHashVerify(HashType& hash_type, utf8string& hash_value) const noexcept {
+  assert(impl_);
+  hash_type = impl_->options_.decompressed_hash_type;
+  hash_value = impl_->options_.decompressed_hash_value;
+}
+
+Result Zoe::setMemoryTarget(bool enabled, void* buffer, int64_t buffer_size) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+
+  impl_->options_.memory_target_enabled = enabled;
+  impl_->options_.memory_buffer = enabled ? buffer : nullptr;
+  impl_->options_.memory_buffer_size = (enabled && buffer) ? std::max(buffer_size, (int64_t)0L) : 0L;
+  return SUCCESSED;
+}
+
+bool Zoe::memoryTargetEnabled() const noexcept {
+  assert(impl_);
+  return impl_->options_.memory_target_enabled;
+}
+
+const void* Zoe::memoryData(int64_t& size) const noexcept {
+  assert(impl_);
+  size = 0L;
+  if (!impl_->options_.memory_target_enabled || impl_->options_.memory_data_size < 0 || impl_->isDownloading())
+    return nullptr;
+
+  size = impl_->options_.memory_data_size;
+  if (impl_->options_.memory_buffer)
+    return impl_->options_.memory_buffer;
+  return impl_->options_.memory_storage ? impl_->options_.memory_storage->data() : nullptr;
+}
+
+Result Zoe::setDownloadCache(const utf8string& dir, int64_t max_size, bool allow_hardlink) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+
+  if (max_size <= 0)
+    max_size = ZOE_DEFAULT_DOWNLOAD_CACHE_MAX_SIZE_BYTE;
+  impl_->options_.download_cache_dir = dir;
+  impl_->options_.download_cache_max_size = max_size;
+  impl_->options_.download_cache_hardlink = allow_hardlink;
+  return SUCCESSED;
+}
+
+void Zoe::downloadCache(utf8string& dir, int64_t& max_size, bool& allow_hardlink) const noexcept {
+  assert(impl_);
+  dir = impl_->options_.download_cache_dir;
+  max_size = impl_->options_.download_cache_max_size;
+  allow_hardlink = impl_->options_.download_cache_hardlink;
+}
+
+Result Zoe::setMirrorUrls(const std::vector<utf8string>& urls) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+
+  impl_->options_.mirror_urls = urls;
+  return SUCCESSED;
+}
+
+std::vector<utf8string> Zoe::mirrorUrls() const noexcept {
+  assert(impl_);
+  return impl_->options_.mirror_urls;
+}
+
+Result Zoe::setMaxAddressNum(int32_t num) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+  impl_->options_.max_address_num = std::max(num, 0);
+  return SUCCESSED;
+}
+
+int32_t Zoe::maxAddressNum() const noexcept {
+  assert(impl_);
+  return impl_->options_.max_address_num;
+}
+
+Result Zoe::setDeltaSource(const utf8string& old_file_path, const utf8string& manifest_url) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+
+  impl_->options_.delta_old_file_path = old_file_path;
+  impl_->options_.delta_manifest_url = manifest_url;
+  return SUCCESSED;
+}
+
+void Zoe::deltaSource(utf8string& old_file_path, utf8string& manifest_url) const noexcept {
+  assert(impl_);
+  old_file_path = impl_->options_.delta_old_file_path;
+  manifest_url = impl_->options_.delta_manifest_url;
+}
+
+Result Zoe::setPeerMode(int32_t listen_port, const std::vector<utf8string>& peers) noexcept {
+  assert(impl_);
+  if (impl_->isDownloading())
+    return ALREADY_DOWNLOADING;
+
+  impl_->options_.peer_listen_port = (listen_port > 0 && listen_port <= 65535) ? listen_port : 0;
+  impl_->options_.peer_urls = peers;
+
+  // The data of peers is checked by chunk hashes.
+  if (impl_->options_.peer_listen_port > 0 || !peers.empty())
+    impl_->options_.chunk_hash_enabled = true;
+  return SUCCESSED;
+}
+
+void Zoe::peerMode(int32_t& listen_port, std::vector<utf8string>& peers) const noexcept {
+  assert(impl_);
+  listen_port = impl_->options_.peer_listen_port;
+  peers = impl_->options_.peer_urls;
+}
+
 std::shared_future<Result> Zoe::start(
     const utf8string& url,
     const utf8string& target_file_path,
@@ -423,6 +1000,27 @@ std::shared_future<Result> Zoe::start(
   assert(impl_);
   Result ret = SUCCESSED;
 
+  // The functors run on the executor with the arguments copied.
+  const CallbackExecutor executor = impl_->options_.callback_executor;
+  if (executor) {
+    if (result_functor) {
+      ResultFunctor functor = result_functor;
+      result_functor = [executor, functor](Result r) { executor([functor, r]() { functor(r); }); };
+    }
+    if (progress_functor) {
+      ProgressFunctor functor = progress_functor;
+      progress_functor = [executor, functor](int64_t total, int64_t downloaded) {
+        executor([functor, total, downloaded]() { functor(total, downloaded); });
+      };
+    }
+    if (realtime_speed_functor) {
+      RealtimeSpeedFunctor functor = realtime_speed_functor;
+      realtime_speed_functor = [executor, functor](int64_t byte_per_sec) {
+        executor([functor, byte_per_sec]() { functor(byte_per_sec); });
+      };
+    }
+  }
+
   utf8string target_path_formatted;
 
   if (impl_->isDownloading()) {
@@ -431,7 +1029,7 @@ std::shared_future<Result> Zoe::start(
   else if (url.length() == 0) {
     ret = INVALID_URL;
   }
-  else {
+  else if (!impl_->options_.memory_target_enabled) {
     if (!FileUtil::PathFormatting(target_file_path, target_path_formatted))
       ret = INVALID_TARGET_FILE_PATH;
   }
@@ -449,13 +1047,18 @@ std::shared_future<Result> Zoe::start(
   impl_->options_.result_functor = result_functor;
   impl_->options_.progress_functor = progress_functor;
   impl_->options_.speed_functor = realtime_speed_functor;
+  impl_->options_.memory_data_size = -1L;
+  impl_->options_.memory_storage.reset();
+  if (impl_->options_.memory_target_enabled && !impl_->options_.memory_buffer)
+    impl_->options_.memory_storage = std::make_shared<std::vector<char>>();
 
   if (impl_->entry_handler_)
     impl_->entry_handler_.reset();
 
   impl_->entry_handler_ = std::make_shared<EntryHandler>();
 
-  return impl_->entry_handler_->start(&impl_->options_);
+  Engine::EngineImpl* engine = impl_->options_.engine ? impl_->options_.engine->impl_ : nullptr;
+  return impl_->entry_handler_->start(&impl_->options_, engine);
 }
 
 void Zoe::pause() noexcept {
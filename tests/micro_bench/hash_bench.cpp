@@ -0,0 +1,253 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "benchmark/benchmark.h"
+#include <string>
+#include <vector>
+#include "md5.h"
+#include "sha1.h"
+#include "sha256.h"
+#include "crc32.h"
+#include "hash_accel.h"
+#include "file_util.h"
+#include "parallel_hash.h"
+#include "delta_sync.h"
+using namespace zoe;
+
+// Arguments: buffer size, use accelerated kernels(0 is the reference implementation).
+// Buffers are hashed repeatedly, so the numbers show the kernel speed without disk reading.
+static void HashArguments(benchmark::internal::Benchmark* b) {
+  for (int64_t size : {4096, 65536, 1048576}) {
+    b->Args({size, 0});
+    b->Args({size, 1});
+  }
+}
+
+static std::vector<unsigned char> MakeData(size_t size) {
+  std::vector<unsigned char> data(size);
+  uint32_t x = 2463534242u;
+  for (size_t i = 0; i < size; i++) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    data[i] = (unsigned char)x;
+  }
+  return data;
+}
+
+static void BM_MD5(benchmark::State& state) {
+  std::vector<unsigned char> data = MakeData((size_t)state.range(0));
+  hash_accel::SetEnabled(state.range(1) != 0);
+  libmd5_internal::MD5Context ctx;
+  libmd5_internal::MD5Init(&ctx);
+  for (auto _ : state)
+    libmd5_internal::MD5Update(&ctx, data.data(), (unsigned)data.size());
+  benchmark::DoNotOptimize(ctx.buf);
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+  hash_accel::SetEnabled(true);
+}
+BENCHMARK(BM_MD5)->Apply(HashArguments);
+
+static void BM_SHA1(benchmark::State& state) {
+  std::vector<unsigned char> data = MakeData((size_t)state.range(0));
+  hash_accel::SetEnabled(state.range(1) != 0);
+  if (state.range(1) && !hash_accel::Sha1Available())
+    state.SkipWithError("SHA-NI is not supported");
+  CSHA1 sha1;
+  sha1.Reset();
+  for (auto _ : state)
+    sha1.Update(data.data(), (unsigned int)data.size());
+  benchmark::DoNotOptimize(sha1.m_state);
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+  hash_accel::SetEnabled(true);
+}
+BENCHMARK(BM_SHA1)->Apply(HashArguments);
+
+static void BM_SHA256(benchmark::State& state) {
+  std::vector<unsigned char> data = MakeData((size_t)state.range(0));
+  hash_accel::SetEnabled(state.range(1) != 0);
+  if (state.range(1) && !hash_accel::Sha256Available())
+    state.SkipWithError("SHA-NI is not supported");
+  sha256_internal::sha256_ctx ctx;
+  sha256_internal::sha256_init(&ctx);
+  for (auto _ : state)
+    sha256_internal::sha256_update(&ctx, data.data(), (uint32_t)data.size());
+  benchmark::DoNotOptimize(ctx.state);
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+  hash_accel::SetEnabled(true);
+}
+BENCHMARK(BM_SHA256)->Apply(HashArguments);
+
+static void BM_CRC32(benchmark::State& state) {
+  std::vector<unsigned char> data = MakeData((size_t)state.range(0));
+  hash_accel::SetEnabled(state.range(1) != 0);
+  uint32_t crc = 0;
+  crc32_internal::crc32Init(&crc);
+  for (auto _ : state)
+    crc32_internal::crc32Update(&crc, data.data(), (uint32_t)data.size());
+  benchmark::DoNotOptimize(crc);
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+  hash_accel::SetEnabled(true);
+}
+BENCHMARK(BM_CRC32)->Apply(HashArguments);
+
+static void BM_Rollsum(benchmark::State& state) {
+  std::vector<unsigned char> data = MakeData((size_t)state.range(0));
+  hash_accel::SetEnabled(state.range(1) != 0);
+  uint32_t s1 = 0;
+  uint32_t s2 = 0;
+  for (auto _ : state)
+    hash_accel::RollsumUpdate(&s1, &s2, data.data(), data.size());
+  benchmark::DoNotOptimize(s2);
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+  hash_accel::SetEnabled(true);
+}
+BENCHMARK(BM_Rollsum)->Apply(HashArguments);
+
+// End to end CalculateFileXXX on a 64MB file, mostly in page cache after the first iteration.
+// Arguments: hash type, use accelerated kernels.
+static void BM_CalculateFile(benchmark::State& state) {
+  const utf8string file_path = "micro_bench_hash.tmp";
+  const size_t file_size = 64 * 1024 * 1024;
+  {
+    std::vector<unsigned char> data = MakeData(file_size);
+    FILE* f = FileUtil::Open(file_path, "wb");
+    if (!f) {
+      state.SkipWithError("create temp file failed");
+      return;
+    }
+    fwrite(data.data(), 1, data.size(), f);
+    fclose(f);
+  }
+
+  hash_accel::SetEnabled(state.range(1) != 0);
+  for (auto _ : state) {
+    utf8string str_hash;
+    Result ret = UNKNOWN_ERROR;
+    switch (state.range(0)) {
+      case MD5:
+        ret = CalculateFileMd5(file_path, nullptr, str_hash);
+        break;
+      case CRC32:
+        ret = CalculateFileCRC32(file_path, nullptr, str_hash);
+        break;
+      case SHA1:
+        ret = CalculateFileSHA1(file_path, nullptr, str_hash);
+        break;
+      case SHA256:
+        ret = CalculateFileSHA256(file_path, nullptr, str_hash);
+        break;
+    }
+    if (ret != SUCCESSED) {
+      state.SkipWithError("calculate file hash failed");
+      break;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * (int64_t)file_size);
+  hash_accel::SetEnabled(true);
+  FileUtil::RemoveFile(file_path);
+}
+BENCHMARK(BM_CalculateFile)
+    ->ArgsProduct({{MD5, CRC32, SHA1, SHA256}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+// CalculateFileHashParallel on the same file as BM_CalculateFile, with accelerated kernels.
+// Arguments: hash type, thread number.
+static void BM_CalculateFileParallel(benchmark::State& state) {
+  const utf8string file_path = "micro_bench_parallel_hash.tmp";
+  const size_t file_size = 64 * 1024 * 1024;
+  {
+    std::vector<unsigned char> data = MakeData(file_size);
+    FILE* f = FileUtil::Open(file_path, "wb");
+    if (!f) {
+      state.SkipWithError("create temp file failed");
+      return;
+    }
+    fwrite(data.data(), 1, data.size(), f);
+    fclose(f);
+  }
+
+  for (auto _ : state) {
+    utf8string str_hash;
+    if (CalculateFileHashParallel(file_path, (HashType)state.range(0), (int32_t)state.range(1), nullptr, str_hash) !=
+        SUCCESSED) {
+      state.SkipWithError("calculate file hash failed");
+      break;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * (int64_t)file_size);
+  FileUtil::RemoveFile(file_path);
+}
+BENCHMARK(BM_CalculateFileParallel)
+    ->ArgsProduct({{MD5, CRC32, SHA1, SHA256}, {2, 4}})
+    ->Unit(benchmark::kMillisecond);
+
+// MatchDeltaBlocks of a 64MB old file against the manifest of 64KB blocks of the new file.
+// Arguments: percent of the old file that is the same as the new file(the rest is rolled byte by byte), thread number.
+static void BM_MatchDeltaBlocks(benchmark::State& state) {
+  const utf8string new_file_path = "micro_bench_delta_new.tmp";
+  const utf8string old_file_path = "micro_bench_delta_old.tmp";
+  const size_t file_size = 64 * 1024 * 1024;
+  {
+    std::vector<unsigned char> data = MakeData(file_size);
+    FILE* f = FileUtil::Open(new_file_path, "wb");
+    if (!f) {
+      state.SkipWithError("create temp file failed");
+      return;
+    }
+    fwrite(data.data(), 1, data.size(), f);
+    fclose(f);
+
+    // Shift the changed part by one byte, so that its blocks are not found at any position.
+    const size_t same = file_size / 100 * (size_t)state.range(0);
+    data.insert(data.begin() + same, 0);
+    f = FileUtil::Open(old_file_path, "wb");
+    if (!f) {
+      state.SkipWithError("create temp file failed");
+      return;
+    }
+    fwrite(data.data(), 1, same, f);
+    std::vector<unsigned char> changed = MakeData(data.size() - same);
+    for (auto& c : changed)
+      c ^= 0x5A;
+    fwrite(changed.data(), 1, changed.size(), f);
+    fclose(f);
+  }
+
+  DeltaManifest manifest;
+  if (MakeDeltaManifest(new_file_path, 65536, 0, manifest) != SUCCESSED) {
+    state.SkipWithError("make delta manifest failed");
+    return;
+  }
+
+  for (auto _ : state) {
+    std::vector<DeltaRun> runs;
+    if (MatchDeltaBlocks(old_file_path, manifest, (int32_t)state.range(1), nullptr, runs) != SUCCESSED) {
+      state.SkipWithError("match delta blocks failed");
+      break;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * (int64_t)file_size);
+  FileUtil::RemoveFile(new_file_path);
+  FileUtil::RemoveFile(old_file_path);
+}
+BENCHMARK(BM_MatchDeltaBlocks)
+    ->ArgsProduct({{100, 50, 0}, {1, 4}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,121 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "benchmark/benchmark.h"
+#include <string.h>
+#include <string>
+#include <vector>
+#include "index_file.h"
+#include "json.hpp"
+using namespace zoe;
+using json = nlohmann::json;
+
+#define INDEX_FILE_JSON_SIGN_STRING "zoe:EASY-FILE-DOWNLOAD(3.0)"
+
+// Exposes the in-memory serialization, so that the file system isn't measured.
+class IndexFileAccessor : public IndexFile {
+ public:
+  using IndexFile::ParseBinary;
+  using IndexFile::ParseJson;
+  using IndexFile::Serialize;
+};
+
+// The JSON format of zoe 3.0, which is only loaded now.
+static void SerializeJson(const IndexFile::Content& content, std::string& data) {
+  json j;
+  j["update_time"] = content.update_time;
+  j["file_size"] = content.file_size;
+  j["content_md5"] = content.content_md5;
+  j["url"] = content.url;
+  j["redirect_url"] = content.redirect_url;
+  j["target_tmp_file_path"] = content.target_tmp_file_path;
+
+  json slices = json::array();
+  for (const auto& record : content.slices) {
+    json s;
+    s["index"] = record.index;
+    s["begin"] = record.begin;
+    s["end"] = record.end;
+    s["capacity"] = record.capacity;
+    s["chunks"] = record.chunks;
+    slices.push_back(s);
+  }
+  j["slices"] = slices;
+
+  data = INDEX_FILE_JSON_SIGN_STRING;
+  data += j.dump();
+}
+
+// Each slice is 16MB and records 16 chunk hashes.
+static IndexFile::Content MakeContent(int32_t slice_num) {
+  IndexFile::Content content;
+  content.update_time = 1700000000L;
+  content.file_size = (int64_t)slice_num * 16 * 1024 * 1024;
+  content.content_md5 = u8"ada0db1429e302d5fd9296f499d82332";
+  content.url = u8"https://example.com/downloads/micro_bench/large_file.bin";
+  content.target_tmp_file_path = u8"/tmp/micro_bench/large_file.bin.zoe";
+  for (int32_t i = 0; i < slice_num; i++) {
+    IndexFile::SliceRecord record;
+    record.index = i + 1;
+    record.begin = (int64_t)i * 16 * 1024 * 1024;
+    record.end = record.begin + 16 * 1024 * 1024 - 1;
+    record.capacity = 8 * 1024 * 1024;
+    for (uint32_t c = 0; c < 16; c++)
+      record.chunks.push_back(0x9E3779B9u * (c + 1) + (uint32_t)i);
+    content.slices.push_back(record);
+  }
+  return content;
+}
+
+// Arguments: slice number, format(0 is JSON, 1 is binary).
+static void BM_IndexSerialize(benchmark::State& state) {
+  const IndexFile::Content content = MakeContent((int32_t)state.range(0));
+  std::string data;
+  for (auto _ : state) {
+    if (state.range(1))
+      IndexFileAccessor::Serialize(content, data);
+    else
+      SerializeJson(content, data);
+    benchmark::DoNotOptimize(data.data());
+  }
+  state.counters["bytes"] = (double)data.size();
+}
+BENCHMARK(BM_IndexSerialize)->ArgsProduct({{16, 256, 4096}, {0, 1}});
+
+// Arguments: slice number, format(0 is JSON, 1 is binary).
+static void BM_IndexParse(benchmark::State& state) {
+  const IndexFile::Content content = MakeContent((int32_t)state.range(0));
+  std::string serialized;
+  if (state.range(1))
+    IndexFileAccessor::Serialize(content, serialized);
+  else
+    SerializeJson(content, serialized);
+  const std::vector<char> data(serialized.begin(), serialized.end());
+
+  for (auto _ : state) {
+    IndexFile::Content parsed;
+    const Result ret = state.range(1) ? IndexFileAccessor::ParseBinary(data, parsed)
+                                      : IndexFileAccessor::ParseJson(data, parsed, nullptr);
+    if (ret != SUCCESSED || parsed.slices.size() != content.slices.size()) {
+      state.SkipWithError("parse index failed");
+      break;
+    }
+    benchmark::DoNotOptimize(parsed.slices.data());
+  }
+  state.SetBytesProcessed(state.iterations() * (int64_t)data.size());
+}
+BENCHMARK(BM_IndexParse)->ArgsProduct({{16, 256, 4096}, {0, 1}});
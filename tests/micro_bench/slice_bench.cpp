@@ -0,0 +1,248 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "benchmark/benchmark.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "curl/curl.h"
+#include "options.h"
+#include "slice.h"
+#include "slice_manager.h"
+#include "target_file.h"
+#include "file_util.h"
+using namespace zoe;
+
+// The slices are started on a multi handle that is never performed, so no request is sent,
+// onNewData is fed the way libcurl write callback does.
+class SliceBenchEnv {
+ public:
+  SliceBenchEnv(int64_t file_size, int32_t slice_num, int32_t disk_cache_size, DiskIoPolicy io_policy)
+      : multi_(curl_multi_init()) {
+    Zoe::GlobalInit();
+    options_.url = u8"http://127.0.0.1:1/micro_bench";
+    options_.target_file_path = u8"micro_bench_slice.tmp";
+    options_.thread_num = slice_num;
+    options_.disk_cache_size = disk_cache_size;
+    options_.disk_io_policy = io_policy;
+    options_.slice_policy = FixedNum;
+    options_.slice_policy_value = slice_num;
+
+    slice_manager_ = std::make_shared<SliceManager>(&options_, u8"");
+    slice_manager_->setOriginFileSize(file_size);
+    ok_ = slice_manager_->makeSlices(true) == SUCCESSED;
+  }
+
+  ~SliceBenchEnv() {
+    for (auto& s : slices_) {
+      s->setStatus(Slice::DOWNLOAD_COMPLETED);
+      s->stop(multi_);
+    }
+    slice_manager_->cleanup();
+    slice_manager_.reset();
+    curl_multi_cleanup(multi_);
+    FileUtil::RemoveFile(options_.target_file_path + u8".zoe");
+  }
+
+  bool ok() const { return ok_; }
+  void* multi() const { return multi_; }
+  std::shared_ptr<SliceManager> sliceManager() const { return slice_manager_; }
+
+  const std::vector<std::shared_ptr<Slice>>& slices() const { return slices_; }
+
+  bool startAll() {
+    slices_ = slice_manager_->getSlices(Slice::UNFETCH);
+    for (auto& s : slices_) {
+      if (s->start(multi_) != SUCCESSED)
+        return false;
+    }
+    return true;
+  }
+
+ protected:
+  Options options_;
+  void* multi_;
+  std::shared_ptr<SliceManager> slice_manager_;
+  std::vector<std::shared_ptr<Slice>> slices_;
+  bool ok_;
+};
+
+// Arguments: callback data size, disk cache size, io policy.
+// Each iteration receives a 32MB slice and flushes it, the data is mostly written to page cache.
+static void BM_SliceOnNewData(benchmark::State& state) {
+  const int64_t slice_size = 32 * 1024 * 1024;
+  const long callback_size = (long)state.range(0);
+  std::vector<char> data(callback_size, 'z');
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::shared_ptr<SliceBenchEnv> env =
+        std::make_shared<SliceBenchEnv>(slice_size, 1, (int32_t)state.range(1), (DiskIoPolicy)state.range(2));
+    if (!env->ok() || !env->startAll()) {
+      state.SkipWithError("prepare slice failed");
+      break;
+    }
+    std::shared_ptr<Slice> slice = env->slices()[0];
+    state.ResumeTiming();
+
+    int64_t received = 0L;
+    bool failed = false;
+    while (received < slice_size && !failed) {
+      const long n = (long)std::min((int64_t)callback_size, slice_size - received);
+      const Slice::DataResult ret = slice->onNewData(data.data(), n);
+      if (ret == Slice::DATA_ACCEPTED)
+        received += n;
+      else if (ret == Slice::DATA_BLOCKED)
+        std::this_thread::yield();  // disk writer is busy, libcurl would pause the transfer
+      else
+        failed = true;
+    }
+    failed = !slice->flushToDisk() || failed;
+
+    state.PauseTiming();
+    env.reset();
+    state.ResumeTiming();
+    if (failed) {
+      state.SkipWithError("slice write failed");
+      break;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * slice_size);
+}
+BENCHMARK(BM_SliceOnNewData)
+    ->ArgsProduct({{1024, 16384, 262144}, {0, 1048576, 20971520}, {STANDARD_IO}})
+    ->Args({16384, 20971520, MEMORY_MAPPED_IO})
+    ->Args({16384, 20971520, DIRECT_IO})
+    ->Unit(benchmark::kMillisecond);
+
+// Arguments: write block size. Each thread writes its own region of a shared file, as slices do.
+static std::shared_ptr<TargetFile> g_target_file;
+static void BM_TargetFileWrite(benchmark::State& state) {
+  const int64_t region_size = 16 * 1024 * 1024;
+  const int64_t block_size = state.range(0);
+  if (state.thread_index() == 0) {
+    g_target_file = std::make_shared<TargetFile>(u8"micro_bench_target.tmp");
+    if (!g_target_file->createNew(region_size * state.threads(), false))
+      g_target_file.reset();
+  }
+
+  std::vector<char> data((size_t)block_size, 'z');
+  const int64_t region_begin = region_size * state.thread_index();
+  int64_t offset = 0L;
+  for (auto _ : state) {
+    if (!g_target_file) {
+      state.SkipWithError("create target file failed");
+      break;
+    }
+    if (g_target_file->write(region_begin + offset, data.data(), block_size) != block_size) {
+      state.SkipWithError("write failed");
+      break;
+    }
+    offset = (offset + block_size) % region_size;
+  }
+  state.SetBytesProcessed(state.iterations() * block_size);
+
+  if (state.thread_index() == 0 && g_target_file) {
+    g_target_file->close();
+    g_target_file.reset();
+    FileUtil::RemoveFile(u8"micro_bench_target.tmp");
+  }
+}
+BENCHMARK(BM_TargetFileWrite)->Arg(16384)->Arg(262144)->ThreadRange(1, 8)->UseRealTime();
+
+// Arguments: slice number. All slices are downloading, the last one is looked up.
+static void BM_GetSliceByCurlHandle(benchmark::State& state) {
+  const int32_t slice_num = (int32_t)state.range(0);
+  SliceBenchEnv env(slice_num * 65536L, slice_num, 0, STANDARD_IO);
+  if (!env.ok() || !env.startAll()) {
+    state.SkipWithError("prepare slices failed");
+    return;
+  }
+
+  std::shared_ptr<SliceManager> slice_manager = env.sliceManager();
+  void* curl = env.slices().back()->curlHandle();
+  for (auto _ : state) {
+    std::shared_ptr<Slice> slice = slice_manager->getSlice(curl);
+    benchmark::DoNotOptimize(slice);
+  }
+}
+BENCHMARK(BM_GetSliceByCurlHandle)->RangeMultiplier(8)->Range(8, 4096);
+
+// Arguments: slice number. All slices are downloading, nothing matches.
+static void BM_GetSliceByStatus(benchmark::State& state) {
+  const int32_t slice_num = (int32_t)state.range(0);
+  SliceBenchEnv env(slice_num * 65536L, slice_num, 0, STANDARD_IO);
+  if (!env.ok() || !env.startAll()) {
+    state.SkipWithError("prepare slices failed");
+    return;
+  }
+
+  std::shared_ptr<SliceManager> slice_manager = env.sliceManager();
+  for (auto _ : state) {
+    std::shared_ptr<Slice> slice = slice_manager->getSlice(Slice::UNFETCH);
+    benchmark::DoNotOptimize(slice);
+  }
+}
+BENCHMARK(BM_GetSliceByStatus)->RangeMultiplier(8)->Range(8, 4096);
+
+// Arguments: slice number. Resume a download whose slices are 90% completed, the tmp file is sparse.
+static void BM_LoadExistSlice(benchmark::State& state) {
+  const int32_t slice_num = (int32_t)state.range(0);
+  const int64_t slice_size = 16384L;
+
+  Options options;
+  options.url = u8"http://127.0.0.1:1/micro_bench";
+  options.target_file_path = u8"micro_bench_resume.tmp";
+
+  IndexFile::Content content;
+  content.update_time = time(nullptr);
+  content.file_size = slice_num * slice_size;
+  content.url = options.url;
+  content.target_tmp_file_path = options.target_file_path + u8".zoe";
+  for (int32_t i = 0; i < slice_num; i++) {
+    IndexFile::SliceRecord record;
+    record.index = i + 1;
+    record.begin = i * slice_size;
+    record.end = record.begin + slice_size - 1;
+    record.capacity = (i % 10 == 0) ? slice_size / 2 : slice_size;
+    content.slices.push_back(record);
+  }
+
+  {
+    TargetFile tmp_file(content.target_tmp_file_path);
+    if (!tmp_file.createNew(content.file_size, true) ||
+        !IndexFile::Save(options.target_file_path + u8".efdindex", content)) {
+      state.SkipWithError("prepare index file failed");
+      return;
+    }
+  }
+
+  for (auto _ : state) {
+    SliceManager slice_manager(&options, u8"");
+    if (slice_manager.loadExistSlice(content.file_size, u8"") != SUCCESSED) {
+      state.SkipWithError("load exist slice failed");
+      break;
+    }
+    benchmark::DoNotOptimize(slice_manager.sliceNum());
+  }
+
+  FileUtil::RemoveFile(content.target_tmp_file_path);
+  FileUtil::RemoveFile(options.target_file_path + u8".efdindex");
+}
+BENCHMARK(BM_LoadExistSlice)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,57 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <future>
+#include <thread>
+using namespace zoe;
+
+TEST(AdaptiveConcurrencyTest, InvalidMinThreadNum) {
+  Zoe efd;
+  efd.setThreadNum(4);
+  EXPECT_TRUE(efd.setAdaptiveConcurrency(true, 5) == INVALID_THREAD_NUM);
+  EXPECT_TRUE(efd.setAdaptiveConcurrency(true, 2) == SUCCESSED);
+
+  bool enabled = false;
+  int32_t min_thread_num = 0;
+  efd.adaptiveConcurrency(enabled, min_thread_num);
+  EXPECT_TRUE(enabled);
+  EXPECT_EQ(min_thread_num, 2);
+}
+
+TEST(AdaptiveConcurrencyTest, Http) {
+  Zoe::GlobalInit();
+
+  for (const auto& test_data : http_test_datas) {
+    Zoe efd;
+
+    efd.setThreadNum(10);
+    efd.setAdaptiveConcurrency(true, 1);
+    if (test_data.md5.length() > 0)
+      efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+
+    Result ret = efd.start(test_data.url, test_data.target_file_path, nullptr, nullptr, nullptr).get();
+    printf("Result: %s\n", GetResultString(ret));
+    EXPECT_TRUE(ret == SUCCESSED);
+  }
+
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
@@ -0,0 +1,58 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <future>
+#include <thread>
+using namespace zoe;
+
+// The slices are cut while downloading, sized by the throughput of connections.
+TEST(AdaptiveSliceTest, test1) {
+  if (http_test_datas.empty())
+    return;
+
+  Zoe::GlobalInit();
+  for (auto& test_data : http_test_datas) {
+    Zoe efd;
+
+    efd.setThreadNum(4);
+    EXPECT_TRUE(efd.setSlicePolicy(Adaptive, 2000) == SUCCESSED);
+    if (test_data.md5.length() > 0)
+      efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+
+    Result ret = efd.start(test_data.url, test_data.target_file_path, nullptr, nullptr, nullptr).get();
+    printf("Result: %s\n", GetResultString(ret));
+    EXPECT_TRUE(ret == SUCCESSED);
+  }
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+// 0 or negative target duration is switched to the default.
+TEST(AdaptiveSliceTest, test2) {
+  Zoe efd;
+  EXPECT_TRUE(efd.setSlicePolicy(Adaptive, 0) == SUCCESSED);
+
+  SlicePolicy policy = Auto;
+  int64_t policy_value = 0L;
+  efd.slicePolicy(policy, policy_value);
+  EXPECT_TRUE(policy == Adaptive);
+  EXPECT_TRUE(policy_value == 10000);
+}
@@ -0,0 +1,71 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <future>
+#include <thread>
+using namespace zoe;
+
+static void DoBatchTest(const std::vector<TestData>& test_datas, int32_t max_transfers) {
+  Zoe::GlobalInit();
+
+  std::vector<BatchEntry> entries;
+  for (const auto& test_data : test_datas) {
+    BatchEntry entry;
+    entry.url = test_data.url;
+    entry.target_file_path = test_data.target_file_path;
+    entry.hash_type = MD5;
+    entry.hash_value = test_data.md5;
+    entries.push_back(entry);
+  }
+
+  Batch batch;
+  EXPECT_TRUE(batch.setMaxConcurrentTransfers(max_transfers) == SUCCESSED);
+  EXPECT_TRUE(batch.maxConcurrentTransfers() == max_transfers);
+
+  std::vector<Result> results(entries.size(), UNKNOWN_ERROR);
+  std::shared_future<Result> r = batch.start(entries, [&results](size_t entry_index, Result ret) {
+    results[entry_index] = ret;
+  });
+  EXPECT_TRUE(batch.setMaxConcurrentTransfers(max_transfers) == ALREADY_DOWNLOADING);
+
+  Result ret = r.get();
+  printf("Result: %s\n", GetResultString(ret));
+  EXPECT_TRUE(ret == SUCCESSED);
+  EXPECT_TRUE(batch.results() == results);
+
+  BatchStats stats = batch.stats();
+  EXPECT_TRUE(stats.file_num == (int32_t)entries.size());
+  EXPECT_TRUE(stats.completed_num == (int32_t)entries.size());
+  EXPECT_TRUE(stats.failed_num == 0);
+  EXPECT_TRUE(stats.downloaded == stats.total);
+
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+TEST(BatchTest, Http_MaxTransfers_2) {
+  DoBatchTest(http_test_datas, 2);
+}
+
+TEST(BatchTest, Http_MaxTransfers_16) {
+  DoBatchTest(http_test_datas, 16);
+}
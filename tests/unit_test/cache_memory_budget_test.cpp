@@ -0,0 +1,91 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+using namespace zoe;
+
+// Download all files at the same time, the disk caches of them share the limit of process.
+static void DoCacheMemoryBudgetTest(const std::vector<TestData>& test_datas, int64_t limit) {
+  Zoe::GlobalInit();
+  Zoe::SetGlobalCacheMemoryLimit(limit);
+
+  std::atomic_bool done(false);
+  std::atomic<int64_t> peak(0L);
+  std::thread monitor([&done, &peak]() {
+    while (!done.load()) {
+      const int64_t used = Zoe::GlobalCacheMemoryUsed();
+      if (used > peak.load())
+        peak.store(used);
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+
+  std::vector<std::shared_ptr<Zoe>> efds;
+  std::vector<std::shared_future<Result>> results;
+  for (auto& test_data : test_datas) {
+    std::shared_ptr<Zoe> efd = std::make_shared<Zoe>();
+    efd->setThreadNum(4);
+    efd->setAsyncDiskWriteEnabled(true);
+    if (test_data.md5.length() > 0)
+      efd->setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+    results.push_back(efd->start(test_data.url, test_data.target_file_path, nullptr, nullptr, nullptr));
+    efds.push_back(efd);
+  }
+
+  for (auto& result : results) {
+    Result ret = result.get();
+    printf("Result: %s\n", GetResultString(ret));
+    EXPECT_TRUE(ret == SUCCESSED);
+  }
+
+  done.store(true);
+  monitor.join();
+  printf("Peak cache memory: %lld\n", (long long)peak.load());
+  EXPECT_TRUE(peak.load() <= limit);
+
+  efds.clear();
+  EXPECT_TRUE(Zoe::GlobalCacheMemoryUsed() == 0);
+
+  Zoe::SetGlobalCacheMemoryLimit(0);
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+TEST(CacheMemoryBudgetTest, test1) {
+  if (http_test_datas.empty())
+    return;
+  DoCacheMemoryBudgetTest(http_test_datas, 8 * 1024 * 1024);
+}
+
+TEST(CacheMemoryBudgetTest, test2) {
+  EXPECT_TRUE(Zoe::GlobalCacheMemoryLimit() == 0);
+  EXPECT_TRUE(Zoe::GlobalCacheMemoryUsed() == 0);
+
+  Zoe::SetGlobalCacheMemoryLimit(64 * 1024 * 1024);
+  EXPECT_TRUE(Zoe::GlobalCacheMemoryLimit() == 64 * 1024 * 1024);
+
+  Zoe::SetGlobalCacheMemoryLimit(-1);
+  EXPECT_TRUE(Zoe::GlobalCacheMemoryLimit() == 0);
+}
@@ -0,0 +1,129 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <future>
+#include <thread>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+using namespace zoe;
+
+// A single thread executor, the tasks run in the order they are posted.
+class TestExecutor {
+ public:
+  TestExecutor()
+      : quit_(false) {
+    thread_ = std::thread([this]() {
+      while (true) {
+        std::function<void()> task;
+        {
+          std::unique_lock<std::mutex> ul(mutex_);
+          cond_.wait(ul, [this]() { return quit_ || !tasks_.empty(); });
+          if (tasks_.empty())
+            return;
+          task = tasks_.front();
+          tasks_.pop_front();
+        }
+        task();
+      }
+    });
+  }
+
+  ~TestExecutor() {
+    {
+      std::lock_guard<std::mutex> lg(mutex_);
+      quit_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+  }
+
+  void post(std::function<void()> task) {
+    std::lock_guard<std::mutex> lg(mutex_);
+    tasks_.push_back(task);
+    cond_.notify_all();
+  }
+
+  std::thread::id threadId() const { return thread_.get_id(); }
+
+ protected:
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<std::function<void()>> tasks_;
+  bool quit_;
+  std::thread thread_;
+};
+
+static void DoCallbackExecutorTest(const std::vector<TestData>& test_datas) {
+  Zoe::GlobalInit();
+  for (auto& test_data : test_datas) {
+    TestExecutor executor;
+    Zoe efd;
+
+    efd.setThreadNum(4);
+    EXPECT_TRUE(efd.setCallbackExecutor([&executor](std::function<void()> task) { executor.post(task); }) == SUCCESSED);
+    if (test_data.md5.length() > 0)
+      efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+
+    const std::thread::id executor_thread = executor.threadId();
+    std::promise<Result> result_promise;
+    efd.start(
+        test_data.url, test_data.target_file_path,
+        [&result_promise, executor_thread](Result ret) {
+          EXPECT_TRUE(std::this_thread::get_id() == executor_thread);
+          result_promise.set_value(ret);
+        },
+        [executor_thread](int64_t total, int64_t downloaded) {
+          EXPECT_TRUE(std::this_thread::get_id() == executor_thread);
+        },
+        [executor_thread](int64_t byte_per_sec) { EXPECT_TRUE(std::this_thread::get_id() == executor_thread); });
+
+    Result ret = result_promise.get_future().get();
+    printf("Result: %s\n", GetResultString(ret));
+    EXPECT_TRUE(ret == SUCCESSED);
+  }
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+TEST(CallbackExecutorTest, test1) {
+  if (http_test_datas.empty())
+    return;
+  DoCallbackExecutorTest(http_test_datas);
+}
+
+// The result of a download failed to start is posted to executor too.
+TEST(CallbackExecutorTest, test2) {
+  Zoe efd;
+  EXPECT_TRUE(!efd.callbackExecutor());
+
+  TestExecutor executor;
+  EXPECT_TRUE(efd.setCallbackExecutor([&executor](std::function<void()> task) { executor.post(task); }) == SUCCESSED);
+  EXPECT_TRUE(!!efd.callbackExecutor());
+
+  const std::thread::id executor_thread = executor.threadId();
+  std::promise<Result> result_promise;
+  efd.start(u8"", u8"", [&result_promise, executor_thread](Result ret) {
+    EXPECT_TRUE(std::this_thread::get_id() == executor_thread);
+    result_promise.set_value(ret);
+  }, nullptr, nullptr);
+  EXPECT_TRUE(result_promise.get_future().get() == INVALID_URL);
+}
@@ -0,0 +1,60 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <future>
+#include <thread>
+using namespace zoe;
+
+// Stop in the middle and resume, the chunks recorded in the index file are verified before being trusted.
+static void DoChunkHashTest(const std::vector<TestData>& test_datas, int32_t thread_num) {
+  Zoe::GlobalInit();
+
+  for (const auto& test_data : test_datas) {
+    Zoe efd;
+    efd.setThreadNum(thread_num);
+    efd.setChunkHashEnabled(true);
+    efd.setUncompletedSliceSavePolicy(SAVE_EXCEPT_FAILED);
+    if (test_data.md5.length() > 0)
+      efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+
+    std::shared_future<Result> r = efd.start(test_data.url, test_data.target_file_path, nullptr, nullptr, nullptr);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    efd.stop();
+    r.wait();
+
+    Result ret = efd.start(test_data.url, test_data.target_file_path, nullptr, nullptr, nullptr).get();
+    printf("Result: %s\n", GetResultString(ret));
+    EXPECT_TRUE(ret == SUCCESSED);
+  }
+
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+TEST(ChunkHashTest, Http_ThreadNum_1_Breakpoint) {
+  DoChunkHashTest(http_test_datas, 1);
+}
+
+TEST(ChunkHashTest, Http_ThreadNum_6_Breakpoint) {
+  DoChunkHashTest(http_test_datas, 6);
+}
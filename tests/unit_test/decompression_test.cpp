@@ -0,0 +1,88 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <future>
+#include <thread>
+using namespace zoe;
+
+namespace {
+// Pass the data through, so the decompressed file is the same as the downloaded one.
+class CopyDecoder : public StreamDecoder {
+ public:
+  bool decode(const void* data, int64_t size, const StreamFunctor& output) override {
+    output(data, size);
+    return true;
+  }
+
+  bool finish(const StreamFunctor& output) override { return true; }
+};
+}  // namespace
+
+// The hash of decompressed data is verified as well as the downloaded data.
+TEST(DecompressionTest, test1) {
+  if (http_test_datas.empty())
+    return;
+
+  Zoe::GlobalInit();
+  for (auto& test_data : http_test_datas) {
+    Zoe efd;
+
+    efd.setThreadNum(4);
+    efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+    EXPECT_TRUE(efd.setDecompression(COMPRESSION_CUSTOM, []() { return std::make_shared<CopyDecoder>(); }) == SUCCESSED);
+    EXPECT_TRUE(efd.setDecompressedHashVerify(MD5, test_data.md5) == SUCCESSED);
+
+    std::shared_future<Result> future_result = efd.start(
+        test_data.url, test_data.target_file_path,
+        [](Result result) {
+          printf("\nResult: %s\n", GetResultString(result));
+          EXPECT_TRUE(result == SUCCESSED);
+        },
+        nullptr, nullptr);
+
+    EXPECT_TRUE(future_result.get() == SUCCESSED);
+    EXPECT_TRUE(efd.metrics().decompressed_bytes > 0);
+  }
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+// The custom codec requires a decoder factory.
+TEST(DecompressionTest, test2) {
+  Zoe efd;
+  CompressionCodec codec = COMPRESSION_GZIP;
+  StreamDecoderFactory decoder_factory;
+  efd.decompression(codec, decoder_factory);
+  EXPECT_TRUE(codec == COMPRESSION_NONE);
+  EXPECT_FALSE(decoder_factory);
+
+  EXPECT_TRUE(efd.setDecompression(COMPRESSION_CUSTOM, nullptr) == UNSUPPORTED_CODEC);
+  EXPECT_TRUE(efd.setDecompression(COMPRESSION_CUSTOM, []() { return std::make_shared<CopyDecoder>(); }) == SUCCESSED);
+  efd.decompression(codec, decoder_factory);
+  EXPECT_TRUE(codec == COMPRESSION_CUSTOM);
+  EXPECT_TRUE(!!decoder_factory);
+
+  HashType hash_type = SHA1;
+  utf8string hash_value;
+  efd.decompressedHashVerify(hash_type, hash_value);
+  EXPECT_TRUE(hash_type == MD5);
+  EXPECT_TRUE(hash_value.empty());
+}
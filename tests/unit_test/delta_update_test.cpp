@@ -0,0 +1,108 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <stdio.h>
+#include <thread>
+#include <vector>
+using namespace zoe;
+
+static bool WriteTestFile(const char* path, size_t size) {
+  FILE* f = fopen(path, "wb");
+  if (!f)
+    return false;
+  std::vector<char> data(size);
+  for (size_t i = 0; i < size; i++)
+    data[i] = (char)(i * 7 + i / 251);
+  const bool ret = fwrite(data.data(), 1, size, f) == size;
+  fclose(f);
+  return ret;
+}
+
+static long TestFileSize(const char* path) {
+  FILE* f = fopen(path, "rb");
+  if (!f)
+    return -1;
+  fseek(f, 0, SEEK_END);
+  const long size = ftell(f);
+  fclose(f);
+  return size;
+}
+
+// The manifest is not published beside the test files, so the whole file is downloaded.
+static void DoDeltaUpdateTest(const std::vector<TestData>& test_datas) {
+  Zoe::GlobalInit();
+  for (auto& test_data : test_datas) {
+    Zoe efd;
+
+    efd.setThreadNum(4);
+    EXPECT_TRUE(efd.setDeltaSource(test_data.target_file_path, test_data.url + ".zdelta") == SUCCESSED);
+    if (test_data.md5.length() > 0)
+      efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+
+    Result ret = efd.start(test_data.url, test_data.target_file_path, nullptr, nullptr, nullptr).get();
+    printf("Result: %s\n", GetResultString(ret));
+    EXPECT_TRUE(ret == SUCCESSED);
+    EXPECT_TRUE(efd.metrics().delta_copied_bytes == 0);
+  }
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+TEST(DeltaUpdateTest, test1) {
+  if (http_test_datas.empty())
+    return;
+  DoDeltaUpdateTest(http_test_datas);
+}
+
+TEST(DeltaUpdateTest, test2) {
+  Zoe efd;
+  utf8string old_file_path;
+  utf8string manifest_url;
+  efd.deltaSource(old_file_path, manifest_url);
+  EXPECT_TRUE(old_file_path.empty() && manifest_url.empty());
+
+  EXPECT_TRUE(efd.setDeltaSource("old.bin", "http://localhost/new.bin.zdelta") == SUCCESSED);
+  efd.deltaSource(old_file_path, manifest_url);
+  EXPECT_TRUE(old_file_path == "old.bin");
+  EXPECT_TRUE(manifest_url == "http://localhost/new.bin.zdelta");
+}
+
+TEST(DeltaUpdateTest, test3) {
+  const char* file_path = "delta_update_test.bin";
+  const char* manifest_path = "delta_update_test.bin.zdelta";
+  ASSERT_TRUE(WriteTestFile(file_path, 1000000));
+
+  // 24 bytes of header and 8 bytes per block, the last block is shorter.
+  EXPECT_TRUE(Zoe::MakeDeltaManifest(file_path, manifest_path, 65536) == SUCCESSED);
+  EXPECT_TRUE(TestFileSize(manifest_path) == 24 + 8 * 16);
+  EXPECT_TRUE(Zoe::MakeDeltaManifest(file_path, manifest_path, 1000000) == SUCCESSED);
+  EXPECT_TRUE(TestFileSize(manifest_path) == 24 + 8);
+
+  EXPECT_TRUE(Zoe::MakeDeltaManifest(file_path, manifest_path, 100) == INVALID_DELTA_MANIFEST);
+  EXPECT_TRUE(Zoe::MakeDeltaManifest(file_path, manifest_path, 32 * 1024 * 1024) == INVALID_DELTA_MANIFEST);
+  EXPECT_TRUE(Zoe::MakeDeltaManifest("delta_update_test_not_exist.bin", manifest_path) == CALCULATE_HASH_FAILED);
+
+  ASSERT_TRUE(WriteTestFile(file_path, 0));
+  EXPECT_TRUE(Zoe::MakeDeltaManifest(file_path, manifest_path) == INVALID_DELTA_MANIFEST);
+
+  remove(file_path);
+  remove(manifest_path);
+}
@@ -16,6 +16,7 @@
 ******************************************************************************/
 
 #include <future>
+#include <thread>
 #include "gtest/gtest.h"
 #include "zoe/zoe.h"
 #include "test_data.h"
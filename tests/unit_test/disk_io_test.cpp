@@ -0,0 +1,70 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <future>
+#include <thread>
+using namespace zoe;
+
+static void DoDiskIoTest(const std::vector<TestData>& test_datas,
+                         DiskIoPolicy policy,
+                         bool async_write,
+                         int32_t disk_cache_size) {
+  Zoe::GlobalInit();
+
+  for (const auto& test_data : test_datas) {
+    Zoe efd;
+
+    efd.setThreadNum(4);
+    efd.setDiskCacheSize(disk_cache_size);
+    EXPECT_TRUE(efd.setDiskIoPolicy(policy) == SUCCESSED);
+    EXPECT_TRUE(efd.setAsyncDiskWriteEnabled(async_write) == SUCCESSED);
+    if (test_data.md5.length() > 0)
+      efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+
+    Result ret = efd.start(test_data.url, test_data.target_file_path, nullptr, nullptr, nullptr).get();
+    printf("Result: %s\n", GetResultString(ret));
+    EXPECT_TRUE(ret == SUCCESSED);
+  }
+
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+TEST(DiskIoTest, Http_AsyncWrite) {
+  DoDiskIoTest(http_test_datas, STANDARD_IO, true, 1024 * 1024);
+}
+
+TEST(DiskIoTest, Http_SyncWrite) {
+  DoDiskIoTest(http_test_datas, STANDARD_IO, false, 1024 * 1024);
+}
+
+TEST(DiskIoTest, Http_MemoryMapped) {
+  DoDiskIoTest(http_test_datas, MEMORY_MAPPED_IO, true, 1024 * 1024);
+}
+
+// Only a few cache blocks for all slices, transfers are paused until the blocks return to pool.
+TEST(DiskIoTest, Http_AsyncWrite_SmallCache) {
+  DoDiskIoTest(http_test_datas, STANDARD_IO, true, 64 * 1024);
+}
+
+TEST(DiskIoTest, Http_DirectIo) {
+  DoDiskIoTest(http_test_datas, DIRECT_IO, true, 4 * 1024 * 1024);
+}
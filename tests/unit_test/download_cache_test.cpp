@@ -0,0 +1,126 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include "filesystem.hpp"
+#include <future>
+#include <thread>
+using namespace zoe;
+
+// The second download of the same file is copied from the download cache.
+TEST(DownloadCacheTest, test1) {
+  if (http_test_datas.empty())
+    return;
+
+  Zoe::GlobalInit();
+  const utf8string cache_dir = "./zoe_download_cache";
+  for (auto& test_data : http_test_datas) {
+    for (int i = 0; i < 2; i++) {
+      Zoe efd;
+
+      efd.setThreadNum(4);
+      efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+      EXPECT_TRUE(efd.setDownloadCache(cache_dir, 0, false) == SUCCESSED);
+
+      const DownloadCacheStats before = Zoe::GlobalDownloadCacheStats();
+      std::shared_future<Result> future_result = efd.start(
+          test_data.url, test_data.target_file_path,
+          [](Result result) {
+            printf("\nResult: %s\n", GetResultString(result));
+            EXPECT_TRUE(result == SUCCESSED);
+          },
+          nullptr, nullptr);
+
+      EXPECT_TRUE(future_result.get() == SUCCESSED);
+
+      const DownloadCacheStats after = Zoe::GlobalDownloadCacheStats();
+      if (i > 0) {
+        EXPECT_TRUE(efd.metrics().download_cache_hit);
+        EXPECT_TRUE(after.hit_num == before.hit_num + 1);
+      }
+    }
+  }
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+// The cached file that doesn't match the hash is evicted and downloaded again.
+TEST(DownloadCacheTest, test3) {
+  if (http_test_datas.empty())
+    return;
+
+  Zoe::GlobalInit();
+  const utf8string cache_dir = "./zoe_download_cache_verify";
+  for (auto& test_data : http_test_datas) {
+    std::error_code ec;
+    ghc::filesystem::remove_all(ghc::filesystem::u8path(cache_dir), ec);
+
+    for (int i = 0; i < 2; i++) {
+      if (i > 0) {
+        // Corrupt the cached file.
+        for (const auto& it : ghc::filesystem::directory_iterator(ghc::filesystem::u8path(cache_dir), ec)) {
+          if (it.path().extension() != ".data")
+            continue;
+          FILE* f = fopen(it.path().u8string().c_str(), "r+b");
+          ASSERT_TRUE(f != nullptr);
+          fwrite("zoe", 1, 3, f);
+          fclose(f);
+        }
+      }
+
+      Zoe efd;
+      efd.setThreadNum(4);
+      efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+      EXPECT_TRUE(efd.setDownloadCache(cache_dir, 0, false) == SUCCESSED);
+
+      const DownloadCacheStats before = Zoe::GlobalDownloadCacheStats();
+      EXPECT_TRUE(efd.start(test_data.url, test_data.target_file_path, nullptr, nullptr, nullptr).get() == SUCCESSED);
+
+      const DownloadCacheStats after = Zoe::GlobalDownloadCacheStats();
+      if (i > 0) {
+        EXPECT_FALSE(efd.metrics().download_cache_hit);
+        EXPECT_TRUE(after.evicted_num > before.evicted_num);
+        EXPECT_TRUE(after.store_num == before.store_num + 1);
+      }
+    }
+  }
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+// The size limit that is not positive is switched to the default.
+TEST(DownloadCacheTest, test2) {
+  Zoe efd;
+  utf8string dir;
+  int64_t max_size = 0L;
+  bool allow_hardlink = true;
+  efd.downloadCache(dir, max_size, allow_hardlink);
+  EXPECT_TRUE(dir.empty());
+  EXPECT_TRUE(max_size == 10737418240LL);
+  EXPECT_FALSE(allow_hardlink);
+
+  EXPECT_TRUE(efd.setDownloadCache("./cache", -1, true) == SUCCESSED);
+  efd.downloadCache(dir, max_size, allow_hardlink);
+  EXPECT_TRUE(dir == "./cache");
+  EXPECT_TRUE(max_size == 10737418240LL);
+  EXPECT_TRUE(allow_hardlink);
+}
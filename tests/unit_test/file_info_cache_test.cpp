@@ -0,0 +1,67 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <future>
+#include <thread>
+using namespace zoe;
+
+// The file info is fetched with range probe first, then taken from cache and revalidated.
+TEST(FileInfoCacheTest, test1) {
+  if (http_test_datas.empty())
+    return;
+
+  Zoe::GlobalInit();
+  Zoe::ClearFileInfoCache();
+  for (auto& test_data : http_test_datas) {
+    for (int32_t cache_time : {3600, 0}) {
+      Zoe efd;
+
+      efd.setThreadNum(4);
+      efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+      EXPECT_TRUE(efd.setFetchFileInfoRangeProbe(true) == SUCCESSED);
+      EXPECT_TRUE(efd.setFileInfoCacheTime(cache_time) == SUCCESSED);
+      EXPECT_TRUE(efd.fetchFileInfoRangeProbe());
+      EXPECT_TRUE(efd.fileInfoCacheTime() == cache_time);
+
+      std::shared_future<Result> future_result = efd.start(
+          test_data.url, test_data.target_file_path,
+          [](Result result) {
+            printf("\nResult: %s\n", GetResultString(result));
+            EXPECT_TRUE(result == SUCCESSED);
+          },
+          nullptr, nullptr);
+
+      EXPECT_TRUE(future_result.get() == SUCCESSED);
+    }
+  }
+  Zoe::ClearFileInfoCache();
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+// The negative cache time is switched to the default.
+TEST(FileInfoCacheTest, test2) {
+  Zoe efd;
+  EXPECT_FALSE(efd.fetchFileInfoRangeProbe());
+  EXPECT_TRUE(efd.fileInfoCacheTime() == -1);
+  EXPECT_TRUE(efd.setFileInfoCacheTime(-100) == SUCCESSED);
+  EXPECT_TRUE(efd.fileInfoCacheTime() == -1);
+}
@@ -0,0 +1,69 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <future>
+#include <thread>
+using namespace zoe;
+
+// Two downloads share the bandwidth and connections of process.
+TEST(GlobalLimitTest, test1) {
+  if (http_test_datas.empty())
+    return;
+
+  Zoe::GlobalInit();
+  Zoe::SetGlobalMaxDownloadSpeed(1024 * 200);
+  Zoe::SetGlobalMaxConnections(4);
+  EXPECT_TRUE(Zoe::GlobalMaxDownloadSpeed() == 1024 * 200);
+  EXPECT_TRUE(Zoe::GlobalMaxConnections() == 4);
+  {
+    Zoe efd1;
+    Zoe efd2;
+
+    efd1.setThreadNum(3);
+    efd1.setHashVerifyPolicy(ALWAYS, MD5, http_test_datas[0].md5);
+    efd2.setThreadNum(3);
+    efd2.setHashVerifyPolicy(ALWAYS, MD5, http_test_datas[0].md5);
+
+    std::shared_future<Result> future_result1 = efd1.start(
+        http_test_datas[0].url, http_test_datas[0].target_file_path,
+        [](Result result) {
+          printf("\nResult: %s\n", GetResultString(result));
+          EXPECT_TRUE(result == SUCCESSED);
+        },
+        nullptr, [](int64_t byte_per_sec) { printf("1: %.3f kb/s\n", (float)byte_per_sec / 1024.f); });
+
+    std::shared_future<Result> future_result2 = efd2.start(
+        http_test_datas[0].url, http_test_datas[0].target_file_path + u8".2",
+        [](Result result) {
+          printf("\nResult: %s\n", GetResultString(result));
+          EXPECT_TRUE(result == SUCCESSED);
+        },
+        nullptr, [](int64_t byte_per_sec) { printf("2: %.3f kb/s\n", (float)byte_per_sec / 1024.f); });
+
+    future_result1.wait();
+    future_result2.wait();
+  }
+  Zoe::SetGlobalMaxDownloadSpeed(0);
+  Zoe::SetGlobalMaxConnections(0);
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
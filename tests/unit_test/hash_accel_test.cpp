@@ -0,0 +1,135 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+#include "sha1.h"
+#include "sha256.h"
+#include "crc32.h"
+#include "hash_accel.h"
+using namespace zoe;
+
+static std::string ToHex(const unsigned char* digest, size_t size) {
+  static const char kHex[] = "0123456789abcdef";
+  std::string str;
+  for (size_t i = 0; i < size; i++) {
+    str.push_back(kHex[digest[i] >> 4]);
+    str.push_back(kHex[digest[i] & 0x0F]);
+  }
+  return str;
+}
+
+// The data is updated in two parts, split at split.
+static std::string Sha1(const unsigned char* data, size_t size, size_t split) {
+  CSHA1 sha1;
+  sha1.Reset();
+  sha1.Update((unsigned char*)data, (unsigned int)split);
+  sha1.Update((unsigned char*)data + split, (unsigned int)(size - split));
+  sha1.Final();
+  unsigned char digest[20] = {0};
+  sha1.GetHash(digest);
+  return ToHex(digest, sizeof(digest));
+}
+
+static std::string Sha256(const unsigned char* data, size_t size, size_t split) {
+  sha256_internal::SHA256_CTX ctx;
+  sha256_internal::sha256_init(&ctx);
+  sha256_internal::sha256_update(&ctx, data, (uint32_t)split);
+  sha256_internal::sha256_update(&ctx, data + split, (uint32_t)(size - split));
+  sha256_internal::sha256_final(&ctx);
+  return sha256_internal::sha256_digest(&ctx);
+}
+
+static uint32_t Crc32(const unsigned char* data, size_t size, size_t split) {
+  uint32_t crc = 0;
+  crc32_internal::crc32Init(&crc);
+  crc32_internal::crc32Update(&crc, (unsigned char*)data, (uint32_t)split);
+  crc32_internal::crc32Update(&crc, (unsigned char*)data + split, (uint32_t)(size - split));
+  crc32_internal::crc32Finish(&crc);
+  return crc;
+}
+
+static std::vector<unsigned char> MakeData(size_t size) {
+  std::vector<unsigned char> data(size);
+  uint32_t x = 2463534242U;
+  for (size_t i = 0; i < size; i++) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    data[i] = (unsigned char)x;
+  }
+  return data;
+}
+
+// Known answers of FIPS 180 and the CRC-32 check value, with and without the accelerated kernels.
+TEST(HashAccelTest, test1) {
+  const std::string abc = "abc";
+  const std::string abc448 = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  const std::string million_a(1000000, 'a');
+  const std::string check = "123456789";
+  const std::string fox = "The quick brown fox jumps over the lazy dog";
+
+  for (int enabled = 1; enabled >= 0; enabled--) {
+    hash_accel::SetEnabled(enabled == 1);
+
+    EXPECT_EQ(Sha1((const unsigned char*)abc.data(), abc.size(), 0), "a9993e364706816aba3e25717850c26c9cd0d89d");
+    EXPECT_EQ(Sha1((const unsigned char*)abc448.data(), abc448.size(), 0), "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+    EXPECT_EQ(Sha1((const unsigned char*)million_a.data(), million_a.size(), 0), "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+
+    EXPECT_EQ(Sha256((const unsigned char*)abc.data(), abc.size(), 0),
+              "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    EXPECT_EQ(Sha256((const unsigned char*)abc448.data(), abc448.size(), 0),
+              "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    EXPECT_EQ(Sha256((const unsigned char*)million_a.data(), million_a.size(), 0),
+              "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+
+    EXPECT_EQ(Crc32((const unsigned char*)check.data(), check.size(), 0), 0xCBF43926U);
+    EXPECT_EQ(Crc32((const unsigned char*)fox.data(), fox.size(), 0), 0x414FA339U);
+  }
+  hash_accel::SetEnabled(true);
+}
+
+// The accelerated kernels match the reference implementations at unaligned addresses, sizes and split points.
+TEST(HashAccelTest, test2) {
+  const std::vector<unsigned char> buffer = MakeData(70000);
+  const size_t sizes[] = {0, 1, 15, 16, 17, 55, 56, 63, 64, 65, 127, 128, 129, 1000, 4095, 4097, 65537};
+
+  for (size_t offset = 0; offset < 16; offset += 3) {
+    const unsigned char* data = buffer.data() + offset;
+    for (size_t size : sizes) {
+      const size_t splits[] = {0, 1, 7, 63, 64, 65, size / 2, size};
+      for (size_t split : splits) {
+        if (split > size)
+          continue;
+
+        hash_accel::SetEnabled(false);
+        const std::string sha1 = Sha1(data, size, split);
+        const std::string sha256 = Sha256(data, size, split);
+        const uint32_t crc32 = Crc32(data, size, split);
+        const uint32_t crc32_slice_by_8 = hash_accel::Crc32Update(0xFFFFFFFF, data, size);
+
+        hash_accel::SetEnabled(true);
+        EXPECT_EQ(Sha1(data, size, split), sha1) << "offset " << offset << ", size " << size << ", split " << split;
+        EXPECT_EQ(Sha256(data, size, split), sha256) << "offset " << offset << ", size " << size << ", split " << split;
+        EXPECT_EQ(Crc32(data, size, split), crc32) << "offset " << offset << ", size " << size << ", split " << split;
+        EXPECT_EQ(~crc32_slice_by_8, crc32) << "offset " << offset << ", size " << size;
+      }
+    }
+  }
+  hash_accel::SetEnabled(true);
+}
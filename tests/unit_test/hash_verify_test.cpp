@@ -0,0 +1,77 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <future>
+#include <thread>
+using namespace zoe;
+
+// The target file is hashed while downloading, the result must be as same as hashing the whole file.
+static void DoHashVerifyTest(const std::vector<TestData>& test_datas,
+                             int32_t thread_num,
+                             bool wrong_hash,
+                             int32_t hash_verify_thread_num = 1) {
+  Zoe::GlobalInit();
+
+  for (const auto& test_data : test_datas) {
+    if (test_data.md5.length() == 0)
+      continue;
+
+    Zoe efd;
+    efd.setThreadNum(thread_num);
+    efd.setHashVerifyThreadNum(hash_verify_thread_num);
+    efd.setHashVerifyPolicy(ALWAYS, MD5, wrong_hash ? u8"00000000000000000000000000000000" : test_data.md5);
+
+    Result ret = efd.start(test_data.url, test_data.target_file_path, nullptr, nullptr, nullptr).get();
+    printf("Result: %s\n", GetResultString(ret));
+    EXPECT_TRUE(ret == (wrong_hash ? HASH_VERIFY_NOT_PASS : SUCCESSED));
+  }
+
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+TEST(HashVerifyTest, Http_ThreadNum_1) {
+  DoHashVerifyTest(http_test_datas, 1, false);
+}
+
+TEST(HashVerifyTest, Http_ThreadNum_6) {
+  DoHashVerifyTest(http_test_datas, 6, false);
+}
+
+TEST(HashVerifyTest, Http_WrongHash) {
+  DoHashVerifyTest(http_test_datas, 4, true);
+}
+
+TEST(HashVerifyTest, Http_ParallelVerify) {
+  DoHashVerifyTest(http_test_datas, 4, false, 0);
+  DoHashVerifyTest(http_test_datas, 4, true, 4);
+}
+
+TEST(HashVerifyTest, HashVerifyThreadNum) {
+  Zoe efd;
+  EXPECT_EQ(efd.hashVerifyThreadNum(), 1);
+  EXPECT_EQ(efd.setHashVerifyThreadNum(0), SUCCESSED);
+  EXPECT_EQ(efd.hashVerifyThreadNum(), 0);
+  EXPECT_EQ(efd.setHashVerifyThreadNum(8), SUCCESSED);
+  EXPECT_EQ(efd.hashVerifyThreadNum(), 8);
+  EXPECT_EQ(efd.setHashVerifyThreadNum(-1), SUCCESSED);
+  EXPECT_EQ(efd.hashVerifyThreadNum(), 1);
+}
@@ -0,0 +1,80 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <future>
+#include <thread>
+using namespace zoe;
+
+// The slices completed by hedged requests are counted in hedge_num.
+TEST(HedgeTest, test1) {
+  if (http_test_datas.empty())
+    return;
+
+  Zoe::GlobalInit();
+  for (auto& test_data : http_test_datas) {
+    Zoe efd;
+
+    efd.setThreadNum(4);
+    efd.setSlicePolicy(FixedSize, 1024 * 1024 * 2);
+    efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+    EXPECT_TRUE(efd.setHedgeEnabled(true, 30) == SUCCESSED);
+    EXPECT_TRUE(efd.setSliceRetryDelay(100, 1000) == SUCCESSED);
+
+    bool hedge_enabled = false;
+    int32_t slow_percent = 0;
+    efd.hedge(hedge_enabled, slow_percent);
+    EXPECT_TRUE(hedge_enabled);
+    EXPECT_TRUE(slow_percent == 30);
+
+    int32_t base_delay = 0;
+    int32_t max_delay = 0;
+    efd.sliceRetryDelay(base_delay, max_delay);
+    EXPECT_TRUE(base_delay == 100);
+    EXPECT_TRUE(max_delay == 1000);
+
+    std::shared_future<Result> future_result = efd.start(
+        test_data.url, test_data.target_file_path,
+        [](Result result) {
+          printf("\nResult: %s\n", GetResultString(result));
+          EXPECT_TRUE(result == SUCCESSED);
+        },
+        nullptr, nullptr);
+
+    EXPECT_TRUE(future_result.get() == SUCCESSED);
+
+    const DownloadMetrics metrics = efd.metrics();
+    EXPECT_TRUE(metrics.hedge_won_num <= metrics.hedge_num);
+  }
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+// The percent out of range is switched to the default.
+TEST(HedgeTest, test2) {
+  Zoe efd;
+  EXPECT_TRUE(efd.setHedgeEnabled(false, 0) == SUCCESSED);
+
+  bool hedge_enabled = true;
+  int32_t slow_percent = 0;
+  efd.hedge(hedge_enabled, slow_percent);
+  EXPECT_FALSE(hedge_enabled);
+  EXPECT_TRUE(slow_percent == 20);
+}
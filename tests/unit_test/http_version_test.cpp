@@ -0,0 +1,71 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <future>
+#include <thread>
+using namespace zoe;
+
+// HTTP/2 is negotiated over TLS, plain http urls fall back to HTTP/1.1.
+static void DoHttpVersionTest(const std::vector<TestData>& test_datas,
+                              int32_t thread_num,
+                              HttpVersion version,
+                              int32_t max_host_connections) {
+  Zoe::GlobalInit();
+
+  for (const auto& test_data : test_datas) {
+    Zoe efd;
+    efd.setThreadNum(thread_num);
+    efd.setSlicePolicy(FixedSize, 1048576);
+    EXPECT_TRUE(efd.setHttpVersion(version, max_host_connections) == SUCCESSED);
+
+    HttpVersion v = HTTP_VERSION_AUTO;
+    int32_t connections = 0;
+    efd.httpVersion(v, connections);
+    EXPECT_TRUE(v == version);
+    EXPECT_TRUE(connections == max_host_connections);
+
+    if (test_data.md5.length() > 0)
+      efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+
+    std::shared_future<Result> r = efd.start(test_data.url, test_data.target_file_path, nullptr, nullptr, nullptr);
+    EXPECT_TRUE(efd.setHttpVersion(version, max_host_connections) == ALREADY_DOWNLOADING);
+
+    Result ret = r.get();
+    printf("Result: %s\n", GetResultString(ret));
+    EXPECT_TRUE(ret == SUCCESSED);
+  }
+
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+TEST(HttpVersionTest, Http_Version_1_1_ThreadNum_8) {
+  DoHttpVersionTest(http_test_datas, 8, HTTP_VERSION_1_1, 2);
+}
+
+TEST(HttpVersionTest, Http_Version_2_ThreadNum_8) {
+  DoHttpVersionTest(http_test_datas, 8, HTTP_VERSION_2, 1);
+}
+
+TEST(HttpVersionTest, Http_Version_3_ThreadNum_8) {
+  DoHttpVersionTest(http_test_datas, 8, HTTP_VERSION_3, 1);
+}
@@ -0,0 +1,83 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <future>
+#include <thread>
+using namespace zoe;
+
+// The memory is allocated by zoe, the hash is verified against the data in memory.
+TEST(MemoryTargetTest, test1) {
+  if (http_test_datas.empty())
+    return;
+
+  Zoe::GlobalInit();
+  for (auto& test_data : http_test_datas) {
+    Zoe efd;
+
+    efd.setThreadNum(3);
+    efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+    EXPECT_TRUE(efd.setMemoryTarget(true, nullptr, 0) == SUCCESSED);
+    EXPECT_TRUE(efd.memoryTargetEnabled());
+
+    std::shared_future<Result> future_result = efd.start(
+        test_data.url, u8"",
+        [](Result result) {
+          printf("\nResult: %s\n", GetResultString(result));
+          EXPECT_TRUE(result == SUCCESSED);
+        },
+        nullptr, nullptr);
+
+    EXPECT_TRUE(future_result.get() == SUCCESSED);
+
+    int64_t size = 0;
+    const void* data = efd.memoryData(size);
+    EXPECT_TRUE(data != nullptr);
+    EXPECT_TRUE(size == efd.originFileSize());
+  }
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+// The buffer owned by user must be large enough.
+TEST(MemoryTargetTest, test2) {
+  if (http_test_datas.empty())
+    return;
+
+  Zoe::GlobalInit();
+  for (auto& test_data : http_test_datas) {
+    Zoe efd;
+    std::vector<char> buffer(1024);
+
+    efd.setThreadNum(3);
+    EXPECT_TRUE(efd.setMemoryTarget(true, buffer.data(), (int64_t)buffer.size()) == SUCCESSED);
+
+    std::shared_future<Result> future_result = efd.start(test_data.url, u8"", nullptr, nullptr, nullptr);
+    EXPECT_TRUE(future_result.get() == TMP_FILE_SIZE_ERROR);
+
+    int64_t size = 0;
+    EXPECT_TRUE(efd.memoryData(size) == nullptr);
+    EXPECT_TRUE(size == 0);
+  }
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
@@ -0,0 +1,71 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <future>
+#include <thread>
+using namespace zoe;
+
+static void DoMetricsTest(const std::vector<TestData>& test_datas, int32_t thread_num) {
+  Zoe::GlobalInit();
+
+  for (const auto& test_data : test_datas) {
+    Zoe efd;
+    efd.setThreadNum(thread_num);
+    if (test_data.md5.length() > 0)
+      efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+
+    std::shared_future<Result> r = efd.start(test_data.url, test_data.target_file_path, nullptr, nullptr, nullptr);
+    Result ret = r.get();
+    printf("Result: %s\n", GetResultString(ret));
+    EXPECT_TRUE(ret == SUCCESSED);
+
+    const DownloadMetrics metrics = efd.metrics();
+    EXPECT_TRUE(metrics.fetch_file_info_time_ms >= 0);
+    EXPECT_TRUE(metrics.transfer_time_ms >= 0);
+    EXPECT_TRUE(metrics.disk_write_num > 0);
+    EXPECT_TRUE(metrics.disk_write_bytes > 0);
+    EXPECT_TRUE(!metrics.disk_write_latency.empty());
+    EXPECT_FALSE(metrics.slices.empty());
+
+    int64_t bucket_sum = 0;
+    for (const auto& n : metrics.disk_write_latency)
+      bucket_sum += n;
+    EXPECT_TRUE(bucket_sum == metrics.disk_write_num);
+
+    for (const auto& slice : metrics.slices) {
+      EXPECT_TRUE(slice.transfers >= 1);
+      EXPECT_TRUE(slice.downloaded >= 0);
+      EXPECT_TRUE(slice.first_byte_time_us >= slice.connect_time_us);
+    }
+  }
+
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+TEST(MetricsTest, Http_ThreadNum_1) {
+  DoMetricsTest(http_test_datas, 1);
+}
+
+TEST(MetricsTest, Http_ThreadNum_6) {
+  DoMetricsTest(http_test_datas, 6);
+}
@@ -0,0 +1,64 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <future>
+#include <thread>
+using namespace zoe;
+
+// The url itself serves as a mirror, the unavailable mirrors are skipped.
+static void DoMirrorTest(const std::vector<TestData>& test_datas, int32_t thread_num) {
+  Zoe::GlobalInit();
+
+  for (const auto& test_data : test_datas) {
+    Zoe efd;
+    efd.setThreadNum(thread_num);
+    efd.setSlicePolicy(FixedSize, 1048576);
+
+    std::vector<utf8string> mirrors;
+    mirrors.push_back(test_data.url);
+    mirrors.push_back(test_data.url + u8".not_exist");
+    mirrors.push_back(u8"http://127.0.0.1:1/not_exist");
+    EXPECT_TRUE(efd.setMirrorUrls(mirrors) == SUCCESSED);
+    EXPECT_TRUE(efd.mirrorUrls() == mirrors);
+
+    if (test_data.md5.length() > 0)
+      efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+
+    std::shared_future<Result> r = efd.start(test_data.url, test_data.target_file_path, nullptr, nullptr, nullptr);
+    EXPECT_TRUE(efd.setMirrorUrls(mirrors) == ALREADY_DOWNLOADING);
+
+    Result ret = r.get();
+    printf("Result: %s\n", GetResultString(ret));
+    EXPECT_TRUE(ret == SUCCESSED);
+  }
+
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+TEST(MirrorTest, Http_ThreadNum_4) {
+  DoMirrorTest(http_test_datas, 4);
+}
+
+TEST(MirrorTest, Http_ThreadNum_8) {
+  DoMirrorTest(http_test_datas, 8);
+}
@@ -0,0 +1,57 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <thread>
+using namespace zoe;
+
+static void DoMultiAddressTest(const std::vector<TestData>& test_datas, int32_t max_address_num) {
+  Zoe::GlobalInit();
+  for (auto& test_data : test_datas) {
+    Zoe efd;
+
+    efd.setThreadNum(8);
+    EXPECT_TRUE(efd.setMaxAddressNum(max_address_num) == SUCCESSED);
+    EXPECT_TRUE(efd.maxAddressNum() == max_address_num);
+    if (test_data.md5.length() > 0)
+      efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+
+    Result ret = efd.start(test_data.url, test_data.target_file_path, nullptr, nullptr, nullptr).get();
+    printf("Result: %s\n", GetResultString(ret));
+    EXPECT_TRUE(ret == SUCCESSED);
+  }
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+TEST(MultiAddressTest, test1) {
+  if (http_test_datas.empty())
+    return;
+  DoMultiAddressTest(http_test_datas, 4);
+}
+
+TEST(MultiAddressTest, test2) {
+  Zoe efd;
+  EXPECT_TRUE(efd.maxAddressNum() == 0);
+  EXPECT_TRUE(efd.setMaxAddressNum(-3) == SUCCESSED);
+  EXPECT_TRUE(efd.maxAddressNum() == 0);
+  EXPECT_TRUE(efd.setMaxAddressNum(2) == SUCCESSED);
+  EXPECT_TRUE(efd.maxAddressNum() == 2);
+}
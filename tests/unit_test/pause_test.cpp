@@ -0,0 +1,74 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <future>
+#include <thread>
+using namespace zoe;
+
+static void DoPauseTest(const std::vector<TestData>& test_datas, int32_t keep_alive_time) {
+  Zoe::GlobalInit();
+  for (auto& test_data : test_datas) {
+    Zoe efd;
+
+    efd.setThreadNum(4);
+    efd.setMaxDownloadSpeed(1024 * 1024);
+    EXPECT_TRUE(efd.setPauseKeepAliveTime(keep_alive_time) == SUCCESSED);
+    EXPECT_TRUE(efd.pauseKeepAliveTime() == keep_alive_time);
+    if (test_data.md5.length() > 0)
+      efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+
+    std::shared_future<Result> future_result =
+        efd.start(test_data.url, test_data.target_file_path, nullptr, nullptr, nullptr);
+
+    // The data received before paused is kept, even if the connections are released.
+    for (int i = 0; i < 3; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+      efd.pause();
+      std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+      efd.resume();
+    }
+
+    Result ret = future_result.get();
+    printf("Result: %s\n", GetResultString(ret));
+    EXPECT_TRUE(ret == SUCCESSED);
+  }
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+// The connections are kept while paused.
+TEST(PauseTest, test1) {
+  if (http_test_datas.empty())
+    return;
+  DoPauseTest(http_test_datas, -1);
+}
+
+// The connections are released as soon as paused.
+TEST(PauseTest, test2) {
+  if (http_test_datas.empty())
+    return;
+  DoPauseTest(http_test_datas, 0);
+}
+
+TEST(PauseTest, test3) {
+  Zoe efd;
+  EXPECT_TRUE(efd.pauseKeepAliveTime() == 30000);
+}
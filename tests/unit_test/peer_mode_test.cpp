@@ -0,0 +1,129 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <stdio.h>
+#include <thread>
+#include <vector>
+using namespace zoe;
+
+// No peer shares the files, so the whole file is downloaded from the server while sharing it.
+static void DoPeerModeTest(const std::vector<TestData>& test_datas) {
+  Zoe::GlobalInit();
+  for (auto& test_data : test_datas) {
+    Zoe efd;
+
+    efd.setThreadNum(4);
+    EXPECT_TRUE(efd.setPeerMode(18888, {"127.0.0.1:18889"}) == SUCCESSED);
+    if (test_data.md5.length() > 0)
+      efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+
+    Result ret = efd.start(test_data.url, test_data.target_file_path, nullptr, nullptr, nullptr).get();
+    printf("Result: %s\n", GetResultString(ret));
+    EXPECT_TRUE(ret == SUCCESSED);
+    EXPECT_TRUE(efd.metrics().peer_received_bytes == 0);
+  }
+  Zoe::StopPeerSharing();
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+// The files downloaded by one Zoe are shared on a port, the other one fetches them from that peer.
+// Then the shared file is corrupted, the mismatched data is downloaded again from the server.
+static void DoPeerFetchTest(const std::vector<TestData>& test_datas) {
+  Zoe::GlobalInit();
+  for (auto& test_data : test_datas) {
+    const utf8string peer_file_path = test_data.target_file_path + ".peer";
+    {
+      Zoe efd;
+
+      efd.setThreadNum(4);
+      EXPECT_TRUE(efd.setPeerMode(18890, {}) == SUCCESSED);
+      Result ret = efd.start(test_data.url, test_data.target_file_path, nullptr, nullptr, nullptr).get();
+      printf("Result: %s\n", GetResultString(ret));
+      EXPECT_TRUE(ret == SUCCESSED);
+    }
+
+    for (int round = 0; round < 2; round++) {
+      if (round == 1) {
+        FILE* f = fopen(test_data.target_file_path.c_str(), "r+b");
+        EXPECT_TRUE(f != nullptr);
+        if (f) {
+          fwrite("corrupted", 1, 9, f);
+          fclose(f);
+        }
+      }
+
+      Zoe efd;
+
+      efd.setThreadNum(4);
+      EXPECT_TRUE(efd.setPeerMode(0, {"127.0.0.1:18890"}) == SUCCESSED);
+      if (test_data.md5.length() > 0)
+        efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+
+      remove(peer_file_path.c_str());
+      Result ret = efd.start(test_data.url, peer_file_path, nullptr, nullptr, nullptr).get();
+      printf("Result: %s, received from peer: %lld\n", GetResultString(ret),
+             (long long)efd.metrics().peer_received_bytes);
+      EXPECT_TRUE(ret == SUCCESSED);
+      if (round == 0) {
+        EXPECT_TRUE(efd.metrics().peer_received_bytes > 0);
+      }
+    }
+    remove(peer_file_path.c_str());
+  }
+  Zoe::StopPeerSharing();
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+TEST(PeerModeTest, test1) {
+  if (http_test_datas.empty())
+    return;
+  DoPeerModeTest(http_test_datas);
+}
+
+TEST(PeerModeTest, test2) {
+  Zoe efd;
+  int32_t listen_port = -1;
+  std::vector<utf8string> peers;
+  efd.peerMode(listen_port, peers);
+  EXPECT_TRUE(listen_port == 0 && peers.empty());
+  EXPECT_FALSE(efd.chunkHashEnabled());
+
+  EXPECT_TRUE(efd.setPeerMode(18888, {"192.168.1.2:18888", "http://192.168.1.3:18888"}) == SUCCESSED);
+  efd.peerMode(listen_port, peers);
+  EXPECT_TRUE(listen_port == 18888);
+  EXPECT_TRUE(peers.size() == 2);
+  EXPECT_TRUE(efd.chunkHashEnabled());
+
+  // Invalid port is not listened.
+  EXPECT_TRUE(efd.setPeerMode(70000, {}) == SUCCESSED);
+  efd.peerMode(listen_port, peers);
+  EXPECT_TRUE(listen_port == 0 && peers.empty());
+}
+
+TEST(PeerModeTest, test3) {
+  if (http_test_datas.empty())
+    return;
+  DoPeerFetchTest(http_test_datas);
+}
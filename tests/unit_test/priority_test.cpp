@@ -0,0 +1,104 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <future>
+#include <thread>
+#include <atomic>
+#include <chrono>
+using namespace zoe;
+
+// A download of high priority preempts the one of low priority on the same engine.
+// With only one transfer slot, the low one makes no progress while the high one transfers, and completes later.
+TEST(PriorityTest, test1) {
+  if (http_test_datas.empty())
+    return;
+
+  Zoe::GlobalInit();
+  {
+    Engine engine(1, 2);
+    engine.setMaxConcurrentTransfers(1);
+    Zoe efd1;
+    Zoe efd2;
+
+    efd1.setEngine(&engine);
+    efd1.setThreadNum(3);
+    efd1.setPriority(PRIORITY_LOW, 1);
+    efd1.setHashVerifyPolicy(ALWAYS, MD5, http_test_datas[0].md5);
+    efd2.setEngine(&engine);
+    efd2.setThreadNum(3);
+    efd2.setPriority(PRIORITY_HIGH, 1);
+    efd2.setHashVerifyPolicy(ALWAYS, MD5, http_test_datas[0].md5);
+
+    TaskPriority priority = PRIORITY_NORMAL;
+    int32_t weight = 0;
+    efd1.priority(priority, weight);
+    EXPECT_TRUE(priority == PRIORITY_LOW);
+    EXPECT_TRUE(weight == 1);
+
+    std::atomic<int64_t> low_downloaded(0L);
+    std::atomic<int64_t> low_completed_ms(0L);
+    std::atomic<int64_t> high_completed_ms(0L);
+    const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+    auto elapsed_ms = [start_time]() {
+      return (int64_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time)
+          .count();
+    };
+
+    std::shared_future<Result> future_result1 = efd1.start(
+        http_test_datas[0].url, http_test_datas[0].target_file_path,
+        [&low_completed_ms, elapsed_ms](Result result) {
+          low_completed_ms = elapsed_ms();
+          printf("\nResult: %s\n", GetResultString(result));
+          EXPECT_TRUE(result == SUCCESSED);
+        },
+        [&low_downloaded](int64_t /*total*/, int64_t downloaded) { low_downloaded = downloaded; },
+        [](int64_t byte_per_sec) { printf("low: %.3f kb/s\n", (float)byte_per_sec / 1024.f); });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+
+    std::shared_future<Result> future_result2 = efd2.start(
+        http_test_datas[0].url, http_test_datas[0].target_file_path + u8".2",
+        [&high_completed_ms, elapsed_ms](Result result) {
+          high_completed_ms = elapsed_ms();
+          printf("\nResult: %s\n", GetResultString(result));
+          EXPECT_TRUE(result == SUCCESSED);
+        },
+        nullptr, [](int64_t byte_per_sec) { printf("high: %.3f kb/s\n", (float)byte_per_sec / 1024.f); });
+
+    EXPECT_TRUE(efd1.setPriority(PRIORITY_HIGH, 1) == ALREADY_DOWNLOADING);
+
+    // The data in flight when the low one is paused is received within the first second.
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    const int64_t low_paused_downloaded = low_downloaded.load();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    if (future_result2.wait_for(std::chrono::milliseconds(0)) != std::future_status::ready) {
+      EXPECT_EQ(low_downloaded.load(), low_paused_downloaded);
+    }
+
+    future_result2.wait();
+    future_result1.wait();
+    EXPECT_TRUE(future_result1.get() == SUCCESSED);
+    EXPECT_TRUE(future_result2.get() == SUCCESSED);
+    EXPECT_TRUE(high_completed_ms.load() <= low_completed_ms.load());
+  }
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
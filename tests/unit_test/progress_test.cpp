@@ -0,0 +1,72 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <future>
+#include <thread>
+using namespace zoe;
+
+// The progress and speed are reported on the thread that performs the transfers at the intervals set.
+static void DoProgressTest(const std::vector<TestData>& test_datas,
+                           int32_t thread_num,
+                           int32_t progress_interval_ms,
+                           int32_t speed_interval_ms) {
+  Zoe::GlobalInit();
+
+  for (const auto& test_data : test_datas) {
+    Zoe efd;
+    efd.setThreadNum(thread_num);
+    EXPECT_TRUE(efd.setProgressInterval(progress_interval_ms, speed_interval_ms) == SUCCESSED);
+    if (test_data.md5.length() > 0)
+      efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+
+    int64_t last_downloaded = -1;
+    bool progress_backward = false;
+    Result ret = efd.start(
+                        test_data.url, test_data.target_file_path, nullptr,
+                        [&](int64_t total, int64_t downloaded) {
+                          if (total > 0) {
+                            EXPECT_TRUE(downloaded <= total);
+                          }
+                          if (downloaded < last_downloaded)
+                            progress_backward = true;
+                          last_downloaded = downloaded;
+                        },
+                        [](int64_t byte_per_sec) { EXPECT_TRUE(byte_per_sec >= 0); })
+                     .get();
+    printf("Result: %s\n", GetResultString(ret));
+    EXPECT_TRUE(ret == SUCCESSED);
+    EXPECT_FALSE(progress_backward);
+    EXPECT_TRUE(efd.progressInterval() == progress_interval_ms);
+    EXPECT_TRUE(efd.speedInterval() == speed_interval_ms);
+  }
+
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+TEST(ProgressTest, Http_ThreadNum_1_Interval_100) {
+  DoProgressTest(http_test_datas, 1, 100, 200);
+}
+
+TEST(ProgressTest, Http_ThreadNum_6_Interval_100) {
+  DoProgressTest(http_test_datas, 6, 100, 200);
+}
@@ -0,0 +1,74 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <future>
+#include <thread>
+using namespace zoe;
+
+// The slices split while downloading are left with holes when stopped, they are merged when resuming.
+static void DoSliceCoalesceTest(const std::vector<TestData>& test_datas, int64_t gap) {
+  Zoe::GlobalInit();
+  for (auto& test_data : test_datas) {
+    for (int i = 0; i < 4; i++) {
+      Zoe efd;
+
+      efd.setThreadNum(8);
+      efd.setMaxDownloadSpeed(i < 3 ? 2 * 1024 * 1024 : -1);
+      efd.setUncompletedSliceSavePolicy(SAVE_EXCEPT_FAILED);
+      EXPECT_TRUE(efd.setSliceCoalesceGap(gap) == SUCCESSED);
+      EXPECT_TRUE(efd.sliceCoalesceGap() == gap);
+      if (test_data.md5.length() > 0)
+        efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+
+      std::shared_future<Result> future_result =
+          efd.start(test_data.url, test_data.target_file_path, nullptr, nullptr, nullptr);
+      if (i < 3) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+        efd.stop();
+      }
+
+      Result ret = future_result.get();
+      printf("Result: %s\n", GetResultString(ret));
+      EXPECT_TRUE(ret == SUCCESSED || (i < 3 && ret == CANCELED));
+    }
+  }
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+TEST(SliceCoalesceTest, test1) {
+  if (http_test_datas.empty())
+    return;
+  DoSliceCoalesceTest(http_test_datas, 1024 * 1024);
+}
+
+TEST(SliceCoalesceTest, test2) {
+  if (http_test_datas.empty())
+    return;
+  DoSliceCoalesceTest(http_test_datas, -1);
+}
+
+TEST(SliceCoalesceTest, test3) {
+  Zoe efd;
+  EXPECT_TRUE(efd.sliceCoalesceGap() == 131072);
+  EXPECT_TRUE(efd.setSliceCoalesceGap(-100) == SUCCESSED);
+  EXPECT_TRUE(efd.sliceCoalesceGap() == -1);
+}
@@ -0,0 +1,79 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <future>
+#include <thread>
+using namespace zoe;
+
+// Query the statistics on another thread while downloading.
+static void DoStatsTest(const std::vector<TestData>& test_datas, int32_t thread_num) {
+  Zoe::GlobalInit();
+
+  for (const auto& test_data : test_datas) {
+    Zoe efd;
+    efd.setThreadNum(thread_num);
+    efd.setProgressInterval(100, 200);
+    if (test_data.md5.length() > 0)
+      efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+
+    std::shared_future<Result> r = efd.start(test_data.url, test_data.target_file_path, nullptr, nullptr, nullptr);
+
+    int64_t last_downloaded = 0;
+    while (r.wait_for(std::chrono::milliseconds(200)) != std::future_status::ready) {
+      const DownloadStats stats = efd.stats();
+      EXPECT_TRUE(stats.downloaded >= last_downloaded);
+      EXPECT_TRUE(stats.speed >= 0 && stats.instant_speed >= 0);
+      EXPECT_TRUE(stats.active_slice_num <= thread_num);
+      if (stats.total > 0) {
+        EXPECT_TRUE(stats.downloaded <= stats.total);
+      }
+
+      int32_t downloading_num = 0;
+      for (const auto& slice : stats.slices) {
+        EXPECT_TRUE(slice.speed >= 0);
+        if (slice.downloading) {
+          downloading_num++;
+        }
+        else {
+          EXPECT_TRUE(slice.speed == 0);
+        }
+      }
+      EXPECT_TRUE(downloading_num == stats.active_slice_num);
+      last_downloaded = stats.downloaded;
+    }
+
+    Result ret = r.get();
+    printf("Result: %s\n", GetResultString(ret));
+    EXPECT_TRUE(ret == SUCCESSED);
+  }
+
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+TEST(StatsTest, Http_ThreadNum_1) {
+  DoStatsTest(http_test_datas, 1);
+}
+
+TEST(StatsTest, Http_ThreadNum_6) {
+  DoStatsTest(http_test_datas, 6);
+}
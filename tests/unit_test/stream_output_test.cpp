@@ -0,0 +1,63 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+#include <future>
+#include <thread>
+using namespace zoe;
+
+// The data is delivered in order while downloading, all of it before the result.
+TEST(StreamOutputTest, test1) {
+  if (http_test_datas.empty())
+    return;
+
+  Zoe::GlobalInit();
+  for (auto& test_data : http_test_datas) {
+    Zoe efd;
+    int64_t streamed = 0;
+
+    efd.setThreadNum(3);
+    efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+    EXPECT_TRUE(efd.setStreamOutput([&streamed](const void* data, int64_t size) {
+      EXPECT_TRUE(data != nullptr);
+      EXPECT_TRUE(size > 0);
+      streamed += size;
+    }, 1024 * 1024 * 8) == SUCCESSED);
+
+    StreamFunctor stream_functor;
+    int64_t read_ahead_size = 0;
+    efd.streamOutput(stream_functor, read_ahead_size);
+    EXPECT_TRUE(!!stream_functor);
+    EXPECT_TRUE(read_ahead_size == 1024 * 1024 * 8);
+
+    std::shared_future<Result> future_result = efd.start(
+        test_data.url, test_data.target_file_path,
+        [](Result result) {
+          printf("\nResult: %s\n", GetResultString(result));
+          EXPECT_TRUE(result == SUCCESSED);
+        },
+        nullptr, nullptr);
+
+    EXPECT_TRUE(future_result.get() == SUCCESSED);
+    EXPECT_TRUE(streamed == efd.originFileSize());
+  }
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
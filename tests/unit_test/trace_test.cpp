@@ -0,0 +1,85 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "zoe/zoe.h"
+#include "test_data.h"
+using namespace zoe;
+
+static std::string ReadTextFile(const char* path) {
+  std::string text;
+  FILE* f = fopen(path, "rb");
+  if (!f)
+    return text;
+  char buf[4096];
+  size_t n = 0;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    text.append(buf, n);
+  fclose(f);
+  return text;
+}
+
+static void DoTraceTest(const std::vector<TestData>& test_datas) {
+  const char* trace_path = "trace_test.json";
+  Zoe::GlobalInit();
+  Zoe::StartTracing();
+  for (auto& test_data : test_datas) {
+    Zoe efd;
+
+    efd.setThreadNum(4);
+    if (test_data.md5.length() > 0)
+      efd.setHashVerifyPolicy(ALWAYS, MD5, test_data.md5);
+
+    Result ret = efd.start(test_data.url, test_data.target_file_path, nullptr, nullptr, nullptr).get();
+    printf("Result: %s\n", GetResultString(ret));
+    EXPECT_TRUE(ret == SUCCESSED);
+  }
+  Zoe::StopTracing();
+
+  EXPECT_TRUE(Zoe::ExportTrace(trace_path) == SUCCESSED);
+  const std::string trace = ReadTextFile(trace_path);
+  EXPECT_TRUE(trace.find("\"Slice<") != std::string::npos);
+  EXPECT_TRUE(trace.find("\"FirstByte\"") != std::string::npos);
+  EXPECT_TRUE(trace.find("\"Perform\"") != std::string::npos);
+  remove(trace_path);
+  Zoe::GlobalUnInit();
+
+  // set test case interval
+  std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+}
+
+TEST(TraceTest, test1) {
+  if (http_test_datas.empty())
+    return;
+  DoTraceTest(http_test_datas);
+}
+
+TEST(TraceTest, test2) {
+  const char* trace_path = "trace_test.json";
+
+  // Nothing is recorded without any download, the events before starting are dropped.
+  Zoe::StartTracing(16);
+  Zoe::StopTracing();
+  EXPECT_TRUE(Zoe::ExportTrace(trace_path) == SUCCESSED);
+  EXPECT_TRUE(ReadTextFile(trace_path) == "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[]}\n");
+  remove(trace_path);
+
+  EXPECT_TRUE(Zoe::ExportTrace("trace_test_not_exist/trace.json") == CREATE_TARGET_FILE_FAILED);
+}
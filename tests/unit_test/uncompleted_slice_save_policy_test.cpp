@@ -19,6 +19,7 @@
 #include "zoe/zoe.h"
 #include "test_data.h"
 #include <future>
+#include <thread>
 using namespace zoe;
 
 void DoTest(const std::vector<TestData>& test_datas,
@@ -0,0 +1,436 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "bench_server.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <algorithm>
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <psapi.h>
+#define CloseBenchSocket closesocket
+#define INVALID_BENCH_SOCKET INVALID_SOCKET
+#define SHUTDOWN_BOTH SD_BOTH
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <time.h>
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+#define CloseBenchSocket close
+#define INVALID_BENCH_SOCKET (-1)
+#define SHUTDOWN_BOTH SHUT_RDWR
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace zoe {
+#define BENCH_SEND_BLOCK_SIZE 65536
+#define BENCH_MAX_REQUEST_HEADER_SIZE 16384
+
+static uint64_t SplitMix64(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+static std::string ToLower(std::string s) {
+  std::transform(s.begin(), s.end(), s.begin(), [](char c) { return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c; });
+  return s;
+}
+
+BenchServer::BenchServer(const BenchServerOptions& options)
+    : options_(options)
+    , listen_socket_(INVALID_BENCH_SOCKET)
+    , port_(0) {
+  stopping_.store(false);
+  cpu_time_us_.store(0L);
+  served_bytes_.store(0L);
+  request_num_.store(0L);
+  range_request_num_.store(0L);
+  injected_error_num_.store(0L);
+  injected_slow_num_.store(0L);
+}
+
+BenchServer::~BenchServer() {
+  stop();
+}
+
+bool BenchServer::start() {
+  listen_socket_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (listen_socket_ == INVALID_BENCH_SOCKET)
+    return false;
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+
+  socklen_t addr_len = sizeof(addr);
+  if (bind(listen_socket_, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+      listen(listen_socket_, 128) != 0 ||
+      getsockname(listen_socket_, (sockaddr*)&addr, &addr_len) != 0) {
+    CloseBenchSocket(listen_socket_);
+    listen_socket_ = INVALID_BENCH_SOCKET;
+    return false;
+  }
+
+  port_ = ntohs(addr.sin_port);
+  stopping_.store(false);
+  accept_thread_ = std::thread(&BenchServer::acceptProcess, this);
+  return true;
+}
+
+void BenchServer::stop() {
+  if (listen_socket_ == INVALID_BENCH_SOCKET)
+    return;
+
+  stopping_.store(true);
+  shutdown(listen_socket_, SHUTDOWN_BOTH);
+  CloseBenchSocket(listen_socket_);
+  listen_socket_ = INVALID_BENCH_SOCKET;
+  if (accept_thread_.joinable())
+    accept_thread_.join();
+
+  std::vector<std::thread> threads;
+  {
+    std::lock_guard<std::mutex> lg(connections_mutex_);
+    for (auto s : connections_)
+      shutdown(s, SHUTDOWN_BOTH);
+    threads.swap(connection_threads_);
+  }
+
+  for (auto& t : threads) {
+    if (t.joinable())
+      t.join();
+  }
+}
+
+int BenchServer::port() const {
+  return port_;
+}
+
+std::string BenchServer::url() const {
+  char buf[64] = {0};
+  snprintf(buf, sizeof(buf), "http://127.0.0.1:%d/bench.bin", port_);
+  return buf;
+}
+
+int64_t BenchServer::cpuTimeUs() const {
+  return cpu_time_us_.load();
+}
+
+int64_t BenchServer::servedBytes() const {
+  return served_bytes_.load();
+}
+
+int64_t BenchServer::requestNum() const {
+  return request_num_.load();
+}
+
+int64_t BenchServer::injectedErrorNum() const {
+  return injected_error_num_.load();
+}
+
+int64_t BenchServer::injectedSlowNum() const {
+  return injected_slow_num_.load();
+}
+
+void BenchServer::Fill(int64_t pos, char* buf, size_t size) {
+  // every 8 bytes word is the hash of its index, so misplaced data can be found.
+  size_t i = 0;
+  while (i < size) {
+    const int64_t p = pos + (int64_t)i;
+    const uint64_t word = SplitMix64((uint64_t)(p >> 3));
+    int shift = (int)(p & 7);
+    while (shift < 8 && i < size) {
+      buf[i++] = (char)((word >> (shift * 8)) & 0xFF);
+      shift++;
+    }
+  }
+}
+
+void BenchServer::acceptProcess() {
+  while (!stopping_.load()) {
+    BenchSocket s = accept(listen_socket_, nullptr, nullptr);
+    if (s == INVALID_BENCH_SOCKET) {
+      if (stopping_.load())
+        break;
+      continue;
+    }
+
+    int nodelay = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&nodelay, sizeof(nodelay));
+
+    std::lock_guard<std::mutex> lg(connections_mutex_);
+    connections_.insert(s);
+    connection_threads_.emplace_back(&BenchServer::connectionProcess, this, s);
+  }
+}
+
+void BenchServer::connectionProcess(BenchSocket s) {
+  std::string buffer;
+  char recv_buf[4096];
+  while (!stopping_.load()) {
+    const size_t header_end = buffer.find("\r\n\r\n");
+    if (header_end == std::string::npos) {
+      if (buffer.size() > BENCH_MAX_REQUEST_HEADER_SIZE)
+        break;
+      const int n = (int)recv(s, recv_buf, sizeof(recv_buf), 0);
+      if (n <= 0)
+        break;
+      buffer.append(recv_buf, n);
+      continue;
+    }
+
+    const std::string request = buffer.substr(0, header_end + 4);
+    buffer.erase(0, header_end + 4);
+
+    const int64_t cpu_begin = ThreadCpuTimeUs();
+    const bool keep_alive = handleRequest(s, request);
+    cpu_time_us_ += ThreadCpuTimeUs() - cpu_begin;
+    if (!keep_alive)
+      break;
+  }
+
+  {
+    std::lock_guard<std::mutex> lg(connections_mutex_);
+    connections_.erase(s);
+  }
+  CloseBenchSocket(s);
+}
+
+bool BenchServer::handleRequest(BenchSocket s, const std::string& request) {
+  request_num_++;
+
+  const std::string lower = ToLower(request);
+  const bool is_head = lower.compare(0, 5, "head ") == 0;
+  const bool close_conn = lower.find("\r\nconnection: close") != std::string::npos;
+  const int64_t file_size = options_.file_size;
+
+  int64_t begin = 0L;
+  int64_t end = file_size - 1;
+  bool is_range = false;
+  const size_t range_pos = lower.find("\r\nrange: bytes=");
+  if (options_.accept_ranges && range_pos != std::string::npos) {
+    const char* p = lower.c_str() + range_pos + strlen("\r\nrange: bytes=");
+    char* next = nullptr;
+    begin = strtoll(p, &next, 10);
+    if (next && *next == '-') {
+      is_range = true;
+      if (next[1] >= '0' && next[1] <= '9')
+        end = std::min((int64_t)strtoll(next + 1, nullptr, 10), file_size - 1);
+    }
+  }
+
+  if (options_.latency_ms > 0)
+    std::this_thread::sleep_for(std::chrono::milliseconds(options_.latency_ms));
+
+  // The ETag only changes with file size, as the content is generated from position.
+  char etag[64] = {0};
+  snprintf(etag, sizeof(etag), "\"zoe-bench-%lld\"", (long long)file_size);
+  const size_t if_none_match_pos = lower.find("\r\nif-none-match: ");
+  if (if_none_match_pos != std::string::npos &&
+      lower.compare(if_none_match_pos + strlen("\r\nif-none-match: "), strlen(etag), etag) == 0) {
+    char header[256] = {0};
+    snprintf(header, sizeof(header), "HTTP/1.1 304 Not Modified\r\nETag: %s\r\n\r\n", etag);
+    return sendAll(s, header, strlen(header)) && !close_conn;
+  }
+
+  if (is_range && (begin < 0 || begin >= file_size || end < begin)) {
+    char header[256] = {0};
+    snprintf(header, sizeof(header),
+             "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%lld\r\nContent-Length: 0\r\n\r\n",
+             (long long)file_size);
+    return sendAll(s, header, strlen(header)) && !close_conn;
+  }
+
+  // Only the transfers of slices are failed, fetching file info always succeeds.
+  bool truncated = false;
+  if (is_range && !is_head && injectError()) {
+    if (range_request_num_.load() & 1)
+      return false;  // close the connection without response
+    truncated = true;
+  }
+  const int64_t rate_limit = (is_range && !is_head && injectSlow()) ? options_.slow_rate_limit : options_.rate_limit;
+
+  const int64_t content_length = end - begin + 1;
+  char header[512] = {0};
+  if (is_range) {
+    snprintf(header, sizeof(header),
+             "HTTP/1.1 206 Partial Content\r\nContent-Type: application/octet-stream\r\n"
+             "Content-Range: bytes %lld-%lld/%lld\r\nContent-Length: %lld\r\nAccept-Ranges: bytes\r\nETag: %s\r\n\r\n",
+             (long long)begin, (long long)end, (long long)file_size, (long long)content_length, etag);
+  }
+  else {
+    snprintf(header, sizeof(header),
+             "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: %lld\r\nETag: %s\r\n%s\r\n",
+             (long long)file_size, etag, options_.accept_ranges ? "Accept-Ranges: bytes\r\n" : "");
+  }
+
+  if (!sendAll(s, header, strlen(header)))
+    return false;
+
+  if (is_head)
+    return !close_conn;
+
+  if (truncated) {
+    sendBody(s, begin, content_length / 2, rate_limit);
+    return false;
+  }
+
+  return sendBody(s, begin, content_length, rate_limit) && !close_conn;
+}
+
+bool BenchServer::sendAll(BenchSocket s, const char* data, size_t size) {
+  while (size > 0) {
+    const int n = (int)send(s, data, (int)std::min(size, (size_t)BENCH_SEND_BLOCK_SIZE), MSG_NOSIGNAL);
+    if (n <= 0)
+      return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool BenchServer::sendBody(BenchSocket s, int64_t begin, int64_t size, int64_t rate_limit) {
+  std::vector<char> block(BENCH_SEND_BLOCK_SIZE);
+  const auto start_time = std::chrono::steady_clock::now();
+  int64_t sent = 0L;
+  while (sent < size) {
+    if (stopping_.load())
+      return false;
+
+    const size_t n = (size_t)std::min((int64_t)block.size(), size - sent);
+    Fill(begin + sent, block.data(), n);
+    if (!sendAll(s, block.data(), n))
+      return false;
+    sent += n;
+    served_bytes_ += n;
+
+    if (rate_limit > 0) {
+      const auto due = start_time + std::chrono::microseconds(sent * 1000000 / rate_limit);
+      const auto now = std::chrono::steady_clock::now();
+      if (due > now)
+        std::this_thread::sleep_for(due - now);
+    }
+  }
+  return true;
+}
+
+bool BenchServer::injectError() {
+  const int64_t n = range_request_num_++;
+  if (options_.error_per_mille <= 0)
+    return false;
+  if ((int64_t)(SplitMix64((uint64_t)n) % 1000) >= options_.error_per_mille)
+    return false;
+  injected_error_num_++;
+  return true;
+}
+
+bool BenchServer::injectSlow() {
+  // Called after injectError of the same request, the request number is salted to be independent of errors.
+  const int64_t n = range_request_num_.load();
+  if (options_.slow_per_mille <= 0 || options_.slow_rate_limit <= 0)
+    return false;
+  if ((int64_t)(SplitMix64((uint64_t)n ^ 0x5851F42D4C957F2DULL) % 1000) >= options_.slow_per_mille)
+    return false;
+  injected_slow_num_++;
+  return true;
+}
+
+int64_t ThreadCpuTimeUs() {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  FILETIME creation_time, exit_time, kernel_time, user_time;
+  if (!GetThreadTimes(GetCurrentThread(), &creation_time, &exit_time, &kernel_time, &user_time))
+    return 0L;
+  ULARGE_INTEGER k, u;
+  k.LowPart = kernel_time.dwLowDateTime;
+  k.HighPart = kernel_time.dwHighDateTime;
+  u.LowPart = user_time.dwLowDateTime;
+  u.HighPart = user_time.dwHighDateTime;
+  return (int64_t)((k.QuadPart + u.QuadPart) / 10);
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+  timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+    return 0L;
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+  return 0L;
+#endif
+}
+
+int64_t ProcessCpuTimeUs() {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  FILETIME creation_time, exit_time, kernel_time, user_time;
+  if (!GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time))
+    return 0L;
+  ULARGE_INTEGER k, u;
+  k.LowPart = kernel_time.dwLowDateTime;
+  k.HighPart = kernel_time.dwHighDateTime;
+  u.LowPart = user_time.dwLowDateTime;
+  u.HighPart = user_time.dwHighDateTime;
+  return (int64_t)((k.QuadPart + u.QuadPart) / 10);
+#else
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0L;
+  return (int64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+         usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#endif
+}
+
+int64_t ProcessMemoryBytes() {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  PROCESS_MEMORY_COUNTERS pmc;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+    return 0L;
+  return (int64_t)pmc.WorkingSetSize;
+#elif defined(__APPLE__)
+  mach_task_basic_info info;
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+    return 0L;
+  return (int64_t)info.resident_size;
+#elif defined(__linux__)
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (!f)
+    return 0L;
+  long long pages = 0, resident = 0;
+  const int n = fscanf(f, "%lld %lld", &pages, &resident);
+  fclose(f);
+  if (n != 2)
+    return 0L;
+  return (int64_t)resident * sysconf(_SC_PAGESIZE);
+#else
+  return 0L;
+#endif
+}
+}  // namespace zoe
@@ -0,0 +1,122 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifndef ZOE_BENCH_SERVER_H_
+#define ZOE_BENCH_SERVER_H_
+#pragma once
+
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#include <winsock2.h>
+typedef SOCKET BenchSocket;
+#else
+typedef int BenchSocket;
+#endif
+
+namespace zoe {
+
+typedef struct _BenchServerOptions {
+  int64_t file_size;       // size of the synthetic file served
+  int32_t latency_ms;      // delay before sending every response
+  int64_t rate_limit;      // bytes per second of each connection, 0 or negative means unlimited
+  int32_t error_per_mille; // how many requests in 1000 requests with Range header are failed
+  bool accept_ranges;      // if false, Range header is ignored and the whole file is returned
+  int32_t slow_per_mille;  // how many requests in 1000 requests with Range header are sent at slow_rate_limit
+  int64_t slow_rate_limit; // bytes per second of the slow responses, such as a congested path of CDN
+
+  _BenchServerOptions()
+      : file_size(0L)
+      , latency_ms(0)
+      , rate_limit(0L)
+      , error_per_mille(0)
+      , accept_ranges(true)
+      , slow_per_mille(0)
+      , slow_rate_limit(0L) {}
+} BenchServerOptions;
+
+// A loopback HTTP/1.1 server for benchmarks.
+// It serves a synthetic file on any path, supports HEAD, keep-alive, single "Range: bytes=" request and If-None-Match,
+// and can inject latency, bandwidth limit, slow responses and errors (connection closed before response or in the middle of body).
+// The content of file is generated from position, see ByteAt, so the downloaded file can be verified without a copy.
+class BenchServer {
+ public:
+  BenchServer(const BenchServerOptions& options);
+  ~BenchServer();
+
+  BenchServer(const BenchServer&) = delete;
+  BenchServer& operator=(const BenchServer&) = delete;
+
+  // Listen on 127.0.0.1 with a random port.
+  bool start();
+  void stop();
+
+  int port() const;
+  std::string url() const;
+
+  // CPU time spent in serving requests, the benchmark subtracts it from the process CPU time.
+  int64_t cpuTimeUs() const;
+  int64_t servedBytes() const;
+  int64_t requestNum() const;
+  int64_t injectedErrorNum() const;
+  int64_t injectedSlowNum() const;
+
+  static void Fill(int64_t pos, char* buf, size_t size);
+
+ protected:
+  void acceptProcess();
+  void connectionProcess(BenchSocket s);
+
+  // Return false if connection should be closed.
+  bool handleRequest(BenchSocket s, const std::string& request);
+  bool sendAll(BenchSocket s, const char* data, size_t size);
+  bool sendBody(BenchSocket s, int64_t begin, int64_t size, int64_t rate_limit);
+  bool injectError();
+  bool injectSlow();
+
+ protected:
+  const BenchServerOptions options_;
+  BenchSocket listen_socket_;
+  int port_;
+  std::atomic<bool> stopping_;
+  std::thread accept_thread_;
+
+  std::mutex connections_mutex_;
+  std::set<BenchSocket> connections_;
+  std::vector<std::thread> connection_threads_;
+
+  std::atomic<int64_t> cpu_time_us_;
+  std::atomic<int64_t> served_bytes_;
+  std::atomic<int64_t> request_num_;
+  std::atomic<int64_t> range_request_num_;
+  std::atomic<int64_t> injected_error_num_;
+  std::atomic<int64_t> injected_slow_num_;
+};
+
+// CPU time of current thread and current process, in microseconds.
+int64_t ThreadCpuTimeUs();
+int64_t ProcessCpuTimeUs();
+
+// Resident memory of current process, 0 if not supported.
+int64_t ProcessMemoryBytes();
+}  // namespace zoe
+#endif  // !ZOE_BENCH_SERVER_H_
@@ -0,0 +1,574 @@
+/*******************************************************************************
+*    Copyright (C) <2019-2023>, winsoft666, <winsoft666@outlook.com>.
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include "zoe/zoe.h"
+#include "bench_server.h"
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+#include <windows.h>
+#else
+#include <signal.h>
+#endif
+
+using namespace zoe;
+
+#define BENCH_MB ((int64_t)1048576)
+#define BENCH_MEMORY_SAMPLE_INTERVAL_MS 20
+#define BENCH_RESULT_VERSION 1
+
+typedef struct _BenchCase {
+  std::string name;
+  std::string profile;
+  BenchServerOptions server;
+  int32_t thread_num;
+  SlicePolicy slice_policy;
+  int64_t slice_policy_value;
+  int32_t disk_cache_size;
+  DiskIoPolicy disk_io_policy;
+  int32_t task_num;  // downloads run at the same time on one Engine, each downloads file_size / task_num bytes
+  bool hedge_enabled;
+  bool range_probe;  // fetch file info with a range request of the beginning of file instead of HEAD
+
+  _BenchCase()
+      : thread_num(1)
+      , slice_policy(Auto)
+      , slice_policy_value(0L)
+      , disk_cache_size(20 * BENCH_MB)
+      , disk_io_policy(STANDARD_IO)
+      , task_num(1)
+      , hedge_enabled(true)
+      , range_probe(false) {}
+} BenchCase;
+
+typedef struct _BenchResult {
+  Result result;
+  bool verified;
+  int64_t bytes;
+  int64_t elapsed_ms;
+  double throughput;      // MB/s
+  double cpu_per_gb;      // CPU seconds used by zoe for each GB, the CPU time of server is excluded
+  int64_t memory_per_task;  // peak resident memory grown during the download, divided by task number
+  int64_t retries;
+  int64_t injected_errors;
+
+  _BenchResult()
+      : result(UNKNOWN_ERROR)
+      , verified(false)
+      , bytes(0L)
+      , elapsed_ms(0L)
+      , throughput(0.0)
+      , cpu_per_gb(0.0)
+      , memory_per_task(0L)
+      , retries(0L)
+      , injected_errors(0L) {}
+} BenchResult;
+
+typedef struct _BenchConfig {
+  int64_t file_size;
+  int32_t repeat;
+  bool verify;
+  bool list_only;
+  std::string filter;
+  std::string work_dir;
+  std::string out_path;
+  std::string baseline_path;
+  double tolerance;  // percent
+
+  _BenchConfig()
+      : file_size(128 * BENCH_MB)
+      , repeat(1)
+      , verify(true)
+      , list_only(false)
+      , work_dir(".")
+      , out_path("zoe_bench_result.json")
+      , tolerance(10.0) {}
+} BenchConfig;
+
+static const char* DiskIoPolicyName(DiskIoPolicy policy) {
+  if (policy == MEMORY_MAPPED_IO)
+    return "mmap";
+  if (policy == DIRECT_IO)
+    return "direct";
+  return "std";
+}
+
+static std::string SlicePolicyName(SlicePolicy policy, int64_t value) {
+  char buf[64] = {0};
+  if (policy == FixedSize)
+    snprintf(buf, sizeof(buf), "size%lldK", (long long)(value / 1024));
+  else if (policy == FixedNum)
+    snprintf(buf, sizeof(buf), "num%lld", (long long)value);
+  else if (policy == Adaptive)
+    snprintf(buf, sizeof(buf), "adaptive%lldms", (long long)value);
+  else
+    snprintf(buf, sizeof(buf), "auto");
+  return buf;
+}
+
+static void NameCase(BenchCase& c) {
+  char buf[256] = {0};
+  snprintf(buf, sizeof(buf), "%s/t%d/%s/c%dK/%s/n%d", c.profile.c_str(), c.thread_num,
+           SlicePolicyName(c.slice_policy, c.slice_policy_value).c_str(), c.disk_cache_size / 1024,
+           DiskIoPolicyName(c.disk_io_policy), c.task_num);
+  c.name = buf;
+}
+
+// Each dimension is varied from a base case, instead of the full cartesian product which takes hours.
+static std::vector<BenchCase> MakeCases(const BenchConfig& config) {
+  std::vector<BenchCase> cases;
+
+  BenchCase local;
+  local.profile = "local";
+  local.server.file_size = config.file_size;
+
+  for (int32_t thread_num : {1, 2, 4, 8}) {
+    BenchCase c = local;
+    c.thread_num = thread_num;
+    cases.push_back(c);
+  }
+
+  local.thread_num = 4;
+  for (int64_t slice_size : {1 * BENCH_MB, 16 * BENCH_MB}) {
+    BenchCase c = local;
+    c.slice_policy = FixedSize;
+    c.slice_policy_value = slice_size;
+    cases.push_back(c);
+  }
+
+  BenchCase adaptive = local;
+  adaptive.slice_policy = Adaptive;
+  adaptive.slice_policy_value = 2000;
+  cases.push_back(adaptive);
+
+  for (int32_t cache_size : {0, (int32_t)BENCH_MB, (int32_t)(64 * BENCH_MB)}) {
+    BenchCase c = local;
+    c.disk_cache_size = cache_size;
+    cases.push_back(c);
+  }
+
+  for (DiskIoPolicy policy : {MEMORY_MAPPED_IO, DIRECT_IO}) {
+    BenchCase c = local;
+    c.disk_io_policy = policy;
+    cases.push_back(c);
+  }
+
+  for (int32_t task_num : {4, 16}) {
+    BenchCase c = local;
+    c.task_num = task_num;
+    cases.push_back(c);
+  }
+
+  // Long distance link, the bandwidth of each connection is limited, so more connections help.
+  BenchCase wan;
+  wan.profile = "wan";
+  wan.server.file_size = std::min(config.file_size, 32 * BENCH_MB);
+  wan.server.latency_ms = 30;
+  wan.server.rate_limit = 4 * BENCH_MB;
+  for (int32_t thread_num : {1, 4, 8}) {
+    BenchCase c = wan;
+    c.thread_num = thread_num;
+    cases.push_back(c);
+  }
+  wan.thread_num = 4;
+  wan.slice_policy = Adaptive;
+  wan.slice_policy_value = 2000;
+  cases.push_back(wan);
+
+  BenchCase flaky = local;
+  flaky.profile = "flaky";
+  flaky.server.error_per_mille = 50;
+  flaky.slice_policy = FixedSize;
+  flaky.slice_policy_value = 2 * BENCH_MB;
+  cases.push_back(flaky);
+
+  // A few connections are much slower than the others, the slow slices are hedged on idle connections.
+  BenchCase straggler = local;
+  straggler.profile = "straggler";
+  straggler.thread_num = 4;
+  straggler.server.file_size = std::min(config.file_size, 64 * BENCH_MB);
+  straggler.server.rate_limit = 16 * BENCH_MB;
+  straggler.server.slow_per_mille = 100;
+  straggler.server.slow_rate_limit = BENCH_MB / 2;
+  straggler.slice_policy = FixedSize;
+  straggler.slice_policy_value = 4 * BENCH_MB;
+  cases.push_back(straggler);
+  straggler.profile = "straggler_nohedge";
+  straggler.hedge_enabled = false;
+  cases.push_back(straggler);
+
+  // Small files over a long distance link, the round trips before the first byte take most of the time.
+  BenchCase small;
+  small.profile = "small";
+  small.thread_num = 4;
+  small.server.file_size = BENCH_MB / 8;
+  small.server.latency_ms = 30;
+  cases.push_back(small);
+  small.profile = "small_probe";
+  small.range_probe = true;
+  cases.push_back(small);
+
+  std::vector<BenchCase> selected;
+  for (auto& c : cases) {
+    NameCase(c);
+    if (config.filter.empty() || c.name.find(config.filter) != std::string::npos)
+      selected.push_back(c);
+  }
+  return selected;
+}
+
+static std::string TargetFilePath(const BenchConfig& config, int32_t index) {
+  char buf[64] = {0};
+  snprintf(buf, sizeof(buf), "zoe_bench_%d.bin", index);
+  return config.work_dir + "/" + buf;
+}
+
+static void RemoveTargetFile(const std::string& path) {
+  remove(path.c_str());
+  remove((path + ".zoe").c_str());
+  remove((path + ".efdindex").c_str());
+}
+
+static bool VerifyTargetFile(const std::string& path, int64_t file_size) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f)
+    return false;
+
+  std::vector<char> expected(BENCH_MB);
+  std::vector<char> actual(BENCH_MB);
+  int64_t pos = 0L;
+  bool ok = true;
+  while (ok) {
+    const size_t n = fread(actual.data(), 1, actual.size(), f);
+    if (n == 0)
+      break;
+    BenchServer::Fill(pos, expected.data(), n);
+    ok = memcmp(expected.data(), actual.data(), n) == 0;
+    pos += n;
+  }
+  fclose(f);
+  return ok && pos == file_size;
+}
+
+static BenchResult RunCase(const BenchConfig& config, const BenchCase& c) {
+  BenchResult r;
+
+  BenchServerOptions server_options = c.server;
+  server_options.file_size = c.server.file_size / c.task_num;
+  BenchServer server(server_options);
+  if (!server.start()) {
+    printf("Start bench server failed.\n");
+    return r;
+  }
+
+  std::shared_ptr<Engine> engine;
+  if (c.task_num > 1)
+    engine = std::make_shared<Engine>(1, 1);
+
+  std::vector<std::shared_ptr<Zoe>> tasks;
+  for (int32_t i = 0; i < c.task_num; i++) {
+    RemoveTargetFile(TargetFilePath(config, i));
+
+    std::shared_ptr<Zoe> z = std::make_shared<Zoe>();
+    if (engine)
+      z->setEngine(engine.get());
+    z->setThreadNum(c.thread_num);
+    z->setDiskCacheSize(c.disk_cache_size);
+    z->setDiskIoPolicy(c.disk_io_policy);
+    if (c.slice_policy != Auto)
+      z->setSlicePolicy(c.slice_policy, c.slice_policy_value);
+    z->setHedgeEnabled(c.hedge_enabled, 0);
+    z->setFetchFileInfoRangeProbe(c.range_probe);
+    tasks.push_back(z);
+  }
+
+  const int64_t memory_base = ProcessMemoryBytes();
+  std::atomic<int64_t> memory_peak(memory_base);
+  std::atomic<bool> done(false);
+  std::thread memory_sampler([&memory_peak, &done]() {
+    while (!done.load()) {
+      const int64_t m = ProcessMemoryBytes();
+      if (m > memory_peak.load())
+        memory_peak.store(m);
+      std::this_thread::sleep_for(std::chrono::milliseconds(BENCH_MEMORY_SAMPLE_INTERVAL_MS));
+    }
+  });
+
+  const int64_t cpu_begin = ProcessCpuTimeUs();
+  const int64_t server_cpu_begin = server.cpuTimeUs();
+  const auto time_begin = std::chrono::steady_clock::now();
+
+  std::vector<std::shared_future<Result>> futures;
+  for (int32_t i = 0; i < c.task_num; i++)
+    futures.push_back(tasks[i]->start(server.url(), TargetFilePath(config, i), nullptr, nullptr, nullptr));
+
+  r.result = SUCCESSED;
+  for (auto& f : futures) {
+    const Result ret = f.get();
+    if (ret != SUCCESSED)
+      r.result = ret;
+  }
+
+  r.elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - time_begin).count();
+  const int64_t cpu_us = (ProcessCpuTimeUs() - cpu_begin) - (server.cpuTimeUs() - server_cpu_begin);
+  done.store(true);
+  memory_sampler.join();
+
+  for (auto& z : tasks) {
+    const DownloadMetrics metrics = z->metrics();
+    for (const auto& slice : metrics.slices)
+      r.retries += slice.retries;
+  }
+  r.injected_errors = server.injectedErrorNum();
+
+  tasks.clear();
+  engine.reset();
+  server.stop();
+
+  r.bytes = server_options.file_size * c.task_num;
+  if (r.elapsed_ms > 0)
+    r.throughput = (double)r.bytes / BENCH_MB / ((double)r.elapsed_ms / 1000.0);
+  if (r.bytes > 0)
+    r.cpu_per_gb = (double)std::max(cpu_us, (int64_t)0) / 1000000.0 / ((double)r.bytes / (1024.0 * BENCH_MB));
+  r.memory_per_task = std::max(memory_peak.load() - memory_base, (int64_t)0) / c.task_num;
+
+  r.verified = r.result == SUCCESSED;
+  for (int32_t i = 0; i < c.task_num; i++) {
+    const std::string path = TargetFilePath(config, i);
+    if (r.verified && config.verify)
+      r.verified = VerifyTargetFile(path, server_options.file_size);
+    RemoveTargetFile(path);
+  }
+  return r;
+}
+
+// The run which has the median throughput is reported.
+static BenchResult RunCaseRepeated(const BenchConfig& config, const BenchCase& c) {
+  std::vector<BenchResult> results;
+  for (int32_t i = 0; i < config.repeat; i++) {
+    results.push_back(RunCase(config, c));
+    if (results.back().result != SUCCESSED)
+      return results.back();
+  }
+
+  std::sort(results.begin(), results.end(),
+            [](const BenchResult& a, const BenchResult& b) { return a.throughput < b.throughput; });
+  return results[results.size() / 2];
+}
+
+static std::string CaseToJson(const BenchCase& c, const BenchResult& r) {
+  char buf[1024] = {0};
+  snprintf(buf, sizeof(buf),
+           "{\"name\": \"%s\", \"profile\": \"%s\", \"thread_num\": %d, \"slice_policy\": \"%s\", "
+           "\"disk_cache_size\": %d, \"disk_io_policy\": \"%s\", \"task_num\": %d, "
+           "\"latency_ms\": %d, \"rate_limit\": %lld, \"error_per_mille\": %d, "
+           "\"result\": \"%s\", \"verified\": %s, \"bytes\": %lld, \"elapsed_ms\": %lld, "
+           "\"throughput_mb_per_sec\": %.2f, \"cpu_sec_per_gb\": %.3f, \"memory_per_task\": %lld, "
+           "\"retries\": %lld, \"injected_errors\": %lld}",
+           c.name.c_str(), c.profile.c_str(), c.thread_num, SlicePolicyName(c.slice_policy, c.slice_policy_value).c_str(),
+           c.disk_cache_size, DiskIoPolicyName(c.disk_io_policy), c.task_num,
+           c.server.latency_ms, (long long)c.server.rate_limit, c.server.error_per_mille,
+           GetResultString(r.result), r.verified ? "true" : "false", (long long)r.bytes, (long long)r.elapsed_ms,
+           r.throughput, r.cpu_per_gb, (long long)r.memory_per_task,
+           (long long)r.retries, (long long)r.injected_errors);
+  return buf;
+}
+
+// Every case is written in one line, so the result file can be compared line by line.
+static bool WriteResults(const BenchConfig& config,
+                         const std::vector<BenchCase>& cases,
+                         const std::vector<BenchResult>& results) {
+  FILE* f = fopen(config.out_path.c_str(), "wb");
+  if (!f)
+    return false;
+
+  fprintf(f, "{\n\"version\": %d,\n\"time\": %lld,\n\"file_size\": %lld,\n\"repeat\": %d,\n\"cases\": [\n",
+          BENCH_RESULT_VERSION, (long long)time(nullptr), (long long)config.file_size, config.repeat);
+  for (size_t i = 0; i < cases.size(); i++)
+    fprintf(f, "%s%s\n", CaseToJson(cases[i], results[i]).c_str(), i + 1 < cases.size() ? "," : "");
+  fprintf(f, "]\n}\n");
+  fclose(f);
+  return true;
+}
+
+static bool ReadJsonValue(const std::string& line, const std::string& key, std::string& value) {
+  const std::string pattern = "\"" + key + "\": ";
+  size_t pos = line.find(pattern);
+  if (pos == std::string::npos)
+    return false;
+  pos += pattern.size();
+
+  if (line[pos] == '"') {
+    const size_t end = line.find('"', pos + 1);
+    if (end == std::string::npos)
+      return false;
+    value = line.substr(pos + 1, end - pos - 1);
+    return true;
+  }
+
+  const size_t end = line.find_first_of(",}", pos);
+  value = line.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+  return true;
+}
+
+// Return the number of cases whose throughput is lower than baseline more than tolerance.
+static int32_t CompareWithBaseline(const BenchConfig& config,
+                                   const std::vector<BenchCase>& cases,
+                                   const std::vector<BenchResult>& results) {
+  std::ifstream f(config.baseline_path);
+  if (!f.is_open()) {
+    printf("Open baseline file failed: %s\n", config.baseline_path.c_str());
+    return 0;
+  }
+
+  std::map<std::string, double> baseline;
+  std::string line;
+  while (std::getline(f, line)) {
+    std::string name, throughput;
+    if (ReadJsonValue(line, "name", name) && ReadJsonValue(line, "throughput_mb_per_sec", throughput))
+      baseline[name] = atof(throughput.c_str());
+  }
+
+  int32_t regression_num = 0;
+  printf("\nCompare with %s (tolerance %.1f%%):\n", config.baseline_path.c_str(), config.tolerance);
+  for (size_t i = 0; i < cases.size(); i++) {
+    auto it = baseline.find(cases[i].name);
+    if (it == baseline.end() || it->second <= 0.0)
+      continue;
+
+    const double change = (results[i].throughput - it->second) / it->second * 100.0;
+    const bool regression = change < -config.tolerance;
+    if (regression)
+      regression_num++;
+    printf("%-40s %10.2f -> %10.2f MB/s %+7.1f%% %s\n", cases[i].name.c_str(), it->second, results[i].throughput, change,
+           regression ? "REGRESSION" : "");
+  }
+  return regression_num;
+}
+
+static void PrintUsage() {
+  printf(
+      "Usage: zoe_bench [options]\n"
+      "  --size MB           size of the file downloaded in each case, default 128\n"
+      "  --repeat N          run each case N times and report the median, default 1\n"
+      "  --filter TEXT       only run the cases whose name contains TEXT\n"
+      "  --dir PATH          directory to save the downloaded files, default current directory\n"
+      "  --out FILE          result file, default zoe_bench_result.json\n"
+      "  --baseline FILE     compare throughput with a previous result file\n"
+      "  --tolerance PERCENT throughput drop allowed when comparing with baseline, default 10\n"
+      "  --no-verify         don't verify the content of downloaded files\n"
+      "  --list              list the cases only\n");
+}
+
+static bool ParseArguments(int argc, char** argv, BenchConfig& config) {
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--size" && has_value)
+      config.file_size = atoll(argv[++i]) * BENCH_MB;
+    else if (arg == "--repeat" && has_value)
+      config.repeat = std::max(atoi(argv[++i]), 1);
+    else if (arg == "--filter" && has_value)
+      config.filter = argv[++i];
+    else if (arg == "--dir" && has_value)
+      config.work_dir = argv[++i];
+    else if (arg == "--out" && has_value)
+      config.out_path = argv[++i];
+    else if (arg == "--baseline" && has_value)
+      config.baseline_path = argv[++i];
+    else if (arg == "--tolerance" && has_value)
+      config.tolerance = atof(argv[++i]);
+    else if (arg == "--no-verify")
+      config.verify = false;
+    else if (arg == "--list")
+      config.list_only = true;
+    else
+      return false;
+  }
+  return config.file_size > 0;
+}
+
+//
+// Usage: see PrintUsage.
+// Exit code: 0 all cases passed, 1 some case failed, 2 throughput regression found when comparing with baseline.
+//
+int main(int argc, char** argv) {
+  BenchConfig config;
+  if (!ParseArguments(argc, argv, config)) {
+    PrintUsage();
+    return 1;
+  }
+
+  const std::vector<BenchCase> cases = MakeCases(config);
+  if (config.list_only) {
+    for (const auto& c : cases)
+      printf("%s\n", c.name.c_str());
+    return 0;
+  }
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  WSADATA wsa_data;
+  WSAStartup(MAKEWORD(2, 2), &wsa_data);
+#else
+  signal(SIGPIPE, SIG_IGN);
+#endif
+  Zoe::GlobalInit();
+
+  printf("%-40s %8s %10s %10s %12s %8s %s\n", "case", "time(ms)", "MB/s", "cpu(s/GB)", "mem/task(KB)", "retries", "result");
+
+  int exit_code = 0;
+  std::vector<BenchResult> results;
+  for (const auto& c : cases) {
+    const BenchResult r = RunCaseRepeated(config, c);
+    results.push_back(r);
+    if (r.result != SUCCESSED || (config.verify && !r.verified))
+      exit_code = 1;
+
+    printf("%-40s %8lld %10.2f %10.3f %12lld %8lld %s%s\n", c.name.c_str(), (long long)r.elapsed_ms, r.throughput,
+           r.cpu_per_gb, (long long)(r.memory_per_task / 1024), (long long)r.retries, GetResultString(r.result),
+           (r.result == SUCCESSED && config.verify && !r.verified) ? " (VERIFY FAILED)" : "");
+    fflush(stdout);
+  }
+
+  if (!WriteResults(config, cases, results)) {
+    printf("Write result file failed: %s\n", config.out_path.c_str());
+    exit_code = 1;
+  }
+
+  if (!config.baseline_path.empty() && CompareWithBaseline(config, cases, results) > 0 && exit_code == 0)
+    exit_code = 2;
+
+  Zoe::GlobalUnInit();
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  WSACleanup();
+#endif
+  return exit_code;
+}
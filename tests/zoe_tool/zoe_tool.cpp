@@ -18,23 +18,33 @@
 #include <iostream>
 #include <string.h>
 #include <sstream>
+#include <fstream>
 #include <chrono>
 #include <algorithm>
 #include <iomanip>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <string>
+#include <vector>
 #include "zoe/zoe.h"
 #include <mutex>
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
 #include <windows.h>
+#include <psapi.h>
 #else
 #include <signal.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
 #endif
 
 using namespace zoe;
 Zoe efd;
 std::mutex console_mutex;
+std::atomic_bool load_stopped(false);
 
 void PrintConsole(int64_t total, int64_t downloaded, int32_t speed);
 
@@ -62,6 +72,7 @@ BOOL WINAPI ControlSignalHandler(DWORD fdwCtrlType) {
     case CTRL_BREAK_EVENT:
     case CTRL_LOGOFF_EVENT:
     case CTRL_SHUTDOWN_EVENT:
+      load_stopped.store(true);
       efd.stop();
       return TRUE;
 
@@ -72,16 +83,376 @@ BOOL WINAPI ControlSignalHandler(DWORD fdwCtrlType) {
 #else
 
 void ControlSignalHandler(int s) {
+  load_stopped.store(true);
   efd.stop();
 }
 #endif
 
+typedef struct _LoadEntry {
+  std::string url;
+  std::string target_file_path;
+} LoadEntry;
+
+typedef struct _LoadConfig {
+  std::string list_path;
+  std::string repeat_url;
+  int32_t repeat;
+  std::string dir;
+  int32_t concurrency;  // files downloading at the same time
+  int32_t io_thread_num;  // of the engine
+  int32_t thread_num;
+  SlicePolicy slice_policy;
+  int64_t slice_policy_value;
+  int32_t disk_cache_mb;
+  DiskIoPolicy disk_io_policy;
+  std::string json_path;
+  bool keep_files;
+
+  _LoadConfig()
+      : repeat(0)
+      , dir(".")
+      , concurrency(8)
+      , io_thread_num(1)
+      , thread_num(0)
+      , slice_policy(Auto)
+      , slice_policy_value(0L)
+      , disk_cache_mb(-1)
+      , disk_io_policy(STANDARD_IO)
+      , keep_files(false) {}
+} LoadConfig;
+
+static void PrintLoadUsage() {
+  std::cout << "Usage: zoe_tool (--list FILE | --repeat N URL) [options]\n"
+               "  --list FILE           download the urls in FILE, one \"URL [TargetFilePath]\" per line\n"
+               "  --repeat N URL        download URL N times\n"
+               "  --dir PATH            directory to save the files without target path, default current directory\n"
+               "  --concurrency N       files downloading at the same time, default 8\n"
+               "  --io-threads N        io threads of the engine shared by the downloads, default 1\n"
+               "  --threads N           thread number of each download\n"
+               "  --slice POLICY        auto, adaptive, size:KB or num:N\n"
+               "  --disk-cache MB       disk cache size of each download\n"
+               "  --io POLICY           std, mmap or direct\n"
+               "  --json FILE           write the summary to FILE in json\n"
+               "  --keep                keep the downloaded files, they are removed by default\n";
+}
+
+static bool ParseSlicePolicy(const std::string& text, SlicePolicy& policy, int64_t& value) {
+  if (text == "auto") {
+    policy = Auto;
+    return true;
+  }
+  if (text == "adaptive") {
+    policy = Adaptive;
+    return true;
+  }
+  if (text.compare(0, 5, "size:") == 0) {
+    policy = FixedSize;
+    value = atoll(text.c_str() + 5) * 1024;
+    return value > 0;
+  }
+  if (text.compare(0, 4, "num:") == 0) {
+    policy = FixedNum;
+    value = atoll(text.c_str() + 4);
+    return value > 0;
+  }
+  return false;
+}
+
+static std::string SlicePolicyText(SlicePolicy policy, int64_t value) {
+  if (policy == FixedSize)
+    return "size:" + std::to_string(value / 1024);
+  if (policy == FixedNum)
+    return "num:" + std::to_string(value);
+  if (policy == Adaptive)
+    return "adaptive";
+  return "auto";
+}
+
+static const char* DiskIoPolicyText(DiskIoPolicy policy) {
+  if (policy == MEMORY_MAPPED_IO)
+    return "mmap";
+  if (policy == DIRECT_IO)
+    return "direct";
+  return "std";
+}
+
+static bool ParseDiskIoPolicy(const std::string& text, DiskIoPolicy& policy) {
+  if (text == "std")
+    policy = STANDARD_IO;
+  else if (text == "mmap")
+    policy = MEMORY_MAPPED_IO;
+  else if (text == "direct")
+    policy = DIRECT_IO;
+  else
+    return false;
+  return true;
+}
+
+static bool ParseLoadArguments(int argc, char** argv, LoadConfig& config) {
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--list" && has_value)
+      config.list_path = argv[++i];
+    else if (arg == "--repeat" && i + 2 < argc) {
+      config.repeat = atoi(argv[++i]);
+      config.repeat_url = argv[++i];
+    }
+    else if (arg == "--dir" && has_value)
+      config.dir = argv[++i];
+    else if (arg == "--concurrency" && has_value)
+      config.concurrency = std::max(atoi(argv[++i]), 1);
+    else if (arg == "--io-threads" && has_value)
+      config.io_thread_num = std::max(atoi(argv[++i]), 1);
+    else if (arg == "--threads" && has_value)
+      config.thread_num = atoi(argv[++i]);
+    else if (arg == "--slice" && has_value) {
+      if (!ParseSlicePolicy(argv[++i], config.slice_policy, config.slice_policy_value))
+        return false;
+    }
+    else if (arg == "--disk-cache" && has_value)
+      config.disk_cache_mb = atoi(argv[++i]);
+    else if (arg == "--io" && has_value) {
+      if (!ParseDiskIoPolicy(argv[++i], config.disk_io_policy))
+        return false;
+    }
+    else if (arg == "--json" && has_value)
+      config.json_path = argv[++i];
+    else if (arg == "--keep")
+      config.keep_files = true;
+    else
+      return false;
+  }
+  return !config.list_path.empty() || config.repeat > 0;
+}
+
+static bool MakeLoadEntries(const LoadConfig& config, std::vector<LoadEntry>& entries) {
+  std::vector<LoadEntry> lines;
+  if (!config.list_path.empty()) {
+    std::ifstream f(config.list_path);
+    if (!f)
+      return false;
+    std::string line;
+    while (std::getline(f, line)) {
+      std::istringstream ss(line);
+      LoadEntry entry;
+      if (!(ss >> entry.url) || entry.url[0] == '#')
+        continue;
+      ss >> entry.target_file_path;
+      lines.push_back(entry);
+    }
+  }
+
+  for (int32_t i = 0; i < config.repeat; i++) {
+    LoadEntry entry;
+    entry.url = config.repeat_url;
+    lines.push_back(entry);
+  }
+
+  for (size_t i = 0; i < lines.size(); i++) {
+    if (lines[i].target_file_path.empty())
+      lines[i].target_file_path = config.dir + "/zoe_tool_load_" + std::to_string(i) + ".dat";
+  }
+  entries.swap(lines);
+  return !entries.empty();
+}
+
+static int64_t ProcessCpuTimeUs() {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  FILETIME creation_time, exit_time, kernel_time, user_time;
+  if (!GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time))
+    return 0L;
+  ULARGE_INTEGER k, u;
+  k.LowPart = kernel_time.dwLowDateTime;
+  k.HighPart = kernel_time.dwHighDateTime;
+  u.LowPart = user_time.dwLowDateTime;
+  u.HighPart = user_time.dwHighDateTime;
+  return (int64_t)((k.QuadPart + u.QuadPart) / 10);
+#else
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0L;
+  return (int64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+         usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#endif
+}
+
+static int64_t ProcessPeakMemoryBytes() {
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32__) || defined(__NT__)
+  PROCESS_MEMORY_COUNTERS pmc;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+    return 0L;
+  return (int64_t)pmc.PeakWorkingSetSize;
+#else
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0L;
+#if defined(__APPLE__)
+  return (int64_t)usage.ru_maxrss;
+#else
+  return (int64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+static int64_t FileSize(const std::string& path) {
+  std::ifstream f(path, std::ios::binary | std::ios::ate);
+  return f ? (int64_t)f.tellg() : 0L;
+}
+
+// The completion time at percent of the sorted times.
+static int64_t Percentile(const std::vector<int64_t>& sorted, int32_t percent) {
+  if (sorted.empty())
+    return 0L;
+  const size_t rank = (sorted.size() * percent + 99) / 100;
+  return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+}
+
+// Download the entries on one engine, at most concurrency files at the same time, then print the summary.
+static int RunLoad(const LoadConfig& config) {
+  std::vector<LoadEntry> entries;
+  if (!MakeLoadEntries(config, entries)) {
+    std::cout << "No url to download\n";
+    return 1;
+  }
+
+  typedef struct _LoadTask {
+    std::shared_ptr<Zoe> zoe;
+    std::chrono::steady_clock::time_point start_time;
+  } LoadTask;
+
+  Engine engine(config.io_thread_num, 1);
+  std::mutex mutex;
+  std::condition_variable cond_var;
+  std::vector<size_t> finished;  // indexes of entries finished and not collected
+  std::vector<Result> results(entries.size(), CANCELED);
+  std::vector<LoadTask> tasks(entries.size());
+  std::vector<int64_t> completion_ms;
+  int64_t total_bytes = 0L;
+  int32_t failed_num = 0;
+  size_t next = 0;
+  size_t running = 0;
+
+  const int64_t cpu_begin = ProcessCpuTimeUs();
+  const auto time_begin = std::chrono::steady_clock::now();
+  while (next < entries.size() || running > 0) {
+    while (next < entries.size() && running < (size_t)config.concurrency && !load_stopped.load()) {
+      const size_t index = next++;
+      std::shared_ptr<Zoe> z = std::make_shared<Zoe>();
+      z->setEngine(&engine);
+      if (config.thread_num > 0)
+        z->setThreadNum(config.thread_num);
+      if (config.slice_policy != Auto)
+        z->setSlicePolicy(config.slice_policy, config.slice_policy_value);
+      if (config.disk_cache_mb >= 0)
+        z->setDiskCacheSize(config.disk_cache_mb * 1024 * 1024);
+      z->setDiskIoPolicy(config.disk_io_policy);
+      remove(entries[index].target_file_path.c_str());
+
+      tasks[index].zoe = z;
+      tasks[index].start_time = std::chrono::steady_clock::now();
+      running++;
+      z->start(entries[index].url, entries[index].target_file_path,
+               [index, &mutex, &cond_var, &finished, &results](Result result) {
+                 std::lock_guard<std::mutex> lg(mutex);
+                 results[index] = result;
+                 finished.push_back(index);
+                 cond_var.notify_one();
+               },
+               nullptr, nullptr);
+    }
+
+    if (load_stopped.load()) {
+      next = entries.size();
+      for (auto& task : tasks) {
+        if (task.zoe)
+          task.zoe->stop();
+      }
+    }
+
+    std::vector<size_t> done;
+    {
+      std::unique_lock<std::mutex> ul(mutex);
+      cond_var.wait_for(ul, std::chrono::milliseconds(200), [&finished] { return !finished.empty(); });
+      done.swap(finished);
+    }
+
+    for (size_t index : done) {
+      LoadTask& task = tasks[index];
+      const int64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                             std::chrono::steady_clock::now() - task.start_time)
+                             .count();
+      if (results[index] == SUCCESSED) {
+        completion_ms.push_back(ms);
+        total_bytes += FileSize(entries[index].target_file_path);
+      }
+      else {
+        failed_num++;
+        std::cout << "Failed: " << entries[index].url << " " << GetResultString(results[index]) << std::endl;
+      }
+
+      // The result functor is called before the download thread ends.
+      task.zoe->futureResult().wait();
+      task.zoe.reset();
+      if (!config.keep_files)
+        remove(entries[index].target_file_path.c_str());
+      running--;
+    }
+  }
+
+  const int64_t elapsed_ms =
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - time_begin).count();
+  const int64_t cpu_ms = (ProcessCpuTimeUs() - cpu_begin) / 1000;
+  const int64_t peak_rss = ProcessPeakMemoryBytes();
+  const double throughput = elapsed_ms > 0 ? (double)total_bytes / 1048576.0 / ((double)elapsed_ms / 1000.0) : 0.0;
+  std::sort(completion_ms.begin(), completion_ms.end());
+
+  char summary[1024] = {0};
+  snprintf(summary, sizeof(summary),
+           "{\"files\": %d, \"succeeded\": %d, \"failed\": %d, \"concurrency\": %d, \"io_threads\": %d, "
+           "\"thread_num\": %d, \"slice_policy\": \"%s\", \"disk_cache_mb\": %d, "
+           "\"disk_io_policy\": \"%s\", \"bytes\": %lld, \"elapsed_ms\": %lld, \"throughput_mb_per_sec\": %.2f, "
+           "\"p50_ms\": %lld, \"p99_ms\": %lld, \"max_ms\": %lld, \"cpu_ms\": %lld, \"peak_rss\": %lld}",
+           (int)entries.size(), (int)completion_ms.size(), failed_num, config.concurrency, config.io_thread_num,
+           config.thread_num, SlicePolicyText(config.slice_policy, config.slice_policy_value).c_str(),
+           config.disk_cache_mb, DiskIoPolicyText(config.disk_io_policy), (long long)total_bytes, (long long)elapsed_ms, throughput,
+           (long long)Percentile(completion_ms, 50), (long long)Percentile(completion_ms, 99),
+           (long long)(completion_ms.empty() ? 0L : completion_ms.back()), (long long)cpu_ms, (long long)peak_rss);
+
+  std::cout << "Files: " << completion_ms.size() << "/" << entries.size() << " succeeded" << std::endl;
+  std::cout << "Total: " << total_bytes << " bytes in " << elapsed_ms << "ms, " << std::fixed << std::setprecision(2)
+            << throughput << " MB/s" << std::endl;
+  std::cout << "Completion time: p50 " << Percentile(completion_ms, 50) << "ms, p99 "
+            << Percentile(completion_ms, 99) << "ms" << std::endl;
+  std::cout << "CPU time: " << cpu_ms << "ms, peak RSS: " << peak_rss / 1024 << "KB" << std::endl;
+
+  if (!config.json_path.empty()) {
+    FILE* f = fopen(config.json_path.c_str(), "wb");
+    if (!f) {
+      std::cout << "Write summary failed: " << config.json_path << std::endl;
+      return 1;
+    }
+    fprintf(f, "%s\n", summary);
+    fclose(f);
+  }
+
+  return failed_num > 0 || load_stopped.load() ? 1 : 0;
+}
+
 //
 // Usage:
 // zoe_tool URL TargetFilePath [ThreadNum] [DiskCacheMb] [MD5] [TmpExpiredSeconds] [MaxSpeed]
+// zoe_tool (--list FILE | --repeat N URL) [options], see PrintLoadUsage.
 //
 int main(int argc, char** argv) {
-  if (argc < 3) {
+  const bool load_mode = argc >= 2 && strncmp(argv[1], "--", 2) == 0;
+  LoadConfig load_config;
+  if (load_mode && !ParseLoadArguments(argc, argv, load_config)) {
+    PrintLoadUsage();
+    return 1;
+  }
+
+  if (!load_mode && argc < 3) {
     std::cout << "Argument Number Error\n";
     return 1;
   }
@@ -99,6 +470,13 @@ int main(int argc, char** argv) {
   sigaction(SIGQUIT, &sigIntHandler, NULL);
 #endif
 
+  if (load_mode) {
+    Zoe::GlobalInit();
+    const int exit_code = RunLoad(load_config);
+    Zoe::GlobalUnInit();
+    return exit_code;
+  }
+
   char* url = argv[1];
   char* target_file_path = argv[2];
 